@@ -0,0 +1,7 @@
+#version 460 core
+layout(location = 0) in vec3 vertexPos;
+
+void main() {
+  // Untransformed; the geometry shader projects it onto each face.
+  gl_Position = vec4(vertexPos, 1.0);
+}
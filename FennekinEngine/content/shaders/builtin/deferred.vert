@@ -1,4 +1,6 @@
 #version 460 core
+#pragma fnk_include < core.glsl>
+#pragma fnk_include < draw_data.glsl>
 #pragma fnk_include < transforms.glsl>
 layout(location = 0) in vec3 vertexPos;
 layout(location = 1) in vec3 vertexNormal;
@@ -16,17 +18,17 @@ out VS_OUT {
 }
 vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Matches depth_prepass.vert bit for bit, see its comment.
+invariant gl_Position;
 
 void main() {
-  gl_Position = projection * view * model * vec4(vertexPos, 1.0);
+  mat4 modelView = fnk_view * fnk_modelTransform();
+  gl_Position = fnk_projection * modelView * vec4(vertexPos, 1.0);
 
   vs_out.texCoords = vertexTexCoords;
-  vs_out.fragPos_viewSpace = vec3(view * model * vec4(vertexPos, 1.0));
+  vs_out.fragPos_viewSpace = vec3(modelView * vec4(vertexPos, 1.0));
 
-  mat3 modelViewInverseTranspose = mat3(transpose(inverse(view * model)));
+  mat3 modelViewInverseTranspose = mat3(transpose(inverse(modelView)));
 
   // Propagate vertex normals in case we don't have a normal map.
   vs_out.fragNormal_viewSpace = modelViewInverseTranspose * vertexNormal;
@@ -34,7 +36,7 @@ void main() {
   // Build a tangent space transform matrix.
   vec3 normal_viewSpace = normalize(vs_out.fragNormal_viewSpace);
   vec3 tangent_viewSpace =
-      normalize(vec3(view * model * vec4(vertexTangent, 0.0)));
+      normalize(vec3(modelView * vec4(vertexTangent, 0.0)));
   vs_out.fragTBN_viewSpace =
       fnk_calculateTBN(normal_viewSpace, tangent_viewSpace);
 }
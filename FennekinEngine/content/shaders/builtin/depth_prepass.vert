@@ -0,0 +1,14 @@
+#version 460 core
+#pragma fnk_include < core.glsl>
+#pragma fnk_include < draw_data.glsl>
+layout(location = 0) in vec3 vertexPos;
+
+// Depth prepass vertex shader. Must compute gl_Position exactly as
+// deferred.vert does, so the G-buffer pass finds the same depth.
+
+invariant gl_Position;
+
+void main() {
+  mat4 modelView = fnk_view * fnk_modelTransform();
+  gl_Position = fnk_projection * modelView * vec4(vertexPos, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 460 core
+
+// Stores the distance to the light, over its range, instead of depth. It is
+// linear, unlike perspective depth, so one bias suits the whole range.
+
+in vec3 fragPos_worldSpace;
+
+uniform vec3 lightPosition;
+uniform float lightRange;
+
+void main() {
+  gl_FragDepth = length(fragPos_worldSpace - lightPosition) / lightRange;
+}
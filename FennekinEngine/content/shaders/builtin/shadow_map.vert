@@ -1,9 +1,9 @@
 #version 460 core
+#pragma fnk_include < core.glsl>
+#pragma fnk_include < draw_data.glsl>
 layout(location = 0) in vec3 vertexPos;
 
-uniform mat4 model;
-uniform mat4 lightViewProjection;
-
 void main() {
-  gl_Position = lightViewProjection * model * vec4(vertexPos, 1.0);
+  // World space; the geometry shader projects into each cascade.
+  gl_Position = fnk_modelTransform() * vec4(vertexPos, 1.0);
 }
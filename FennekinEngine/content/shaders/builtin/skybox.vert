@@ -1,16 +1,16 @@
 #version 460 core
+#pragma fnk_include < core.glsl>
 layout(location = 0) in vec3 vertexPos;
 
 out vec3 skyboxCoords;
 
-// Note that the view matrix should *not* have any translation, since the skybox
-// is always rendered at the camera origin and thus should "follow" the camera.
-uniform mat4 view;
-uniform mat4 projection;
-
 void main() {
+  // The view matrix should *not* have any translation, since the skybox is
+  // always rendered at the camera origin and thus should "follow" the camera.
+  // We drop it by converting to a mat3 and back.
+  mat4 view = mat4(mat3(fnk_view));
   // No model transform needed for a skybox.
-  vec4 pos = projection * view * vec4(vertexPos, 1.0);
+  vec4 pos = fnk_projection * view * vec4(vertexPos, 1.0);
   // The skybox is meant to be drawn last, so to take advantage of early depth
   // testing, we set the vertex's z component to w so that after the perspective
   // division by w the resulting normalized device coordinate will equal 1.0,
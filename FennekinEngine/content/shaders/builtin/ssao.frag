@@ -1,4 +1,5 @@
 #version 460 core
+#pragma fnk_include < core.glsl>
 #pragma fnk_include < transforms.glsl>
 #pragma fnk_include < window.frag>
 
@@ -19,8 +20,6 @@ uniform float fnk_ssaoSampleBias;
 uniform vec3 fnk_ssaoKernel[fnk_MAX_SSAO_KERNEL_SIZE];
 uniform int fnk_ssaoKernelSize;
 
-uniform mat4 projection;
-
 void main() {
   ivec2 noiseSize = textureSize(fnk_ssaoNoise, /*lod=*/0);
   // Create a scale factor to tile the noise texture across the screen (this
@@ -49,7 +48,7 @@ void main() {
         fragPos_viewSpace + sampleOffset_viewSpace * fnk_ssaoSampleRadius;
 
     // Now we transform the sample to screen space.
-    vec4 samplePos_clipSpace = projection * vec4(samplePos_viewSpace, 1.0);
+    vec4 samplePos_clipSpace = fnk_projection * vec4(samplePos_viewSpace, 1.0);
     samplePos_clipSpace /= samplePos_clipSpace.w;  // Perspective divide.
     // Transform from [-1, 1] to [0, 1] so that we can use them as tex coords.
     samplePos_clipSpace = samplePos_clipSpace * 0.5 + 0.5;
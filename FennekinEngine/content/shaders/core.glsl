@@ -1,3 +1,106 @@
 #pragma once
 
-uniform float fnk_time;
\ No newline at end of file
+/**
+ * Engine-wide uniform blocks. These are written once per frame (or view) on
+ * the CPU and shared by every program through fixed binding points, which
+ * must match EUniformBlockBinding. All uniform blocks use std140 layout, so
+ * the CPU side mirrors have to pad vec3 members to 16 bytes.
+ */
+
+layout(std140, binding = 0) uniform FnkFrame {
+  float fnk_time;
+  float fnk_deltaTime;
+  int fnk_windowWidth;
+  int fnk_windowHeight;
+};
+
+layout(std140, binding = 1) uniform FnkCamera {
+  mat4 fnk_view;
+  mat4 fnk_projection;
+};
+
+struct FnkAttenuation {
+  float constant;
+  float linear;
+  float quadratic;
+};
+
+struct FnkDirectionalLight {
+  vec3 direction;
+
+  vec3 diffuse;
+  vec3 specular;
+};
+
+struct FnkPointLight {
+  vec3 position;
+
+  vec3 diffuse;
+  vec3 specular;
+
+  FnkAttenuation attenuation;
+  // The first of the light's six tiles in fnk_shadowTiles, or -1.
+  int shadowIndex;
+};
+
+struct FnkSpotLight {
+  vec3 position;
+  vec3 direction;
+  float innerAngle;
+  float outerAngle;
+
+  vec3 diffuse;
+  vec3 specular;
+
+  FnkAttenuation attenuation;
+  // The light's tile in fnk_shadowTiles, or -1.
+  int shadowIndex;
+};
+
+// The block size is fixed, so this must match the CPU side limit.
+#define FNK_MAX_DIRECTIONAL_LIGHTS 10
+
+layout(std140, binding = 2) uniform FnkLights {
+  int fnk_directionalLightCount;
+  int fnk_pointLightCount;
+  int fnk_spotLightCount;
+  FnkDirectionalLight fnk_directionalLights[FNK_MAX_DIRECTIONAL_LIGHTS];
+};
+
+// Point and spot lights are unbounded in number, so they live in storage
+// buffers. The bindings must match EStorageBufferBinding.
+layout(std430, binding = 6) readonly buffer FnkPointLights {
+  FnkPointLight fnk_pointLights[];
+};
+
+layout(std430, binding = 7) readonly buffer FnkSpotLights {
+  FnkSpotLight fnk_spotLights[];
+};
+
+// Must match MAX_SHADOW_CASCADES.
+#define FNK_MAX_SHADOW_CASCADES 4
+
+// The directional light's cascades. Cascade i covers view depths up to
+// fnk_cascadeSplits[i], and maps world space to its layer of the shadow map.
+layout(std140, binding = 3) uniform FnkShadow {
+  mat4 fnk_cascadeViewProjections[FNK_MAX_SHADOW_CASCADES];
+  vec4 fnk_cascadeSplits;
+  int fnk_shadowCascadeCount;
+};
+
+// A tile of the point and spot light shadow atlas, see ShadowAtlas. Point
+// lights have six, one per cube face in the order +x, -x, +y, -y, +z, -z.
+struct FnkShadowTile {
+  // From view space to the tile's clip space.
+  mat4 viewProjection;
+  // The tile's offset and size in atlas texture coordinates.
+  vec4 rect;
+  // The reciprocal of the light's range, which the stored distances are
+  // divided by, and the tile's side in texels.
+  float invRange;
+  float size;
+};
+
+layout(std430, binding = 10) readonly buffer FnkShadowTiles {
+  FnkShadowTile fnk_shadowTiles[];
+};
@@ -0,0 +1,15 @@
+#pragma once
+#pragma fnk_include < draw_data_buffer.glsl>
+
+/** The model transform for regular, non-indirect draws. */
+uniform mat4 model;
+/** Whether the current draw reads its data from fnk_drawData. */
+uniform bool fnk_indirectDraw = false;
+
+/** Returns the index of the current draw's FnkDrawData, via gl_BaseInstance. */
+uint fnk_drawIndex() { return uint(gl_BaseInstance); }
+
+/** Returns the model transform of the current draw. */
+mat4 fnk_modelTransform() {
+  return fnk_indirectDraw ? fnk_drawData[fnk_drawIndex()].model : model;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+/**
+ * Per-draw data for draws submitted through IndirectDrawList. Must match
+ * IndirectDrawData and EStorageBufferBinding::DRAW_DATA.
+ */
+struct FnkDrawData {
+  mat4 model;
+  /** Model space bounds. w is 0 if the draw has no bounds. */
+  vec4 boundsCenter;
+  vec4 boundsExtents;
+  uint materialIndex;
+  /** The batch the draw belongs to, and the batch's first command. */
+  uint batchIndex;
+  uint batchFirst;
+};
+
+layout(std430, binding = 0) readonly buffer FnkDrawDataBuffer {
+  FnkDrawData fnk_drawData[];
+};
@@ -0,0 +1,75 @@
+#version 460 core
+#pragma fnk_include < core.glsl>
+#pragma fnk_include < standard_lights_phong.frag>
+#pragma fnk_include < standard_lights_pbr.frag>
+
+// Shades one point or spot light on the pixels inside its volume, added on
+// top of the lighting pass. See LightVolumeRenderer.
+
+out vec4 fragColor;
+
+uniform sampler2D gPositionAO;
+uniform sampler2D gNormalRoughness;
+uniform sampler2D gAlbedoMetallic;
+
+uniform bool ssao;
+uniform sampler2D fnk_ssao;
+
+uniform vec3 ambient;
+uniform float shininess;
+
+uniform int lightingModel;
+
+// The light's index into fnk_spotLights if spotLight is set, or else into
+// fnk_pointLights.
+uniform uint lightIndex;
+uniform bool spotLight;
+
+void main() {
+  // The volume covers the pixel, but the G-buffer is read at the pixel.
+  vec2 texCoords =
+      gl_FragCoord.xy / vec2(fnk_windowWidth, fnk_windowHeight);
+  vec3 fragPos_viewSpace = texture(gPositionAO, texCoords).rgb;
+  float fragAO = texture(gPositionAO, texCoords).a;
+  vec3 fragNormal_viewSpace = texture(gNormalRoughness, texCoords).rgb;
+  float fragRoughness = texture(gNormalRoughness, texCoords).a;
+  vec3 fragAlbedo = texture(gAlbedoMetallic, texCoords).rgb;
+  float fragMetallic = texture(gAlbedoMetallic, texCoords).a;
+
+  float ao = fragAO;
+  if (ssao) {
+    ao *= texture(fnk_ssao, texCoords).r;
+  }
+
+  vec3 color;
+  if (lightingModel == 0) {
+    // Phong.
+    if (spotLight) {
+      color = fnk_shadeSpotLightBlinnPhongDeferred(
+          fragAlbedo, /*specular=*/vec3(fragMetallic), ambient, shininess,
+          fnk_spotLights[lightIndex], fragPos_viewSpace, fragNormal_viewSpace,
+          ao);
+    } else {
+      color = fnk_shadePointLightBlinnPhongDeferred(
+          fragAlbedo, /*specular=*/vec3(fragMetallic), ambient, shininess,
+          fnk_pointLights[lightIndex], fragPos_viewSpace, fragNormal_viewSpace,
+          ao);
+    }
+  } else if (lightingModel == 1) {
+    // GGX.
+    if (spotLight) {
+      color = fnk_shadeSpotLightCookTorranceGGXDeferred(
+          fragAlbedo, fragRoughness, fragMetallic, fnk_spotLights[lightIndex],
+          fragPos_viewSpace, fragNormal_viewSpace);
+    } else {
+      color = fnk_shadePointLightCookTorranceGGXDeferred(
+          fragAlbedo, fragRoughness, fragMetallic, fnk_pointLights[lightIndex],
+          fragPos_viewSpace, fragNormal_viewSpace);
+    }
+  } else {
+    // The lighting pass already flags an invalid lighting model.
+    color = vec3(0.0);
+  }
+
+  fragColor = vec4(color, 1.0);
+}
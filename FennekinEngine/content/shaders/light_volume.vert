@@ -0,0 +1,9 @@
+#version 460 core
+#pragma fnk_include < core.glsl>
+layout(location = 0) in vec3 vertexPos;
+
+// Places a unit sphere around a light, see LightVolumeRenderer. The lights
+// are in view space, so the model transform goes straight to view space.
+uniform mat4 model;
+
+void main() { gl_Position = fnk_projection * model * vec4(vertexPos, 1.0); }
@@ -1,16 +1,11 @@
 #pragma once
 
+#pragma fnk_include < core.glsl>
 #pragma fnk_include < gamma.frag>
 #pragma fnk_include < normals.frag>
 
 /** Core lighting structs and functions. */
 
-struct FnkAttenuation {
-  float constant;
-  float linear;
-  float quadratic;
-};
-
 #ifndef fnk_MAX_DIFFUSE_TEXTURES
 #define fnk_MAX_DIFFUSE_TEXTURES 1
 #endif
@@ -73,34 +68,6 @@ struct FnkMaterial {
   FnkAttenuation emissionAttenuation;
 };
 
-struct FnkDirectionalLight {
-  vec3 direction;
-
-  vec3 diffuse;
-  vec3 specular;
-};
-
-struct FnkPointLight {
-  vec3 position;
-
-  vec3 diffuse;
-  vec3 specular;
-
-  FnkAttenuation attenuation;
-};
-
-struct FnkSpotLight {
-  vec3 position;
-  vec3 direction;
-  float innerAngle;
-  float outerAngle;
-
-  vec3 diffuse;
-  vec3 specular;
-
-  FnkAttenuation attenuation;
-};
-
 /** Extracts albedo from the material. */
 vec3 fnk_extractAlbedo(FnkMaterial material, vec2 texCoords) {
   vec3 albedo = vec3(0.0);
@@ -276,15 +243,18 @@ float fnk_shadowBias(float minBias, float maxBias, vec3 normal, vec3 lightDir) {
   return max(maxBias * (1.0 - dot(normal, lightDir)), minBias);
 }
 
-/** Sample from a shadow map using 9-texel percentage-closer filtering. */
-float fnk_shadowSamplePCF(sampler2D shadowMap, vec2 shadowTexCoords,
-                          float currentDepth, float bias) {
+/**
+ * Sample from a layer of a shadow map using 9-texel percentage-closer
+ * filtering.
+ */
+float fnk_shadowSamplePCF(sampler2DArray shadowMap, vec2 shadowTexCoords,
+                          int layer, float currentDepth, float bias) {
   float shadow = 0.0;
-  vec2 texelOffset = 1.0 / textureSize(shadowMap, /*mip=*/0);
+  vec2 texelOffset = 1.0 / vec2(textureSize(shadowMap, /*mip=*/0).xy);
   for (int x = -1; x <= 1; x++) {
     for (int y = -1; y <= 1; y++) {
-      float pcfDepth =
-          texture(shadowMap, shadowTexCoords + vec2(x, y) * texelOffset).r;
+      vec2 offsetCoords = shadowTexCoords + vec2(x, y) * texelOffset;
+      float pcfDepth = texture(shadowMap, vec3(offsetCoords, layer)).r;
       // Check whether in shadow.
       shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
     }
@@ -292,13 +262,32 @@ float fnk_shadowSamplePCF(sampler2D shadowMap, vec2 shadowTexCoords,
   return shadow / 9.0;
 }
 
+/** Returns the shadow cascade covering the given view depth, or -1. */
+int fnk_shadowCascade(float viewDepth) {
+  for (int i = 0; i < fnk_shadowCascadeCount; i++) {
+    if (viewDepth <= fnk_cascadeSplits[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 /**
- * Calculate whether the given fragment is in shadow.
+ * Calculate whether the given fragment is in the directional light's shadow,
+ * using the cascade that covers its view depth.
  * Returns 1.0 if in shadow, 0.0 if not.
  */
-float fnk_shadow(sampler2D shadowMap, vec4 fragPosLightSpace, float bias) {
-  // Perform perspective divide.
-  vec3 projectedPos = fragPosLightSpace.xyz / fragPosLightSpace.w;
+float fnk_shadow(sampler2DArray shadowMap, vec3 fragPosWorldSpace,
+                 vec3 fragPosViewSpace, float bias) {
+  // The view looks down -z.
+  int cascade = fnk_shadowCascade(-fragPosViewSpace.z);
+  if (cascade < 0) {
+    // Beyond the last cascade. Assume not in shadow.
+    return 0.0;
+  }
+  // The cascades are orthographic, so there's no perspective divide.
+  vec3 projectedPos = (fnk_cascadeViewProjections[cascade] *
+                       vec4(fragPosWorldSpace, 1.0)).xyz;
   // Shift to the range 0..1 so that we can compare with depth.
   projectedPos = projectedPos * 0.5 + 0.5;
   // Check for out-of-frustum.
@@ -308,5 +297,164 @@ float fnk_shadow(sampler2D shadowMap, vec4 fragPosLightSpace, float bias) {
   }
   vec2 shadowTexCoords = projectedPos.xy;
   float currentDepth = projectedPos.z;
-  return fnk_shadowSamplePCF(shadowMap, shadowTexCoords, currentDepth, bias);
+  return fnk_shadowSamplePCF(shadowMap, shadowTexCoords, cascade,
+                             currentDepth, bias);
+}
+
+/** ======================== Virtual shadow map ========================= **/
+
+// Must match VirtualShadowMap.
+#define FNK_VSM_PAGE_SIZE 128
+#define FNK_VSM_PAGES_PER_SIDE 128
+
+/** The directional light's virtual shadow map, see VirtualShadowMap. */
+uniform sampler2D fnk_vsmPhysicalPages;
+/** Each virtual page's physical page plus one, or 0 if it isn't resident. */
+uniform usampler2D fnk_vsmPageTable;
+/** From world space to the light's clip space. */
+uniform mat4 fnk_vsmViewProjection;
+
+/**
+ * The depth of a texel of the virtual shadow map, or 1.0 if its page isn't
+ * resident.
+ */
+float fnk_virtualShadowDepth(ivec2 virtualTexel) {
+  ivec2 page = virtualTexel / FNK_VSM_PAGE_SIZE;
+  if (any(lessThan(virtualTexel, ivec2(0))) ||
+      any(greaterThanEqual(page, ivec2(FNK_VSM_PAGES_PER_SIDE)))) {
+    return 1.0;
+  }
+  uint entry = texelFetch(fnk_vsmPageTable, page, /*mip=*/0).r;
+  if (entry == 0u) {
+    return 1.0;
+  }
+  int physicalPagesPerSide =
+      textureSize(fnk_vsmPhysicalPages, /*mip=*/0).x / FNK_VSM_PAGE_SIZE;
+  int physicalPage = int(entry - 1u);
+  ivec2 physicalTexel = ivec2(physicalPage % physicalPagesPerSide,
+                              physicalPage / physicalPagesPerSide) *
+                            FNK_VSM_PAGE_SIZE +
+                        virtualTexel - page * FNK_VSM_PAGE_SIZE;
+  return texelFetch(fnk_vsmPhysicalPages, physicalTexel, /*mip=*/0).r;
+}
+
+/**
+ * Calculate whether the given fragment is in the directional light's shadow,
+ * like fnk_shadow(), but from the virtual shadow map. Pages that aren't
+ * resident yet are taken as unshadowed.
+ */
+float fnk_virtualShadow(vec3 fragPosWorldSpace, float bias) {
+  // Orthographic, so there's no perspective divide.
+  vec3 projectedPos =
+      (fnk_vsmViewProjection * vec4(fragPosWorldSpace, 1.0)).xyz * 0.5 + 0.5;
+  if (projectedPos.z > 1.0) {
+    return 0.0;
+  }
+  ivec2 virtualTexel = ivec2(floor(
+      projectedPos.xy * float(FNK_VSM_PAGE_SIZE * FNK_VSM_PAGES_PER_SIDE)));
+  // 9-texel percentage-closer filtering.
+  float shadow = 0.0;
+  for (int x = -1; x <= 1; x++) {
+    for (int y = -1; y <= 1; y++) {
+      float pcfDepth = fnk_virtualShadowDepth(virtualTexel + ivec2(x, y));
+      shadow += projectedPos.z - bias > pcfDepth ? 1.0 : 0.0;
+    }
+  }
+  return shadow / 9.0;
+}
+
+/** ==================== Point and spot light shadows ==================== **/
+
+/** The point and spot light shadows, see ShadowAtlas. */
+uniform sampler2D fnk_shadowAtlas;
+/** Whether fnk_shadowAtlas is bound. Lights have no shadow otherwise. */
+uniform bool fnk_useShadowAtlas = false;
+
+/** Relative to the light's range, like the stored distances. */
+const float FNK_SHADOW_ATLAS_BIAS = 0.002;
+
+/**
+ * Calculate whether the given view space position is in the shadow of a tile
+ * of the shadow atlas, using 9-texel percentage-closer filtering. The samples
+ * are kept inside the tile, so they never read a neighbour's.
+ * Returns 1.0 if in shadow, 0.0 if not.
+ */
+float fnk_shadowAtlasSamplePCF(int tileIndex, vec3 fragPos, vec3 lightPos) {
+  FnkShadowTile tile = fnk_shadowTiles[tileIndex];
+  vec4 clipPos = tile.viewProjection * vec4(fragPos, 1.0);
+  if (clipPos.w <= 0.0) {
+    return 0.0;
+  }
+  vec2 tileCoords = clipPos.xy / clipPos.w * 0.5 + 0.5;
+  vec2 texelOffset = 1.0 / vec2(textureSize(fnk_shadowAtlas, /*mip=*/0));
+  vec2 minCoords = tile.rect.xy + 0.5 * texelOffset;
+  vec2 maxCoords = tile.rect.xy + tile.rect.zw - 0.5 * texelOffset;
+  vec2 shadowTexCoords = tile.rect.xy + tileCoords * tile.rect.zw;
+  // The tiles store the distance to the light rather than depth.
+  float currentDistance = length(fragPos - lightPos) * tile.invRange;
+
+  float shadow = 0.0;
+  for (int x = -1; x <= 1; x++) {
+    for (int y = -1; y <= 1; y++) {
+      vec2 sampleCoords = clamp(shadowTexCoords + vec2(x, y) * texelOffset,
+                                minCoords, maxCoords);
+      float pcfDistance = texture(fnk_shadowAtlas, sampleCoords).r;
+      shadow += currentDistance - FNK_SHADOW_ATLAS_BIAS > pcfDistance ? 1.0
+                                                                      : 0.0;
+    }
+  }
+  return shadow / 9.0;
+}
+
+/**
+ * Moves a view space position off its surface by about a texel of a tile
+ * with the given field of view, so the surface doesn't shadow itself.
+ */
+vec3 fnk_shadowAtlasOffset(int tileIndex, vec3 fragPos, vec3 normal,
+                           vec3 lightPos, float tanHalfFov) {
+  float texelSize = 2.0 * length(fragPos - lightPos) * tanHalfFov /
+                    fnk_shadowTiles[tileIndex].size;
+  return fragPos + normal * (1.5 * texelSize);
+}
+
+/**
+ * Calculate whether the given fragment is in the point light's shadow.
+ * Returns 1.0 if in shadow, 0.0 if not.
+ */
+float fnk_pointLightShadow(FnkPointLight light, vec3 fragPos, vec3 normal) {
+  if (!fnk_useShadowAtlas || light.shadowIndex < 0) {
+    return 0.0;
+  }
+  // The cube faces are aligned with the world axes, so pick one from the
+  // world space direction. The view has no scale, so its inverse rotation is
+  // its transpose.
+  vec3 lightToFrag = transpose(mat3(fnk_view)) * (fragPos - light.position);
+  vec3 absDir = abs(lightToFrag);
+  int face;
+  if (absDir.x >= absDir.y && absDir.x >= absDir.z) {
+    face = lightToFrag.x > 0.0 ? 0 : 1;
+  } else if (absDir.y >= absDir.z) {
+    face = lightToFrag.y > 0.0 ? 2 : 3;
+  } else {
+    face = lightToFrag.z > 0.0 ? 4 : 5;
+  }
+  int tileIndex = light.shadowIndex + face;
+  vec3 offsetPos = fnk_shadowAtlasOffset(tileIndex, fragPos, normal,
+                                         light.position, /*tanHalfFov=*/1.0);
+  return fnk_shadowAtlasSamplePCF(tileIndex, offsetPos, light.position);
+}
+
+/**
+ * Calculate whether the given fragment is in the spot light's shadow.
+ * Returns 1.0 if in shadow, 0.0 if not.
+ */
+float fnk_spotLightShadow(FnkSpotLight light, vec3 fragPos, vec3 normal) {
+  if (!fnk_useShadowAtlas || light.shadowIndex < 0) {
+    return 0.0;
+  }
+  vec3 offsetPos =
+      fnk_shadowAtlasOffset(light.shadowIndex, fragPos, normal,
+                            light.position, tan(light.outerAngle));
+  return fnk_shadowAtlasSamplePCF(light.shadowIndex, offsetPos,
+                                  light.position);
 }
\ No newline at end of file
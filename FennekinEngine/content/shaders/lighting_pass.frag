@@ -17,6 +17,9 @@ uniform sampler2D gAlbedoMetallic;
 uniform sampler2D gEmission;
 
 uniform bool shadowMapping;
+// Whether the directional light's shadow comes from the virtual shadow map
+// instead of the cascades.
+uniform bool virtualShadows;
 uniform bool ssao;
 uniform sampler2D fnk_ssao;
 
@@ -26,12 +29,11 @@ uniform float emissionIntensity;
 uniform FnkAttenuation emissionAttenuation;
 
 uniform int lightingModel;
+// Whether to shade the point and spot lights here. They are left to light
+// volumes drawn afterwards otherwise, see LightVolumeRenderer.
+uniform bool localLights;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightViewProjection;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap;
 uniform float shadowBiasMin;
 uniform float shadowBiasMax;
 uniform samplerCube fnk_irradianceMap;
@@ -59,10 +61,12 @@ void main() {
         fnk_shadowBias(shadowBiasMin, shadowBiasMax, fragNormal_viewSpace,
                        fnk_directionalLights[0].direction);
     // Since we're in view space, we have to un-project to world space in order
-    // to get to the light's view.
-    vec4 fragPos_worldSpace = inverse(view) * vec4(fragPos_viewSpace, 1.0);
-    vec4 fragPos_lightSpace = lightViewProjection * fragPos_worldSpace;
-    shadow = fnk_shadow(shadowMap, fragPos_lightSpace, shadowBias);
+    // to get to the cascades.
+    vec4 fragPos_worldSpace = inverse(fnk_view) * vec4(fragPos_viewSpace, 1.0);
+    shadow = virtualShadows
+                 ? fnk_virtualShadow(fragPos_worldSpace.xyz, shadowBias)
+                 : fnk_shadow(shadowMap, fragPos_worldSpace.xyz,
+                              fragPos_viewSpace, shadowBias);
   }
 
   // Ambient occlusion.
@@ -73,17 +77,22 @@ void main() {
     ao *= texture(fnk_ssao, texCoords).r;
   }
 
-  // Shade with normal lights.
+  // Shade with normal lights. Only the point and spot lights listed for the
+  // fragment's cluster can reach it, and an empty cluster leaves just the
+  // directional lights.
+  uvec4 cluster = localLights
+                      ? fnk_getLightCluster(gl_FragCoord.xy, fragPos_viewSpace)
+                      : uvec4(0);
   if (lightingModel == 0) {
     // Phong.
     color = fnk_shadeAllLightsBlinnPhongDeferred(
         fragAlbedo, /*specular=*/vec3(fragMetallic), ambient, shininess,
-        fragPos_viewSpace, fragNormal_viewSpace, shadow, ao);
+        fragPos_viewSpace, fragNormal_viewSpace, shadow, ao, cluster);
   } else if (lightingModel == 1) {
     // GGX.
     color = fnk_shadeAllLightsCookTorranceGGXDeferred(
         fragAlbedo, fragRoughness, fragMetallic, fragPos_viewSpace,
-        fragNormal_viewSpace, shadow);
+        fragNormal_viewSpace, shadow, cluster);
   } else {
     // Invalid lighting model (pink to signal!).
     color = vec3(1.0, 0.0, 0.5);
@@ -92,9 +101,9 @@ void main() {
       // Add ambient term.
     if (useIBL) {
       // Need to sample from cubemaps via worlspace vectors.
-      vec3 fragNormal_worldSpace = mat3(transpose(view)) * fragNormal_viewSpace;
+      vec3 fragNormal_worldSpace = mat3(transpose(fnk_view)) * fragNormal_viewSpace;
       vec3 viewDir_worldSpace =
-          mat3(inverse(view)) * normalize(-fragPos_viewSpace);
+          mat3(inverse(fnk_view)) * normalize(-fragPos_viewSpace);
       vec3 reflectionDir_worldSpace =
           reflect(-viewDir_worldSpace, fragNormal_worldSpace);
 
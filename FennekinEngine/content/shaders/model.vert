@@ -1,4 +1,5 @@
 #version 460 core
+#pragma fnk_include < core.glsl>
 layout(location = 0) in vec3 vertexPos;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec3 vertexTangent;
@@ -15,16 +16,14 @@ out VS_OUT {
 vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 uniform bool inverseNormals;
 
 void main() {
-  gl_Position = projection * view * model * vec4(vertexPos, 1.0);
+  gl_Position = fnk_projection * fnk_view * model * vec4(vertexPos, 1.0);
 
   vs_out.texCoords = vertexTexCoords;
-  vs_out.fragPos = vec3(view * model * vec4(vertexPos, 1.0));
-  vs_out.fragNormal = mat3(transpose(inverse(view * model))) *
+  vs_out.fragPos = vec3(fnk_view * model * vec4(vertexPos, 1.0));
+  vs_out.fragNormal = mat3(transpose(inverse(fnk_view * model))) *
                       (inverseNormals ? -vertexNormal : vertexNormal);
 }
@@ -206,12 +206,13 @@ vec3 fnk_shadePointLightCookTorranceGGXDeferred(vec3 albedo, float roughness,
   // Calculate attenuation from light source.
   float lightDist = length(light.position - fragPos);
   float attenuation = fnk_calcAttenuation(light.attenuation, lightDist);
+  float shadowMultiplier = 1.0 - fnk_pointLightShadow(light, fragPos, normal);
 
   vec3 result = fnk_shadeCookTorranceGGXDeferred(albedo, roughness, metallic,
                                                  light.diffuse, light.specular,
                                                  lightDir, viewDir, normal);
-  // Apply attenuation.
-  return result * attenuation;
+  // Apply attenuation and shadowing, if any.
+  return result * attenuation * shadowMultiplier;
 }
 
 /** Calculate shading for a point light source. */
@@ -238,12 +239,13 @@ vec3 fnk_shadeSpotLightCookTorranceGGXDeferred(vec3 albedo, float roughness,
   float attenuation = fnk_calcAttenuation(light.attenuation, lightDist);
 
   float spotlightIntensity = fnk_calcSpotLightIntensity(light, lightDir);
+  float shadowMultiplier = 1.0 - fnk_spotLightShadow(light, fragPos, normal);
 
   vec3 result = fnk_shadeCookTorranceGGXDeferred(albedo, roughness, metallic,
                                                  light.diffuse, light.specular,
                                                  lightDir, viewDir, normal);
-  // Apply attenuation and intensity.
-  return result * attenuation * spotlightIntensity;
+  // Apply attenuation, intensity and shadowing, if any.
+  return result * attenuation * spotlightIntensity * shadowMultiplier;
 }
 
 /** Calculate shading for a spot light source. */
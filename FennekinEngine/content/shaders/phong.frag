@@ -93,10 +93,11 @@ vec3 fnk_shadePointLightBlinnPhongDeferred(vec3 albedo, vec3 specular,
   // Calculate attenuation from light source.
   float lightDist = length(light.position - fragPos);
   float attenuation = fnk_calcAttenuation(light.attenuation, lightDist);
+  float shadow = fnk_pointLightShadow(light, fragPos, normal);
 
   vec3 result = fnk_shadeBlinnPhongDeferred(
       albedo, specular, ambient, shininess, light.diffuse, light.specular,
-      lightDir, viewDir, normal, /*intensity=*/1.0, /*shadow=*/0.0, ao);
+      lightDir, viewDir, normal, /*intensity=*/1.0, shadow, ao);
   // Apply attenuation.
   return result * attenuation;
 }
@@ -125,10 +126,11 @@ vec3 fnk_shadeSpotLightBlinnPhongDeferred(vec3 albedo, vec3 specular,
   float attenuation = fnk_calcAttenuation(light.attenuation, lightDist);
 
   float intensity = fnk_calcSpotLightIntensity(light, lightDir);
+  float shadow = fnk_spotLightShadow(light, fragPos, normal);
 
   vec3 result = fnk_shadeBlinnPhongDeferred(
       albedo, specular, ambient, shininess, light.diffuse, light.specular,
-      lightDir, viewDir, normal, intensity, /*shadow=*/0.0, ao);
+      lightDir, viewDir, normal, intensity, shadow, ao);
   // Apply attenuation.
   return result * attenuation;
 }
@@ -1,22 +1,45 @@
 #pragma once
 
+#pragma fnk_include < core.glsl>
 #pragma fnk_include < lighting.frag>
 #pragma fnk_include < pbr.frag>
 
-#ifndef FNK_MAX_DIRECTIONAL_LIGHTS
-#define FNK_MAX_DIRECTIONAL_LIGHTS 10
-#endif
-uniform FnkDirectionalLight fnk_directionalLights[FNK_MAX_DIRECTIONAL_LIGHTS];
-uniform int fnk_directionalLightCount;
+// The light counts live in the FnkLights uniform block in core.glsl, and the
+// point and spot lights in storage buffers next to it.
 
-#ifndef FNK_MAX_POINT_LIGHTS
-#define FNK_MAX_POINT_LIGHTS 10
-#endif
-uniform FnkPointLight fnk_pointLights[FNK_MAX_POINT_LIGHTS];
-uniform int fnk_pointLightCount;
+// The cluster grid built by LightClusterGrid. Must match its constants.
+#define FNK_CLUSTER_TILES_X 16
+#define FNK_CLUSTER_TILES_Y 9
+#define FNK_CLUSTER_SLICES 24
 
-#ifndef FNK_MAX_SPOT_LIGHTS
-#define FNK_MAX_SPOT_LIGHTS 10
-#endif
-uniform FnkSpotLight fnk_spotLights[FNK_MAX_SPOT_LIGHTS];
-uniform int fnk_spotLightCount;
\ No newline at end of file
+// Per cluster: the offset of its lights in fnk_clusterLightIndices, then the
+// number of point lights and of spot lights listed there, in that order.
+layout(std430, binding = 8) readonly buffer FnkLightClusters {
+  uvec4 fnk_lightClusters[];
+};
+
+layout(std430, binding = 9) readonly buffer FnkClusterLightIndices {
+  uint fnk_clusterLightIndices[];
+};
+
+/**
+ * Returns the cluster of a fragment, from its window position and view space
+ * depth. The depth range is recovered from the projection, so it always
+ * matches the camera the clusters were built for.
+ */
+uvec4 fnk_getLightCluster(vec2 fragCoord, vec3 fragPos_viewSpace) {
+  float nearPlane = fnk_projection[3][2] / (fnk_projection[2][2] - 1.0);
+  float farPlane = fnk_projection[3][2] / (fnk_projection[2][2] + 1.0);
+  float depth = max(-fragPos_viewSpace.z, nearPlane);
+  int slice = int(floor(log(depth / nearPlane) / log(farPlane / nearPlane) *
+                        float(FNK_CLUSTER_SLICES)));
+  slice = clamp(slice, 0, FNK_CLUSTER_SLICES - 1);
+
+  vec2 tiles = vec2(FNK_CLUSTER_TILES_X, FNK_CLUSTER_TILES_Y);
+  ivec2 tile = ivec2(clamp(
+      floor(fragCoord / vec2(fnk_windowWidth, fnk_windowHeight) * tiles),
+      vec2(0.0), tiles - 1.0));
+  return fnk_lightClusters[(slice * FNK_CLUSTER_TILES_Y + tile.y) *
+                               FNK_CLUSTER_TILES_X +
+                           tile.x];
+}
\ No newline at end of file
@@ -48,15 +48,18 @@ vec3 fnk_shadeAllPointLightsCookTorranceGGX(FnkMaterial material, vec3 fragPos,
   return result;
 }
 
-/** Calculate shading from all active point lights using deferred data. */
-vec3 fnk_shadeAllPointLightsCookTorranceGGXDeferred(vec3 albedo,
-                                                    float roughness,
-                                                    float metallic,
-                                                    vec3 fragPos, vec3 normal) {
+/**
+ * Calculate shading from the point lights of the fragment's cluster using
+ * deferred data.
+ */
+vec3 fnk_shadeClusterPointLightsCookTorranceGGXDeferred(
+    vec3 albedo, float roughness, float metallic, vec3 fragPos, vec3 normal,
+    uvec4 cluster) {
   vec3 result = vec3(0.0);
-  for (int i = 0; i < fnk_pointLightCount; i++) {
+  for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
     result += fnk_shadePointLightCookTorranceGGXDeferred(
-        albedo, roughness, metallic, fnk_pointLights[i], fragPos, normal);
+        albedo, roughness, metallic,
+        fnk_pointLights[fnk_clusterLightIndices[i]], fragPos, normal);
   }
   return result;
 }
@@ -72,14 +75,19 @@ vec3 fnk_shadeAllSpotLightsCookTorranceGGX(FnkMaterial material, vec3 fragPos,
   return result;
 }
 
-/** Calculate shading from all active spot lights using deferred data. */
-vec3 fnk_shadeAllSpotLightsCookTorranceGGXDeferred(vec3 albedo, float roughness,
-                                                   float metallic, vec3 fragPos,
-                                                   vec3 normal) {
+/**
+ * Calculate shading from the spot lights of the fragment's cluster using
+ * deferred data.
+ */
+vec3 fnk_shadeClusterSpotLightsCookTorranceGGXDeferred(
+    vec3 albedo, float roughness, float metallic, vec3 fragPos, vec3 normal,
+    uvec4 cluster) {
   vec3 result = vec3(0.0);
-  for (int i = 0; i < fnk_spotLightCount; i++) {
+  uint first = cluster.x + cluster.y;
+  for (uint i = first; i < first + cluster.z; i++) {
     result += fnk_shadeSpotLightCookTorranceGGXDeferred(
-        albedo, roughness, metallic, fnk_spotLights[i], fragPos, normal);
+        albedo, roughness, metallic,
+        fnk_spotLights[fnk_clusterLightIndices[i]], fragPos, normal);
   }
   return result;
 }
@@ -112,24 +120,26 @@ vec3 fnk_shadeAllLightsCookTorranceGGX(FnkMaterial material, vec3 fragPos,
  * Calculate shading from all light sources, except ambient and emission
  * textures, using deferred data.
  * AO can be a mix of AO textures and SSAO, but the mixing should be handled by
- * the caller.
+ * the caller. Point and spot lights are those of the fragment's cluster, see
+ * fnk_getLightCluster().
  */
 vec3 fnk_shadeAllLightsCookTorranceGGXDeferred(vec3 albedo, float roughness,
                                                float metallic, vec3 fragPos,
-                                               vec3 normal, float shadow) {
+                                               vec3 normal, float shadow,
+                                               uvec4 cluster) {
   vec3 directional = fnk_shadeAllDirectionalLightsCookTorranceGGXDeferred(
       albedo, roughness, metallic, fragPos, normal, shadow);
-  vec3 point = fnk_shadeAllPointLightsCookTorranceGGXDeferred(
-      albedo, roughness, metallic, fragPos, normal);
-  vec3 spot = fnk_shadeAllSpotLightsCookTorranceGGXDeferred(
-      albedo, roughness, metallic, fragPos, normal);
+  vec3 point = fnk_shadeClusterPointLightsCookTorranceGGXDeferred(
+      albedo, roughness, metallic, fragPos, normal, cluster);
+  vec3 spot = fnk_shadeClusterSpotLightsCookTorranceGGXDeferred(
+      albedo, roughness, metallic, fragPos, normal, cluster);
   return directional + point + spot;
 }
 
 vec3 fnk_shadeAllLightsCookTorranceGGXDeferred(vec3 albedo, float roughness,
                                                float metallic, vec3 fragPos,
-                                               vec3 normal) {
+                                               vec3 normal, uvec4 cluster) {
   return fnk_shadeAllLightsCookTorranceGGXDeferred(albedo, roughness, metallic,
                                                    fragPos, normal,
-                                                   /*shadow=*/0.0);
+                                                   /*shadow=*/0.0, cluster);
 }
\ No newline at end of file
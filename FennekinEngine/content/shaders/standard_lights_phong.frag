@@ -43,16 +43,20 @@ vec3 fnk_shadeAllPointLightsBlinnPhong(FnkMaterial material, vec3 fragPos,
   return result;
 }
 
-/** Calculate shading from all active point lights using deferred data. */
-vec3 fnk_shadeAllPointLightsBlinnPhongDeferred(vec3 albedo, vec3 specular,
-                                               vec3 ambient, float shininess,
-                                               vec3 fragPos, vec3 normal,
-                                               float ao) {
+/**
+ * Calculate shading from the point lights of the fragment's cluster using
+ * deferred data.
+ */
+vec3 fnk_shadeClusterPointLightsBlinnPhongDeferred(vec3 albedo, vec3 specular,
+                                                   vec3 ambient,
+                                                   float shininess,
+                                                   vec3 fragPos, vec3 normal,
+                                                   float ao, uvec4 cluster) {
   vec3 result = vec3(0.0);
-  for (int i = 0; i < fnk_pointLightCount; i++) {
+  for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
     result += fnk_shadePointLightBlinnPhongDeferred(
-        albedo, specular, ambient, shininess, fnk_pointLights[i], fragPos,
-        normal, ao);
+        albedo, specular, ambient, shininess,
+        fnk_pointLights[fnk_clusterLightIndices[i]], fragPos, normal, ao);
   }
   return result;
 }
@@ -68,16 +72,21 @@ vec3 fnk_shadeAllSpotLightsBlinnPhong(FnkMaterial material, vec3 fragPos,
   return result;
 }
 
-/** Calculate shading from all active spot lights using deferred data. */
-vec3 fnk_shadeAllSpotLightsDeferredBlinnPhong(vec3 albedo, vec3 specular,
-                                              vec3 ambient, float shininess,
-                                              vec3 fragPos, vec3 normal,
-                                              float ao) {
+/**
+ * Calculate shading from the spot lights of the fragment's cluster using
+ * deferred data.
+ */
+vec3 fnk_shadeClusterSpotLightsBlinnPhongDeferred(vec3 albedo, vec3 specular,
+                                                  vec3 ambient,
+                                                  float shininess,
+                                                  vec3 fragPos, vec3 normal,
+                                                  float ao, uvec4 cluster) {
   vec3 result = vec3(0.0);
-  for (int i = 0; i < fnk_spotLightCount; i++) {
-    result += fnk_shadeSpotLightBlinnPhongDeferred(albedo, specular, ambient,
-                                                   shininess, fnk_spotLights[i],
-                                                   fragPos, normal, ao);
+  uint first = cluster.x + cluster.y;
+  for (uint i = first; i < first + cluster.z; i++) {
+    result += fnk_shadeSpotLightBlinnPhongDeferred(
+        albedo, specular, ambient, shininess,
+        fnk_spotLights[fnk_clusterLightIndices[i]], fragPos, normal, ao);
   }
   return result;
 }
@@ -102,24 +111,28 @@ vec3 fnk_shadeAllLightsBlinnPhong(FnkMaterial material, vec3 fragPos,
 }
 
 /** Calculate shading from all light sources, except emission textures, using
- * deferred data. */
+ * deferred data. Point and spot lights are those of the fragment's cluster,
+ * see fnk_getLightCluster(). */
 vec3 fnk_shadeAllLightsBlinnPhongDeferred(vec3 albedo, vec3 specular,
                                           vec3 ambient, float shininess,
                                           vec3 fragPos, vec3 normal,
-                                          float shadow, float ao) {
+                                          float shadow, float ao,
+                                          uvec4 cluster) {
   vec3 directional = fnk_shadeAllDirectionalLightsBlinnPhongDeferred(
       albedo, specular, ambient, shininess, fragPos, normal, shadow, ao);
-  vec3 point = fnk_shadeAllPointLightsBlinnPhongDeferred(
-      albedo, specular, ambient, shininess, fragPos, normal, ao);
-  vec3 spot = fnk_shadeAllSpotLightsDeferredBlinnPhong(
-      albedo, specular, ambient, shininess, fragPos, normal, ao);
+  vec3 point = fnk_shadeClusterPointLightsBlinnPhongDeferred(
+      albedo, specular, ambient, shininess, fragPos, normal, ao, cluster);
+  vec3 spot = fnk_shadeClusterSpotLightsBlinnPhongDeferred(
+      albedo, specular, ambient, shininess, fragPos, normal, ao, cluster);
   return directional + point + spot;
 }
 
 vec3 fnk_shadeAllLightsBlinnPhongDeferred(vec3 albedo, vec3 specular,
                                           vec3 ambient, float shininess,
-                                          vec3 fragPos, vec3 normal) {
+                                          vec3 fragPos, vec3 normal,
+                                          uvec4 cluster) {
   return fnk_shadeAllLightsBlinnPhongDeferred(albedo, specular, ambient,
                                               shininess, fragPos, normal,
-                                              /*shadow=*/0.0, /*ao=*/1.0);
+                                              /*shadow=*/0.0, /*ao=*/1.0,
+                                              cluster);
 }
\ No newline at end of file
@@ -2,10 +2,8 @@
 
 // TODO: This file should be .glsl
 
-uniform float fnk_deltaTime;
-// TODO: Replace these uniforms with a vec2.
-uniform int fnk_windowWidth;
-uniform int fnk_windowHeight;
+// fnk_deltaTime and the window size live in the FnkFrame block.
+#pragma fnk_include < core.glsl>
 
 bool fnk_isWindowLeftHalf() { return gl_FragCoord.x < (fnk_windowWidth / 2); }
 bool fnk_isWindowRightHalf() { return gl_FragCoord.x >= (fnk_windowWidth / 2); }
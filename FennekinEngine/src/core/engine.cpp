@@ -2,6 +2,8 @@
 #include "debug/logger.hpp"
 #include "core/gui.hpp"
 
+#include <bit>
+
 
 Engine::Engine() : m_window(1920, 1080, "Model Render - William Clark", true, 4) {
 }
@@ -65,6 +67,7 @@ void Engine::run() {
       Attenuation attenuation = {
           .constant = 0.0f, .linear = 0.0f, .quadratic = 1.0f};
       light->setAttenuation(attenuation);
+      light->setCastsShadows(true);
 
       lightRegistry->addLight(light.get());
       pointLights.push_back(light);
@@ -86,6 +89,7 @@ void Engine::run() {
       Attenuation attenuation = {
           .constant = 0.0f, .linear = 0.0f, .quadratic = 1.0f};
       light->setAttenuation(attenuation);
+      light->setCastsShadows(true);
 
       lightRegistry->addLight(light.get());
       spotLights.push_back(light);
@@ -102,7 +106,7 @@ void Engine::run() {
 
     // Build the G-Buffer and prepare deferred shading.
     DeferredGeometryPassShader geometryPassShader;
-    geometryPassShader.addUniformSource(camera);
+    DepthPrepassShader depthPrepassShader;
 
     auto gBuffer = std::make_shared<GBuffer>(m_window.getSize());
     auto lightingTextureRegistry = std::make_shared<TextureRegistry>();
@@ -114,24 +118,31 @@ void Engine::run() {
 
     ScreenShader lightingPassShader(
         ShaderPath("content/shaders/lighting_pass.frag"));
-    lightingPassShader.addUniformSource(camera);
     lightingPassShader.addUniformSource(lightingTextureRegistry);
-    lightingPassShader.addUniformSource(lightRegistry);
 
     // Setup shadow mapping.
+    // Every cascade gets a layer at half the size, so that all of them take
+    // the memory of a single map.
     constexpr int SHADOW_MAP_SIZE = 2048;
-    auto shadowMap =
-        std::make_shared<ShadowMap>(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    constexpr int SHADOW_CASCADE_SIZE = SHADOW_MAP_SIZE / 2;
+    auto shadowMap = std::make_shared<ShadowMap>(SHADOW_CASCADE_SIZE,
+                                                 MAX_SHADOW_CASCADES);
     lightingTextureRegistry->addTextureSource(shadowMap);
 
     ShadowMapShader shadowShader;
-    auto shadowCamera = std::make_shared<ShadowCamera>(directionalLight);
-    shadowShader.addUniformSource(shadowCamera);
-    lightingPassShader.addUniformSource(shadowCamera);
+    auto shadowCamera =
+        std::make_shared<ShadowCamera>(directionalLight, SHADOW_CASCADE_SIZE);
+    ShadowCache shadowCache(SHADOW_CASCADE_SIZE, MAX_SHADOW_CASCADES);
+    // Point and spot lights share the tiles of one atlas.
+    auto shadowAtlas = std::make_shared<ShadowAtlas>();
+    lightingTextureRegistry->addTextureSource(shadowAtlas);
+    // The alternative to the cascades, with pages kept across frames.
+    auto virtualShadowMap =
+        std::make_shared<VirtualShadowMap>(directionalLight);
+    lightingTextureRegistry->addTextureSource(virtualShadowMap);
 
     // Setup SSAO.
     SsaoShader ssaoShader;
-    ssaoShader.addUniformSource(camera);
 
     auto ssaoKernel = std::make_shared<SsaoKernel>();
     ssaoShader.addUniformSource(ssaoKernel);
@@ -159,7 +170,6 @@ void Engine::run() {
 
     // Setup skybox and IBL.
     SkyboxShader skyboxShader;
-    skyboxShader.addUniformSource(camera);
 
     constexpr int CUBEMAP_SIZE = 1024;
     EquirectCubemapConverter equirectCubemapConverter(CUBEMAP_SIZE,
@@ -174,10 +184,11 @@ void Engine::run() {
     lightingTextureRegistry->addTextureSource(irradianceCalculator);
 
     // Create prefiltered envmap for specular IBL. It doesn't have to be super
-    // large.
+    // large, so is capped at DEFAULT_MAX_SIZE.
     auto prefilteredEnvMapCalculator =
         std::make_shared<GGXPrefilteredEnvMapCalculator>(CUBEMAP_SIZE,
                                                          CUBEMAP_SIZE);
+    prefilteredEnvMapCalculator->setNumSamples(opts.prefilterSamples);
     auto prefilteredEnvMap =
         prefilteredEnvMapCalculator->getPrefilteredEnvMap();
     lightingTextureRegistry->addTextureSource(prefilteredEnvMapCalculator);
@@ -202,15 +213,67 @@ void Engine::run() {
     Shader normalShader(ShaderPath("content/shaders/model.vert"),
                         ShaderPath("content/shaders/normal.frag"),
                         ShaderPath("content/shaders/model_normals.geom"));
-    normalShader.addUniformSource(camera);
 
     Shader lampShader(ShaderPath("content/shaders/model.vert"),
                       ShaderPath("content/shaders/lamp.frag"));
-    lampShader.addUniformSource(camera);
 
     // Load primary model.
     std::unique_ptr<Model> model = loadModelOrDefault();
 
+    // Per-frame visibility of the model's meshes from every view.
+    SceneVisibility visibility;
+    // Hides meshes behind large occluders from the camera, on the CPU.
+    WorkerPool workerPool;
+    SoftwareOcclusionCuller softwareOcclusionCuller(workerPool);
+    // Assigns point and spot lights to view space clusters for the lighting
+    // pass.
+    LightClusterGrid lightClusters(workerPool);
+    // Alternatively shades them by drawing a stencil masked volume per light.
+    LightVolumeRenderer lightVolumes;
+    lightVolumes.getShader().addUniformSource(lightingTextureRegistry);
+    std::vector<std::unique_ptr<Light>> stressLights;
+    int stressLightCount = 0;
+    float stressLightRange = 0.0f;
+    float stressLightSpread = 0.0f;
+    // Meshes visible from each cell of the static model, baked offline and
+    // stored next to the scenes.
+    PotentiallyVisibleSet pvs;
+    pvs.load(getPvsPath(*model), *model);
+    // Ray and frustum queries against the model in its own space, with one
+    // hierarchy per distinct mesh.
+    SceneBvh sceneBvh;
+    sceneBvh.addRenderable(*model, glm::inverse(model->getModelTransform()));
+    sceneBvh.build(workerPool);
+    opts.bvhInstances = static_cast<int>(sceneBvh.getNumInstances());
+    opts.bvhTriangles = static_cast<int>(sceneBvh.getNumTriangles());
+    opts.bvhBuildMs = sceneBvh.getBuildMs();
+    // Draw queues for the model passes, sorted by state and depth. Static and
+    // dynamic shadow casters are queued apart, for the shadow cache.
+    RenderQueue shadowQueue;
+    RenderQueue dynamicShadowQueue;
+    RenderQueue geometryQueue;
+    RenderQueue depthPrepassQueue;
+    // Indirect command lists for the same passes.
+    IndirectDrawList shadowDrawList;
+    IndirectDrawList dynamicShadowDrawList;
+    IndirectDrawList geometryDrawList;
+    IndirectDrawList depthPrepassDrawList;
+    // Frustum culls the indirect lists on the GPU, if the driver can draw
+    // with GPU-side counts, and occlusion culls the G-buffer pass against a
+    // Hi-Z pyramid of its depth.
+    std::unique_ptr<GpuCuller> gpuCuller;
+    std::unique_ptr<HiZBuffer> hiZBuffer;
+    if (GpuCuller::isSupported()) {
+      gpuCuller = std::make_unique<GpuCuller>();
+      hiZBuffer = std::make_unique<HiZBuffer>(gBuffer->getDepthTexture());
+    }
+    opts.gpuCullingSupported = gpuCuller != nullptr;
+    // Measure the G-buffer pass, to show what the depth prepass gains and to
+    // turn it on by overdraw.
+    GpuQuery depthPrepassTimer(GL_TIME_ELAPSED);
+    GpuQuery gBufferPassTimer(GL_TIME_ELAPSED);
+    GpuQuery gBufferSamples(GL_SAMPLES_PASSED);
+
     m_window.enableFaceCull();
     m_window.loop([&](float deltaTime) {
       // ImGui logic.
@@ -234,17 +297,62 @@ void Engine::run() {
       opts.numFrameDeltas = m_window.getNumFrameDeltas();
       opts.frameDeltasOffset = m_window.getFrameDeltasOffset();
       opts.avgFPS = m_window.getAvgFps();
+      // GL state changes made during the previous frame.
+      const GlStateStats glStats = GlState::getStats();
+      opts.glCallsIssued = glStats.issued;
+      opts.glCallsSkipped = glStats.skipped;
+      GlState::resetStats();
+      const RenderQueueStats& queueStats = geometryQueue.getStats();
+      opts.queueDraws = queueStats.draws;
+      opts.queueStateChangesUnsorted = queueStats.stateChangesUnsorted;
+      opts.queueStateChangesSorted = queueStats.stateChangesSorted;
+      opts.queueDrawCalls = queueStats.drawCalls;
+      opts.queueCulled = queueStats.culled;
+      opts.shadowQueueCulled = shadowQueue.getStats().culled;
+      if (opts.shadowCaching) {
+        opts.shadowQueueCulled += dynamicShadowQueue.getStats().culled;
+      }
+      const OcclusionCullStats& occlusionStats =
+          softwareOcclusionCuller.getStats();
+      opts.cpuOcclusionOccluders = occlusionStats.occluders;
+      opts.cpuOcclusionTriangles = occlusionStats.triangles;
+      opts.cpuOcclusionCulled = occlusionStats.culled;
+      opts.cpuOcclusionRasterizeMs = occlusionStats.rasterizeMs;
+      opts.cpuOcclusionTestMs = occlusionStats.testMs;
+      const PvsStats& pvsStats = pvs.getStats();
+      opts.pvsLoaded = pvs.isValid();
+      opts.pvsCells = pvsStats.cells;
+      opts.pvsSolidCells = pvsStats.solidCells;
+      opts.pvsUniqueSets = pvsStats.uniqueSets;
+      opts.pvsBytes = static_cast<int>(pvsStats.bytes);
+      opts.pvsBakeMs = pvsStats.bakeMs;
+      const GpuCullStats& gpuCullStats = geometryDrawList.getCullStats();
+      opts.gpuFrustumCulled = static_cast<int>(gpuCullStats.frustumCulled);
+      opts.gpuOcclusionCulled = static_cast<int>(gpuCullStats.occlusionCulled);
 
       // Render UI.
       const UIContext ctx = {
           .camera = *camera,
           .shadowMap = *shadowMap,
+          .shadowAtlas = *shadowAtlas,
+          .virtualShadowMap = *virtualShadowMap,
           .ssaoBuffer = *ssaoBlurredBuffer,
       };
       renderImGuiUI(opts, ctx);
 
       // Post-process options. Some option values are used later during
       // rendering.
+      if (opts.spinModel) {
+        opts.modelRotation =
+            glm::angleAxis(deltaTime * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f)) *
+            opts.modelRotation;
+      }
+      if (opts.dynamicModel != prevOpts.dynamicModel) {
+        model->setDynamic(opts.dynamicModel);
+      }
+      if (opts.occluderModel != prevOpts.occluderModel) {
+        model->setOccluder(opts.occluderModel);
+      }
       model->setModelTransform(glm::scale(glm::mat4_cast(opts.modelRotation),
                                           glm::vec3(opts.modelScale)));
 
@@ -284,48 +392,345 @@ void Engine::run() {
         }
       }
 
+      if (opts.prefilterSamples != prevOpts.prefilterSamples) {
+        prefilteredEnvMapCalculator->setNumSamples(opts.prefilterSamples);
+        if (opts.skyboxImage == prevOpts.skyboxImage) {
+          prefilteredEnvMapCalculator->draw(
+              equirectCubemapConverter.getCubemap());
+        }
+      }
+
       if (opts.skyboxImage != prevOpts.skyboxImage) {
         loadSkyboxImage(opts.skyboxImage, skybox, equirectCubemapConverter,
                         *irradianceCalculator, *prefilteredEnvMapCalculator);
       }
 
+      if (opts.checkPrefilterParity) {
+        opts.checkPrefilterParity = false;
+        opts.prefilterParity = prefilteredEnvMapCalculator->checkParity(
+            equirectCubemapConverter.getCubemap());
+      }
+
       m_window.setMouseButtonBehavior(opts.captureMouse
                                      ? EMouseButtonBehavior::CAPTURE_MOUSE
                                      : EMouseButtonBehavior::NONE);
 
+      shadowCamera->setNumCascades(opts.shadowCascades);
+      shadowCamera->setSplitLambda(opts.shadowSplitLambda);
+      shadowCamera->setMaxDistance(opts.shadowDistance);
+
+      // Write the per-view uniform blocks once. Every program reads them
+      // through the fixed binding points in core.glsl.
+      camera->updateUniformBlock();
+      if (opts.stressLights != stressLightCount ||
+          opts.stressLightRange != stressLightRange ||
+          opts.stressLightSpread != stressLightSpread) {
+        stressLightCount = opts.stressLights;
+        stressLightRange = opts.stressLightRange;
+        stressLightSpread = opts.stressLightSpread;
+        for (const auto &light : stressLights) {
+          lightRegistry->removeLight(light.get());
+        }
+        stressLights.clear();
+        // Seeded, so changing the range or spread keeps the same layout.
+        std::mt19937 stressGen(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> colorDist(0.5f, 3.0f);
+        for (int i = 0; i < stressLightCount; i++) {
+          const glm::vec3 position =
+              glm::vec3(unit(stressGen), unit(stressGen) * 0.25f,
+                        unit(stressGen)) *
+              stressLightSpread;
+          const glm::vec3 color(colorDist(stressGen), colorDist(stressGen),
+                                colorDist(stressGen));
+          const Attenuation attenuation = getAttenuationForRange(
+              stressLightRange, std::max({color.r, color.g, color.b}));
+          if (i % 2 == 0) {
+            stressLights.push_back(std::make_unique<PointLight>(
+                position, color, color, attenuation));
+          } else {
+            stressLights.push_back(std::make_unique<SpotLight>(
+                position,
+                glm::vec3(unit(stressGen), -1.0f, unit(stressGen)),
+                DEFAULT_INNER_ANGLE, DEFAULT_OUTER_ANGLE, color, color,
+                attenuation));
+          }
+          lightRegistry->addLight(stressLights.back().get());
+        }
+      }
+      // Tiles go to the lights before they are uploaded, which hands each
+      // light its first tile.
+      if (opts.localShadows) {
+        shadowAtlas->update(*lightRegistry, *camera, model->getScene(),
+                            model->getModelTransform());
+      } else {
+        shadowAtlas->releaseTiles(*lightRegistry);
+      }
+      lightRegistry->updateUniformBlock();
+      if (!opts.lightVolumes) {
+        lightClusters.build(*lightRegistry, camera->getProjectionTransform(),
+                            camera->getNearPlane(), camera->getFarPlane());
+        opts.lightClusters = lightClusters.getStats();
+      }
+      shadowCamera->setSceneBounds(
+          sceneBvh.getBounds().transformed(model->getModelTransform()));
+      shadowCamera->fit(*camera);
+      shadowCamera->updateUniformBlock();
+
+      const Frustum cameraFrustum = camera->getFrustum();
+      const Frustum shadowFrustum = shadowCamera->getFrustum();
+      GpuCuller* culler = opts.gpuCulling ? gpuCuller.get() : nullptr;
+      HiZBuffer* hiZ = nullptr;
+      if (culler && opts.occlusionCulling) {
+        hiZ = hiZBuffer.get();
+      } else if (hiZBuffer) {
+        // The pyramid isn't kept up to date while occlusion culling is off.
+        hiZBuffer->invalidate();
+      }
+
+      if (opts.runTransformBenchmark) {
+        opts.runTransformBenchmark = false;
+        opts.transformBenchmark = benchmarkTransformKernels();
+        opts.transformBenchmarkDone = true;
+      }
+      if (opts.runBvhBenchmark) {
+        opts.runBvhBenchmark = false;
+        opts.bvhBenchmark = benchmarkBvh(sceneBvh, workerPool);
+        opts.bvhBenchmarkDone = true;
+      }
+      if (opts.runOcclusionBenchmark) {
+        opts.runOcclusionBenchmark = false;
+        opts.occlusionBenchmark = benchmarkOcclusion(
+            model->getScene(), model->getModelTransform(), cameraFrustum,
+            camera->getProjectionTransform() * camera->getViewTransform(),
+            workerPool, opts.minOccluderArea);
+        opts.occlusionBenchmarkDone = true;
+      }
+
+      // The bake doesn't depend on culling being on this frame.
+      if (opts.bakePvs) {
+        opts.bakePvs = false;
+        pvs.bake(*model, workerPool);
+        pvs.save(getPvsPath(*model));
+      }
+
+      // Cull the model against all views at once, walking it only once.
+      int cameraView = -1;
+      int shadowView = -1;
+      if (opts.frustumCulling) {
+        visibility.begin();
+        visibility.add(model->getScene(), model->getModelTransform());
+        cameraView = visibility.addView(cameraFrustum);
+        if (opts.shadowMapping) {
+          shadowView = visibility.addView(shadowFrustum);
+        }
+        visibility.cull();
+        opts.pvsCulled = 0;
+        if (opts.usePvs) {
+          // The set is baked in the model's space.
+          const glm::vec3 position =
+              glm::inverse(model->getModelTransform()) *
+              glm::vec4(camera->getPosition(), 1.0f);
+          opts.pvsCulled = pvs.apply(visibility, cameraView, position);
+        }
+        if (opts.cpuOcclusionCulling) {
+          softwareOcclusionCuller.setMinOccluderArea(opts.minOccluderArea);
+          softwareOcclusionCuller.cull(
+              visibility, cameraView,
+              camera->getProjectionTransform() * camera->getViewTransform());
+        }
+      }
+
       // == Main render path ==
       // Step 0: optional shadow pass.
-      if (opts.shadowMapping) {
-        shadowCamera->setCuboidExtents(opts.shadowCameraCuboidExtents);
-        shadowCamera->setNearPlane(opts.shadowCameraNear);
-        shadowCamera->setFarPlane(opts.shadowCameraFar);
-        shadowCamera->setDistanceFromOrigin(opts.shadowCameraDistance);
-
-        shadowMap->activate();
-        shadowMap->clear();
-        shadowShader.updateUniforms();
-        model->draw(shadowShader);
-        shadowMap->deactivate();
+      opts.shadowCascadesRedrawn = 0;
+      if (opts.shadowMapping && opts.virtualShadows) {
+        virtualShadowMap->setSceneBounds(
+            sceneBvh.getBounds().transformed(model->getModelTransform()));
+        virtualShadowMap->update(model->getScene(),
+                                 model->getModelTransform());
+        opts.virtualShadowMap = virtualShadowMap->getStats();
+      } else if (opts.shadowMapping) {
+        // Whatever moved meanwhile isn't tracked by the virtual pages.
+        virtualShadowMap->invalidate();
+        const auto queueShadowCasters = [&](RenderQueue& t_queue,
+                                            const EMeshMobility t_mobility) {
+          t_queue.begin(shadowCamera->getViewTransform(), t_mobility);
+          if (opts.frustumCulling) {
+            t_queue.addVisible(visibility, shadowView, shadowShader);
+          } else {
+            t_queue.add(*model, shadowShader);
+          }
+          if (opts.sortDrawQueue) {
+            t_queue.sort();
+          }
+        };
+        const auto drawShadowCasters = [&](RenderQueue& t_queue,
+                                           IndirectDrawList& t_drawList) {
+          if (opts.indirectDraw) {
+            // Depth only, so the whole pass is one multi-draw.
+            t_queue.submitIndirect(
+                t_drawList, nullptr, ERenderPass::DEPTH_ONLY,
+                {.culler = culler, .frustum = shadowFrustum});
+          } else {
+            t_queue.submit(nullptr, ERenderPass::DEPTH_ONLY);
+          }
+        };
+        const unsigned int allCascades =
+            (1u << shadowCamera->getNumCascades()) - 1u;
+
+        if (opts.shadowCaching) {
+          // Redraw the static casters of the cascades that moved, then draw
+          // the dynamic ones over a copy of them.
+          Scene& scene = model->getScene();
+          scene.update(model->getModelTransform());
+          const unsigned int staleCascades =
+              shadowCache.update(*shadowCamera, scene.getStaticRevision());
+          if (staleCascades != 0) {
+            opts.shadowCascadesRedrawn = std::popcount(staleCascades);
+            ShadowMap& staticMap = shadowCache.getStaticMap();
+            staticMap.activate();
+            shadowCache.clearCascades(staleCascades);
+            shadowShader.setUInt("cascadeMask", staleCascades);
+            queueShadowCasters(shadowQueue, EMeshMobility::STATIC);
+            drawShadowCasters(shadowQueue, shadowDrawList);
+            staticMap.deactivate();
+          }
+
+          queueShadowCasters(dynamicShadowQueue, EMeshMobility::DYNAMIC);
+          const bool drawsDynamic = !dynamicShadowQueue.isEmpty();
+          shadowCache.compose(*shadowMap, shadowCamera->getNumCascades(),
+                              drawsDynamic);
+          if (drawsDynamic) {
+            shadowMap->activate();
+            shadowShader.setUInt("cascadeMask", allCascades);
+            drawShadowCasters(dynamicShadowQueue, dynamicShadowDrawList);
+            shadowMap->deactivate();
+          }
+        } else {
+          shadowCache.invalidate();
+          opts.shadowCascadesRedrawn = shadowCamera->getNumCascades();
+          shadowMap->activate();
+          shadowMap->clear();
+          shadowShader.setUInt("cascadeMask", allCascades);
+          queueShadowCasters(shadowQueue, EMeshMobility::ALL);
+          drawShadowCasters(shadowQueue, shadowDrawList);
+          shadowMap->deactivate();
+        }
       }
+      if (opts.localShadows) {
+        shadowAtlas->render(model->getScene(), model->getModelTransform());
+      }
+      opts.shadowAtlas = shadowAtlas->getStats();
 
       // Step 1: geometry pass. Build the G-Buffer.
       {
         gBuffer->activate();
         gBuffer->clear();
 
-        geometryPassShader.updateUniforms();
-
         // Draw model.
         if (opts.wireframe) {
           m_window.enableWireframe();
         }
-        model->draw(geometryPassShader);
+        const auto queueGeometry = [&](RenderQueue& t_queue,
+                                       Shader& t_shader) {
+          t_queue.begin(camera->getViewTransform());
+          if (opts.frustumCulling) {
+            t_queue.addVisible(visibility, cameraView, t_shader);
+          } else {
+            t_queue.add(*model, t_shader);
+          }
+          if (opts.sortDrawQueue) {
+            t_queue.sort();
+          }
+        };
+        const IndirectCulling geometryCulling = {
+            .culler = culler,
+            .frustum = cameraFrustum,
+            .hiZ = hiZ,
+            .viewProjection =
+                camera->getProjectionTransform() * camera->getViewTransform()};
+
+        // The prepass pays off once the G-buffer pass draws pixels over
+        // several times. The samples counted are the same either way, as
+        // only the pass writing depth is measured.
+        opts.overdraw =
+            static_cast<float>(gBufferSamples.getResult()) /
+            static_cast<float>(gBuffer->getSize().width *
+                               gBuffer->getSize().height);
+        opts.depthPrepassActive =
+            opts.depthPrepass == EDepthPrepass::ON ||
+            (opts.depthPrepass == EDepthPrepass::AUTO &&
+             opts.overdraw > opts.depthPrepassOverdraw);
+        opts.depthPrepassMs =
+            opts.depthPrepassActive ? depthPrepassTimer.getMs() : 0.0f;
+        opts.gBufferPassMs = gBufferPassTimer.getMs();
+
+        if (opts.depthPrepassActive) {
+          depthPrepassTimer.begin();
+          gBufferSamples.begin();
+          // Depth only, so nothing may reach the color attachments.
+          glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+          queueGeometry(depthPrepassQueue, depthPrepassShader);
+          if (opts.indirectDraw) {
+            depthPrepassQueue.submitIndirect(depthPrepassDrawList, nullptr,
+                                             ERenderPass::DEPTH_ONLY,
+                                             geometryCulling);
+          } else {
+            depthPrepassQueue.submit(nullptr, ERenderPass::DEPTH_ONLY);
+          }
+          glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+          gBufferSamples.end();
+          depthPrepassTimer.end();
+
+          // Only the nearest surface passes now, as its depth is already
+          // written.
+          geometryPassShader.setDepthFunc(GL_EQUAL);
+          GlState::setDepthMask(false);
+        } else {
+          geometryPassShader.setDepthFunc(GL_LESS);
+        }
+
+        gBufferPassTimer.begin();
+        if (!opts.depthPrepassActive) {
+          gBufferSamples.begin();
+        }
+        if (opts.lightVolumes) {
+          // Light volumes skip the pixels the model doesn't cover.
+          LightVolumeRenderer::beginGeometryMask();
+        }
+        queueGeometry(geometryQueue, geometryPassShader);
+        if (opts.indirectDraw) {
+          IndirectCulling culling = geometryCulling;
+          if (opts.depthPrepassActive) {
+            // The prepass just rebuilt the pyramid from this frame's depth,
+            // so test against it as is, with no second phase.
+            culling.rebuildHiZ = false;
+          }
+          geometryQueue.submitIndirect(geometryDrawList, nullptr,
+                                       ERenderPass::SHADED, culling);
+        } else {
+          geometryQueue.submit();
+        }
+        if (opts.lightVolumes) {
+          LightVolumeRenderer::endGeometryMask();
+        }
+        if (opts.depthPrepassActive) {
+          GlState::setDepthMask(true);
+        } else {
+          gBufferSamples.end();
+        }
+        gBufferPassTimer.end();
         if (opts.wireframe) {
           m_window.disableWireframe();
         }
 
         gBuffer->deactivate();
       }
+      if (opts.shadowMapping && opts.virtualShadows) {
+        // Pages first seen here are drawn by the following frames.
+        virtualShadowMap->markPages(*gBuffer, *camera);
+      }
 
       if (opts.gBufferVis != EGBufferVis::DISABLED) {
         {
@@ -355,7 +760,10 @@ void Engine::run() {
         }
 
         // TODO: Refactor avoid needing to copy this.
-        { ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); }
+        {
+          ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+          GlState::invalidate();
+        }
         return;
       }
 
@@ -389,16 +797,26 @@ void Engine::run() {
       {
         mainFb.activate();
         mainFb.clear();
+        if (opts.lightVolumes) {
+          // The volumes are tested against the scene's depth and the
+          // geometry stencil bit. The full screen pass mustn't be.
+          gBuffer->blit(mainFb,
+                        GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+          mainFb.activate();
+          m_window.disableDepthTest();
+        }
 
         // TODO: Set up environment mapping with the skybox.
         lightingPassShader.updateUniforms();
         lightingPassShader.setBool("shadowMapping", opts.shadowMapping);
+        lightingPassShader.setBool("virtualShadows", opts.virtualShadows);
         lightingPassShader.setFloat("shadowBiasMin", opts.shadowBiasMin);
         lightingPassShader.setFloat("shadowBiasMax", opts.shadowBiasMax);
         lightingPassShader.setBool("useIBL", opts.useIBL);
         lightingPassShader.setBool("ssao", opts.ssao);
         lightingPassShader.setInt("lightingModel",
                                   static_cast<int>(opts.lightingModel));
+        lightingPassShader.setBool("localLights", !opts.lightVolumes);
 
         // TODO: Pull this out into a material class.
         lightingPassShader.setVec3("ambient", opts.ambientColor);
@@ -415,25 +833,40 @@ void Engine::run() {
         screenQuad.unsetTexture();
         screenQuad.draw(lightingPassShader, lightingTextureRegistry.get());
 
+        opts.lightVolumesDrawn = 0;
+        if (opts.lightVolumes) {
+          m_window.enableDepthTest();
+          Shader &volumeShader = lightVolumes.getShader();
+          volumeShader.setBool("ssao", opts.ssao);
+          volumeShader.setInt("lightingModel",
+                              static_cast<int>(opts.lightingModel));
+          volumeShader.setVec3("ambient", opts.ambientColor);
+          volumeShader.setFloat("shininess", opts.shininess);
+          lightVolumes.draw(*lightRegistry, camera->getFarPlane(),
+                            lightingTextureRegistry.get());
+          opts.lightVolumesDrawn = lightVolumes.getNumVolumes();
+        }
+
         mainFb.deactivate();
       }
 
       // Step 3: forward render anything else on top.
       {
 
-        // Before we do so, we have to blit the depth buffer.
-        gBuffer->blit(mainFb, GL_DEPTH_BUFFER_BIT);
+        // Before we do so, we have to blit the depth buffer, unless the light
+        // volumes already did.
+        if (!opts.lightVolumes) {
+          gBuffer->blit(mainFb, GL_DEPTH_BUFFER_BIT);
+        }
 
         mainFb.activate();
 
         if (opts.drawNormals) {
           // Draw the normals.
-          normalShader.updateUniforms();
           model->draw(normalShader);
         }
 
         // Draw light source.
-        lampShader.updateUniforms();
         for (const auto &light : pointLights) {
           pointLightCube.setModelTransform(
               glm::scale(glm::translate(glm::mat4(1.0f), light->getPosition()),
@@ -442,7 +875,6 @@ void Engine::run() {
           pointLightCube.draw(lampShader);
         }
 
-        lampShader.updateUniforms();
         for (const auto &light : spotLights) {
           spotLightSphere.setModelTransform(
               glm::scale(glm::translate(glm::mat4(1.0f), light->getPosition()),
@@ -461,7 +893,6 @@ void Engine::run() {
         }
 
         // Draw skybox.
-        skyboxShader.updateUniforms();
         skybox.draw(skyboxShader);
 
         mainFb.deactivate();
@@ -502,8 +933,10 @@ void Engine::run() {
 
       // == End render path ==
 
-      // Finally, draw ImGui data.
+      // Finally, draw ImGui data. ImGui sets GL state directly, so the cache
+      // can't be trusted afterwards.
       ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      GlState::invalidate();
     });
 
     // Cleanup.
@@ -44,6 +44,13 @@ enum class EGBufferVis {
   SSAO
 };
 
+enum class EDepthPrepass {
+  OFF = 0,
+  ON,
+  // On while the G-buffer pass's overdraw is above a threshold.
+  AUTO,
+};
+
 enum class EToneMapping {
   NONE = 0,
   REINHARD,
@@ -57,6 +64,13 @@ struct ModelRenderOptions {
   // Model.
   glm::quat modelRotation = glm::identity<glm::quat>();
   float modelScale = 1.0f;
+  // Whether the model's meshes are dynamic, see Mesh::isDynamic().
+  bool dynamicModel = false;
+  // Turns the model about the Y axis, to move it every frame.
+  bool spinModel = false;
+  // Whether all of the model's meshes occlude in CPU occlusion culling, see
+  // Model::setOccluder().
+  bool occluderModel = false;
 
   // Rendering.
   ELightingModel lightingModel = ELightingModel::COOK_TORRANCE_GGX;
@@ -67,17 +81,38 @@ struct ModelRenderOptions {
   glm::vec3 directionalDirection =
       glm::normalize(glm::vec3(-0.2f, -1.0f, -0.3f));
 
+  // Extra point and spot lights scattered around the model, half of each, to
+  // stress the clustered lighting.
+  int stressLights = 0;
+  float stressLightRange = 1.0f;
+  float stressLightSpread = 4.0f;
+  LightClusterStats lightClusters;
+  bool lightVolumes = false;
+  int lightVolumesDrawn = 0;
+
   bool shadowMapping = true;
-  float shadowCameraCuboidExtents = 2.0f;
-  float shadowCameraNear = 0.1f;
-  float shadowCameraFar = 15.0f;
-  float shadowCameraDistance = 5.0f;
+  bool shadowCaching = true;
+  int shadowCascadesRedrawn = 0;
+  int shadowCascades = 3;
+  float shadowSplitLambda = 0.75f;
+  float shadowDistance = 50.0f;
   float shadowBiasMin = 0.0001;
   float shadowBiasMax = 0.001;
+  bool virtualShadows = false;
+  VirtualShadowMapStats virtualShadowMap;
+  // Point and spot light shadows, from the shadow atlas.
+  bool localShadows = true;
+  ShadowAtlasStats shadowAtlas;
 
   ESkyboxImage skyboxImage = ESkyboxImage::KLOPPENHEIM;
 
   bool useIBL = true;
+  // GGX samples per texel of the prefiltered env map.
+  int prefilterSamples = 64;
+  // Set by the UI to compare the prefiltered env map with the fragment shader
+  // bake at the start of the next frame.
+  bool checkPrefilterParity = false;
+  GGXPrefilterParity prefilterParity;
   glm::vec3 ambientColor = glm::vec3(0.1f);
   bool ssao = true;
   float ssaoRadius = 0.5f;
@@ -114,6 +149,67 @@ struct ModelRenderOptions {
   int frameDeltasOffset = 0;
   float avgFPS = 0;
   bool enableVsync = true;
+  unsigned long long glCallsIssued = 0;
+  unsigned long long glCallsSkipped = 0;
+  EDepthPrepass depthPrepass = EDepthPrepass::AUTO;
+  // Samples drawn per pixel above which AUTO turns the prepass on.
+  float depthPrepassOverdraw = 1.5f;
+  bool depthPrepassActive = false;
+  // Depth test passing samples per G-buffer pixel, a frame or two behind.
+  float overdraw = 0.0f;
+  // GPU time of each pass, a frame or two behind.
+  float depthPrepassMs = 0.0f;
+  float gBufferPassMs = 0.0f;
+  bool sortDrawQueue = true;
+  int queueDraws = 0;
+  int queueStateChangesUnsorted = 0;
+  int queueStateChangesSorted = 0;
+  int queueDrawCalls = 0;
+  bool indirectDraw = true;
+  bool gpuCullingSupported = false;
+  bool gpuCulling = true;
+  bool occlusionCulling = true;
+  // G-buffer indirect draws rejected on the GPU, a frame behind.
+  int gpuFrustumCulled = 0;
+  int gpuOcclusionCulled = 0;
+  bool frustumCulling = true;
+  bool cpuOcclusionCulling = false;
+  // Fraction of the screen a mesh's bounds must cover to occlude by default.
+  float minOccluderArea = 0.02f;
+  int cpuOcclusionOccluders = 0;
+  int cpuOcclusionTriangles = 0;
+  int cpuOcclusionCulled = 0;
+  float cpuOcclusionRasterizeMs = 0.0f;
+  float cpuOcclusionTestMs = 0.0f;
+  // Set by the UI to compare frustum culling with and without software
+  // occlusion culling at the start of the next frame.
+  bool runOcclusionBenchmark = false;
+  bool occlusionBenchmarkDone = false;
+  OcclusionBenchmarkResult occlusionBenchmark;
+  bool usePvs = true;
+  // Set by the UI to bake the PVS at the start of the next frame.
+  bool bakePvs = false;
+  bool pvsLoaded = false;
+  int pvsCells = 0;
+  int pvsSolidCells = 0;
+  int pvsUniqueSets = 0;
+  int pvsBytes = 0;
+  float pvsBakeMs = 0.0f;
+  int pvsCulled = 0;
+  // Set by the UI to time the transform kernels at the start of the next
+  // frame.
+  bool runTransformBenchmark = false;
+  bool transformBenchmarkDone = false;
+  TransformBenchmarkResult transformBenchmark;
+  int bvhInstances = 0;
+  int bvhTriangles = 0;
+  float bvhBuildMs = 0.0f;
+  // Set by the UI to time ray queries at the start of the next frame.
+  bool runBvhBenchmark = false;
+  bool bvhBenchmarkDone = false;
+  BvhBenchmarkResult bvhBenchmark;
+  int queueCulled = 0;
+  int shadowQueueCulled = 0;
 };
 
 // Helper to display a little (?) mark which shows a tooltip when hovered.
@@ -157,6 +253,8 @@ static void imguiImage(const Texture &texture, glm::vec2 size) {
 struct UIContext {
   Camera &camera;
   ShadowMap &shadowMap;
+  ShadowAtlas &shadowAtlas;
+  VirtualShadowMap &virtualShadowMap;
   SsaoBuffer &ssaoBuffer;
 };
 
@@ -195,6 +293,18 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
     }
     imguiFloatSlider("Model scale", &opts.modelScale, 0.0001f, 100.0f, "%.04f",
                      EScale::LOG);
+    ImGui::Checkbox("Dynamic", &opts.dynamicModel);
+    ImGui::SameLine();
+    imguiHelpMarker("Shadow caches draw dynamic meshes every frame on top of "
+                    "the cached static depth, instead of redrawing "
+                    "everything when they move.");
+    ImGui::SameLine();
+    ImGui::Checkbox("Spin", &opts.spinModel);
+    ImGui::Checkbox("Occluder", &opts.occluderModel);
+    ImGui::SameLine();
+    imguiHelpMarker("CPU occlusion culling rasterizes every mesh of the model "
+                    "that is simple enough, not just those that are large on "
+                    "screen.");
   }
 
   ImGui::Separator();
@@ -246,31 +356,83 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
       ImGui::TreePop();
     }
 
+    if (ImGui::TreeNode("Clustered lights")) {
+      ImGui::SliderInt("Stress lights", &opts.stressLights, 0, 8192);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Extra point and spot lights, half of each, scattered around the "
+          "model. They aren't drawn as lamps.");
+      imguiFloatSlider("Stress light range", &opts.stressLightRange, 0.1f,
+                       10.0f, nullptr, EScale::LOG);
+      imguiFloatSlider("Stress light spread", &opts.stressLightSpread, 1.0f,
+                       50.0f, nullptr, EScale::LOG);
+      const LightClusterStats &stats = opts.lightClusters;
+      ImGui::Text("%d point, %d spot lights", stats.pointLights,
+                  stats.spotLights);
+      ImGui::Text("%d lit clusters, at most %d lights in one",
+                  stats.litClusters, stats.maxLightsPerCluster);
+      ImGui::Text("%d light indices, built in %.2f ms", stats.lightIndices,
+                  stats.buildMs);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Lights are assigned to a 16x9x24 grid of view space clusters on "
+          "worker threads each frame, and the lighting pass only shades a "
+          "pixel with the lights of its cluster.");
+      ImGui::Checkbox("Light volumes", &opts.lightVolumes);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Shades point and spot lights by drawing a stencil masked sphere "
+          "around each with additive blending, instead of through the "
+          "clusters. Cheaper for a few lights that cover little of the "
+          "screen.");
+      if (opts.lightVolumes) {
+        ImGui::Text("%d light volumes drawn", opts.lightVolumesDrawn);
+      }
+
+      ImGui::TreePop();
+    }
+
     if (ImGui::TreeNode("Shadows")) {
       ImGui::Checkbox("Shadow mapping", &opts.shadowMapping);
       ImGui::BeginDisabled(!opts.shadowMapping);
-      // Shadow map texture is a square, so extend both width/height by the
-      // aspect ratio.
-      imguiImage(ctx.shadowMap.getDepthTexture(),
-                 glm::vec2(IMAGE_BASE_SIZE * ctx.camera.getAspectRatio(),
-                           IMAGE_BASE_SIZE * ctx.camera.getAspectRatio()));
-      imguiFloatSlider("Cuboid extents", &opts.shadowCameraCuboidExtents, 0.1f,
-                       50.0f, nullptr, EScale::LOG);
-
-      if (imguiFloatSlider("Near plane", &opts.shadowCameraNear, 0.01, 1000.0,
-                           nullptr, EScale::LOG)) {
-        if (opts.shadowCameraNear > opts.shadowCameraFar) {
-          opts.shadowCameraFar = opts.shadowCameraNear;
-        }
+      ImGui::Checkbox("Virtual shadow map", &opts.virtualShadows);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Replaces the cascades with one 16K x 16K map over the whole scene, "
+          "of which only the 128 x 128 pages the camera sees are drawn, into "
+          "a 4K pool. Drawn pages are kept until the scene under them "
+          "changes.");
+      if (opts.virtualShadows) {
+        const VirtualShadowMapStats &stats = opts.virtualShadowMap;
+        ImGui::Text("Pages requested: %d, resident: %d", stats.pagesRequested,
+                    stats.pagesResident);
+        ImGui::Text("Allocated: %d, rendered: %d, cached: %d",
+                    stats.pagesAllocated, stats.pagesRendered,
+                    stats.pagesCached);
+        imguiImage(ctx.virtualShadowMap.getPhysicalTexture(),
+                   glm::vec2(IMAGE_BASE_SIZE, IMAGE_BASE_SIZE));
       }
-      if (imguiFloatSlider("Far plane", &opts.shadowCameraFar, 0.01, 1000.0,
-                           nullptr, EScale::LOG)) {
-        if (opts.shadowCameraFar < opts.shadowCameraNear) {
-          opts.shadowCameraNear = opts.shadowCameraFar;
+      ImGui::BeginDisabled(opts.virtualShadows);
+      ImGui::SliderInt("Cascades", &opts.shadowCascades, MIN_SHADOW_CASCADES,
+                       MAX_SHADOW_CASCADES);
+      ImGui::Checkbox("Cache static casters", &opts.shadowCaching);
+      ImGui::Text("Cascades redrawn: %d", opts.shadowCascadesRedrawn);
+      // Cascade textures are squares, so extend both width/height by the
+      // aspect ratio, and fit them side by side.
+      const float cascadeImageSize = IMAGE_BASE_SIZE *
+                                     ctx.camera.getAspectRatio() /
+                                     static_cast<float>(opts.shadowCascades);
+      for (int i = 0; i < opts.shadowCascades; i++) {
+        if (i > 0) {
+          ImGui::SameLine();
         }
+        imguiImage(ctx.shadowMap.getCascadeTexture(i),
+                   glm::vec2(cascadeImageSize, cascadeImageSize));
       }
-      imguiFloatSlider("Distance from origin", &opts.shadowCameraDistance, 0.01,
-                       100.0f, nullptr, EScale::LOG);
+      imguiFloatSlider("Split lambda", &opts.shadowSplitLambda, 0.0f, 1.0f);
+      imguiFloatSlider("Max distance", &opts.shadowDistance, 1.0f, 1000.0f,
+                       nullptr, EScale::LOG);
+      ImGui::EndDisabled();
       if (imguiFloatSlider("Bias min", &opts.shadowBiasMin, 0.0001, 1.0,
                            "%.04f", EScale::LOG)) {
         if (opts.shadowBiasMin > opts.shadowBiasMax) {
@@ -286,6 +448,23 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
 
       ImGui::EndDisabled();
 
+      ImGui::Checkbox("Point and spot light shadows", &opts.localShadows);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Shadow casting point and spot lights in view get tiles of a shared "
+          "atlas, sized by how much of the screen they cover. A tile is only "
+          "redrawn when its light, the static scene or a dynamic mesh in its "
+          "range changes.");
+      if (opts.localShadows) {
+        const ShadowAtlasStats &stats = opts.shadowAtlas;
+        ImGui::Text("%d lights in %d tiles, %.0f%% of the atlas",
+                    stats.shadowedLights, stats.tiles,
+                    stats.usedFraction * 100.0f);
+        ImGui::Text("Lights redrawn: %d", stats.lightsDrawn);
+        imguiImage(ctx.shadowAtlas.getDepthTexture(),
+                   glm::vec2(IMAGE_BASE_SIZE, IMAGE_BASE_SIZE));
+      }
+
       ImGui::TreePop();
     }
 
@@ -298,6 +477,22 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
       ImGui::Checkbox("Use IBL", &opts.useIBL);
       ImGui::EndDisabled();
 
+      ImGui::BeginDisabled(!opts.useIBL);
+      ImGui::SliderInt("Prefilter samples", &opts.prefilterSamples, 8, 256);
+      if (ImGui::Button("Check prefilter parity")) {
+        opts.checkPrefilterParity = true;
+      }
+      ImGui::SameLine();
+      imguiHelpMarker("Bakes the prefiltered env map with the fragment shader "
+                      "as well, and compares the two.");
+      ImGui::Text("Bake: %.2f ms, reference: %.2f ms",
+                  opts.prefilterParity.bakeMs,
+                  opts.prefilterParity.referenceMs);
+      ImGui::Text("Relative error: max %.4f, mean %.4f",
+                  opts.prefilterParity.maxError,
+                  opts.prefilterParity.meanError);
+      ImGui::EndDisabled();
+
       ImGui::BeginDisabled(opts.lightingModel != ELightingModel::BLINN_PHONG &&
                            opts.useIBL);
       ImGui::ColorEdit3("Ambient color",
@@ -363,7 +558,7 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
     imguiFloatSlider("Speed", &opts.speed, 0.1, 50.0);
     imguiFloatSlider("Sensitivity", &opts.sensitivity, 0.01, 1.0, nullptr,
                      EScale::LOG);
-    imguiFloatSlider("FoV", &opts.fov, MIN_FOV, MAX_FOV, "%.1f");
+    imguiFloatSlider("FoV", &opts.fov, MIN_FOV, MAX_FOV, "%.1f°");
     if (imguiFloatSlider("Near plane", &opts.nearPlane, 0.01, 1000.0, nullptr,
                          EScale::LOG)) {
       if (opts.nearPlane > opts.farPlane) {
@@ -400,6 +595,151 @@ inline void renderImGuiUI(ModelRenderOptions &opts, UIContext ctx) {
                      ImVec2(0, 80.0f));
 
     ImGui::Checkbox("Enable VSync", &opts.enableVsync);
+
+    ImGui::Text("GL state calls: %llu issued, %llu skipped", opts.glCallsIssued,
+                opts.glCallsSkipped);
+    ImGui::SameLine();
+    imguiHelpMarker(
+        "State changes (binds, toggles) sent to the driver last frame, versus "
+        "those dropped by the state cache because nothing changed.");
+
+    if (ImGui::Button("Benchmark transform kernels")) {
+      opts.runTransformBenchmark = true;
+    }
+    ImGui::SameLine();
+    imguiHelpMarker(
+        "Times the batched kernels that propagate scene transforms and "
+        "bounds against one glm multiply and box transform per node. Results "
+        "are in ns per transform.");
+    if (opts.transformBenchmarkDone) {
+      const TransformBenchmarkResult &bench = opts.transformBenchmark;
+      ImGui::Text("%zu transforms, %s kernels", bench.count,
+                  getSimdLevelName(bench.level));
+      ImGui::Text("multiply: glm %.2f, scalar %.2f, SIMD %.2f",
+                  bench.glmMultiplyNs, bench.scalarMultiplyNs,
+                  bench.simdMultiplyNs);
+      ImGui::Text("bounds: glm %.2f, scalar %.2f, SIMD %.2f",
+                  bench.glmBoundsNs, bench.scalarBoundsNs,
+                  bench.simdBoundsNs);
+    }
+
+    ImGui::Text("BVH: %d instances, %d tris, built in %.1f ms",
+                opts.bvhInstances, opts.bvhTriangles, opts.bvhBuildMs);
+    if (ImGui::Button("Benchmark BVH")) {
+      opts.runBvhBenchmark = true;
+    }
+    ImGui::SameLine();
+    imguiHelpMarker(
+        "Casts random rays at the model through its two-level BVH, on one "
+        "thread and then on every worker thread.");
+    if (opts.bvhBenchmarkDone) {
+      const BvhBenchmarkResult &bench = opts.bvhBenchmark;
+      ImGui::Text("%zu rays, %.0f%% hit", bench.numRays,
+                  bench.hitRate * 100.0f);
+      ImGui::Text("closest %.2f, any %.2f, closest on %u threads %.2f Mrays/s",
+                  bench.closestRaysPerSecond * 1e-6,
+                  bench.anyHitRaysPerSecond * 1e-6, bench.numThreads,
+                  bench.parallelClosestRaysPerSecond * 1e-6);
+    }
+
+    if (ImGui::Button("Benchmark occlusion culling")) {
+      opts.runOcclusionBenchmark = true;
+    }
+    ImGui::SameLine();
+    imguiHelpMarker(
+        "Culls the model for the camera with frustum culling alone, then with "
+        "CPU occlusion culling on top, with its min occluder area. Times "
+        "include gathering the meshes.");
+    if (opts.occlusionBenchmarkDone) {
+      const OcclusionBenchmarkResult &bench = opts.occlusionBenchmark;
+      ImGui::Text("frustum: %d/%d meshes in %.2f ms", bench.frustumVisible,
+                  bench.meshes, bench.frustumMs);
+      ImGui::Text("+ occlusion: %d/%d meshes in %.2f ms, %d occluders",
+                  bench.occlusionVisible, bench.meshes, bench.occlusionMs,
+                  bench.occluders);
+    }
+
+    ImGui::Checkbox("Frustum culling", &opts.frustumCulling);
+    ImGui::SameLine();
+    ImGui::Text("culled: %d G-buffer, %d shadow", opts.queueCulled,
+                opts.shadowQueueCulled);
+    if (opts.frustumCulling) {
+      ImGui::Checkbox("CPU occlusion culling", &opts.cpuOcclusionCulling);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Rasterizes large meshes into a small depth buffer on worker "
+          "threads, and hides meshes whose bounds are behind it from the "
+          "G-buffer pass. Compare against frustum culling alone with the "
+          "G-buffer draw count below.");
+      if (opts.cpuOcclusionCulling) {
+        ImGui::SliderFloat("Min occluder area", &opts.minOccluderArea, 0.0f,
+                           0.2f, "%.3f");
+        ImGui::Text("%d occluders (%d tris), %d culled in %.2f + %.2f ms",
+                    opts.cpuOcclusionOccluders, opts.cpuOcclusionTriangles,
+                    opts.cpuOcclusionCulled, opts.cpuOcclusionRasterizeMs,
+                    opts.cpuOcclusionTestMs);
+      }
+      ImGui::Checkbox("Use PVS", &opts.usePvs);
+      ImGui::SameLine();
+      if (ImGui::Button("Bake PVS")) {
+        opts.bakePvs = true;
+      }
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Hides meshes that can't be seen from the camera's cell, using sets "
+          "baked by casting rays from every cell of the model. Bake again "
+          "after changing the model's meshes; the sets are saved under "
+          "content/scenes.");
+      if (opts.pvsLoaded) {
+        ImGui::Text("PVS: %d cells (%d solid), %d sets, %d bytes, %d culled",
+                    opts.pvsCells, opts.pvsSolidCells, opts.pvsUniqueSets,
+                    opts.pvsBytes, opts.pvsCulled);
+        if (opts.pvsBakeMs > 0.0f) {
+          ImGui::Text("Baked in %.0f ms", opts.pvsBakeMs);
+        }
+      } else {
+        ImGui::Text("No PVS baked for this model");
+      }
+    }
+    ImGui::Combo("Depth prepass", reinterpret_cast<int *>(&opts.depthPrepass),
+                 "Off\0On\0Auto\0\0");
+    ImGui::SameLine();
+    imguiHelpMarker("Draws the depth of the G-buffer pass first, so that the "
+                    "G-buffer pass writes each pixel once. Auto turns it on "
+                    "when the overdraw is above the threshold.");
+    ImGui::BeginDisabled(opts.depthPrepass != EDepthPrepass::AUTO);
+    imguiFloatSlider("Prepass overdraw threshold", &opts.depthPrepassOverdraw,
+                     1.0f, 8.0f, "%.2f");
+    ImGui::EndDisabled();
+    ImGui::Text("Overdraw: %.2f, prepass %s", opts.overdraw,
+                opts.depthPrepassActive ? "on" : "off");
+    ImGui::Text("GPU: prepass %.3f ms, G-buffer %.3f ms, total %.3f ms",
+                opts.depthPrepassMs, opts.gBufferPassMs,
+                opts.depthPrepassMs + opts.gBufferPassMs);
+    ImGui::Checkbox("Sort draw queue", &opts.sortDrawQueue);
+    ImGui::Text("G-buffer draws: %d, state changes: %d unsorted, %d sorted",
+                opts.queueDraws, opts.queueStateChangesUnsorted,
+                opts.queueStateChangesSorted);
+    ImGui::Checkbox("Multi-draw indirect", &opts.indirectDraw);
+    ImGui::SameLine();
+    ImGui::Text("G-buffer draw calls: %d", opts.queueDrawCalls);
+    if (opts.indirectDraw && opts.gpuCullingSupported) {
+      ImGui::Checkbox("GPU frustum culling", &opts.gpuCulling);
+      ImGui::SameLine();
+      imguiHelpMarker(
+          "Culls indirect draws against the view frustum in a compute shader "
+          "and draws the survivors with glMultiDrawElementsIndirectCount.");
+      if (opts.gpuCulling) {
+        ImGui::Checkbox("Hi-Z occlusion culling", &opts.occlusionCulling);
+        ImGui::SameLine();
+        imguiHelpMarker(
+            "Also culls G-buffer draws hidden behind the previous frame's "
+            "depth, then retests them against this frame's depth so that "
+            "newly visible objects are still drawn.");
+        ImGui::Text("GPU culled: %d frustum, %d occlusion",
+                    opts.gpuFrustumCulled, opts.gpuOcclusionCulled);
+      }
+    }
   }
 
   ImGui::EndChild();
@@ -415,6 +755,18 @@ inline std::unique_ptr<Model> loadModelOrDefault() {
   return helmet;
 }
 
+/** Returns where the PVS of a model is stored. */
+inline std::string getPvsPath(const Model &model) {
+  const std::string &path = model.getPath();
+  const size_t nameStart = path.find_last_of('/') + 1;
+  const size_t extension = path.find_last_of('.');
+  const size_t nameEnd =
+      extension != std::string::npos && extension > nameStart ? extension
+                                                              : path.size();
+  return "content/scenes/" + path.substr(nameStart, nameEnd - nameStart) +
+         ".pvs";
+}
+
 /** Loads a skybox image as a cubemap and generates IBL info. */
 inline void
 loadSkyboxImage(ESkyboxImage skyboxImage, SkyboxMesh &skybox,
@@ -450,14 +802,14 @@ loadSkyboxImage(ESkyboxImage skyboxImage, SkyboxMesh &skybox,
 
   // Process HDR cubemap
   {
-    equirectCubemapConverter.multipassDraw(hdr);
+    equirectCubemapConverter.draw(hdr);
   }
   auto cubemap = equirectCubemapConverter.getCubemap();
   {
-    irradianceCalculator.multipassDraw(cubemap);
+    irradianceCalculator.draw(cubemap);
   }
   {
-    prefilteredEnvMapCalculator.multipassDraw(cubemap);
+    prefilteredEnvMapCalculator.draw(cubemap);
   }
 
   skybox.setTexture(cubemap);
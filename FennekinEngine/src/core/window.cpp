@@ -27,6 +27,7 @@ Window::Window(int t_width, int height, const char* title, bool fullscreen, int
     }
 
     Fnk::initGlErrorLogging();
+    GlState::invalidate();
 
     // Allow us to refer to the object while accessing C APIs.
     glfwSetWindowUserPointer(m_window, this);
@@ -47,6 +48,8 @@ Window::Window(int t_width, int height, const char* title, bool fullscreen, int
 }
 
 Window::~Window() {
+    // The buffer must be released before the context goes away.
+    m_frameUniformBuffer.free();
     if (m_window != nullptr) {
         glfwDestroyWindow(m_window);
     }
@@ -57,12 +60,15 @@ void Window::activate() {
     glfwMakeContextCurrent(m_window);
 }
 
-void Window::updateUniforms(Shader& t_shader) {
-    t_shader.setFloat("fnk_deltaTime", m_deltaTime);
-
+void Window::updateUniformBlock() {
     ImageSize size = getSize();
-    t_shader.setInt("fnk_windowWidth", size.width);
-    t_shader.setInt("fnk_windowHeight", size.height);
+    const FrameUniformBlock block = {
+        .time = Fnk::time(),
+        .deltaTime = m_deltaTime,
+        .windowWidth = size.width,
+        .windowHeight = size.height,
+    };
+    m_frameUniformBuffer.update(block);
 }
 
 ImageSize Window::getSize() const {
@@ -171,7 +177,7 @@ void Window::disableMouseButtonInput() {
 }
 
 void Window::framebufferSizeCallback(GLFWwindow* t_window, int t_width, int t_height) {
-    glViewport(0, 0, t_width, t_height);
+    GlState::setViewport(0, 0, t_width, t_height);
 
     if (m_boundCamera) {
         m_boundCamera->setAspectRatio(t_width / static_cast<float>(t_height));
@@ -353,6 +359,7 @@ void Window::loop(std::function<void(float)> t_callback) {
         m_lastTime = currentTime;
 
         updateFrameStats(m_deltaTime);
+        updateUniformBlock();
 
         // Clear the appropriate buffers.
         glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
@@ -6,6 +6,8 @@
 // clang-format on
 
 #include "core/debug/exceptions.hpp"
+#include "rendering/core/gl_state.hpp"
+#include "rendering/core/uniform_buffer.hpp"
 #include "rendering/interfaces/screen.hpp"
 #include "rendering/resources/shader.hpp"
 #include "scene/camera.hpp"
@@ -39,7 +41,15 @@ enum class EMouseButtonBehavior {
     CAPTURE_MOUSE,
 };
 
-class Window final : public UniformSource {
+// CPU side mirror of the std140 FnkFrame block in core.glsl.
+struct FrameUniformBlock {
+    float time;
+    float deltaTime;
+    int windowWidth;
+    int windowHeight;
+};
+
+class Window final : public UniformBlockSource {
 public:
     Window(int t_width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT, const char* title = DEFAULT_TITLE,
            bool fullscreen = false, int samples = 0);
@@ -54,7 +64,7 @@ public:
 
     void setViewport() {
         ImageSize size = getSize();
-        glViewport(0, 0, size.width, size.height);
+        GlState::setViewport(0, 0, size.width, size.height);
     }
 
     void enableVsync() {
@@ -68,24 +78,24 @@ public:
 
     // TODO: Extract all these as a "Context" object.
     void enableDepthTest() {
-        glEnable(GL_DEPTH_TEST);
+        GlState::setDepthTest(true);
         m_depthTestEnabled = true;
     }
     void disableDepthTest() {
-        glDisable(GL_DEPTH_TEST);
+        GlState::setDepthTest(false);
         m_depthTestEnabled = false;
     }
 
     // TODO: Consider extracting stencil logic out to a separate class.
     void enableStencilTest() {
-        glEnable(GL_STENCIL_TEST);
+        GlState::setStencilTest(true);
         // Only replace the value in the stencil buffer if both the stencil and
         // depth test pass.
         glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
         m_stencilTestEnabled = true;
     }
     void disableStencilTest() {
-        glDisable(GL_STENCIL_TEST);
+        GlState::setStencilTest(false);
         m_stencilTestEnabled = false;
     }
 
@@ -113,26 +123,26 @@ public:
 
     // TODO: Consider extracting blending logic.
     void enableAlphaBlending() {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glBlendEquation(GL_FUNC_ADD);
+        GlState::setBlend(true);
+        GlState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GlState::setBlendEquation(GL_FUNC_ADD);
     }
     void disableAlphaBlending() {
-        glDisable(GL_BLEND);
+        GlState::setBlend(false);
     }
 
     void enableFaceCull() {
-        glEnable(GL_CULL_FACE);
+        GlState::setCullFace(true);
     }
     void disableFaceCull() {
-        glDisable(GL_CULL_FACE);
+        GlState::setCullFace(false);
     }
 
     void enableWireframe() {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        GlState::setPolygonMode(GL_LINE);
     }
     void disableWireframe() {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        GlState::setPolygonMode(GL_FILL);
     }
 
     void enableSeamlessCubemap() {
@@ -143,13 +153,15 @@ public:
     }
 
     void cullFrontFaces() {
-        glCullFace(GL_FRONT);
+        GlState::setCullFaceMode(GL_FRONT);
     }
     void cullBackFaces() {
-        glCullFace(GL_BACK);
+        GlState::setCullFaceMode(GL_BACK);
     }
 
-    void updateUniforms(Shader& t_shader) override;
+    // Writes the per-frame constants into the shared frame uniform block. Called
+    // automatically at the start of every loop iteration.
+    void updateUniformBlock() override;
 
     [[nodiscard]] ImageSize getSize() const;
     void setSize(int t_width, int t_height);
@@ -257,4 +269,6 @@ private:
 
     std::shared_ptr<Camera> m_boundCamera = nullptr;
     std::shared_ptr<CameraControls> m_boundCameraControls = nullptr;
+
+    UniformBuffer m_frameUniformBuffer{EUniformBlockBinding::FRAME, sizeof(FrameUniformBlock)};
 };
@@ -0,0 +1,87 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int t_numThreads) {
+  if (!t_numThreads) {
+    t_numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  m_workers.reserve(t_numThreads - 1);
+  for (unsigned int i = 1; i < t_numThreads; ++i) {
+    m_workers.emplace_back(&WorkerPool::workerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (std::thread& worker : m_workers) {
+    worker.join();
+  }
+}
+
+void WorkerPool::parallelFor(const unsigned int t_count,
+                             const std::function<void(unsigned int)>& t_body) {
+  if (!t_count) {
+    return;
+  }
+  if (m_workers.empty() || t_count == 1) {
+    for (unsigned int i = 0; i < t_count; ++i) {
+      t_body(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_body = &t_body;
+    m_count = t_count;
+    m_nextIndex = 0;
+    m_busyWorkers = static_cast<unsigned int>(m_workers.size());
+    ++m_generation;
+  }
+  m_wake.notify_all();
+
+  runBodies();
+
+  // Workers may still be finishing their last body.
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+  m_body = nullptr;
+}
+
+void WorkerPool::runBodies() {
+  for (unsigned int i = m_nextIndex++; i < m_count; i = m_nextIndex++) {
+    (*m_body)(i);
+  }
+}
+
+void WorkerPool::workerLoop() {
+  unsigned long long seenGeneration = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] {
+        return m_stopping || m_generation != seenGeneration;
+      });
+      if (m_stopping) {
+        return;
+      }
+      seenGeneration = m_generation;
+    }
+
+    runBodies();
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      last = --m_busyWorkers == 0;
+    }
+    if (last) {
+      m_done.notify_one();
+    }
+  }
+}
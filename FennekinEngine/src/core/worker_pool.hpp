@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in each loop, so a pool of N threads runs N - 1 workers.
+//
+// Only one loop runs at a time, and parallelFor() must not be called from
+// inside a loop body.
+class WorkerPool {
+ public:
+  // Creates a pool of t_numThreads threads, including the caller. Zero picks
+  // the hardware concurrency.
+  explicit WorkerPool(unsigned int t_numThreads = 0);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  // The number of threads that run loop bodies, including the caller.
+  [[nodiscard]] unsigned int getNumThreads() const {
+    return static_cast<unsigned int>(m_workers.size()) + 1;
+  }
+
+  // Calls t_body(i) for every i in [0, t_count), spread across all threads,
+  // and returns once every call has finished. Indices are handed out one at a
+  // time, so each should stand for a reasonably large piece of work.
+  void parallelFor(unsigned int t_count,
+                   const std::function<void(unsigned int)>& t_body);
+
+ private:
+  void workerLoop();
+  // Runs loop bodies until the indices of the current loop run out.
+  void runBodies();
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+
+  // The current loop. Guarded by m_mutex, except for m_nextIndex.
+  const std::function<void(unsigned int)>* m_body = nullptr;
+  unsigned int m_count = 0;
+  std::atomic<unsigned int> m_nextIndex = 0;
+  // Incremented for every loop, so workers can tell a new loop from a
+  // spurious wake-up.
+  unsigned long long m_generation = 0;
+  // Workers still running bodies of the current loop.
+  unsigned int m_busyWorkers = 0;
+  bool m_stopping = false;
+};
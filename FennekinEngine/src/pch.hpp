@@ -2,11 +2,21 @@
 
 #include "core/core.hpp"
 #include "core/window.hpp"
+#include "core/worker_pool.hpp"
 
 #include "core/debug/exceptions.hpp"
 
 #include "rendering/core/framebuffer.hpp"
 #include "rendering/core/gBuffer.hpp"
+#include "rendering/core/geometry_arena.hpp"
+#include "rendering/core/gl_state.hpp"
+#include "rendering/core/gpu_culler.hpp"
+#include "rendering/core/gpu_query.hpp"
+#include "rendering/core/hi_z_buffer.hpp"
+#include "rendering/core/indirect_draw.hpp"
+#include "rendering/core/render_queue.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "rendering/core/uniform_buffer.hpp"
 #include "rendering/core/vertex_array.hpp"
 
 #include "rendering/postprocess/bloom.hpp"
@@ -18,6 +28,7 @@
 #include "rendering/registers/texture_registry.hpp"
 
 #include "rendering/resources/cubemap.hpp"
+#include "rendering/resources/material.hpp"
 #include "rendering/resources/shader.hpp"
 #include "rendering/resources/shader_defs.hpp"
 #include "rendering/resources/shader_primitives.hpp"
@@ -27,10 +38,23 @@
 #include "rendering/resources/loaders/shader_compiler.hpp"
 #include "rendering/resources/loaders/shader_loader.hpp"
 
+#include "scene/bounds.hpp"
+#include "scene/bvh.hpp"
 #include "scene/camera.hpp"
+#include "scene/culling.hpp"
 #include "scene/mesh.hpp"
 #include "scene/mesh_primitives.hpp"
 #include "scene/model.hpp"
+#include "scene/occlusion.hpp"
+#include "scene/pvs.hpp"
+#include "scene/scene.hpp"
+#include "scene/scene_bvh.hpp"
+#include "scene/transform_kernels.hpp"
+#include "scene/visibility.hpp"
 
 #include "scene/lighting/light.hpp"
+#include "scene/lighting/light_clusters.hpp"
+#include "scene/lighting/light_volumes.hpp"
+#include "scene/lighting/shadow_atlas.hpp"
 #include "scene/lighting/shadows.hpp"
+#include "scene/lighting/virtual_shadow_map.hpp"
@@ -1,5 +1,6 @@
 #include <gl/glew.h>
 #include "framebuffer.hpp"
+#include "rendering/core/gl_state.hpp"
 
 
 Texture Attachment::asTexture() {
@@ -21,12 +22,25 @@ Framebuffer::Framebuffer(int t_width, int t_height, int t_samples)
 }
 
 Framebuffer::~Framebuffer() {
+  GlState::forgetFramebuffer(m_fbo);
   glDeleteFramebuffers(1, &m_fbo);
   // TODO: Delete attachments.
 }
 
 void Framebuffer::activate(int t_mipLevel, int t_cubemapFace) {
-  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  GlState::bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+  ImageSize mipSize = calculateMipLevel(m_width, m_height, t_mipLevel);
+  GlState::setViewport(0, 0, mipSize.width, mipSize.height);
+
+  // Attachments are framebuffer state, so they only need to be re-attached
+  // when switching to a different mip level or cubemap face.
+  if (t_mipLevel == m_attachedMipLevel &&
+      t_cubemapFace == m_attachedCubemapFace) {
+    return;
+  }
+  m_attachedMipLevel = t_mipLevel;
+  m_attachedCubemapFace = t_cubemapFace;
 
   // Activate the specified mip level (usually 0).
   for (Attachment& attachment : m_attachments) {
@@ -35,6 +49,15 @@ void Framebuffer::activate(int t_mipLevel, int t_cubemapFace) {
 
     switch (attachment.target) {
       case EAttachmentTarget::TEXTURE: {
+        if (attachment.textureType == ETextureType::TEXTURE_2D_ARRAY ||
+            (attachment.textureType == ETextureType::CUBEMAP &&
+             t_cubemapFace == ALL_CUBEMAP_FACES)) {
+          // Arrays stay attached layered; a face makes no sense for them.
+          // Cubemaps are too when all of their faces are asked for.
+          glFramebufferTexture(GL_FRAMEBUFFER, attachmentType, attachment.id,
+                               t_mipLevel);
+          break;
+        }
         GLenum target = GL_TEXTURE_2D;
         if (t_cubemapFace >= 0) {
           if (t_cubemapFace >= 6) {
@@ -53,7 +76,7 @@ void Framebuffer::activate(int t_mipLevel, int t_cubemapFace) {
           LOG_CRITICAL(
               "ERROR::FRAMEBUFFER::MIP_ACTIVATED_FOR_RENDERBUFFER");
         }
-        if (t_cubemapFace >= 0) {
+        if (t_cubemapFace != -1) {
           // Renderbuffers currently can't be cubemaps.
           LOG_CRITICAL(
               "ERROR::FRAMEBUFFER::CUBEMAP_FACE_GIVEN_FOR_RENDERBUFFER");
@@ -61,12 +84,9 @@ void Framebuffer::activate(int t_mipLevel, int t_cubemapFace) {
         break;
     }
   }
-
-  ImageSize mipSize = calculateMipLevel(m_width, m_height, t_mipLevel);
-  glViewport(0, 0, mipSize.width, mipSize.height);
 }
 
-void Framebuffer::deactivate() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+void Framebuffer::deactivate() { GlState::bindFramebuffer(GL_FRAMEBUFFER, 0); }
 
 ImageSize Framebuffer::getSize() {
   ImageSize size = {.width = m_width, .height = m_height};
@@ -98,7 +118,7 @@ Attachment Framebuffer::attachTexture(EBufferType t_type,
   // instead?
   unsigned int texture;
   glGenTextures(1, &texture);
-  glBindTexture(textureTarget, texture);
+  GlState::bindTexture(textureTarget, texture);
 
   GLenum internalFormat = bufferTypeToGlInternalFormat(t_type);
 
@@ -137,13 +157,57 @@ Attachment Framebuffer::attachTexture(EBufferType t_type,
   updateFlags(t_type);
   updateBufferSources();
 
-  glBindTexture(textureTarget, 0);
+  GlState::bindTexture(textureTarget, 0);
   deactivate();
 
   return saveAttachment(texture, numMips, EAttachmentTarget::TEXTURE, t_type,
                         colorAttachmentIndex, textureType);
 }
 
+Attachment Framebuffer::attachTextureArray(EBufferType t_type,
+                                           const int t_numLayers,
+                                           const TextureParams& t_params) {
+  checkFlags(t_type);
+  activate();
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  GlState::bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+  int numMips = 1;
+  if (t_params.generateMips == EMipGeneration::ALWAYS) {
+    numMips = calculateNumMips(m_width, m_height);
+    if (t_params.maxNumMips >= 0) {
+      numMips = std::min(numMips, t_params.maxNumMips);
+    }
+  }
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, numMips,
+                 bufferTypeToGlInternalFormat(t_type), m_width, m_height,
+                 t_numLayers);
+
+  Texture::applyParams(t_params, ETextureType::TEXTURE_2D_ARRAY);
+
+  int colorAttachmentIndex = m_numColorAttachments;
+  GLenum attachmentType =
+      bufferTypeToGlAttachmentType(t_type, colorAttachmentIndex);
+  glFramebufferTexture(GL_FRAMEBUFFER, attachmentType, texture,
+                       /* mipmap level */ 0);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    LOG_CRITICAL("ERROR::FRAMEBUFFER::TEXTURE_ARRAY::INCOMPLETE");
+  }
+
+  updateFlags(t_type);
+  updateBufferSources();
+
+  GlState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  deactivate();
+
+  return saveAttachment(texture, numMips, EAttachmentTarget::TEXTURE, t_type,
+                        colorAttachmentIndex, ETextureType::TEXTURE_2D_ARRAY,
+                        t_numLayers);
+}
+
 Attachment Framebuffer::attachRenderbuffer(EBufferType t_type) {
   checkFlags(t_type);
   activate();
@@ -198,16 +262,16 @@ Attachment Framebuffer::getRenderbuffer(EBufferType t_type) {
 
 void Framebuffer::blit(Framebuffer& target, GLenum bits) {
   // TODO: This doesn't handle non-mip0 blits.
-  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.m_fbo);
+  GlState::bindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+  GlState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, target.m_fbo);
   glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, bits,
                     GL_NEAREST);
   deactivate();
 }
 
 void Framebuffer::blitToDefault(GLenum bits) {
-  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  GlState::bindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+  GlState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
   glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, bits,
                     GL_NEAREST);
   deactivate();
@@ -216,7 +280,8 @@ void Framebuffer::blitToDefault(GLenum bits) {
 Attachment Framebuffer::saveAttachment(unsigned int t_id, int t_numMips,
                                        EAttachmentTarget t_target, EBufferType t_type,
                                        int t_colorAttachmentIndex,
-                                       ETextureType t_textureType) {
+                                       ETextureType t_textureType,
+                                       const int t_numLayers) {
   Attachment attachment = {.id = t_id,
                            .width = m_width,
                            .height = m_height,
@@ -224,7 +289,8 @@ Attachment Framebuffer::saveAttachment(unsigned int t_id, int t_numMips,
                            .target = t_target,
                            .type = t_type,
                            .colorAttachmentIndex = t_colorAttachmentIndex,
-                           .textureType = t_textureType};
+                           .textureType = t_textureType,
+                           .numLayers = t_numLayers};
   m_attachments.push_back(attachment);
   return attachment;
 }
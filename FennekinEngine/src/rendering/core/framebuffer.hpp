@@ -3,6 +3,7 @@
 #include "rendering/resources/shader.hpp"
 #include "rendering/resources/texture.hpp"
 #include "core/window.hpp"
+#include "rendering/core/gl_state.hpp"
 
 #include <glm/glm.hpp>
 #include <string>
@@ -45,6 +46,8 @@ class Attachment {
   // Attachment index. Only applies for color buffers.
   int colorAttachmentIndex;
   ETextureType textureType;
+  // More than one only for TEXTURE_2D_ARRAY textures.
+  int numLayers = 1;
 
   Texture asTexture();
 
@@ -157,6 +160,11 @@ class Framebuffer {
       : Framebuffer(t_size.width, t_size.height, t_samples) {}
   virtual ~Framebuffer();
 
+  // Pass as the cubemap face to activate() to attach cubemaps layered, with
+  // all of their faces at once, so a geometry shader can pick the face each
+  // primitive is drawn to with gl_Layer.
+  static constexpr int ALL_CUBEMAP_FACES = -2;
+
   // Activates the current framebuffer. Optionally specify a mipmap level to
   // draw to, and a cubemap face (0 means GL_TEXTURE_CUBE_MAP_POSITIVE_X, etc).
   void activate(int t_mipLevel = 0, int t_cubemapFace = -1);
@@ -172,6 +180,10 @@ class Framebuffer {
 
   Attachment attachTexture(EBufferType t_type);
   Attachment attachTexture(EBufferType t_type, const TextureParams& t_params);
+  // Attaches a TEXTURE_2D_ARRAY with every layer at once, so a geometry
+  // shader can pick the layer each primitive is drawn to with gl_Layer.
+  Attachment attachTextureArray(EBufferType t_type, int t_numLayers,
+                                const TextureParams& t_params);
   Attachment attachRenderbuffer(EBufferType t_type);
 
   // Returns the first texture attachment of the given type.
@@ -186,18 +198,18 @@ class Framebuffer {
   void blitToDefault(GLenum type);
 
   void enableAlphaBlending() {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBlendEquation(GL_FUNC_ADD);
+    GlState::setBlend(true);
+    GlState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GlState::setBlendEquation(GL_FUNC_ADD);
   }
-  void disableAlphaBlending() { glDisable(GL_BLEND); }
+  void disableAlphaBlending() { GlState::setBlend(false); }
 
   void enableAdditiveBlending() {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
-    glBlendEquation(GL_FUNC_ADD);
+    GlState::setBlend(true);
+    GlState::setBlendFunc(GL_ONE, GL_ONE);
+    GlState::setBlendEquation(GL_FUNC_ADD);
   }
-  void disableAdditiveBlending() { glDisable(GL_BLEND); }
+  void disableAdditiveBlending() { GlState::setBlend(false); }
 
  private:
   unsigned int m_fbo = 0;
@@ -205,6 +217,10 @@ class Framebuffer {
   int m_height;
   int m_samples;
   std::vector<Attachment> m_attachments;
+  // The mip level and cubemap face the attachments are currently bound at.
+  // New attachments are always attached at mip 0.
+  int m_attachedMipLevel = 0;
+  int m_attachedCubemapFace = -1;
 
   bool m_hasColorAttachment = false;
   int m_numColorAttachments = 0;
@@ -214,7 +230,8 @@ class Framebuffer {
 
   Attachment saveAttachment(unsigned int t_id, int t_numMips,
                             EAttachmentTarget t_target, EBufferType t_type,
-                            int t_colorAttachmentIndex, ETextureType t_textureType);
+                            int t_colorAttachmentIndex, ETextureType t_textureType,
+                            int t_numLayers = 1);
   Attachment getAttachment(EAttachmentTarget t_target, EBufferType t_type);
   void checkFlags(EBufferType t_type);
   void updateFlags(EBufferType t_type);
@@ -4,12 +4,19 @@ DeferredGeometryPassShader::DeferredGeometryPassShader()
     : Shader(ShaderPath("content/shaders/builtin/deferred.vert"),
              ShaderPath("content/shaders/builtin/deferred.frag")) {}
 
+DepthPrepassShader::DepthPrepassShader()
+    : Shader(ShaderPath("content/shaders/builtin/depth_prepass.vert"),
+             ShaderPath("content/shaders/builtin/shadow_map.frag")) {}
+
 GBuffer::GBuffer(int width, int height) : Framebuffer(width, height) {
   // Need to use a zero clear color, or else the G-Buffer won't work properly.
   setClearColor(glm::vec4(0.0f));
   // Create and attach all components of the G-Buffer.
-  // Don't need to read from depth, so we attach as a renderbuffer.
-  attachRenderbuffer(EBufferType::DEPTH_AND_STENCIL);
+  // Depth is a texture so the Hi-Z pyramid can be built from it.
+  m_depthBuffer = attachTexture(
+      EBufferType::DEPTH_AND_STENCIL,
+      {.filtering = ETextureFiltering::NEAREST,
+       .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE});
   // Position and normal are stored as "HDR" colors for higher precision.
   // TODO: Positions can be un-projected from depth without storing them.
   m_positionAoBuffer = attachTexture(EBufferType::COLOR_HDR_ALPHA);
@@ -14,6 +14,13 @@ class DeferredGeometryPassShader : public Shader {
   DeferredGeometryPassShader();
 };
 
+// Writes only the depth of the G-buffer pass's geometry, so that the G-buffer
+// pass then shades each pixel once. Reads nothing but positions.
+class DepthPrepassShader : public Shader {
+ public:
+  DepthPrepassShader();
+};
+
 class GBuffer final : public Framebuffer, public TextureSource {
  public:
   GBuffer(int width, int height);
@@ -28,6 +35,7 @@ class GBuffer final : public Framebuffer, public TextureSource {
     return m_albedoMetallicBuffer.asTexture();
   }
   Texture getEmissionTexture() { return m_emissionBuffer.asTexture(); }
+  Texture getDepthTexture() { return m_depthBuffer.asTexture(); }
 
   unsigned int bindTexture(unsigned int t_nextTextureUnit,
                            Shader& t_shader) override;
@@ -41,4 +49,6 @@ class GBuffer final : public Framebuffer, public TextureSource {
   Attachment m_albedoMetallicBuffer{};
   // RGB used for emission color, alpha channel unused.
   Attachment m_emissionBuffer{};
+  // Depth and stencil.
+  Attachment m_depthBuffer{};
 };
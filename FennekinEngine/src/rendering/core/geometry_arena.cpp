@@ -0,0 +1,175 @@
+#include "geometry_arena.hpp"
+#include "rendering/core/gl_state.hpp"
+
+#include "core/debug/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Sized for a typical scene (e.g. Sponza) so that growth is rare.
+static constexpr size_t INITIAL_VERTEX_CAPACITY_BYTES = 32 * 1024 * 1024;
+static constexpr size_t INITIAL_INDEX_CAPACITY_BYTES = 8 * 1024 * 1024;
+static constexpr size_t INITIAL_POSITION_CAPACITY_BYTES = 8 * 1024 * 1024;
+static constexpr unsigned int POSITION_BYTES = 3 * sizeof(float);
+
+GeometryArena::GeometryArena(const unsigned int t_vertexSizeBytes)
+    : m_vertexSizeBytes(t_vertexSizeBytes) {}
+
+void GeometryArena::addVertexAttrib(const unsigned int t_size,
+                                    const unsigned int t_type) {
+  if (t_type != GL_FLOAT) {
+    LOG_CRITICAL("ERROR::GEOMETRY_ARENA::UNSUPPORTED_ATTRIB_TYPE");
+  }
+  m_attribs.push_back(
+      {.size = t_size, .type = t_type, .offset = m_nextAttribOffset});
+  m_nextAttribOffset += t_size * sizeof(float);
+}
+
+void GeometryArena::finalizeVertexAttribs() {
+  if (m_nextAttribOffset != m_vertexSizeBytes) {
+    LOG_CRITICAL("ERROR::GEOMETRY_ARENA::VERTEX_SIZE_MISMATCH");
+  }
+  glCreateVertexArrays(1, &m_vao);
+  for (unsigned int i = 0; i < m_attribs.size(); ++i) {
+    const VertexAttrib& attrib = m_attribs[i];
+    glEnableVertexArrayAttrib(m_vao, i);
+    glVertexArrayAttribFormat(m_vao, i, attrib.size, attrib.type,
+                              /*normalized=*/GL_FALSE, attrib.offset);
+    glVertexArrayAttribBinding(m_vao, i, /*bindingindex=*/0);
+  }
+}
+
+void GeometryArena::addPositionStream() {
+  if (!m_vao || m_numVertices) {
+    LOG_CRITICAL("ERROR::GEOMETRY_ARENA::POSITION_STREAM_TOO_LATE");
+  }
+  if (m_attribs.empty() || m_attribs[0].size != 3) {
+    LOG_CRITICAL("ERROR::GEOMETRY_ARENA::NO_POSITION_ATTRIB");
+  }
+  glCreateVertexArrays(1, &m_positionVao);
+  glEnableVertexArrayAttrib(m_positionVao, 0);
+  glVertexArrayAttribFormat(m_positionVao, 0, 3, GL_FLOAT,
+                            /*normalized=*/GL_FALSE, /*relativeoffset=*/0);
+  glVertexArrayAttribBinding(m_positionVao, 0, /*bindingindex=*/0);
+}
+
+void GeometryArena::reserve(unsigned int& t_buffer, size_t& t_capacityBytes,
+                            const size_t t_usedBytes,
+                            const size_t t_neededBytes) {
+  if (t_neededBytes <= t_capacityBytes) {
+    return;
+  }
+  size_t capacity = std::max(t_capacityBytes * 2, t_neededBytes);
+
+  unsigned int buffer;
+  glCreateBuffers(1, &buffer);
+  glNamedBufferData(buffer, static_cast<GLsizeiptr>(capacity), nullptr,
+                    GL_STATIC_DRAW);
+  if (t_buffer) {
+    if (t_usedBytes) {
+      glCopyNamedBufferSubData(t_buffer, buffer, 0, 0,
+                               static_cast<GLsizeiptr>(t_usedBytes));
+    }
+    glDeleteBuffers(1, &t_buffer);
+  }
+  t_buffer = buffer;
+  t_capacityBytes = capacity;
+}
+
+GeometryAllocation GeometryArena::allocate(const void* t_vertexData,
+                                           const unsigned int t_numVertices,
+                                           const unsigned int* t_indices,
+                                           const unsigned int t_numIndices) {
+  if (!m_vao) {
+    LOG_CRITICAL("ERROR::GEOMETRY_ARENA::NOT_FINALIZED");
+  }
+
+  const size_t vertexOffset = size_t(m_numVertices) * m_vertexSizeBytes;
+  const size_t vertexBytes = size_t(t_numVertices) * m_vertexSizeBytes;
+  const size_t indexOffset = size_t(m_numIndices) * sizeof(unsigned int);
+  const size_t indexBytes = size_t(t_numIndices) * sizeof(unsigned int);
+
+  const unsigned int oldVbo = m_vbo;
+  const unsigned int oldEbo = m_ebo;
+  reserve(m_vbo, m_vertexCapacityBytes, vertexOffset,
+          std::max(vertexOffset + vertexBytes, INITIAL_VERTEX_CAPACITY_BYTES));
+  reserve(m_ebo, m_indexCapacityBytes, indexOffset,
+          std::max(indexOffset + indexBytes, INITIAL_INDEX_CAPACITY_BYTES));
+  if (m_vbo != oldVbo) {
+    glVertexArrayVertexBuffer(m_vao, /*bindingindex=*/0, m_vbo, /*offset=*/0,
+                              static_cast<GLsizei>(m_vertexSizeBytes));
+  }
+  if (m_ebo != oldEbo) {
+    glVertexArrayElementBuffer(m_vao, m_ebo);
+  }
+  if (m_positionVao) {
+    uploadPositions(t_vertexData, t_numVertices, m_ebo != oldEbo);
+  }
+
+  glNamedBufferSubData(m_vbo, static_cast<GLintptr>(vertexOffset),
+                       static_cast<GLsizeiptr>(vertexBytes), t_vertexData);
+  glNamedBufferSubData(m_ebo, static_cast<GLintptr>(indexOffset),
+                       static_cast<GLsizeiptr>(indexBytes), t_indices);
+
+  GeometryAllocation allocation = {
+      .firstIndex = m_numIndices,
+      .indexCount = t_numIndices,
+      .baseVertex = static_cast<int>(m_numVertices),
+  };
+  m_numVertices += t_numVertices;
+  m_numIndices += t_numIndices;
+  return allocation;
+}
+
+void GeometryArena::uploadPositions(const void* t_vertexData,
+                                    const unsigned int t_numVertices,
+                                    const bool t_indexBufferChanged) {
+  const size_t offset = size_t(m_numVertices) * POSITION_BYTES;
+  const size_t bytes = size_t(t_numVertices) * POSITION_BYTES;
+
+  const unsigned int oldVbo = m_positionVbo;
+  reserve(m_positionVbo, m_positionCapacityBytes, offset,
+          std::max(offset + bytes, INITIAL_POSITION_CAPACITY_BYTES));
+  if (m_positionVbo != oldVbo) {
+    glVertexArrayVertexBuffer(m_positionVao, /*bindingindex=*/0,
+                              m_positionVbo, /*offset=*/0, POSITION_BYTES);
+  }
+  if (t_indexBufferChanged) {
+    glVertexArrayElementBuffer(m_positionVao, m_ebo);
+  }
+
+  // Gather the positions out of the interleaved vertices.
+  const auto* vertices = static_cast<const char*>(t_vertexData);
+  m_positions.resize(size_t(t_numVertices) * 3);
+  for (size_t i = 0; i < t_numVertices; ++i) {
+    std::memcpy(&m_positions[i * 3],
+                vertices + i * m_vertexSizeBytes + m_attribs[0].offset,
+                POSITION_BYTES);
+  }
+  glNamedBufferSubData(m_positionVbo, static_cast<GLintptr>(offset),
+                       static_cast<GLsizeiptr>(bytes), m_positions.data());
+}
+
+void GeometryArena::activate(const EVertexStream t_stream) {
+  if (t_stream == EVertexStream::POSITION && m_positionVao) {
+    GlState::bindVertexArray(m_positionVao);
+  } else {
+    GlState::bindVertexArray(m_vao);
+  }
+}
+
+void GeometryArena::free() {
+  if (m_vao || m_positionVao) {
+    GlState::bindVertexArray(0);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteVertexArrays(1, &m_positionVao);
+  }
+  glDeleteBuffers(1, &m_vbo);
+  glDeleteBuffers(1, &m_ebo);
+  glDeleteBuffers(1, &m_positionVbo);
+  m_vao = m_vbo = m_ebo = 0;
+  m_positionVao = m_positionVbo = 0;
+  m_vertexCapacityBytes = m_indexCapacityBytes = 0;
+  m_positionCapacityBytes = 0;
+  m_numVertices = m_numIndices = 0;
+}
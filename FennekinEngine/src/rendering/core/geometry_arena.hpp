@@ -0,0 +1,103 @@
+#pragma once
+
+#include <gl/glew.h>
+
+#include <vector>
+
+// A suballocated range of an arena, in the form glDraw*BaseVertex and
+// DrawElementsIndirectCommand expect.
+struct GeometryAllocation {
+  // Offset into the index buffer, in indices.
+  unsigned int firstIndex = 0;
+  unsigned int indexCount = 0;
+  // Added to every index of the allocation.
+  int baseVertex = 0;
+};
+
+// Which vertex data of an arena a draw reads.
+enum class EVertexStream {
+  // Every attribute of the vertex format.
+  ALL = 0,
+  // Only the position, attribute 0, from the tightly packed position stream
+  // if the arena has one. For depth-only passes.
+  POSITION,
+};
+
+// Packs the vertex and index data of many meshes that share one vertex format
+// into a single large vertex buffer, index buffer and VAO. Drawing any mesh in
+// the arena then needs no VAO or buffer switches, which is what allows a whole
+// pass to be issued with one multi-draw-indirect call.
+//
+// Buffers grow geometrically, copying existing data on the GPU.
+//
+// An arena can also keep a copy of every vertex's position in a separate,
+// tightly packed buffer with its own VAO. Passes that only need positions,
+// like shadow passes, then fetch 12 bytes per vertex rather than whole
+// interleaved vertices.
+class GeometryArena {
+ public:
+  explicit GeometryArena(unsigned int t_vertexSizeBytes);
+  GeometryArena(const GeometryArena&) = delete;
+  GeometryArena& operator=(const GeometryArena&) = delete;
+
+  // Describes the vertex format, in the same way as VertexArray. Only float
+  // attributes are supported.
+  void addVertexAttrib(unsigned int t_size, unsigned int t_type);
+  void finalizeVertexAttribs();
+  // Keeps a position stream, see EVertexStream::POSITION. The first attribute
+  // must be a vec3 position. Must be called after finalizeVertexAttribs() and
+  // before the first allocate().
+  void addPositionStream();
+
+  // Copies the mesh data into the arena. Indices are local to the mesh.
+  GeometryAllocation allocate(const void* t_vertexData,
+                              unsigned int t_numVertices,
+                              const unsigned int* t_indices,
+                              unsigned int t_numIndices);
+
+  void activate(EVertexStream t_stream = EVertexStream::ALL);
+  // Frees the GL objects. Must be called while the context is still alive if
+  // the arena outlives it.
+  void free();
+
+  unsigned int getVao() const { return m_vao; }
+  unsigned int getVertexBuffer() const { return m_vbo; }
+  unsigned int getIndexBuffer() const { return m_ebo; }
+  unsigned int getNumVertices() const { return m_numVertices; }
+  unsigned int getNumIndices() const { return m_numIndices; }
+  bool hasPositionStream() const { return m_positionVao != 0; }
+
+ private:
+  struct VertexAttrib {
+    unsigned int size;
+    unsigned int type;
+    unsigned int offset;
+  };
+
+  // Grows the buffer so it can hold at least t_neededBytes, keeping the first
+  // t_usedBytes.
+  static void reserve(unsigned int& t_buffer, size_t& t_capacityBytes,
+                      size_t t_usedBytes, size_t t_neededBytes);
+  // Appends the positions of the vertices about to be allocated to the
+  // position stream.
+  void uploadPositions(const void* t_vertexData, unsigned int t_numVertices,
+                       bool t_indexBufferChanged);
+
+  unsigned int m_vertexSizeBytes;
+  std::vector<VertexAttrib> m_attribs;
+  unsigned int m_nextAttribOffset = 0;
+
+  unsigned int m_vao = 0;
+  unsigned int m_vbo = 0;
+  unsigned int m_ebo = 0;
+  size_t m_vertexCapacityBytes = 0;
+  size_t m_indexCapacityBytes = 0;
+  // The position stream, which shares the index buffer.
+  unsigned int m_positionVao = 0;
+  unsigned int m_positionVbo = 0;
+  size_t m_positionCapacityBytes = 0;
+  // Scratch space for gathering the positions of an allocation.
+  std::vector<float> m_positions;
+  unsigned int m_numVertices = 0;
+  unsigned int m_numIndices = 0;
+};
@@ -0,0 +1,330 @@
+#include "gl_state.hpp"
+
+#include "core/debug/logger.hpp"
+
+unsigned int GlState::s_program = UNKNOWN;
+unsigned int GlState::s_vao = UNKNOWN;
+unsigned int GlState::s_activeTextureUnit = UNKNOWN;
+std::array<std::array<unsigned int, GlState::SLOT_COUNT>,
+           GlState::MAX_TEXTURE_UNITS>
+    GlState::s_textures;
+std::array<unsigned int, GlState::MAX_TEXTURE_UNITS> GlState::s_samplers;
+unsigned int GlState::s_drawFramebuffer = UNKNOWN;
+unsigned int GlState::s_readFramebuffer = UNKNOWN;
+std::array<int, 4> GlState::s_viewport = {};
+bool GlState::s_viewportKnown = false;
+
+unsigned int GlState::s_depthTest = UNKNOWN;
+unsigned int GlState::s_depthFunc = UNKNOWN;
+unsigned int GlState::s_depthMask = UNKNOWN;
+unsigned int GlState::s_blend = UNKNOWN;
+unsigned int GlState::s_blendSrc = UNKNOWN;
+unsigned int GlState::s_blendDst = UNKNOWN;
+unsigned int GlState::s_blendEquation = UNKNOWN;
+unsigned int GlState::s_cullFace = UNKNOWN;
+unsigned int GlState::s_cullFaceMode = UNKNOWN;
+unsigned int GlState::s_stencilTest = UNKNOWN;
+unsigned int GlState::s_polygonMode = UNKNOWN;
+
+GlStateStats GlState::s_stats;
+
+void GlState::invalidate() {
+  s_program = UNKNOWN;
+  s_vao = UNKNOWN;
+  s_activeTextureUnit = UNKNOWN;
+  for (auto& unit : s_textures) {
+    unit.fill(UNKNOWN);
+  }
+  s_samplers.fill(UNKNOWN);
+  s_drawFramebuffer = UNKNOWN;
+  s_readFramebuffer = UNKNOWN;
+  s_viewportKnown = false;
+
+  s_depthTest = UNKNOWN;
+  s_depthFunc = UNKNOWN;
+  s_depthMask = UNKNOWN;
+  s_blend = UNKNOWN;
+  s_blendSrc = UNKNOWN;
+  s_blendDst = UNKNOWN;
+  s_blendEquation = UNKNOWN;
+  s_cullFace = UNKNOWN;
+  s_cullFaceMode = UNKNOWN;
+  s_stencilTest = UNKNOWN;
+  s_polygonMode = UNKNOWN;
+}
+
+void GlState::forgetTexture(const unsigned int t_texture) {
+  for (auto& unit : s_textures) {
+    for (auto& texture : unit) {
+      if (texture == t_texture) {
+        texture = 0;
+      }
+    }
+  }
+}
+
+void GlState::forgetFramebuffer(const unsigned int t_fbo) {
+  if (s_drawFramebuffer == t_fbo) {
+    s_drawFramebuffer = 0;
+  }
+  if (s_readFramebuffer == t_fbo) {
+    s_readFramebuffer = 0;
+  }
+}
+
+bool GlState::changed(unsigned int& t_cached, const unsigned int t_value) {
+  if (t_cached == t_value) {
+    ++s_stats.skipped;
+    return false;
+  }
+  t_cached = t_value;
+  ++s_stats.issued;
+  return true;
+}
+
+void GlState::setCapability(const GLenum t_cap, unsigned int& t_cached,
+                            const bool t_enabled) {
+  if (!changed(t_cached, t_enabled)) {
+    return;
+  }
+  if (t_enabled) {
+    glEnable(t_cap);
+  } else {
+    glDisable(t_cap);
+  }
+}
+
+int GlState::targetSlot(const GLenum t_target) {
+  switch (t_target) {
+    case GL_TEXTURE_2D:
+      return SLOT_2D;
+    case GL_TEXTURE_2D_MULTISAMPLE:
+      return SLOT_2D_MULTISAMPLE;
+    case GL_TEXTURE_2D_ARRAY:
+      return SLOT_2D_ARRAY;
+    case GL_TEXTURE_3D:
+      return SLOT_3D;
+    case GL_TEXTURE_CUBE_MAP:
+      return SLOT_CUBE_MAP;
+    default:
+      return -1;
+  }
+}
+
+void GlState::useProgram(const unsigned int t_program) {
+  if (changed(s_program, t_program)) {
+    glUseProgram(t_program);
+  }
+}
+
+void GlState::bindVertexArray(const unsigned int t_vao) {
+  if (changed(s_vao, t_vao)) {
+    glBindVertexArray(t_vao);
+  }
+}
+
+void GlState::bindTextureUnit(const unsigned int t_unit, const GLenum t_target,
+                              const unsigned int t_texture) {
+  const int slot = targetSlot(t_target);
+  if (t_unit >= MAX_TEXTURE_UNITS || slot < 0) {
+    // Untracked; always issue.
+    ++s_stats.issued;
+    glActiveTexture(GL_TEXTURE0 + t_unit);
+    glBindTexture(t_target, t_texture);
+    s_activeTextureUnit = t_unit;
+    if (t_unit < MAX_TEXTURE_UNITS) {
+      s_textures[t_unit].fill(UNKNOWN);
+    }
+    return;
+  }
+  if (!changed(s_textures[t_unit][slot], t_texture)) {
+    return;
+  }
+  if (t_texture == 0) {
+    // Unbinding through DSA is ambiguous about the target.
+    activeTexture(t_unit);
+    glBindTexture(t_target, 0);
+    return;
+  }
+  glBindTextureUnit(t_unit, t_texture);
+}
+
+void GlState::bindTextures(const unsigned int t_firstUnit, const int t_count,
+                           const GLenum* t_targets,
+                           const unsigned int* t_textures) {
+  bool anyChanged = false;
+  for (int i = 0; i < t_count; ++i) {
+    const unsigned int unit = t_firstUnit + i;
+    const int slot = targetSlot(t_targets[i]);
+    if (unit >= MAX_TEXTURE_UNITS || slot < 0 ||
+        s_textures[unit][slot] != t_textures[i]) {
+      anyChanged = true;
+      break;
+    }
+  }
+  if (!anyChanged) {
+    ++s_stats.skipped;
+    return;
+  }
+  ++s_stats.issued;
+  glBindTextures(t_firstUnit, t_count, t_textures);
+  for (int i = 0; i < t_count; ++i) {
+    const unsigned int unit = t_firstUnit + i;
+    if (unit >= MAX_TEXTURE_UNITS) {
+      continue;
+    }
+    const int slot = targetSlot(t_targets[i]);
+    if (t_textures[i] == 0) {
+      // Binding 0 this way unbinds every target of the unit.
+      s_textures[unit].fill(0);
+    } else if (slot >= 0) {
+      s_textures[unit][slot] = t_textures[i];
+    } else {
+      s_textures[unit].fill(UNKNOWN);
+    }
+  }
+}
+
+void GlState::bindTexture(const GLenum t_target, const unsigned int t_texture) {
+  if (s_activeTextureUnit == UNKNOWN) {
+    activeTexture(0);
+  }
+  const unsigned int unit = s_activeTextureUnit;
+  const int slot = targetSlot(t_target);
+  if (unit >= MAX_TEXTURE_UNITS || slot < 0) {
+    ++s_stats.issued;
+    glBindTexture(t_target, t_texture);
+    return;
+  }
+  if (changed(s_textures[unit][slot], t_texture)) {
+    glBindTexture(t_target, t_texture);
+  }
+}
+
+void GlState::activeTexture(const unsigned int t_unit) {
+  if (changed(s_activeTextureUnit, t_unit)) {
+    glActiveTexture(GL_TEXTURE0 + t_unit);
+  }
+}
+
+void GlState::bindSampler(const unsigned int t_unit,
+                          const unsigned int t_sampler) {
+  if (t_unit >= MAX_TEXTURE_UNITS) {
+    ++s_stats.issued;
+    glBindSampler(t_unit, t_sampler);
+    return;
+  }
+  if (changed(s_samplers[t_unit], t_sampler)) {
+    glBindSampler(t_unit, t_sampler);
+  }
+}
+
+void GlState::bindFramebuffer(const GLenum t_target, const unsigned int t_fbo) {
+  switch (t_target) {
+    case GL_FRAMEBUFFER:
+      if (s_drawFramebuffer == t_fbo && s_readFramebuffer == t_fbo) {
+        ++s_stats.skipped;
+        return;
+      }
+      ++s_stats.issued;
+      s_drawFramebuffer = t_fbo;
+      s_readFramebuffer = t_fbo;
+      glBindFramebuffer(GL_FRAMEBUFFER, t_fbo);
+      break;
+    case GL_DRAW_FRAMEBUFFER:
+      if (changed(s_drawFramebuffer, t_fbo)) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, t_fbo);
+      }
+      break;
+    case GL_READ_FRAMEBUFFER:
+      if (changed(s_readFramebuffer, t_fbo)) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, t_fbo);
+      }
+      break;
+    default:
+      LOG_CRITICAL("ERROR::GL_STATE::INVALID_FRAMEBUFFER_TARGET");
+  }
+}
+
+void GlState::setViewport(const int t_x, const int t_y, const int t_width,
+                          const int t_height) {
+  const std::array<int, 4> viewport = {t_x, t_y, t_width, t_height};
+  if (s_viewportKnown && s_viewport == viewport) {
+    ++s_stats.skipped;
+    return;
+  }
+  ++s_stats.issued;
+  s_viewport = viewport;
+  s_viewportKnown = true;
+  glViewport(t_x, t_y, t_width, t_height);
+}
+
+void GlState::setViewportIndexed(const unsigned int t_index, const int t_x,
+                                 const int t_y, const int t_width,
+                                 const int t_height) {
+  if (t_index == 0) {
+    setViewport(t_x, t_y, t_width, t_height);
+    return;
+  }
+  ++s_stats.issued;
+  glViewportIndexedf(t_index, static_cast<float>(t_x),
+                     static_cast<float>(t_y), static_cast<float>(t_width),
+                     static_cast<float>(t_height));
+}
+
+void GlState::setDepthTest(const bool t_enabled) {
+  setCapability(GL_DEPTH_TEST, s_depthTest, t_enabled);
+}
+
+void GlState::setDepthFunc(const GLenum t_func) {
+  if (changed(s_depthFunc, t_func)) {
+    glDepthFunc(t_func);
+  }
+}
+
+void GlState::setDepthMask(const bool t_enabled) {
+  if (changed(s_depthMask, t_enabled)) {
+    glDepthMask(t_enabled ? GL_TRUE : GL_FALSE);
+  }
+}
+
+void GlState::setBlend(const bool t_enabled) {
+  setCapability(GL_BLEND, s_blend, t_enabled);
+}
+
+void GlState::setBlendFunc(const GLenum t_srcFactor, const GLenum t_dstFactor) {
+  if (s_blendSrc == t_srcFactor && s_blendDst == t_dstFactor) {
+    ++s_stats.skipped;
+    return;
+  }
+  ++s_stats.issued;
+  s_blendSrc = t_srcFactor;
+  s_blendDst = t_dstFactor;
+  glBlendFunc(t_srcFactor, t_dstFactor);
+}
+
+void GlState::setBlendEquation(const GLenum t_mode) {
+  if (changed(s_blendEquation, t_mode)) {
+    glBlendEquation(t_mode);
+  }
+}
+
+void GlState::setCullFace(const bool t_enabled) {
+  setCapability(GL_CULL_FACE, s_cullFace, t_enabled);
+}
+
+void GlState::setCullFaceMode(const GLenum t_mode) {
+  if (changed(s_cullFaceMode, t_mode)) {
+    glCullFace(t_mode);
+  }
+}
+
+void GlState::setStencilTest(const bool t_enabled) {
+  setCapability(GL_STENCIL_TEST, s_stencilTest, t_enabled);
+}
+
+void GlState::setPolygonMode(const GLenum t_mode) {
+  if (changed(s_polygonMode, t_mode)) {
+    glPolygonMode(GL_FRONT_AND_BACK, t_mode);
+  }
+}
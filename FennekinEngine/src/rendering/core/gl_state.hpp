@@ -0,0 +1,115 @@
+#pragma once
+
+#include <gl/glew.h>
+
+#include <array>
+#include <cstdint>
+
+// Counts of GL state changes that were sent to the driver versus dropped
+// because the state was already set.
+struct GlStateStats {
+  uint64_t issued = 0;
+  uint64_t skipped = 0;
+};
+
+// Mirrors the GL context state that the engine touches, so that redundant
+// binds and toggles never reach the driver. All engine state changes should go
+// through here; code that changes state behind its back (e.g. third party
+// renderers) must call invalidate() afterwards.
+class GlState {
+ public:
+  static constexpr int MAX_TEXTURE_UNITS = 32;
+
+  // Forgets all cached state, so the next change of each kind is always issued.
+  // Must be called once the context is created.
+  static void invalidate();
+
+  // Deleting a bound object silently rebinds 0, and its name may be reused, so
+  // these must be called when a texture or framebuffer is deleted.
+  static void forgetTexture(unsigned int t_texture);
+  static void forgetFramebuffer(unsigned int t_fbo);
+
+  static void useProgram(unsigned int t_program);
+  static void bindVertexArray(unsigned int t_vao);
+
+  // Binds a texture to the given unit (via DSA, leaving the active unit as-is).
+  static void bindTextureUnit(unsigned int t_unit, GLenum t_target,
+                              unsigned int t_texture);
+  // Binds textures to the contiguous units starting at t_firstUnit with a
+  // single call, unless all of them are already bound.
+  static void bindTextures(unsigned int t_firstUnit, int t_count,
+                           const GLenum* t_targets,
+                           const unsigned int* t_textures);
+  // Binds a texture to the active unit, usually for editing it.
+  static void bindTexture(GLenum t_target, unsigned int t_texture);
+  static void activeTexture(unsigned int t_unit);
+  static void bindSampler(unsigned int t_unit, unsigned int t_sampler);
+
+  // Accepts GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER.
+  static void bindFramebuffer(GLenum t_target, unsigned int t_fbo);
+  static void setViewport(int t_x, int t_y, int t_width, int t_height);
+  // Sets one of the viewports a geometry shader selects with gl_ViewportIndex.
+  // Viewport 0 is the one setViewport() sets.
+  static void setViewportIndexed(unsigned int t_index, int t_x, int t_y,
+                                 int t_width, int t_height);
+
+  static void setDepthTest(bool t_enabled);
+  static void setDepthFunc(GLenum t_func);
+  static void setDepthMask(bool t_enabled);
+
+  static void setBlend(bool t_enabled);
+  static void setBlendFunc(GLenum t_srcFactor, GLenum t_dstFactor);
+  static void setBlendEquation(GLenum t_mode);
+
+  static void setCullFace(bool t_enabled);
+  static void setCullFaceMode(GLenum t_mode);
+
+  static void setStencilTest(bool t_enabled);
+  static void setPolygonMode(GLenum t_mode);
+
+  static GlStateStats getStats() { return s_stats; }
+  static void resetStats() { s_stats = {}; }
+
+ private:
+  // Cached value meaning "unknown", which never matches a real value.
+  static constexpr unsigned int UNKNOWN = ~0u;
+
+  enum ETextureTargetSlot {
+    SLOT_2D = 0,
+    SLOT_2D_MULTISAMPLE,
+    SLOT_2D_ARRAY,
+    SLOT_3D,
+    SLOT_CUBE_MAP,
+    SLOT_COUNT,
+  };
+  static int targetSlot(GLenum t_target);
+
+  // Records a change, returning true if it must be sent to GL.
+  static bool changed(unsigned int& t_cached, unsigned int t_value);
+  static void setCapability(GLenum t_cap, unsigned int& t_cached, bool t_enabled);
+
+  static unsigned int s_program;
+  static unsigned int s_vao;
+  static unsigned int s_activeTextureUnit;
+  static std::array<std::array<unsigned int, SLOT_COUNT>, MAX_TEXTURE_UNITS>
+      s_textures;
+  static std::array<unsigned int, MAX_TEXTURE_UNITS> s_samplers;
+  static unsigned int s_drawFramebuffer;
+  static unsigned int s_readFramebuffer;
+  static std::array<int, 4> s_viewport;
+  static bool s_viewportKnown;
+
+  static unsigned int s_depthTest;
+  static unsigned int s_depthFunc;
+  static unsigned int s_depthMask;
+  static unsigned int s_blend;
+  static unsigned int s_blendSrc;
+  static unsigned int s_blendDst;
+  static unsigned int s_blendEquation;
+  static unsigned int s_cullFace;
+  static unsigned int s_cullFaceMode;
+  static unsigned int s_stencilTest;
+  static unsigned int s_polygonMode;
+
+  static GlStateStats s_stats;
+};
@@ -0,0 +1,63 @@
+#include "gpu_culler.hpp"
+#include "rendering/core/gl_state.hpp"
+
+#include <string>
+
+// Must match local_size_x in cull_draws.comp.
+static constexpr unsigned int CULL_GROUP_SIZE = 64;
+// Texture unit of the Hi-Z pyramid while culling.
+static constexpr unsigned int HI_Z_TEXTURE_UNIT = 0;
+
+GpuCuller::GpuCuller()
+    : m_shader(ShaderPath("content/shaders/builtin/cull_draws.comp")) {}
+
+bool GpuCuller::isSupported() {
+  return GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+}
+
+void GpuCuller::cull(IndirectDrawList& t_drawList, const Frustum& t_frustum,
+                     HiZBuffer* t_hiZ, const bool t_secondChance) {
+  t_drawList.beginCulling(ECullPhase::MAIN);
+  if (!t_drawList.size()) {
+    return;
+  }
+
+  m_shader.setUInt("numDraws", t_drawList.size());
+  m_shader.setUInt("cullPhase", static_cast<unsigned int>(ECullPhase::MAIN));
+  for (int i = 0; i < Frustum::NUM_PLANES; ++i) {
+    m_shader.setVec4("frustumPlanes[" + std::to_string(i) + "]",
+                     t_frustum.planes[i]);
+  }
+  const bool occlusionCulling = t_hiZ && t_hiZ->isValid();
+  m_shader.setBool("occlusionCulling", occlusionCulling);
+  m_shader.setBool("secondChance", t_secondChance);
+  if (occlusionCulling) {
+    bindHiZ(*t_hiZ);
+  }
+  // The culled commands and counts are consumed as indirect draw parameters.
+  m_shader.dispatchForItems(t_drawList.size(), CULL_GROUP_SIZE,
+                            GL_COMMAND_BARRIER_BIT);
+}
+
+void GpuCuller::cullSecondChance(IndirectDrawList& t_drawList,
+                                 HiZBuffer& t_hiZ) {
+  t_drawList.beginCulling(ECullPhase::SECOND_CHANCE);
+  if (!t_drawList.size()) {
+    return;
+  }
+
+  m_shader.setUInt("numDraws", t_drawList.size());
+  m_shader.setUInt("cullPhase",
+                   static_cast<unsigned int>(ECullPhase::SECOND_CHANCE));
+  m_shader.setBool("occlusionCulling", true);
+  bindHiZ(t_hiZ);
+  m_shader.dispatchForItems(t_drawList.size(), CULL_GROUP_SIZE,
+                            GL_COMMAND_BARRIER_BIT);
+}
+
+void GpuCuller::bindHiZ(HiZBuffer& t_hiZ) {
+  GlState::bindTextureUnit(HI_Z_TEXTURE_UNIT, GL_TEXTURE_2D,
+                           t_hiZ.getTexture().getId());
+  m_shader.setInt("hiZ", HI_Z_TEXTURE_UNIT);
+  m_shader.setMat4("hiZViewProjection", t_hiZ.getViewProjection());
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rendering/core/hi_z_buffer.hpp"
+#include "rendering/core/indirect_draw.hpp"
+#include "rendering/resources/shader.hpp"
+#include "scene/bounds.hpp"
+
+// Frustum culls the draws of an IndirectDrawList on the GPU. A compute shader
+// tests each draw's bounds and compacts the visible commands within their
+// batch, counting them with atomics. The list then draws with
+// glMultiDrawElementsIndirectCount, so the counts never leave the GPU.
+//
+// Draws can also be occlusion culled against a HiZBuffer, in two phases. The
+// main phase tests against the pyramid of the previous frame. Its survivors are
+// drawn and the pyramid is rebuilt from them, then the second-chance phase
+// retests the rejected draws against it and draws any that are visible after
+// all. Draws wrongly rejected by the stale pyramid, e.g. after the camera
+// moved, are still drawn in the same frame.
+class GpuCuller {
+ public:
+  GpuCuller();
+
+  // Whether the context can draw with a GPU-side count (GL 4.6 or
+  // ARB_indirect_parameters). Without it, lists are drawn unculled.
+  static bool isSupported();
+
+  // Culls the uploaded draws of the list against the world space frustum and,
+  // if a valid pyramid is given, against the depth it was last built from.
+  // Unless cullSecondChance() will follow, occluded draws are final rejects.
+  void cull(IndirectDrawList& t_drawList, const Frustum& t_frustum,
+            HiZBuffer* t_hiZ = nullptr, bool t_secondChance = true);
+  // Retests the draws that the last cull() rejected as occluded, against the
+  // pyramid rebuilt from the draws that it kept.
+  void cullSecondChance(IndirectDrawList& t_drawList, HiZBuffer& t_hiZ);
+
+ private:
+  void bindHiZ(HiZBuffer& t_hiZ);
+
+  ComputeShader m_shader;
+};
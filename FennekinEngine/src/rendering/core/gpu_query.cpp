@@ -0,0 +1,42 @@
+#include "gpu_query.hpp"
+
+GpuQuery::GpuQuery(const GLenum t_target) : m_target(t_target) {
+  glCreateQueries(m_target, NUM_QUERIES, m_queries.data());
+}
+
+GpuQuery::~GpuQuery() { glDeleteQueries(NUM_QUERIES, m_queries.data()); }
+
+void GpuQuery::begin() {
+  // If the GPU is so far behind that this query is still pending, its result
+  // is dropped.
+  m_pending[m_next] = false;
+  glBeginQuery(m_target, m_queries[m_next]);
+}
+
+void GpuQuery::end() {
+  glEndQuery(m_target);
+  m_pending[m_next] = true;
+  m_next = (m_next + 1) % NUM_QUERIES;
+}
+
+uint64_t GpuQuery::getResult() {
+  // Queries finish in the order they were issued, so go from the oldest and
+  // stop at the first that isn't available.
+  for (int i = 0; i < NUM_QUERIES; ++i) {
+    const int query = (m_next + i) % NUM_QUERIES;
+    if (!m_pending[query]) {
+      continue;
+    }
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(m_queries[query], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available) {
+      break;
+    }
+    GLuint64 result = 0;
+    glGetQueryObjectui64v(m_queries[query], GL_QUERY_RESULT, &result);
+    m_result = result;
+    m_pending[query] = false;
+  }
+  return m_result;
+}
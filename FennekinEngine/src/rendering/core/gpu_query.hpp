@@ -0,0 +1,40 @@
+#pragma once
+
+#include <gl/glew.h>
+
+#include <array>
+#include <cstdint>
+
+// Measures a span of GPU commands with a GL query, e.g. GL_TIME_ELAPSED for
+// its duration in nanoseconds or GL_SAMPLES_PASSED for the samples it drew.
+//
+// Each begin()/end() pair uses the next of a small ring of query objects, and
+// getResult() returns the newest one the GPU has finished, so reading never
+// waits for it. Results therefore lag a frame or two behind.
+class GpuQuery {
+ public:
+  explicit GpuQuery(GLenum t_target);
+  ~GpuQuery();
+  GpuQuery(const GpuQuery&) = delete;
+  GpuQuery& operator=(const GpuQuery&) = delete;
+
+  // Only one query of a target can be active at a time.
+  void begin();
+  void end();
+
+  // The result of the newest finished query, or 0 if none has finished yet.
+  uint64_t getResult();
+  // getResult() of a GL_TIME_ELAPSED query, in milliseconds.
+  float getMs() { return static_cast<float>(getResult()) / 1.0e6f; }
+
+ private:
+  static constexpr int NUM_QUERIES = 4;
+
+  GLenum m_target;
+  std::array<unsigned int, NUM_QUERIES> m_queries{};
+  // Whether each query was ended but not yet read back.
+  std::array<bool, NUM_QUERIES> m_pending{};
+  // The query the next begin() uses, which is also the oldest.
+  int m_next = 0;
+  uint64_t m_result = 0;
+};
@@ -0,0 +1,60 @@
+#include "hi_z_buffer.hpp"
+#include "rendering/core/gl_state.hpp"
+
+#include <bit>
+
+// Must match the local size in hi_z_downsample.comp.
+static constexpr unsigned int DOWNSAMPLE_GROUP_SIZE = 8;
+
+// Image units used by the downsample shader.
+static constexpr unsigned int DST_IMAGE_UNIT = 0;
+static constexpr unsigned int SRC_IMAGE_UNIT = 1;
+
+HiZBuffer::HiZBuffer(Texture t_depthTexture)
+    : m_depthTexture(t_depthTexture),
+      m_downsampleShader(
+          ShaderPath("content/shaders/builtin/hi_z_downsample.comp")) {
+  const int width = static_cast<int>(
+      std::bit_floor(static_cast<unsigned int>(m_depthTexture.getWidth())));
+  const int height = static_cast<int>(
+      std::bit_floor(static_cast<unsigned int>(m_depthTexture.getHeight())));
+  m_texture = Texture::create(
+      width, height, GL_R32F,
+      {.filtering = ETextureFiltering::NEAREST,
+       .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE,
+       .generateMips = EMipGeneration::ALWAYS});
+  // Every level is read with texelFetch, which needs the full chain to be
+  // addressable.
+  glTextureParameteri(m_texture.getId(), GL_TEXTURE_MIN_FILTER,
+                      GL_NEAREST_MIPMAP_NEAREST);
+}
+
+void HiZBuffer::build(const glm::mat4& t_viewProjection) {
+  GlState::bindTextureUnit(0, GL_TEXTURE_2D, m_depthTexture.getId());
+  m_downsampleShader.setInt("depthTexture", 0);
+
+  ImageSize size = {.width = m_texture.getWidth(),
+                    .height = m_texture.getHeight()};
+  for (int level = 0; level < m_texture.getNumMips(); ++level) {
+    // Level 0 reduces the depth texture instead of a previous level.
+    const int srcLevel = level > 0 ? level - 1 : 0;
+    glBindImageTexture(SRC_IMAGE_UNIT, m_texture.getId(), srcLevel,
+                       /*layered=*/GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(DST_IMAGE_UNIT, m_texture.getId(), level,
+                       /*layered=*/GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    m_downsampleShader.setBool("fromDepth", level == 0);
+
+    // Each level reads the previous one through image loads; the culling
+    // shader reads the finished pyramid with texelFetch.
+    const bool last = level + 1 == m_texture.getNumMips();
+    m_downsampleShader.dispatch(
+        (size.width + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE,
+        (size.height + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, 1,
+        last ? GL_TEXTURE_FETCH_BARRIER_BIT
+             : GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    size = calculateNextMip(size);
+  }
+
+  m_viewProjection = t_viewProjection;
+  m_valid = true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "rendering/resources/shader.hpp"
+#include "rendering/resources/texture.hpp"
+
+#include <glm/glm.hpp>
+
+// A hierarchical depth buffer: a mip chain of depth where each texel holds the
+// farthest depth of the area it covers. A box whose nearest depth is behind
+// the farthest depth over its whole screen footprint is hidden, and that can
+// be checked with four texel fetches at the mip where the footprint spans at
+// most two texels.
+//
+// Level 0 is the largest power of two that fits in the source depth buffer,
+// so every level halves exactly and texel coordinates map directly between
+// levels.
+class HiZBuffer {
+ public:
+  // Builds from the given depth texture, which must stay alive.
+  explicit HiZBuffer(Texture t_depthTexture);
+
+  // Rebuilds the pyramid from the current contents of the depth texture, which
+  // was rendered with the given view-projection.
+  void build(const glm::mat4& t_viewProjection);
+  // Marks the pyramid as stale, e.g. after a camera cut, so it isn't tested
+  // against until the next build.
+  void invalidate() { m_valid = false; }
+
+  [[nodiscard]] bool isValid() const { return m_valid; }
+  [[nodiscard]] Texture& getTexture() { return m_texture; }
+  // The view-projection of the depth the pyramid was last built from.
+  [[nodiscard]] const glm::mat4& getViewProjection() const {
+    return m_viewProjection;
+  }
+
+ private:
+  Texture m_depthTexture;
+  Texture m_texture;
+  ComputeShader m_downsampleShader;
+  glm::mat4 m_viewProjection = glm::mat4(1.0f);
+  bool m_valid = false;
+};
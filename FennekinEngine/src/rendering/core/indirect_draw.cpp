@@ -0,0 +1,186 @@
+#include "indirect_draw.hpp"
+
+// Mesa only exposes the ARB entry point on drivers below GL 4.6, including
+// software rendering. Both take the same arguments.
+static void multiDrawElementsIndirectCount(const GLintptr t_indirectOffset,
+                                           const GLintptr t_countOffset,
+                                           const GLsizei t_maxCount) {
+  const auto* indirect = reinterpret_cast<const void*>(t_indirectOffset);
+  if (glMultiDrawElementsIndirectCount) {
+    glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, indirect,
+                                     t_countOffset, t_maxCount, /*stride=*/0);
+  } else {
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        indirect, t_countOffset, t_maxCount,
+                                        /*stride=*/0);
+  }
+}
+
+IndirectDrawList::IndirectDrawList() {
+  glCreateBuffers(1, &m_cullStatsReadback);
+  glNamedBufferStorage(m_cullStatsReadback, sizeof(GpuCullStats), nullptr,
+                       GL_CLIENT_STORAGE_BIT);
+}
+
+IndirectDrawList::~IndirectDrawList() {
+  if (m_cullStatsFence) {
+    glDeleteSync(m_cullStatsFence);
+  }
+  glDeleteBuffers(1, &m_cullStatsReadback);
+}
+
+void IndirectDrawList::begin() {
+  m_commands.clear();
+  m_drawData.clear();
+  m_batches.clear();
+  m_culled = false;
+}
+
+unsigned int IndirectDrawList::beginBatch() {
+  m_batches.push_back({.first = size(), .count = 0});
+  return getNumBatches() - 1;
+}
+
+unsigned int IndirectDrawList::add(const GeometryAllocation& t_allocation,
+                                   const glm::mat4& t_model,
+                                   const uint32_t t_materialIndex,
+                                   const Aabb& t_localBounds) {
+  if (m_batches.empty()) {
+    beginBatch();
+  }
+  Batch& batch = m_batches.back();
+  const unsigned int drawIndex = size();
+  m_commands.push_back({
+      .count = t_allocation.indexCount,
+      .instanceCount = 1,
+      .firstIndex = t_allocation.firstIndex,
+      .baseVertex = t_allocation.baseVertex,
+      .baseInstance = drawIndex,
+  });
+
+  const bool hasBounds = !t_localBounds.isEmpty();
+  m_drawData.push_back({
+      .model = t_model,
+      .boundsCenter = hasBounds ? glm::vec4(t_localBounds.getCenter(), 1.0f)
+                                : glm::vec4(0.0f),
+      .boundsExtents = hasBounds ? glm::vec4(t_localBounds.getExtents(), 0.0f)
+                                 : glm::vec4(0.0f),
+      .materialIndex = t_materialIndex,
+      .batchIndex = getNumBatches() - 1,
+      .batchFirst = batch.first,
+      ._pad = 0,
+  });
+  ++batch.count;
+  return drawIndex;
+}
+
+void IndirectDrawList::upload() {
+  m_commandBuffer.update(m_commands.data(),
+                         m_commands.size() * sizeof(DrawElementsIndirectCommand));
+  m_drawDataBuffer.update(m_drawData.data(),
+                          m_drawData.size() * sizeof(IndirectDrawData));
+  m_culled = false;
+}
+
+// Zeroes the first t_count uints of a buffer. A null clear value zeroes the
+// range.
+static void clearUInts(const StorageBuffer& t_buffer, const size_t t_count) {
+  glClearNamedBufferSubData(t_buffer.getId(), GL_R32UI, 0,
+                            static_cast<GLsizeiptr>(t_count * sizeof(uint32_t)),
+                            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+}
+
+void IndirectDrawList::readCullStats() {
+  if (!m_cullStatsFence) {
+    return;
+  }
+  const GLenum status = glClientWaitSync(m_cullStatsFence, 0, /*timeout=*/0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return;
+  }
+  glDeleteSync(m_cullStatsFence);
+  m_cullStatsFence = nullptr;
+  glGetNamedBufferSubData(m_cullStatsReadback, 0, sizeof(GpuCullStats),
+                          &m_cullStats);
+}
+
+void IndirectDrawList::beginCulling(const ECullPhase t_phase) {
+  if (t_phase == ECullPhase::MAIN) {
+    readCullStats();
+    if (m_cullStatsPending && !m_cullStatsFence) {
+      // The last frame's culling is queued by now. Copy its counts and read
+      // them once the GPU is done, rather than waiting for it here.
+      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+      glCopyNamedBufferSubData(m_cullStatsBuffer.getId(), m_cullStatsReadback,
+                               0, 0, sizeof(GpuCullStats));
+      m_cullStatsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    m_cullStatsBuffer.reserve(sizeof(GpuCullStats));
+    clearUInts(m_cullStatsBuffer, sizeof(GpuCullStats) / sizeof(uint32_t));
+    m_cullStatsPending = true;
+    // Written for every draw by the main phase, so no clear is needed.
+    m_occlusionCandidateBuffer.reserve(m_commands.size() * sizeof(uint32_t));
+  }
+
+  CulledCommands& culled = m_culledCommands[static_cast<size_t>(t_phase)];
+  culled.commands.reserve(m_commands.size() *
+                          sizeof(DrawElementsIndirectCommand));
+  culled.counts.reserve(m_batches.size() * sizeof(uint32_t));
+  clearUInts(culled.counts, m_batches.size());
+
+  m_commandBuffer.bind();
+  m_drawDataBuffer.bind();
+  culled.commands.bind();
+  culled.counts.bind();
+  m_occlusionCandidateBuffer.bind();
+  m_cullStatsBuffer.bind();
+  m_culled = true;
+  m_cullPhase = t_phase;
+}
+
+void IndirectDrawList::drawBatch(GeometryArena& t_arena, Shader& t_shader,
+                                 const unsigned int t_batch,
+                                 const EVertexStream t_stream) {
+  const Batch& batch = m_batches[t_batch];
+  if (!m_culled) {
+    draw(t_arena, t_shader, batch.first, batch.count, t_stream);
+    return;
+  }
+  if (!batch.count) {
+    return;
+  }
+  const CulledCommands& culled =
+      m_culledCommands[static_cast<size_t>(m_cullPhase)];
+  t_shader.setBool("fnk_indirectDraw", true);
+  t_shader.activate();
+  t_arena.activate(t_stream);
+  m_drawDataBuffer.bind();
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culled.commands.getId());
+  glBindBuffer(GL_PARAMETER_BUFFER, culled.counts.getId());
+  multiDrawElementsIndirectCount(
+      static_cast<GLintptr>(batch.first * sizeof(DrawElementsIndirectCommand)),
+      static_cast<GLintptr>(t_batch * sizeof(uint32_t)),
+      static_cast<GLsizei>(batch.count));
+  t_shader.setBool("fnk_indirectDraw", false);
+}
+
+void IndirectDrawList::draw(GeometryArena& t_arena, Shader& t_shader,
+                            const unsigned int t_first,
+                            const unsigned int t_count,
+                            const EVertexStream t_stream) {
+  if (!t_count) {
+    return;
+  }
+  t_shader.setBool("fnk_indirectDraw", true);
+  t_shader.activate();
+  t_arena.activate(t_stream);
+  m_drawDataBuffer.bind();
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.getId());
+  glMultiDrawElementsIndirect(
+      GL_TRIANGLES, GL_UNSIGNED_INT,
+      reinterpret_cast<const void*>(t_first *
+                                    sizeof(DrawElementsIndirectCommand)),
+      static_cast<GLsizei>(t_count), /*stride=*/0);
+  // Regular draws with the same program read the `model` uniform.
+  t_shader.setBool("fnk_indirectDraw", false);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <gl/glew.h>
+#include "rendering/core/geometry_arena.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "rendering/resources/shader.hpp"
+#include "scene/bounds.hpp"
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// The command layout consumed by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+  unsigned int count;
+  unsigned int instanceCount;
+  unsigned int firstIndex;
+  int baseVertex;
+  unsigned int baseInstance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20);
+
+// Per-draw data, mirroring FnkDrawData in draw_data_buffer.glsl (std430).
+struct IndirectDrawData {
+  glm::mat4 model;
+  // Model space bounds. w is 1, or 0 if the draw has no bounds and must never
+  // be culled.
+  glm::vec4 boundsCenter;
+  glm::vec4 boundsExtents;
+  uint32_t materialIndex;
+  // The batch the draw belongs to, and the batch's first command. Culling
+  // compacts surviving commands within their batch.
+  uint32_t batchIndex;
+  uint32_t batchFirst;
+  uint32_t _pad;
+};
+static_assert(sizeof(IndirectDrawData) == 112);
+
+// The passes of two-phase occlusion culling, see cull_draws.comp.
+enum class ECullPhase {
+  // Draws that pass the frustum test and the previous frame's Hi-Z.
+  MAIN = 0,
+  // Draws that failed the previous frame's Hi-Z but pass the rebuilt one.
+  SECOND_CHANCE,
+  COUNT,
+};
+
+// Draws rejected by GPU culling, mirroring CullStats in cull_draws.comp.
+struct GpuCullStats {
+  uint32_t frustumCulled = 0;
+  uint32_t occlusionCulled = 0;
+};
+
+// Builds the indirect commands and per-draw data for meshes in a GeometryArena
+// and submits them with glMultiDrawElementsIndirect.
+//
+// Each command's baseInstance is the index of its IndirectDrawData, which the
+// vertex shader reads via gl_BaseInstance. Unlike gl_DrawID, this stays valid
+// when commands are split across several multi-draws or compacted on the GPU.
+//
+// Commands are grouped into batches, each drawn with one multi-draw. After a
+// GpuCuller has run on the list, batches draw only their surviving commands
+// with glMultiDrawElementsIndirectCount, taking the count from the GPU. Each
+// cull phase has its own culled commands, so a batch drawn in the main phase
+// can be drawn again with just its second-chance survivors.
+class IndirectDrawList {
+ public:
+  IndirectDrawList();
+  ~IndirectDrawList();
+  IndirectDrawList(const IndirectDrawList&) = delete;
+  IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+
+  // Clears all recorded draws and batches.
+  void begin();
+  // Starts a new batch, which the following draws are added to. Returns the
+  // batch index.
+  unsigned int beginBatch();
+  // Records a draw of the given arena allocation into the current batch,
+  // starting one if needed. Returns the draw index.
+  unsigned int add(const GeometryAllocation& t_allocation,
+                   const glm::mat4& t_model, uint32_t t_materialIndex,
+                   const Aabb& t_localBounds = Aabb());
+  // Uploads the recorded commands and draw data. Must be called after the last
+  // add() and before culling or drawing.
+  void upload();
+
+  // Draws every command of a batch with one multi-draw, or only those that
+  // survived the latest cull phase if the list was culled since the last
+  // upload. The draws read the given stream of the arena.
+  void drawBatch(GeometryArena& t_arena, Shader& t_shader,
+                 unsigned int t_batch,
+                 EVertexStream t_stream = EVertexStream::ALL);
+  // Draws the commands in [t_first, t_first + t_count) with one multi-draw,
+  // ignoring culling.
+  void draw(GeometryArena& t_arena, Shader& t_shader, unsigned int t_first,
+            unsigned int t_count, EVertexStream t_stream = EVertexStream::ALL);
+  // Draws every recorded command with one multi-draw, ignoring culling.
+  void drawAll(GeometryArena& t_arena, Shader& t_shader,
+               EVertexStream t_stream = EVertexStream::ALL) {
+    draw(t_arena, t_shader, 0, size(), t_stream);
+  }
+
+  unsigned int size() const {
+    return static_cast<unsigned int>(m_commands.size());
+  }
+  unsigned int getNumBatches() const {
+    return static_cast<unsigned int>(m_batches.size());
+  }
+  unsigned int getCommandBuffer() const { return m_commandBuffer.getId(); }
+  StorageBuffer& getDrawDataBuffer() { return m_drawDataBuffer; }
+
+  // Prepares the buffers written by a GPU cull phase: sizes the phase's
+  // culled command buffer, zeroes its per-batch counts and binds everything
+  // the culling shader reads. Draws use the phase's culled commands from then
+  // on, until the next upload or phase.
+  void beginCulling(ECullPhase t_phase = ECullPhase::MAIN);
+  // Counts from the most recent culling of the list that has been read back.
+  // When the main phase begins, the previous frame's counts are copied to a
+  // client side buffer behind a fence, and read in a later frame once the
+  // fence has signaled, so reading never waits for the GPU. The counts
+  // therefore lag a frame or two behind.
+  [[nodiscard]] const GpuCullStats& getCullStats() const {
+    return m_cullStats;
+  }
+
+ private:
+  // Takes in the copied counts if the GPU is done with them.
+  void readCullStats();
+
+  struct Batch {
+    unsigned int first;
+    unsigned int count;
+  };
+
+  // The output of one cull phase.
+  struct CulledCommands {
+    StorageBuffer commands{EStorageBufferBinding::CULLED_DRAW_COMMANDS};
+    // One uint per batch, used as the parameter buffer of the count draws.
+    StorageBuffer counts{EStorageBufferBinding::DRAW_COUNTS};
+  };
+
+  std::vector<DrawElementsIndirectCommand> m_commands;
+  std::vector<IndirectDrawData> m_drawData;
+  std::vector<Batch> m_batches;
+  bool m_culled = false;
+  ECullPhase m_cullPhase = ECullPhase::MAIN;
+  GpuCullStats m_cullStats;
+  // Whether the stats buffer holds counts that haven't been copied back.
+  bool m_cullStatsPending = false;
+  unsigned int m_cullStatsReadback = 0;
+  GLsync m_cullStatsFence = nullptr;
+
+  StorageBuffer m_commandBuffer{EStorageBufferBinding::DRAW_COMMANDS};
+  StorageBuffer m_drawDataBuffer{EStorageBufferBinding::DRAW_DATA};
+  std::array<CulledCommands, static_cast<size_t>(ECullPhase::COUNT)>
+      m_culledCommands;
+  // One uint per draw, flagging draws to retest in the second-chance phase.
+  StorageBuffer m_occlusionCandidateBuffer{
+      EStorageBufferBinding::OCCLUSION_CANDIDATES};
+  StorageBuffer m_cullStatsBuffer{EStorageBufferBinding::CULL_STATS};
+};
@@ -0,0 +1,215 @@
+#include "render_queue.hpp"
+#include "scene/mesh.hpp"
+#include "scene/visibility.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+// Field widths of the sort key.
+static constexpr int PROGRAM_BITS = 11;
+static constexpr int MATERIAL_BITS = 20;
+static constexpr uint64_t PROGRAM_MASK = (1ull << PROGRAM_BITS) - 1;
+static constexpr uint64_t MATERIAL_MASK = (1ull << MATERIAL_BITS) - 1;
+
+void RenderQueue::begin(const glm::mat4& t_view,
+                        const EMeshMobility t_mobility) {
+  m_view = t_view;
+  m_mobility = t_mobility;
+  m_packets.clear();
+  m_order.clear();
+  m_sorted = false;
+  m_stats.culled = 0;
+}
+
+void RenderQueue::add(Renderable& t_renderable, Shader& t_shader) {
+  t_renderable.enqueue(glm::mat4(1.0f), t_shader, *this);
+}
+
+void RenderQueue::addMesh(Mesh& t_mesh, const glm::mat4& t_transform,
+                          Shader& t_shader) {
+  if (!isRecorded(t_mesh)) {
+    return;
+  }
+  const Material& material = t_mesh.getMaterial();
+  const glm::vec4 viewPos = m_view * t_transform[3];
+
+  DrawPacket packet = {
+      .mesh = &t_mesh,
+      .material = &material,
+      .shader = &t_shader,
+      .transform = t_transform,
+      // The camera looks down -Z. Anything behind it sorts first.
+      .depth = std::max(-viewPos.z, 0.0f),
+      .key = 0,
+  };
+  packet.key = makeKey(packet);
+  m_order.push_back(static_cast<uint32_t>(m_packets.size()));
+  m_packets.push_back(packet);
+}
+
+void RenderQueue::addVisible(const SceneVisibility& t_visibility,
+                             const int t_view, Shader& t_shader) {
+  const std::vector<SceneVisibility::Entry>& entries =
+      t_visibility.getEntries();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (!isRecorded(*entries[i].mesh)) {
+      continue;
+    }
+    if (t_visibility.isVisible(i, t_view)) {
+      addMesh(*entries[i].mesh, entries[i].transform, t_shader);
+    } else {
+      ++m_stats.culled;
+    }
+  }
+}
+
+bool RenderQueue::isRecorded(const Mesh& t_mesh) const {
+  return m_mobility == EMeshMobility::ALL ||
+         t_mesh.isDynamic() == (m_mobility == EMeshMobility::DYNAMIC);
+}
+
+uint64_t RenderQueue::makeKey(const DrawPacket& t_packet) {
+  const uint64_t program = t_packet.shader->getProgramId() & PROGRAM_MASK;
+  const uint64_t material = t_packet.material->getId() & MATERIAL_MASK;
+  // Non-negative floats order the same as their bit patterns.
+  const uint64_t depth = std::bit_cast<uint32_t>(t_packet.depth);
+  return (program << (MATERIAL_BITS + 32)) | (material << 32) | depth;
+}
+
+int RenderQueue::countStateChanges() const {
+  int changes = 0;
+  const DrawPacket* prev = nullptr;
+  for (const uint32_t idx : m_order) {
+    const DrawPacket& packet = m_packets[idx];
+    if (!prev || prev->shader != packet.shader) {
+      ++changes;
+    }
+    if (!prev || prev->material->getId() != packet.material->getId()) {
+      ++changes;
+    }
+    if (!prev || prev->mesh != packet.mesh) {
+      ++changes;
+    }
+    prev = &packet;
+  }
+  return changes;
+}
+
+void RenderQueue::sort() {
+  m_stats.draws = static_cast<int>(m_packets.size());
+  m_stats.stateChangesUnsorted = countStateChanges();
+
+  // Sort compact (key, index) pairs rather than moving whole packets.
+  m_sortKeys.clear();
+  m_sortKeys.reserve(m_packets.size());
+  for (uint32_t i = 0; i < m_packets.size(); ++i) {
+    m_sortKeys.emplace_back(m_packets[i].key, i);
+  }
+  std::sort(m_sortKeys.begin(), m_sortKeys.end());
+  for (size_t i = 0; i < m_sortKeys.size(); ++i) {
+    m_order[i] = m_sortKeys[i].second;
+  }
+
+  m_stats.stateChangesSorted = countStateChanges();
+  m_sorted = true;
+}
+
+void RenderQueue::updateUnsortedStats() {
+  if (!m_sorted) {
+    // Submitting in insertion order; report it for both.
+    m_stats.draws = static_cast<int>(m_packets.size());
+    m_stats.stateChangesUnsorted = countStateChanges();
+    m_stats.stateChangesSorted = m_stats.stateChangesUnsorted;
+  }
+  m_stats.drawCalls = 0;
+}
+
+void RenderQueue::drawDirect(const DrawPacket& t_packet,
+                             TextureRegistry* t_textureRegistry,
+                             const ERenderPass t_pass) {
+  t_packet.mesh->drawWithModel(t_packet.transform, *t_packet.shader,
+                               t_textureRegistry, t_pass);
+  ++m_stats.drawCalls;
+}
+
+void RenderQueue::submit(TextureRegistry* t_textureRegistry,
+                         const ERenderPass t_pass) {
+  updateUnsortedStats();
+
+  for (const uint32_t idx : m_order) {
+    drawDirect(m_packets[idx], t_textureRegistry, t_pass);
+  }
+}
+
+void RenderQueue::drawIndirectBatches(IndirectDrawList& t_drawList,
+                                      TextureRegistry* t_textureRegistry,
+                                      const ERenderPass t_pass) {
+  const bool depthOnly = t_pass == ERenderPass::DEPTH_ONLY;
+  for (const IndirectBatch& batch : m_indirectBatches) {
+    if (!depthOnly) {
+      batch.packet->mesh->bindMaterial(*batch.packet->shader,
+                                       t_textureRegistry);
+    }
+    t_drawList.drawBatch(
+        *batch.packet->mesh->getArena(), *batch.packet->shader, batch.index,
+        depthOnly ? EVertexStream::POSITION : EVertexStream::ALL);
+    ++m_stats.drawCalls;
+  }
+}
+
+void RenderQueue::submitIndirect(IndirectDrawList& t_drawList,
+                                 TextureRegistry* t_textureRegistry,
+                                 const ERenderPass t_pass,
+                                 const IndirectCulling& t_culling) {
+  updateUnsortedStats();
+
+  t_drawList.begin();
+  m_indirectBatches.clear();
+  m_directDraws.clear();
+  for (const uint32_t idx : m_order) {
+    const DrawPacket& packet = m_packets[idx];
+    if (!packet.mesh->getArena()) {
+      m_directDraws.push_back(idx);
+      continue;
+    }
+
+    bool newBatch = m_indirectBatches.empty();
+    if (!newBatch) {
+      const DrawPacket& prev = *m_indirectBatches.back().packet;
+      newBatch = prev.shader != packet.shader ||
+                 prev.mesh->getArena() != packet.mesh->getArena() ||
+                 (t_pass == ERenderPass::SHADED &&
+                  prev.material->getId() != packet.material->getId());
+    }
+    if (newBatch) {
+      m_indirectBatches.push_back(
+          {.index = t_drawList.beginBatch(), .packet = &packet});
+    }
+    t_drawList.add(packet.mesh->getArenaAllocation(), packet.transform,
+                   static_cast<uint32_t>(packet.material->getId()),
+                   packet.mesh->getLocalBounds());
+  }
+  t_drawList.upload();
+  if (t_culling.culler) {
+    t_culling.culler->cull(t_drawList, t_culling.frustum, t_culling.hiZ,
+                           t_culling.rebuildHiZ);
+  }
+  drawIndirectBatches(t_drawList, t_textureRegistry, t_pass);
+
+  if (t_culling.culler && t_culling.hiZ && t_culling.rebuildHiZ) {
+    // Rebuild the pyramid from what was just drawn, then draw the occlusion
+    // candidates that it shows are visible.
+    const bool tested = t_culling.hiZ->isValid();
+    t_culling.hiZ->build(t_culling.viewProjection);
+    if (tested) {
+      t_culling.culler->cullSecondChance(t_drawList, *t_culling.hiZ);
+      drawIndirectBatches(t_drawList, t_textureRegistry, t_pass);
+    }
+  }
+
+  // Meshes outside an arena, in their sorted order.
+  for (const uint32_t idx : m_directDraws) {
+    drawDirect(m_packets[idx], t_textureRegistry, t_pass);
+  }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "rendering/core/gpu_culler.hpp"
+#include "rendering/core/hi_z_buffer.hpp"
+#include "rendering/core/indirect_draw.hpp"
+#include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/material.hpp"
+#include "rendering/resources/shader.hpp"
+#include "scene/bounds.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+class Mesh;
+class Renderable;
+class SceneVisibility;
+
+// A single draw recorded for later submission.
+struct DrawPacket {
+  Mesh* mesh;
+  const Material* material;
+  Shader* shader;
+  // The full model transform, including all parent transforms.
+  glm::mat4 transform;
+  // View space distance from the camera to the mesh origin.
+  float depth;
+  uint64_t key;
+};
+
+// Which meshes a queue records, by Mesh::isDynamic().
+enum class EMeshMobility {
+  ALL = 0,
+  STATIC,
+  DYNAMIC,
+};
+
+// What a submitted pass needs of its draws.
+enum class ERenderPass {
+  // Binds each draw's material and reads every vertex attribute.
+  SHADED = 0,
+  // Writes depth only, e.g. shadow passes: binds no materials, and draws
+  // arena meshes from their position stream, see EVertexStream::POSITION.
+  DEPTH_ONLY,
+};
+
+// Counts for the last sorted batch. A state change is a switch of program,
+// material or mesh (VAO) between consecutive draws.
+struct RenderQueueStats {
+  int draws = 0;
+  int stateChangesUnsorted = 0;
+  int stateChangesSorted = 0;
+  // GL draw calls issued by the last submit, counting a multi-draw as one.
+  int drawCalls = 0;
+  // Meshes of the queue's mobility skipped by addVisible() since the last
+  // begin().
+  int culled = 0;
+};
+
+// GPU culling of the draws submitted through an indirect list.
+struct IndirectCulling {
+  GpuCuller* culler = nullptr;
+  // World space frustum to cull against.
+  Frustum frustum;
+  // If set, draws are also occlusion culled in two phases (see GpuCuller). The
+  // pyramid must be built from the depth buffer the pass renders to, and is
+  // rebuilt between the phases using viewProjection.
+  HiZBuffer* hiZ = nullptr;
+  glm::mat4 viewProjection = glm::mat4(1.0f);
+  // If unset, draws are only tested against the pyramid as it is, with no
+  // rebuild or second phase, e.g. when it was already built from the depth
+  // of this frame.
+  bool rebuildHiZ = true;
+};
+
+// Collects the draws of a pass and submits them ordered by a packed 64-bit
+// key, rather than in scene tree order:
+//
+//   0 | program (11) | material (20) | depth (32, front-to-back)
+//
+// Draws are grouped by program and then material to minimise state changes,
+// and front-to-back within a group to help early-Z. Every draw is opaque:
+// the renderer is deferred, and the G-buffer can't be alpha blended.
+class RenderQueue {
+ public:
+  // Clears recorded draws and sets the view used to compute draw depth. Until
+  // the next begin(), meshes of other mobility than t_mobility are skipped.
+  void begin(const glm::mat4& t_view,
+             EMeshMobility t_mobility = EMeshMobility::ALL);
+  // Records every mesh under the renderable, drawn with the given shader.
+  void add(Renderable& t_renderable, Shader& t_shader);
+  // Records a single mesh draw. Called by Mesh::enqueue.
+  void addMesh(Mesh& t_mesh, const glm::mat4& t_transform, Shader& t_shader);
+
+  // Records every mesh of the visibility set that is visible from the given
+  // view, instead of walking a renderable tree.
+  void addVisible(const SceneVisibility& t_visibility, int t_view,
+                  Shader& t_shader);
+
+  // Sorts the recorded draws by key. Skipping this submits them in the order
+  // they were added.
+  void sort();
+  void submit(TextureRegistry* t_textureRegistry = nullptr,
+              ERenderPass t_pass = ERenderPass::SHADED);
+  // Submits the draws of arena meshes through the indirect list, with one
+  // multi-draw per run of draws sharing a program and, for shaded passes, a
+  // material. A depth-only pass binds no materials, so it is a single
+  // multi-draw. Everything else is drawn directly.
+  //
+  // If t_culling has a culler, the indirect draws are first culled on the GPU.
+  void submitIndirect(IndirectDrawList& t_drawList,
+                      TextureRegistry* t_textureRegistry = nullptr,
+                      ERenderPass t_pass = ERenderPass::SHADED,
+                      const IndirectCulling& t_culling = {});
+
+  [[nodiscard]] bool isEmpty() const { return m_packets.empty(); }
+  [[nodiscard]] const RenderQueueStats& getStats() const { return m_stats; }
+
+ private:
+  // Whether the mesh matches the mobility given to begin().
+  bool isRecorded(const Mesh& t_mesh) const;
+  static uint64_t makeKey(const DrawPacket& t_packet);
+  int countStateChanges() const;
+  void updateUnsortedStats();
+  // Draws a packet with its own draw call.
+  void drawDirect(const DrawPacket& t_packet,
+                  TextureRegistry* t_textureRegistry, ERenderPass t_pass);
+  // Draws every batch recorded by submitIndirect() with one multi-draw each.
+  void drawIndirectBatches(IndirectDrawList& t_drawList,
+                           TextureRegistry* t_textureRegistry,
+                           ERenderPass t_pass);
+
+  // A batch of the indirect draw list, drawn with one multi-draw. The packet
+  // is the batch's first draw, which supplies the shared state.
+  struct IndirectBatch {
+    unsigned int index;
+    const DrawPacket* packet;
+  };
+
+  glm::mat4 m_view = glm::mat4(1.0f);
+  EMeshMobility m_mobility = EMeshMobility::ALL;
+  std::vector<DrawPacket> m_packets;
+  // Submission order, as indices into m_packets.
+  std::vector<uint32_t> m_order;
+  std::vector<std::pair<uint64_t, uint32_t>> m_sortKeys;
+  bool m_sorted = false;
+  std::vector<IndirectBatch> m_indirectBatches;
+  std::vector<uint32_t> m_directDraws;
+  RenderQueueStats m_stats;
+};
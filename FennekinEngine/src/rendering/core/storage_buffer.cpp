@@ -0,0 +1,71 @@
+#include "storage_buffer.hpp"
+
+#include <algorithm>
+
+unsigned int StorageBuffer::s_boundBuffers[static_cast<unsigned int>(
+    EStorageBufferBinding::COUNT)] = {};
+
+StorageBuffer::StorageBuffer(const EStorageBufferBinding t_binding)
+    : m_binding(t_binding) {}
+
+StorageBuffer::~StorageBuffer() { free(); }
+
+void StorageBuffer::reserve(const std::size_t t_sizeBytes) {
+  if (m_id && t_sizeBytes <= m_capacityBytes) {
+    return;
+  }
+  // Grow geometrically so steadily growing contents don't reallocate every
+  // frame.
+  const std::size_t capacity =
+      std::max({t_sizeBytes, m_capacityBytes * 2, std::size_t(256)});
+  free();
+  glCreateBuffers(1, &m_id);
+  glNamedBufferData(m_id, static_cast<GLsizeiptr>(capacity), nullptr,
+                    GL_DYNAMIC_DRAW);
+  m_capacityBytes = capacity;
+}
+
+void StorageBuffer::update(const void* t_data, const std::size_t t_sizeBytes) {
+  reserve(t_sizeBytes);
+  if (t_sizeBytes) {
+    glNamedBufferSubData(m_id, 0, static_cast<GLsizeiptr>(t_sizeBytes),
+                         t_data);
+  }
+  bind();
+}
+
+void StorageBuffer::update(const void* t_data, const std::size_t t_sizeBytes,
+                           const std::size_t t_offset) {
+  if (!m_id) {
+    reserve(t_offset + t_sizeBytes);
+  }
+  if (t_sizeBytes) {
+    glNamedBufferSubData(m_id, static_cast<GLintptr>(t_offset),
+                         static_cast<GLsizeiptr>(t_sizeBytes), t_data);
+  }
+  bind();
+}
+
+void StorageBuffer::bind() {
+  if (!m_id) {
+    reserve(0);
+  }
+  const auto binding = static_cast<unsigned int>(m_binding);
+  if (s_boundBuffers[binding] == m_id) {
+    return;
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_id);
+  s_boundBuffers[binding] = m_id;
+}
+
+void StorageBuffer::free() {
+  if (m_id) {
+    const auto binding = static_cast<unsigned int>(m_binding);
+    if (s_boundBuffers[binding] == m_id) {
+      s_boundBuffers[binding] = 0;
+    }
+    glDeleteBuffers(1, &m_id);
+    m_id = 0;
+    m_capacityBytes = 0;
+  }
+}
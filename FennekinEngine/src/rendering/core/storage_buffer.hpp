@@ -0,0 +1,70 @@
+#pragma once
+
+#include <gl/glew.h>
+
+#include <cstddef>
+
+// Fixed binding points for the engine's std430 shader storage blocks. These
+// must match the `binding` layout qualifiers of the blocks declared in the
+// shaders.
+enum class EStorageBufferBinding : unsigned int {
+  DRAW_DATA = 0,
+  // Inputs and outputs of GPU draw culling, see cull_draws.comp.
+  DRAW_COMMANDS,
+  CULLED_DRAW_COMMANDS,
+  DRAW_COUNTS,
+  OCCLUSION_CANDIDATES,
+  CULL_STATS,
+  // Point and spot lights, and the clusters of the screen they reach. See
+  // core.glsl.
+  POINT_LIGHTS,
+  SPOT_LIGHTS,
+  LIGHT_CLUSTERS,
+  CLUSTER_LIGHT_INDICES,
+  // The point and spot light tiles of the shadow atlas.
+  SHADOW_TILES,
+  // The pages of the virtual shadow map requested by the G-buffer.
+  VIRTUAL_SHADOW_PAGE_REQUESTS,
+  COUNT,
+};
+
+// A shader storage buffer bound to a fixed binding point, for per-draw or
+// per-object arrays whose size isn't known up front. The GL buffer is lazily
+// allocated and grows to fit the largest upload.
+class StorageBuffer {
+ public:
+  explicit StorageBuffer(EStorageBufferBinding t_binding);
+  ~StorageBuffer();
+  StorageBuffer(const StorageBuffer&) = delete;
+  StorageBuffer& operator=(const StorageBuffer&) = delete;
+
+  unsigned int getId() const { return m_id; }
+  EStorageBufferBinding getBinding() const { return m_binding; }
+  std::size_t getCapacity() const { return m_capacityBytes; }
+
+  // Makes sure the buffer can hold t_sizeBytes. Existing contents are lost if
+  // it has to grow.
+  void reserve(std::size_t t_sizeBytes);
+  // Uploads the given data at the start of the buffer, growing it if needed,
+  // and binds it to its binding point.
+  void update(const void* t_data, std::size_t t_sizeBytes);
+  // Uploads the given data at t_offset, keeping the rest of the contents,
+  // and binds the buffer. The range must lie within the capacity.
+  void update(const void* t_data, std::size_t t_sizeBytes,
+              std::size_t t_offset);
+
+  // Binds the buffer to its binding point. This is a no-op if the buffer is
+  // already bound there.
+  void bind();
+  // Frees the GL buffer. Must be called while the context is still alive if
+  // the owner outlives it.
+  void free();
+
+ private:
+  unsigned int m_id = 0;
+  EStorageBufferBinding m_binding;
+  std::size_t m_capacityBytes = 0;
+
+  static unsigned int s_boundBuffers[static_cast<unsigned int>(
+      EStorageBufferBinding::COUNT)];
+};
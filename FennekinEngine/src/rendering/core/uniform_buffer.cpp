@@ -0,0 +1,56 @@
+#include "uniform_buffer.hpp"
+
+#include "core/debug/logger.hpp"
+
+unsigned int UniformBuffer::s_boundBuffers[static_cast<unsigned int>(
+    EUniformBlockBinding::COUNT)] = {};
+
+UniformBuffer::UniformBuffer(const EUniformBlockBinding t_binding,
+                             const std::size_t t_sizeBytes)
+    : m_binding(t_binding), m_sizeBytes(t_sizeBytes) {}
+
+UniformBuffer::~UniformBuffer() { free(); }
+
+void UniformBuffer::allocate() {
+  glCreateBuffers(1, &m_id);
+  // The whole block is rewritten at most once per frame.
+  glNamedBufferData(m_id, static_cast<GLsizeiptr>(m_sizeBytes), nullptr,
+                    GL_DYNAMIC_DRAW);
+}
+
+void UniformBuffer::update(const void* t_data, const std::size_t t_sizeBytes,
+                           const std::size_t t_offset) {
+  if (t_offset + t_sizeBytes > m_sizeBytes) {
+    LOG_CRITICAL("ERROR::UNIFORM_BUFFER::UPDATE_OUT_OF_RANGE");
+    return;
+  }
+  if (!m_id) {
+    allocate();
+  }
+  glNamedBufferSubData(m_id, static_cast<GLintptr>(t_offset),
+                       static_cast<GLsizeiptr>(t_sizeBytes), t_data);
+  bind();
+}
+
+void UniformBuffer::bind() {
+  if (!m_id) {
+    allocate();
+  }
+  const auto binding = static_cast<unsigned int>(m_binding);
+  if (s_boundBuffers[binding] == m_id) {
+    return;
+  }
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_id);
+  s_boundBuffers[binding] = m_id;
+}
+
+void UniformBuffer::free() {
+  if (m_id) {
+    const auto binding = static_cast<unsigned int>(m_binding);
+    if (s_boundBuffers[binding] == m_id) {
+      s_boundBuffers[binding] = 0;
+    }
+    glDeleteBuffers(1, &m_id);
+    m_id = 0;
+  }
+}
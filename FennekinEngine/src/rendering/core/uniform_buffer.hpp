@@ -0,0 +1,72 @@
+#pragma once
+
+#include <gl/glew.h>
+
+#include <cstddef>
+
+// Fixed binding points for the engine's std140 uniform blocks. These must match
+// the `binding` layout qualifiers of the blocks declared in core.glsl.
+enum class EUniformBlockBinding : unsigned int {
+  FRAME = 0,
+  CAMERA = 1,
+  LIGHTS = 2,
+  SHADOW = 3,
+  COUNT,
+};
+
+// A byte range within a uniform block, used for partial uploads.
+struct UniformBlockRange {
+  std::size_t offset;
+  std::size_t size;
+};
+
+// A source of per-frame or per-view data that is written into a uniform buffer
+// once, rather than being pushed into every shader that consumes it.
+class UniformBlockSource {
+ public:
+  virtual ~UniformBlockSource() = default;
+  virtual void updateUniformBlock() = 0;
+};
+
+// A uniform buffer object that is bound to a fixed binding point. The GL
+// buffer is lazily allocated on first use so that owners can be created before
+// the GL context.
+class UniformBuffer {
+ public:
+  UniformBuffer(EUniformBlockBinding t_binding, std::size_t t_sizeBytes);
+  ~UniformBuffer();
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+  unsigned int getId() const { return m_id; }
+  EUniformBlockBinding getBinding() const { return m_binding; }
+  std::size_t getSize() const { return m_sizeBytes; }
+
+  // Uploads the given data at the given offset and binds the buffer to its
+  // binding point, making it visible to all programs.
+  void update(const void* t_data, std::size_t t_sizeBytes,
+              std::size_t t_offset = 0);
+  template <typename T>
+  void update(const T& t_block) {
+    update(&t_block, sizeof(T));
+  }
+
+  // Binds the buffer to its binding point without uploading anything. This is
+  // a no-op if the buffer is already bound there.
+  void bind();
+  // Frees the GL buffer. Must be called while the context is still alive if
+  // the owner outlives it.
+  void free();
+
+ private:
+  void allocate();
+
+  unsigned int m_id = 0;
+  EUniformBlockBinding m_binding;
+  std::size_t m_sizeBytes;
+
+  // The buffer currently bound to each binding point, so that unchanged
+  // sources don't issue any GL calls.
+  static unsigned int s_boundBuffers[static_cast<unsigned int>(
+      EUniformBlockBinding::COUNT)];
+};
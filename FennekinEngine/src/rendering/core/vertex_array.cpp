@@ -1,4 +1,5 @@
 #include "vertex_array.hpp"
+#include "rendering/core/gl_state.hpp"
 
 VertexArray::VertexArray() {
     glGenVertexArrays(1, &m_vao);
@@ -6,11 +7,11 @@ VertexArray::VertexArray() {
 }
 
 void VertexArray::activate() {
-    glBindVertexArray(m_vao);
+    GlState::bindVertexArray(m_vao);
 }
 
 void VertexArray::deactivate() {
-    glBindVertexArray(0);
+    GlState::bindVertexArray(0);
 }
 
 // TODO: Reduce duplication in these methods.
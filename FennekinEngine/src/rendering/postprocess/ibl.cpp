@@ -1,8 +1,17 @@
 #include "ibl.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// Must match the local size in ggx_prefilter_cubemap.comp.
+static constexpr int PREFILTER_GROUP_SIZE = 8;
+
 CubemapIrradianceShader::CubemapIrradianceShader() :
-    Shader(ShaderPath("content/shaders/builtin/cubemap.vert"),
-           ShaderPath("content/shaders/builtin/irradiance_cubemap.frag")) {
+    Shader(ShaderPath("content/shaders/builtin/cubemap_layered.vert"),
+           ShaderPath("content/shaders/builtin/irradiance_cubemap.frag"),
+           ShaderPath("content/shaders/builtin/cubemap_layered.geom")) {
     // Set defaults.
     setHemisphereSampleDelta(m_hemisphereSampleDelta);
 }
@@ -17,12 +26,12 @@ CubemapIrradianceCalculator::CubemapIrradianceCalculator(int width, int t_height
     m_cubemap = m_buffer.attachTexture(EBufferType::COLOR_CUBEMAP_HDR);
 }
 
-void CubemapIrradianceCalculator::multipassDraw(Texture t_source) {
+void CubemapIrradianceCalculator::draw(Texture t_source) {
     // Set up the source.
     t_source.bindToUnit(0, ETextureBindType::CUBEMAP);
     m_irradianceShader.setInt("fnk_environmentMap", 0);
 
-    m_cubemapRenderHelper.multipassDraw(m_irradianceShader);
+    m_cubemapRenderHelper.layeredDraw(m_irradianceShader);
 }
 
 unsigned int CubemapIrradianceCalculator::bindTexture(unsigned int t_nextTextureUnit, Shader& t_shader) {
@@ -34,8 +43,9 @@ unsigned int CubemapIrradianceCalculator::bindTexture(unsigned int t_nextTexture
 }
 
 GGXPrefilterShader::GGXPrefilterShader() :
-    Shader(ShaderPath("content/shaders/builtin/cubemap.vert"),
-           ShaderPath("content/shaders/builtin/ggx_prefilter_cubemap.frag")) {
+    Shader(ShaderPath("content/shaders/builtin/cubemap_layered.vert"),
+           ShaderPath("content/shaders/builtin/ggx_prefilter_cubemap.frag"),
+           ShaderPath("content/shaders/builtin/cubemap_layered.geom")) {
     setNumSamples(m_numSamples);
 }
 
@@ -48,8 +58,10 @@ void GGXPrefilterShader::setRoughness(float t_roughness) {
     setFloat("fnk_roughness", t_roughness);
 }
 
-GGXPrefilteredEnvMapCalculator::GGXPrefilteredEnvMapCalculator(int t_width, int t_height, int t_maxNumMips) :
-    m_buffer(t_width, t_height), m_cubemapRenderHelper(&m_buffer) {
+GGXPrefilteredEnvMapCalculator::GGXPrefilteredEnvMapCalculator(int t_width, int t_height, int t_maxNumMips,
+                                                               int t_maxSize) :
+    m_size(std::min({t_width, t_height, t_maxSize})),
+    m_shader(ShaderPath("content/shaders/builtin/ggx_prefilter_cubemap.comp")) {
     TextureParams textureParams = {
         // Need trilinear filtering in order to make use of mip levels.
         .filtering = ETextureFiltering::TRILINEAR,
@@ -60,29 +72,106 @@ GGXPrefilteredEnvMapCalculator::GGXPrefilteredEnvMapCalculator(int t_width, int
         .generateMips = EMipGeneration::ALWAYS,
         .maxNumMips = t_maxNumMips,
     };
-    m_cubemap = m_buffer.attachTexture(EBufferType::COLOR_CUBEMAP_HDR, textureParams);
+    // With alpha, as image stores can't write RGB formats.
+    m_cubemap = Texture::createCubemap(m_size, GL_RGBA16F, textureParams);
 }
 
-void GGXPrefilteredEnvMapCalculator::multipassDraw(Texture t_source) {
+void GGXPrefilteredEnvMapCalculator::draw(Texture t_source) {
     // Set up the source.
     t_source.bindToUnit(0, ETextureBindType::CUBEMAP);
     m_shader.setInt("fnk_environmentMap", 0);
+    m_shader.setUInt("fnk_numSamples", m_numSamples);
 
-    for (int mip = 0; mip < m_cubemap.numMips; ++mip) {
-        m_cubemapRenderHelper.setTargetMip(mip);
+    const int numMips = m_cubemap.getNumMips();
+    for (int mip = 0; mip < numMips; ++mip) {
         // Go through roughness from [0..1].
-        float roughness = static_cast<float>(mip) / (m_cubemap.numMips - 1);
-        m_shader.setRoughness(roughness);
-        m_cubemapRenderHelper.multipassDraw(m_shader);
+        float roughness = numMips > 1 ? static_cast<float>(mip) / (numMips - 1) : 0.0f;
+        m_shader.setFloat("fnk_roughness", roughness);
+        // All six faces of the mip at once, one per z of the dispatch.
+        glBindImageTexture(0, m_cubemap.getId(), mip, /*layered=*/GL_TRUE, 0, GL_WRITE_ONLY,
+                           GL_RGBA16F);
+        ImageSize mipSize = calculateMipLevel(m_size, m_size, mip);
+        m_shader.dispatch((mipSize.width + PREFILTER_GROUP_SIZE - 1) / PREFILTER_GROUP_SIZE,
+                          (mipSize.height + PREFILTER_GROUP_SIZE - 1) / PREFILTER_GROUP_SIZE, 6,
+                          GL_TEXTURE_FETCH_BARRIER_BIT);
     }
 }
 
+GGXPrefilterParity GGXPrefilteredEnvMapCalculator::checkParity(Texture t_source) {
+    const int numMips = m_cubemap.getNumMips();
+    if (!m_referenceBuffer) {
+        m_referenceBuffer = std::make_unique<Framebuffer>(m_size, m_size);
+        m_referenceCubemap = m_referenceBuffer->attachTexture(
+            EBufferType::COLOR_CUBEMAP_HDR_ALPHA, {
+                .filtering = ETextureFiltering::TRILINEAR,
+                .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE,
+                .generateMips = EMipGeneration::ALWAYS,
+                .maxNumMips = numMips,
+            });
+        m_referenceShader = std::make_unique<GGXPrefilterShader>();
+    }
+
+    GGXPrefilterParity parity;
+    using Clock = std::chrono::steady_clock;
+    glFinish();
+    auto start = Clock::now();
+    draw(t_source);
+    glFinish();
+    parity.bakeMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+    start = Clock::now();
+    t_source.bindToUnit(0, ETextureBindType::CUBEMAP);
+    m_referenceShader->setInt("fnk_environmentMap", 0);
+    CubemapRenderHelper referenceHelper(m_referenceBuffer.get());
+    for (int mip = 0; mip < numMips; ++mip) {
+        referenceHelper.setTargetMip(mip);
+        float roughness = numMips > 1 ? static_cast<float>(mip) / (numMips - 1) : 0.0f;
+        m_referenceShader->setRoughness(roughness);
+        referenceHelper.layeredDraw(*m_referenceShader);
+    }
+    glFinish();
+    parity.referenceMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+    // The baked mips were written as images, which the readback below only
+    // sees after this barrier; glFinish() doesn't order them.
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    // Errors are relative, but not to the darkest values, where any noise is.
+    constexpr float MIN_REFERENCE = 0.01f;
+    double errorSum = 0.0;
+    size_t numValues = 0;
+    std::vector<glm::vec4> baked;
+    std::vector<glm::vec4> reference;
+    for (int mip = 0; mip < numMips; ++mip) {
+        ImageSize mipSize = calculateMipLevel(m_size, m_size, mip);
+        const size_t numTexels = static_cast<size_t>(mipSize.width) * mipSize.height * 6;
+        const auto numBytes = static_cast<GLsizei>(numTexels * sizeof(glm::vec4));
+        baked.resize(numTexels);
+        reference.resize(numTexels);
+        glGetTextureImage(m_cubemap.getId(), mip, GL_RGBA, GL_FLOAT, numBytes, baked.data());
+        glGetTextureImage(m_referenceCubemap.id, mip, GL_RGBA, GL_FLOAT, numBytes,
+                          reference.data());
+        for (size_t i = 0; i < numTexels; ++i) {
+            for (int channel = 0; channel < 3; ++channel) {
+                const float expected = reference[i][channel];
+                const float error = std::abs(baked[i][channel] - expected) /
+                                    std::max(std::abs(expected), MIN_REFERENCE);
+                parity.maxError = std::max(parity.maxError, error);
+                errorSum += error;
+                ++numValues;
+            }
+        }
+    }
+    parity.meanError = numValues ? static_cast<float>(errorSum / numValues) : 0.0f;
+    return parity;
+}
+
 void GGXPrefilteredEnvMapCalculator::updateUniforms(Shader& t_shader) {
-    t_shader.setFloat("fnk_ggxPrefilteredEnvMapMaxLOD", static_cast<float>(m_cubemap.numMips - 1.0));
+    t_shader.setFloat("fnk_ggxPrefilteredEnvMapMaxLOD", static_cast<float>(m_cubemap.getNumMips() - 1.0));
 }
 
 unsigned int GGXPrefilteredEnvMapCalculator::bindTexture(unsigned int t_nextTextureUnit, Shader& shader) {
-    m_cubemap.asTexture().bindToUnit(t_nextTextureUnit, ETextureBindType::CUBEMAP);
+    m_cubemap.bindToUnit(t_nextTextureUnit, ETextureBindType::CUBEMAP);
     // Bind sampler uniforms.
     shader.setInt("fnk_ggxPrefilteredEnvMap", t_nextTextureUnit);
 
@@ -7,6 +7,8 @@
 #include "rendering/resources/shader_primitives.hpp"
 #include "scene/mesh_primitives.hpp"
 
+#include <memory>
+
 
 class CubemapIrradianceShader final : public Shader {
 public:
@@ -41,7 +43,7 @@ public:
     }
 
     // Draw onto the allocated cubemap from the given cubemap as the source.
-    void multipassDraw(Texture t_source);
+    void draw(Texture t_source);
 
     Texture getIrradianceMap() {
         return m_cubemap.asTexture();
@@ -71,42 +73,72 @@ private:
     unsigned int m_numSamples = 1024;
 };
 
+// How far the compute bake of GGXPrefilteredEnvMapCalculator strays from the
+// fragment shader one, and how long each took.
+struct GGXPrefilterParity {
+    // The largest and the mean difference of any channel, relative to the
+    // fragment shader's value, over every texel of every mip.
+    float maxError = 0.0f;
+    float meanError = 0.0f;
+    float bakeMs = 0.0f;
+    float referenceMs = 0.0f;
+};
+
 // Calculates the prefiltered env map based on the GGX microfacet model. The map
 // contains multiple mip level, which each mip level representing a different
 // material roughness (mip0 -> roughness 0).
-class GGXPrefilteredEnvMapCalculator : public UniformSource, public TextureSource {
+//
+// Every mip is baked by a compute shader writing straight into it, one
+// dispatch per mip for all six faces. Each sample reads the source mip that
+// matches the solid angle it stands for, judged from the GGX PDF, so a few
+// dozen samples per texel come out smooth. Glossy reflections don't need much
+// detail, so the top mip is capped in size.
+class GGXPrefilteredEnvMapCalculator : public VersionedUniformSource, public TextureSource {
 public:
-    GGXPrefilteredEnvMapCalculator(int t_width, int t_height, int t_maxNumMips = -1);
-    explicit GGXPrefilteredEnvMapCalculator(ImageSize t_size, int t_maxNumMips = -1) :
-        GGXPrefilteredEnvMapCalculator(t_size.width, t_size.height, t_maxNumMips) {
+    static constexpr int DEFAULT_MAX_SIZE = 256;
+
+    // The map is as large as the given size, up to t_maxSize per side.
+    GGXPrefilteredEnvMapCalculator(int t_width, int t_height, int t_maxNumMips = -1,
+                                   int t_maxSize = DEFAULT_MAX_SIZE);
+    explicit GGXPrefilteredEnvMapCalculator(ImageSize t_size, int t_maxNumMips = -1,
+                                            int t_maxSize = DEFAULT_MAX_SIZE) :
+        GGXPrefilteredEnvMapCalculator(t_size.width, t_size.height, t_maxNumMips, t_maxSize) {
     }
 
     ~GGXPrefilteredEnvMapCalculator() override = default;
 
     [[nodiscard]] unsigned int getNumSamples() const {
-        return m_shader.getNumSamples();
+        return m_numSamples;
     }
     void setNumSamples(const unsigned int t_samples) {
-        m_shader.setNumSamples(t_samples);
+        m_numSamples = t_samples;
     }
 
     // Draw onto the allocated prefiltering cubemap from the given cubemap as the
-    // source. The cubemap should ideally have mip levels in order to avoid
-    // hotspot artifacts.
-    void multipassDraw(Texture t_source);
+    // source. The cubemap must have mip levels for the samples to read from.
+    void draw(Texture t_source);
+    // Bakes the source again with the fragment shader at its full sample
+    // count, and compares the result with a fresh draw(). Waits for the GPU,
+    // so is only meant for checking the compute bake.
+    GGXPrefilterParity checkParity(Texture t_source);
 
     Texture getPrefilteredEnvMap() {
-        return m_cubemap.asTexture();
+        return m_cubemap;
     }
 
     void updateUniforms(Shader& t_shader) override;
     unsigned int bindTexture(unsigned int t_nextTextureUnit, Shader& shader) override;
 
 private:
-    Framebuffer m_buffer;
-    Attachment m_cubemap;
-    GGXPrefilterShader m_shader;
-    CubemapRenderHelper m_cubemapRenderHelper;
+    int m_size;
+    unsigned int m_numSamples = 64;
+    Texture m_cubemap;
+    ComputeShader m_shader;
+
+    // The fragment shader bake, only created for checkParity().
+    std::unique_ptr<Framebuffer> m_referenceBuffer;
+    Attachment m_referenceCubemap;
+    std::unique_ptr<GGXPrefilterShader> m_referenceShader;
 };
 
 class GGXBrdfIntegrationShader : public ScreenShader {
@@ -64,6 +64,7 @@ void SsaoKernel::regenerate(int kernelSize, int noiseTextureSideLength) {
   noiseTexture_ =
       Texture::createFromData(noiseTextureSideLength, noiseTextureSideLength,
                               /*internalFormat=*/GL_RGB16F, noiseData, params);
+  markUniformsChanged();
 }
 
 void SsaoKernel::updateUniforms(Shader& shader) {
@@ -19,16 +19,24 @@ class SsaoShader : public Shader {
 
 // A sample kernel for use in screen space ambient occlusion. Uses a hemisphere
 // sampling method and a noise texture.
-class SsaoKernel : public UniformSource, public TextureSource {
+class SsaoKernel : public VersionedUniformSource, public TextureSource {
  public:
   SsaoKernel(float t_radius = 0.5, float t_bias = 0.025, int t_kernelSize = 64,
              int t_noiseTextureSideLength = 4);
   int getSize() const { return m_kernel.size(); }
   int getNoiseTextureSideLength() const { return noiseTexture_.getWidth(); }
   float getRadius() const { return m_radius; }
-  void setRadius(float radius) { m_radius = radius; }
+  void setRadius(float radius) {
+    if (m_radius == radius) return;
+    m_radius = radius;
+    markUniformsChanged();
+  }
   float getBias() const { return m_bias; }
-  void setBias(float bias) { m_bias = bias; }
+  void setBias(float bias) {
+    if (m_bias == bias) return;
+    m_bias = bias;
+    markUniformsChanged();
+  }
 
   // Binds kernel uniforms.
   void updateUniforms(Shader& shader) override;
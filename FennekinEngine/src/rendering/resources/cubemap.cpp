@@ -1,27 +1,35 @@
 #include "cubemap.hpp"
 
-void CubemapRenderHelper::multipassDraw(Shader& shader,
-                                        TextureRegistry* textureRegistry) {
-  // Set projection to a 90-degree, 1:1 aspect ratio in order to render a single
-  // face of the cube.
-  shader.setMat4("projection", glm::perspective(glm::radians(90.0f),
-                                                /*aspect=*/1.0f, 0.1f, 10.0f));
+#include <string>
+
+// Renders the faces with a 90-degree, 1:1 aspect ratio projection, so that each
+// covers a single face of the cube.
+static glm::mat4 getFaceProjection() {
+  return glm::perspective(glm::radians(90.0f), /*aspect=*/1.0f, 0.1f, 10.0f);
+}
 
+std::array<glm::mat4, 6> getCubemapFaceViews(const glm::vec3& t_eye) {
   // TODO: Why are the up vectors negative?
-  glm::mat4 faceViews[] = {
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(/*eye=*/glm::vec3(0.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))};
+  return {
+      glm::lookAt(t_eye, t_eye + glm::vec3(1.0f, 0.0f, 0.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(t_eye, t_eye + glm::vec3(-1.0f, 0.0f, 0.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(t_eye, t_eye + glm::vec3(0.0f, 1.0f, 0.0f),
+                  glm::vec3(0.0f, 0.0f, 1.0f)),
+      glm::lookAt(t_eye, t_eye + glm::vec3(0.0f, -1.0f, 0.0f),
+                  glm::vec3(0.0f, 0.0f, -1.0f)),
+      glm::lookAt(t_eye, t_eye + glm::vec3(0.0f, 0.0f, 1.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(t_eye, t_eye + glm::vec3(0.0f, 0.0f, -1.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f))};
+}
+
+void CubemapRenderHelper::multipassDraw(Shader& shader,
+                                        TextureRegistry* textureRegistry) {
+  shader.setMat4("projection", getFaceProjection());
 
+  const std::array<glm::mat4, 6> faceViews = getCubemapFaceViews();
   for (int cubemapFace = 0; cubemapFace < 6; ++cubemapFace) {
     buffer_->activate(targetMip_, cubemapFace);
     buffer_->clear();
@@ -33,9 +41,27 @@ void CubemapRenderHelper::multipassDraw(Shader& shader,
   buffer_->deactivate();
 }
 
+void CubemapRenderHelper::layeredDraw(Shader& shader,
+                                      TextureRegistry* textureRegistry) {
+  const glm::mat4 projection = getFaceProjection();
+  const std::array<glm::mat4, 6> faceViews = getCubemapFaceViews();
+  for (int cubemapFace = 0; cubemapFace < 6; ++cubemapFace) {
+    shader.setMat4(
+        "faceViewProjections[" + std::to_string(cubemapFace) + "]",
+        projection * faceViews[cubemapFace]);
+  }
+
+  // Clearing a layered attachment clears every face.
+  buffer_->activate(targetMip_, Framebuffer::ALL_CUBEMAP_FACES);
+  buffer_->clear();
+  room_.draw(shader, textureRegistry);
+  buffer_->deactivate();
+}
+
 EquirectCubemapShader::EquirectCubemapShader()
-    : Shader(ShaderPath("content/shaders/builtin/cubemap.vert"),
-             ShaderPath("content/shaders/builtin/equirect_cubemap.frag")) {}
+    : Shader(ShaderPath("content/shaders/builtin/cubemap_layered.vert"),
+             ShaderPath("content/shaders/builtin/equirect_cubemap.frag"),
+             ShaderPath("content/shaders/builtin/cubemap_layered.geom")) {}
 
 EquirectCubemapConverter::EquirectCubemapConverter(int width, int height,
                                                    bool generateMips)
@@ -53,12 +79,12 @@ EquirectCubemapConverter::EquirectCubemapConverter(int width, int height,
   m_cubemap = m_buffer.attachTexture(EBufferType::COLOR_CUBEMAP_HDR, params);
 }
 
-void EquirectCubemapConverter::multipassDraw(Texture t_source) {
+void EquirectCubemapConverter::draw(Texture t_source) {
   // Set up the source.
   t_source.bindToUnit(0, ETextureBindType::TEXTURE_2D);
   m_equirectCubemapShader.setInt("fnk_equirectMap", 0);
 
-  m_cubemapRenderHelper.multipassDraw(m_equirectCubemapShader);
+  m_cubemapRenderHelper.layeredDraw(m_equirectCubemapShader);
 
   if (m_generateMips) {
     // Generate mips after having rendered to the cubemap.
@@ -7,6 +7,15 @@
 
 #include "scene/mesh_primitives.hpp"
 
+#include <array>
+#include <glm/glm.hpp>
+
+// The views from t_eye through each face of a cubemap, in the order of the
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X, etc. faces. Each needs a 90-degree, 1:1
+// projection to cover its face exactly.
+std::array<glm::mat4, 6> getCubemapFaceViews(
+    const glm::vec3& t_eye = glm::vec3(0.0f));
+
 // A helper for rendering to a cubemap texture in a framebuffer. The passed-in
 // framebuffer must outlive the life of this helper.
 class CubemapRenderHelper {
@@ -17,9 +26,15 @@ class CubemapRenderHelper {
 
   // Draws with the given shader to each face of the cubemap. This results in 6
   // different draw calls. Shader should be prepared (i.e. necessary textures
-  // should either be bound or be in the registry, uniforms should be set, etc).
+  // should either be bound or be in the registry, uniforms should be set, etc)
+  // and use builtin/cubemap.vert.
   void multipassDraw(Shader& shader,
                      TextureRegistry* textureRegistry = nullptr);
+  // Draws with the given shader to all faces of the cubemap in a single draw
+  // call, with the cubemap attached layered. Shader should be prepared as for
+  // multipassDraw(), but use builtin/cubemap_layered.vert and
+  // builtin/cubemap_layered.geom, which sends each triangle to every face.
+  void layeredDraw(Shader& shader, TextureRegistry* textureRegistry = nullptr);
 
  private:
   Framebuffer* buffer_;
@@ -42,7 +57,7 @@ class EquirectCubemapConverter final : public TextureSource {
   ~EquirectCubemapConverter() override = default;
 
   // Draw onto the allocated cubemap from the given texture as the source.
-  void multipassDraw(Texture t_source);
+  void draw(Texture t_source);
 
   Texture getCubemap() { return m_cubemap.asTexture(); }
 
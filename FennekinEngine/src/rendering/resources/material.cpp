@@ -0,0 +1,136 @@
+#include "material.hpp"
+#include "rendering/core/gl_state.hpp"
+
+uint64_t Material::s_nextId = 1;
+std::unordered_map<unsigned int, Material::AppliedMaterial>
+    Material::s_appliedMaterials;
+
+static const char* const COUNT_UNIFORM_NAMES[] = {
+    "material.diffuseCount",   "material.specularCount",
+    "material.roughnessCount", "material.metallicCount",
+    "material.aoCount",        "material.emissionCount",
+    "material.hasNormalMap",
+};
+
+Material::Material(const std::vector<TextureMap>& t_textureMaps)
+    : m_id(s_nextId++) {
+  for (const TextureMap& textureMap : t_textureMaps) {
+    const ETextureMapType type = textureMap.getType();
+
+    Entry entry = {.target = GL_TEXTURE_2D,
+                   .textureId = textureMap.getTexture().getId(),
+                   .samplerName = {},
+                   .packedName = {},
+                   .packed = textureMap.isPacked()};
+    // TODO: Make this more configurable / less generic?
+    switch (type) {
+      case ETextureMapType::DIFFUSE:
+        entry.samplerName = "material.diffuseMaps[" +
+                            std::to_string(m_counts[COUNT_DIFFUSE]++) + "]";
+        break;
+      case ETextureMapType::SPECULAR:
+        entry.samplerName = "material.specularMaps[" +
+                            std::to_string(m_counts[COUNT_SPECULAR]++) + "]";
+        break;
+      case ETextureMapType::ROUGHNESS: {
+        const std::string idx = std::to_string(m_counts[COUNT_ROUGHNESS]++);
+        entry.samplerName = "material.roughnessMaps[" + idx + "]";
+        entry.packedName = "material.roughnessIsPacked[" + idx + "]";
+      } break;
+      case ETextureMapType::METALLIC: {
+        const std::string idx = std::to_string(m_counts[COUNT_METALLIC]++);
+        entry.samplerName = "material.metallicMaps[" + idx + "]";
+        entry.packedName = "material.metallicIsPacked[" + idx + "]";
+      } break;
+      case ETextureMapType::AO: {
+        const std::string idx = std::to_string(m_counts[COUNT_AO]++);
+        entry.samplerName = "material.aoMaps[" + idx + "]";
+        entry.packedName = "material.aoIsPacked[" + idx + "]";
+      } break;
+      case ETextureMapType::EMISSION:
+        entry.samplerName = "material.emissionMaps[" +
+                            std::to_string(m_counts[COUNT_EMISSION]++) + "]";
+        break;
+      case ETextureMapType::NORMAL:
+        // Only a single normal map supported.
+        entry.samplerName = "material.normalMap";
+        m_counts[HAS_NORMAL_MAP] = 1;
+        break;
+      case ETextureMapType::CUBEMAP:
+        entry.target = GL_TEXTURE_CUBE_MAP;
+        entry.samplerName = "skybox";
+        break;
+    }
+    m_targets.push_back(entry.target);
+    m_textureIds.push_back(entry.textureId);
+    m_entries.push_back(std::move(entry));
+  }
+}
+
+const Material::ShaderBindings& Material::getShaderBindings(
+    const Shader& t_shader) {
+  const unsigned int program = t_shader.getProgramId();
+  auto it = m_shaderBindings.find(program);
+  if (it != m_shaderBindings.end()) {
+    return it->second;
+  }
+
+  // First use with this program; resolve all locations up front.
+  ShaderBindings bindings;
+  for (const Entry& entry : m_entries) {
+    bindings.samplerLocations.push_back(
+        glGetUniformLocation(program, entry.samplerName.c_str()));
+    bindings.packedLocations.push_back(
+        entry.packedName.empty()
+            ? -1
+            : glGetUniformLocation(program, entry.packedName.c_str()));
+  }
+  for (int i = 0; i < NUM_COUNT_UNIFORMS; ++i) {
+    bindings.countLocations[i] =
+        glGetUniformLocation(program, COUNT_UNIFORM_NAMES[i]);
+  }
+  return m_shaderBindings.emplace(program, std::move(bindings)).first->second;
+}
+
+void Material::bind(Shader& t_shader, TextureRegistry* t_textureRegistry) {
+  // If a TextureRegistry isn't provided, just start with texture unit 0.
+  unsigned int firstUnit = 0;
+  if (t_textureRegistry != nullptr) {
+    t_textureRegistry->pushUsageBlock();
+    firstUnit = t_textureRegistry->getNextTextureUnit();
+    t_textureRegistry->popUsageBlock();
+  }
+
+  if (!m_entries.empty()) {
+    GlState::bindTextures(firstUnit, static_cast<int>(m_entries.size()),
+                          m_targets.data(), m_textureIds.data());
+  }
+
+  // Uniform values are per program, so if it was last set up for this same
+  // material and units there's nothing left to do.
+  const unsigned int program = t_shader.getProgramId();
+  auto applied = s_appliedMaterials.find(program);
+  if (applied != s_appliedMaterials.end() &&
+      applied->second.materialId == m_id &&
+      applied->second.firstUnit == firstUnit) {
+    return;
+  }
+  s_appliedMaterials[program] = {.materialId = m_id, .firstUnit = firstUnit};
+
+  const ShaderBindings& bindings = getShaderBindings(t_shader);
+  for (size_t i = 0; i < m_entries.size(); ++i) {
+    if (bindings.samplerLocations[i] != -1) {
+      glProgramUniform1i(program, bindings.samplerLocations[i],
+                         static_cast<int>(firstUnit + i));
+    }
+    if (bindings.packedLocations[i] != -1) {
+      glProgramUniform1i(program, bindings.packedLocations[i],
+                         m_entries[i].packed);
+    }
+  }
+  for (int i = 0; i < NUM_COUNT_UNIFORMS; ++i) {
+    if (bindings.countLocations[i] != -1) {
+      glProgramUniform1i(program, bindings.countLocations[i], m_counts[i]);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <gl/glew.h>
+#include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/shader.hpp"
+#include "rendering/resources/texture_map.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// The set of texture maps used by a mesh, flattened into a binding table when
+// the mesh is loaded. Binding a material to a shader is then a single
+// glBindTextures call plus a few uniform writes with cached locations, which
+// are skipped entirely when the program was last set up for the same material.
+//
+// Maps are bound to contiguous texture units in order, and assigned to the
+// `material.*` samplers of FnkMaterial (or `skybox` for cubemaps).
+class Material {
+ public:
+  Material() = default;
+  explicit Material(const std::vector<TextureMap>& t_textureMaps);
+
+  // Binds the material's textures to the next texture units available in the
+  // registry (or starting from unit 0 if none is given), and points the
+  // shader's samplers at them.
+  void bind(Shader& t_shader, TextureRegistry* t_textureRegistry = nullptr);
+
+  [[nodiscard]] bool empty() const { return m_entries.empty(); }
+  // A unique ID per material, used to group draws.
+  [[nodiscard]] uint64_t getId() const { return m_id; }
+
+ private:
+  // The per-type counts written to `material.<type>Count`, plus hasNormalMap.
+  enum ECountUniform {
+    COUNT_DIFFUSE = 0,
+    COUNT_SPECULAR,
+    COUNT_ROUGHNESS,
+    COUNT_METALLIC,
+    COUNT_AO,
+    COUNT_EMISSION,
+    HAS_NORMAL_MAP,
+    NUM_COUNT_UNIFORMS,
+  };
+
+  struct Entry {
+    GLenum target;
+    unsigned int textureId;
+    // The sampler this map is assigned to, e.g. "material.diffuseMaps[0]".
+    std::string samplerName;
+    // The matching "...IsPacked[n]" uniform, or empty if the type has none.
+    std::string packedName;
+    bool packed;
+  };
+
+  // Uniform locations resolved for a single program.
+  struct ShaderBindings {
+    std::vector<int> samplerLocations;
+    std::vector<int> packedLocations;
+    std::array<int, NUM_COUNT_UNIFORMS> countLocations;
+  };
+
+  // What a program's material uniforms were last set to.
+  struct AppliedMaterial {
+    uint64_t materialId;
+    unsigned int firstUnit;
+  };
+
+  const ShaderBindings& getShaderBindings(const Shader& t_shader);
+
+  uint64_t m_id = 0;
+  std::vector<Entry> m_entries;
+  std::vector<GLenum> m_targets;
+  std::vector<unsigned int> m_textureIds;
+  std::array<int, NUM_COUNT_UNIFORMS> m_counts = {};
+  std::unordered_map<unsigned int, ShaderBindings> m_shaderBindings;
+
+  static uint64_t s_nextId;
+  static std::unordered_map<unsigned int, AppliedMaterial> s_appliedMaterials;
+};
@@ -1,5 +1,6 @@
 #include "core/core.hpp"
 #include "shader.hpp"
+#include "rendering/core/gl_state.hpp"
 #include "rendering/resources/loaders/shader_compiler.hpp"
 #include "rendering/resources/loaders/shader_loader.hpp"
 
@@ -34,58 +35,69 @@ int Shader::safeGetUniformLocation(const char* name) const {
   return uniform;
 }
 
-void Shader::activate() { glUseProgram(shaderProgram); }
-void Shader::deactivate() { glUseProgram(0); }
+void Shader::activate() {
+  GlState::setDepthFunc(depthFunc);
+  GlState::useProgram(shaderProgram);
+}
+void Shader::deactivate() { GlState::useProgram(0); }
 
 // TODO: Is shared_ptr really the best approach here?
 void Shader::addUniformSource(std::shared_ptr<UniformSource> source) {
   uniformSources.push_back(source);
+  consumedUniformVersions.push_back(UniformSource::UNVERSIONED);
 }
 
 void Shader::updateUniforms() {
-  // Update core uniforms.
-  setFloat("fnk_time", Fnk::time());
-
-  for (const auto& uniformSource : uniformSources) {
-    uniformSource->updateUniforms(*this);
+  // Core per-frame uniforms (fnk_time etc.) are provided by the uniform blocks
+  // in core.glsl and don't need to be set per shader.
+  for (size_t i = 0; i < uniformSources.size(); ++i) {
+    const unsigned long long version = uniformSources[i]->getUniformVersion();
+    if (version != UniformSource::UNVERSIONED &&
+        version == consumedUniformVersions[i]) {
+      // Uniform values are per program, so they're still set from last time.
+      continue;
+    }
+    uniformSources[i]->updateUniforms(*this);
+    consumedUniformVersions[i] = version;
   }
 }
 
 void Shader::setBool(const char* name, bool value) {
-  activate();
-  glUniform1i(safeGetUniformLocation(name), static_cast<int>(value));
+  glProgramUniform1i(shaderProgram, safeGetUniformLocation(name),
+                     static_cast<int>(value));
 }
 
 void Shader::setUInt(const char* name, unsigned int value) {
-  activate();
-  glUniform1ui(safeGetUniformLocation(name), value);
+  glProgramUniform1ui(shaderProgram, safeGetUniformLocation(name), value);
 }
 
 void Shader::setInt(const char* name, int value) {
-  activate();
-  glUniform1i(safeGetUniformLocation(name), value);
+  glProgramUniform1i(shaderProgram, safeGetUniformLocation(name), value);
 }
 
 void Shader::setFloat(const char* name, float value) {
-  activate();
-  glUniform1f(safeGetUniformLocation(name), value);
+  glProgramUniform1f(shaderProgram, safeGetUniformLocation(name), value);
 }
 
 void Shader::setVec3(const char* name, const glm::vec3& vector) {
-  activate();
-  glUniform3fv(safeGetUniformLocation(name), /*count=*/1,
-               glm::value_ptr(vector));
+  glProgramUniform3fv(shaderProgram, safeGetUniformLocation(name),
+                      /*count=*/1, glm::value_ptr(vector));
 }
 
 void Shader::setVec3(const char* name, float v0, float v1, float v2) {
-  activate();
-  glUniform3f(safeGetUniformLocation(name), v0, v1, v2);
+  glProgramUniform3f(shaderProgram, safeGetUniformLocation(name), v0, v1,
+                     v2);
+}
+
+void Shader::setVec4(const char* name, const glm::vec4& vector) {
+  glProgramUniform4fv(shaderProgram, safeGetUniformLocation(name),
+                      /*count=*/1, glm::value_ptr(vector));
 }
 
 void Shader::setMat4(const char* name, const glm::mat4& matrix) {
-  activate();
-  glUniformMatrix4fv(safeGetUniformLocation(name), /*count=*/1,
-                     /*transpose=*/GL_FALSE, glm::value_ptr(matrix));
+  glProgramUniformMatrix4fv(shaderProgram, safeGetUniformLocation(name),
+                            /*count=*/1, /*transpose=*/GL_FALSE,
+                            glm::value_ptr(matrix));
 }
 
 ComputeShader::ComputeShader(const ShaderSource& computeSource) {
@@ -102,3 +114,19 @@ void ComputeShader::dispatchToTexture(Texture& texture) {
   // Guard until writing is complete.
   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
+
+void ComputeShader::dispatch(unsigned int groupsX, unsigned int groupsY,
+                             unsigned int groupsZ, GLbitfield barriers) {
+  if (!groupsX || !groupsY || !groupsZ) {
+    return;
+  }
+  activate();
+  glDispatchCompute(groupsX, groupsY, groupsZ);
+  glMemoryBarrier(barriers);
+}
+
+void ComputeShader::dispatchForItems(unsigned int numItems,
+                                     unsigned int localSize,
+                                     GLbitfield barriers) {
+  dispatch((numItems + localSize - 1) / localSize, 1, 1, barriers);
+}
@@ -19,8 +19,32 @@ class Shader;
 // than the shader collecting UniformSources directly.
 class UniformSource {
  public:
+    static constexpr unsigned long long UNVERSIONED = 0;
+
     virtual ~UniformSource() = default;
     virtual void updateUniforms(Shader& shader) = 0;
+
+    // Returns a counter that changes whenever the values this source sets
+    // change. Each shader remembers the last version it consumed and skips the
+    // source until it changes again. Sources that touch global GL state (such
+    // as texture units) must run on every update and return UNVERSIONED.
+    virtual unsigned long long getUniformVersion() const { return UNVERSIONED; }
+};
+
+// A uniform source that is only re-applied to a shader after it calls
+// markUniformsChanged().
+class VersionedUniformSource : public UniformSource {
+ public:
+    unsigned long long getUniformVersion() const override {
+      return m_uniformVersion;
+    }
+
+ protected:
+    void markUniformsChanged() { ++m_uniformVersion; }
+
+ private:
+    // Starts above UNVERSIONED so that every shader consumes it once.
+    unsigned long long m_uniformVersion = UNVERSIONED + 1;
 };
 
 class Shader {
@@ -32,13 +56,19 @@ class Shader {
 
   unsigned int getProgramId() const { return shaderProgram; }
 
+  // Makes this the current program, along with any fixed-function state it
+  // expects. Both go through the GL state cache, so redundant calls are cheap.
   virtual void activate();
   virtual void deactivate();
 
+  // The depth comparison used while this program is active.
+  void setDepthFunc(GLenum func) { depthFunc = func; }
+
   void addUniformSource(std::shared_ptr<UniformSource> source);
   void updateUniforms();
 
-  // Functions for uniforms.
+  // Functions for uniforms. These write straight to the program object, so
+  // they don't need the program to be bound.
 
   virtual void setBool(const char* name, bool value);
   void setBool(std::string name, bool value) { setBool(name.c_str(), value); }
@@ -60,6 +90,10 @@ class Shader {
   void setVec3(std::string name, float v0, float v1, float v2) {
     setVec3(name.c_str(), v0, v1, v2);
   }
+  virtual void setVec4(const char* name, const glm::vec4& vector);
+  void setVec4(std::string name, const glm::vec4& vector) {
+    setVec4(name.c_str(), vector);
+  }
   virtual void setMat4(const char* name, const glm::mat4& matrix);
   void setMat4(std::string name, const glm::mat4& matrix) {
     setMat4(name.c_str(), matrix);
@@ -70,7 +104,10 @@ class Shader {
   int safeGetUniformLocation(const char* name) const;
 
   unsigned int shaderProgram;
+  GLenum depthFunc = GL_LESS;
   std::vector<std::shared_ptr<UniformSource>> uniformSources;
+  // The last version of each uniform source consumed by this program.
+  std::vector<unsigned long long> consumedUniformVersions;
 };
 
 class ComputeShader : public Shader {
@@ -82,4 +119,15 @@ class ComputeShader : public Shader {
   // texture. Assumes that the texture has already been bound to the correct
   // texture unit.
   void dispatchToTexture(Texture& texture);
+  // Dispatches the given number of work groups, for shaders that work on
+  // storage buffers, then waits for the writes covered by `barriers` to become
+  // visible. The default covers later shader storage reads; add
+  // GL_COMMAND_BARRIER_BIT when the results are used as indirect commands.
+  void dispatch(unsigned int groupsX, unsigned int groupsY = 1,
+                unsigned int groupsZ = 1,
+                GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT);
+  // Like dispatch(), but with enough work groups of `localSize` invocations to
+  // cover `numItems`. `localSize` must match the shader's local_size_x.
+  void dispatchForItems(unsigned int numItems, unsigned int localSize,
+                        GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT);
 };
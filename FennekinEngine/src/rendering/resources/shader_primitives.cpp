@@ -1,35 +1,14 @@
 #include <gl/glew.h>
 #include "shader_primitives.hpp"
 
-#include <cstring>
-
 
 SkyboxShader::SkyboxShader()
     : Shader(ShaderPath("content/shaders/builtin/skybox.vert"),
-             ShaderPath("content/shaders/builtin/skybox.frag")) {}
-
-void SkyboxShader::activate() {
+             ShaderPath("content/shaders/builtin/skybox.frag")) {
   // The shader always outputs a depth of 1.0 (the max depth) for skybox
   // fragments, so we have to switch the depth function to LEQUAL in order for
   // them to render at all.
-  glDepthFunc(GL_LEQUAL);
-  Shader::activate();
-}
-
-void SkyboxShader::deactivate() {
-  Shader::deactivate();
-  glDepthFunc(GL_LESS);
-}
-
-void SkyboxShader::setMat4(const char* name, const glm::mat4& matrix) {
-  // Special case the "view" transform.
-  if (strcmp(name, "view") == 0) {
-    // We drop the translation (by just converting to a mat3 and then back)
-    // since the skybox needs to always follow the camera.
-    Shader::setMat4(name, glm::mat4(glm::mat3(matrix)));
-    return;
-  }
-  Shader::setMat4(name, matrix);
+  setDepthFunc(GL_LEQUAL);
 }
 
 ScreenShader::ScreenShader()
@@ -46,5 +25,6 @@ ScreenLodShader::ScreenLodShader()
 
 ShadowMapShader::ShadowMapShader()
     : Shader(ShaderPath("content/shaders/builtin/shadow_map.vert"),
-             ShaderPath("content/shaders/builtin/shadow_map.frag")) {}
+             ShaderPath("content/shaders/builtin/shadow_map.frag"),
+             ShaderPath("content/shaders/builtin/shadow_map.geom")) {}
 
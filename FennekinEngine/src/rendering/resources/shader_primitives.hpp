@@ -10,11 +10,6 @@
 class SkyboxShader : public Shader {
  public:
   SkyboxShader();
-
-  virtual void activate() override;
-  virtual void deactivate() override;
-
-  virtual void setMat4(const char* name, const glm::mat4& matrix) override;
 };
 
 class ScreenShader : public Shader {
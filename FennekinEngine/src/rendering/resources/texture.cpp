@@ -1,5 +1,6 @@
 #include <gl/glew.h>
 #include "texture.hpp"
+#include "rendering/core/gl_state.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image/stb_image.h>
 
@@ -69,7 +70,7 @@ Texture Texture::load(const char* t_path, bool t_isSrgb,
   }
 
   glGenTextures(1, &texture.m_id);
-  glBindTexture(GL_TEXTURE_2D, texture.m_id);
+  GlState::bindTexture(GL_TEXTURE_2D, texture.m_id);
 
   // TODO: Replace with glTexStorage2D
   glTexImage2D(GL_TEXTURE_2D, /* mipmap level */ 0, texture.m_internalFormat,
@@ -134,7 +135,7 @@ Texture Texture::loadHdr(const char* t_path, const TextureParams& t_params) {
   }
 
   glGenTextures(1, &texture.m_id);
-  glBindTexture(GL_TEXTURE_2D, texture.m_id);
+  GlState::bindTexture(GL_TEXTURE_2D, texture.m_id);
 
   // TODO: Replace with glTexStorage2D
   glTexImage2D(GL_TEXTURE_2D, /*mip=*/0, texture.m_internalFormat,
@@ -169,7 +170,7 @@ Texture Texture::loadCubemap(std::vector<std::string> t_faces,
   texture.m_internalFormat = GL_RGB8;  // Cubemaps must be RGB.
 
   glGenTextures(1, &texture.m_id);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture.m_id);
+  GlState::bindTexture(GL_TEXTURE_CUBE_MAP, texture.m_id);
 
   int width, height, numChannels;
   bool initialized = false;
@@ -242,7 +243,7 @@ Texture Texture::create(int t_width, int t_height, GLenum t_internalFormat,
   texture.m_internalFormat = t_internalFormat;
 
   glGenTextures(1, &texture.m_id);
-  glBindTexture(GL_TEXTURE_2D, texture.m_id);
+  GlState::bindTexture(GL_TEXTURE_2D, texture.m_id);
 
   glTexStorage2D(GL_TEXTURE_2D, texture.m_numMips, texture.m_internalFormat,
                  texture.m_width, texture.m_height);
@@ -276,7 +277,7 @@ Texture Texture::createCubemap(int t_size, GLenum t_internalFormat,
   texture.m_internalFormat = t_internalFormat;
 
   glGenTextures(1, &texture.m_id);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture.m_id);
+  GlState::bindTexture(GL_TEXTURE_CUBE_MAP, texture.m_id);
 
   glTexStorage2D(GL_TEXTURE_CUBE_MAP, texture.m_numMips, texture.m_internalFormat,
                  texture.m_width, texture.m_height);
@@ -310,18 +311,19 @@ Texture Texture::createFromData(int t_width, int t_height, GLenum t_internalForm
 
 void Texture::bindToUnit(unsigned int t_textureUnit, ETextureBindType t_bindType) {
   // TODO: Take into account GL_MAX_TEXTURE_UNITS here.
-  glActiveTexture(GL_TEXTURE0 + t_textureUnit);
-
   if (t_bindType == ETextureBindType::BY_TEXTURE_TYPE) {
     t_bindType = textureTypeToTextureBindType(m_type);
   }
 
   switch (t_bindType) {
     case ETextureBindType::TEXTURE_2D:
-      glBindTexture(GL_TEXTURE_2D, m_id);
+      GlState::bindTextureUnit(t_textureUnit, GL_TEXTURE_2D, m_id);
       break;
     case ETextureBindType::CUBEMAP:
-      glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+      GlState::bindTextureUnit(t_textureUnit, GL_TEXTURE_CUBE_MAP, m_id);
+      break;
+    case ETextureBindType::TEXTURE_2D_ARRAY:
+      GlState::bindTextureUnit(t_textureUnit, GL_TEXTURE_2D_ARRAY, m_id);
       break;
     case ETextureBindType::IMAGE_TEXTURE:
       // Bind image unit.
@@ -336,7 +338,7 @@ void Texture::bindToUnit(unsigned int t_textureUnit, ETextureBindType t_bindType
 
 void Texture::setSamplerMipRange(int t_min, int t_max) {
   GLenum target = textureTypeToGlTarget(m_type);
-  glBindTexture(target, m_id);
+  GlState::bindTexture(target, m_id);
   glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, t_min);
   glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, t_max);
 }
@@ -346,7 +348,10 @@ void Texture::unsetSamplerMipRange() {
   setSamplerMipRange(0, 1000);
 }
 
-void Texture::free() { glDeleteTextures(1, &m_id); }
+void Texture::free() {
+  GlState::forgetTexture(m_id);
+  glDeleteTextures(1, &m_id);
+}
 
 void Texture::generateMips(int t_maxNumMips) {
   if (t_maxNumMips >= 0) {
@@ -354,7 +359,7 @@ void Texture::generateMips(int t_maxNumMips) {
   }
 
   GLenum target = textureTypeToGlTarget(m_type);
-  glBindTexture(target, m_id);
+  GlState::bindTexture(target, m_id);
   glGenerateMipmap(target);
 
   if (t_maxNumMips >= 0) {
@@ -14,6 +14,8 @@
 enum class ETextureType {
     TEXTURE_2D = 0,
     CUBEMAP,
+    // A stack of same sized 2D layers, e.g. shadow cascades.
+    TEXTURE_2D_ARRAY,
 };
 
 inline GLenum textureTypeToGlTarget(const ETextureType t_type) {
@@ -22,6 +24,8 @@ inline GLenum textureTypeToGlTarget(const ETextureType t_type) {
         return GL_TEXTURE_2D;
     case ETextureType::CUBEMAP:
         return GL_TEXTURE_CUBE_MAP;
+    case ETextureType::TEXTURE_2D_ARRAY:
+        return GL_TEXTURE_2D_ARRAY;
     }
     LOG_CRITICAL("Invalid Texture Type");
 }
@@ -34,6 +38,8 @@ enum class ETextureBindType {
     TEXTURE_2D,
     // A cubemap.
     CUBEMAP,
+    // A TEXTURE_2D_ARRAY.
+    TEXTURE_2D_ARRAY,
     // An image texture that is directly indexed, rather than sampled.
     IMAGE_TEXTURE,
 };
@@ -44,6 +50,8 @@ inline ETextureBindType textureTypeToTextureBindType(ETextureType type) {
         return ETextureBindType::TEXTURE_2D;
     case ETextureType::CUBEMAP:
         return ETextureBindType::CUBEMAP;
+    case ETextureType::TEXTURE_2D_ARRAY:
+        return ETextureBindType::TEXTURE_2D_ARRAY;
     }
     LOG_CRITICAL("Invalid Texture Type");
 }
@@ -66,6 +66,7 @@ class TextureMap {
       : m_texture(std::move(texture)), m_type(type), m_packed(isPacked) {}
 
   Texture& getTexture() { return m_texture; }
+  [[nodiscard]] const Texture& getTexture() const { return m_texture; }
   [[nodiscard]] ETextureMapType getType() const { return m_type; }
   [[nodiscard]] bool isPacked() const { return m_packed; }
   void setPacked(bool packed) { m_packed = packed; }
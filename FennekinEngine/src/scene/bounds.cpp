@@ -0,0 +1,34 @@
+#include "bounds.hpp"
+
+Aabb Aabb::transformed(const glm::mat4& t_transform) const {
+  if (isEmpty()) {
+    return *this;
+  }
+  // Transform the center, and project the extents onto the new axes.
+  const glm::vec3 center(t_transform * glm::vec4(getCenter(), 1.0f));
+  const glm::mat3 absLinear(glm::abs(glm::vec3(t_transform[0])),
+                            glm::abs(glm::vec3(t_transform[1])),
+                            glm::abs(glm::vec3(t_transform[2])));
+  const glm::vec3 extents = absLinear * getExtents();
+  return {.min = center - extents, .max = center + extents};
+}
+
+Frustum Frustum::fromViewProjection(const glm::mat4& t_viewProjection) {
+  // Gribb-Hartmann: each plane is the last row of the matrix plus or minus
+  // one of the others. GLM matrices are column-major, so gather the rows.
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = glm::vec4(t_viewProjection[0][i], t_viewProjection[1][i],
+                        t_viewProjection[2][i], t_viewProjection[3][i]);
+  }
+
+  Frustum frustum;
+  frustum.planes = {
+      rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+      rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2],
+  };
+  for (glm::vec4& plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include <limits>
+
+// An axis-aligned bounding box. A default constructed box is empty.
+struct Aabb {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  [[nodiscard]] bool isEmpty() const { return min.x > max.x; }
+  [[nodiscard]] glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+  [[nodiscard]] glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+  void expand(const glm::vec3& t_point) {
+    min = glm::min(min, t_point);
+    max = glm::max(max, t_point);
+  }
+
+  // Returns the smallest axis-aligned box enclosing this box after the given
+  // affine transform. Empty boxes stay empty.
+  [[nodiscard]] Aabb transformed(const glm::mat4& t_transform) const;
+};
+
+// The six planes of a view frustum, in the order left, right, bottom, top,
+// near, far. Each plane is stored as (normal, distance) with the normal
+// pointing inwards, so a point p is inside if dot(plane.xyz, p) + plane.w >= 0
+// for every plane.
+struct Frustum {
+  static constexpr int NUM_PLANES = 6;
+  std::array<glm::vec4, NUM_PLANES> planes;
+
+  // Extracts the normalized planes of a view-projection matrix. The planes are
+  // in the space the matrix transforms from, i.e. world space for a camera's
+  // projection * view.
+  static Frustum fromViewProjection(const glm::mat4& t_viewProjection);
+};
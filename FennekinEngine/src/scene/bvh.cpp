@@ -0,0 +1,487 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNK_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+// Relative costs of visiting a node and intersecting a primitive, for the
+// surface area heuristic.
+static constexpr float TRAVERSAL_COST = 1.0f;
+static constexpr float INTERSECTION_COST = 1.0f;
+static constexpr int NUM_BINS = 16;
+// Below this depth, nodes are split at the object median instead, which
+// bounds the depth of degenerate inputs and so the traversal stacks.
+static constexpr int MAX_SAH_DEPTH = 48;
+static constexpr int MAX_TRAVERSAL_STACK = 256;
+
+static float getSurfaceArea(const Aabb& t_bounds) {
+  if (t_bounds.isEmpty()) {
+    return 0.0f;
+  }
+  const glm::vec3 size = t_bounds.max - t_bounds.min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static void expand(Aabb& t_bounds, const Aabb& t_other) {
+  t_bounds.min = glm::min(t_bounds.min, t_other.min);
+  t_bounds.max = glm::max(t_bounds.max, t_other.max);
+}
+
+namespace {
+
+// A node of the binary tree built first, before it is collapsed to 4 wide.
+struct BinaryNode {
+  Aabb bounds;
+  // Internal nodes.
+  uint32_t left;
+  uint32_t right;
+  // Leaves, as a range of the primitive order.
+  uint32_t first;
+  uint32_t count;
+};
+
+class BinaryBuilder {
+ public:
+  BinaryBuilder(const std::vector<Aabb>& t_bounds, const uint32_t t_maxLeafSize,
+                std::vector<uint32_t>& t_order)
+      : m_bounds(t_bounds), m_maxLeafSize(t_maxLeafSize), m_order(t_order) {
+    m_centroids.resize(t_bounds.size());
+    for (size_t i = 0; i < t_bounds.size(); ++i) {
+      m_centroids[i] = t_bounds[i].getCenter();
+    }
+    m_nodes.reserve(t_bounds.size() * 2);
+  }
+
+  uint32_t build(uint32_t t_first, uint32_t t_count, int t_depth);
+  [[nodiscard]] const std::vector<BinaryNode>& getNodes() const {
+    return m_nodes;
+  }
+
+ private:
+  // Returns the end of the first child's range, or t_first if the range is
+  // best kept as a leaf.
+  uint32_t split(uint32_t t_first, uint32_t t_count, const Aabb& t_bounds,
+                 int t_depth);
+
+  const std::vector<Aabb>& m_bounds;
+  const uint32_t m_maxLeafSize;
+  std::vector<uint32_t>& m_order;
+  std::vector<glm::vec3> m_centroids;
+  std::vector<BinaryNode> m_nodes;
+};
+
+uint32_t BinaryBuilder::build(const uint32_t t_first, const uint32_t t_count,
+                              const int t_depth) {
+  const auto index = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back({});
+  Aabb bounds;
+  for (uint32_t i = t_first; i < t_first + t_count; ++i) {
+    expand(bounds, m_bounds[m_order[i]]);
+  }
+  m_nodes[index].bounds = bounds;
+
+  const uint32_t middle = split(t_first, t_count, bounds, t_depth);
+  if (middle == t_first) {
+    m_nodes[index].first = t_first;
+    m_nodes[index].count = t_count;
+    return index;
+  }
+  const uint32_t left = build(t_first, middle - t_first, t_depth + 1);
+  const uint32_t right = build(middle, t_first + t_count - middle, t_depth + 1);
+  m_nodes[index].left = left;
+  m_nodes[index].right = right;
+  m_nodes[index].count = 0;
+  return index;
+}
+
+uint32_t BinaryBuilder::split(const uint32_t t_first, const uint32_t t_count,
+                              const Aabb& t_bounds, const int t_depth) {
+  if (t_count <= 1) {
+    return t_first;
+  }
+  Aabb centroidBounds;
+  for (uint32_t i = t_first; i < t_first + t_count; ++i) {
+    centroidBounds.expand(m_centroids[m_order[i]]);
+  }
+  const glm::vec3 size = centroidBounds.max - centroidBounds.min;
+  int longest = size.y > size.x ? 1 : 0;
+  longest = size.z > size[longest] ? 2 : longest;
+  const auto begin = m_order.begin() + t_first;
+  const auto end = begin + t_count;
+
+  // Identical centroids can't be told apart, so only their count matters.
+  if (size[longest] <= 0.0f) {
+    return t_count <= m_maxLeafSize ? t_first : t_first + t_count / 2;
+  }
+  if (t_depth >= MAX_SAH_DEPTH) {
+    std::nth_element(begin, begin + t_count / 2, end,
+                     [&](const uint32_t t_a, const uint32_t t_b) {
+                       return m_centroids[t_a][longest] <
+                              m_centroids[t_b][longest];
+                     });
+    return t_first + t_count / 2;
+  }
+
+  // Bin the centroids along each axis, and sweep the bins from both sides to
+  // find the cheapest plane between them.
+  float bestCost = std::numeric_limits<float>::max();
+  int bestAxis = -1;
+  int bestBin = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (size[axis] <= 0.0f) {
+      continue;
+    }
+    std::array<Aabb, NUM_BINS> binBounds;
+    std::array<uint32_t, NUM_BINS> binCounts{};
+    const float scale = NUM_BINS / size[axis];
+    for (uint32_t i = t_first; i < t_first + t_count; ++i) {
+      const uint32_t primitive = m_order[i];
+      const int bin = std::min(
+          static_cast<int>((m_centroids[primitive][axis] -
+                            centroidBounds.min[axis]) *
+                           scale),
+          NUM_BINS - 1);
+      ++binCounts[bin];
+      expand(binBounds[bin], m_bounds[primitive]);
+    }
+
+    std::array<float, NUM_BINS - 1> leftCosts;
+    Aabb left;
+    uint32_t leftCount = 0;
+    for (int bin = 0; bin < NUM_BINS - 1; ++bin) {
+      expand(left, binBounds[bin]);
+      leftCount += binCounts[bin];
+      leftCosts[bin] = getSurfaceArea(left) * static_cast<float>(leftCount);
+    }
+    Aabb right;
+    uint32_t rightCount = 0;
+    for (int bin = NUM_BINS - 1; bin > 0; --bin) {
+      expand(right, binBounds[bin]);
+      rightCount += binCounts[bin];
+      const float cost = leftCosts[bin - 1] +
+                         getSurfaceArea(right) * static_cast<float>(rightCount);
+      if (rightCount && rightCount < t_count && cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+
+  const float area = getSurfaceArea(t_bounds);
+  const float splitCost =
+      TRAVERSAL_COST +
+      INTERSECTION_COST * bestCost / std::max(area, 1e-30f);
+  const float leafCost = INTERSECTION_COST * static_cast<float>(t_count);
+  if (bestAxis < 0 || (t_count <= m_maxLeafSize && splitCost >= leafCost)) {
+    return t_count <= m_maxLeafSize ? t_first : t_first + t_count / 2;
+  }
+
+  const float scale = NUM_BINS / size[bestAxis];
+  const auto middle =
+      std::partition(begin, end, [&](const uint32_t t_primitive) {
+        const int bin = std::min(
+            static_cast<int>((m_centroids[t_primitive][bestAxis] -
+                              centroidBounds.min[bestAxis]) *
+                             scale),
+            NUM_BINS - 1);
+        return bin < bestBin;
+      });
+  return t_first + static_cast<uint32_t>(middle - begin);
+}
+
+// Collapses a binary tree into a 4-wide one by pulling up the children of
+// the largest internal children until each node has four.
+uint32_t collapse(const std::vector<BinaryNode>& t_binary,
+                  const uint32_t t_index, std::vector<Bvh4Node>& t_nodes) {
+  const auto index = static_cast<uint32_t>(t_nodes.size());
+  t_nodes.emplace_back();
+
+  std::array<uint32_t, Bvh4Node::WIDTH> children;
+  uint32_t numChildren = 0;
+  const BinaryNode& node = t_binary[t_index];
+  if (node.count) {
+    children[numChildren++] = t_index;
+  } else {
+    children[numChildren++] = node.left;
+    children[numChildren++] = node.right;
+  }
+  while (numChildren < Bvh4Node::WIDTH) {
+    int largest = -1;
+    float largestArea = -1.0f;
+    for (uint32_t i = 0; i < numChildren; ++i) {
+      const BinaryNode& child = t_binary[children[i]];
+      const float area = getSurfaceArea(child.bounds);
+      if (!child.count && area > largestArea) {
+        largest = static_cast<int>(i);
+        largestArea = area;
+      }
+    }
+    if (largest < 0) {
+      break;
+    }
+    const BinaryNode& child = t_binary[children[largest]];
+    children[largest] = child.left;
+    children[numChildren++] = child.right;
+  }
+
+  Bvh4Node collapsed{};
+  collapsed.numChildren = numChildren;
+  for (uint32_t i = 0; i < Bvh4Node::WIDTH; ++i) {
+    // Unused children get inverted bounds, though they are masked out anyway.
+    const Aabb bounds = i < numChildren ? t_binary[children[i]].bounds : Aabb();
+    collapsed.minX[i] = bounds.min.x;
+    collapsed.minY[i] = bounds.min.y;
+    collapsed.minZ[i] = bounds.min.z;
+    collapsed.maxX[i] = bounds.max.x;
+    collapsed.maxY[i] = bounds.max.y;
+    collapsed.maxZ[i] = bounds.max.z;
+  }
+  for (uint32_t i = 0; i < numChildren; ++i) {
+    const BinaryNode& child = t_binary[children[i]];
+    if (child.count) {
+      collapsed.child[i] = child.first;
+      collapsed.count[i] = child.count;
+    } else {
+      collapsed.child[i] = collapse(t_binary, children[i], t_nodes);
+    }
+  }
+  t_nodes[index] = collapsed;
+  return index;
+}
+
+}  // namespace
+
+void buildBvh4(const std::vector<Aabb>& t_bounds, const uint32_t t_maxLeafSize,
+               std::vector<Bvh4Node>& t_nodes, std::vector<uint32_t>& t_order) {
+  t_nodes.clear();
+  t_order.resize(t_bounds.size());
+  for (uint32_t i = 0; i < t_order.size(); ++i) {
+    t_order[i] = i;
+  }
+  if (t_bounds.empty()) {
+    return;
+  }
+  BinaryBuilder builder(t_bounds, t_maxLeafSize, t_order);
+  builder.build(0, static_cast<uint32_t>(t_bounds.size()), 0);
+  t_nodes.reserve(builder.getNodes().size() / 2 + 1);
+  collapse(builder.getNodes(), 0, t_nodes);
+}
+
+PreparedRay::PreparedRay(const Ray& t_ray) : origin(t_ray.origin) {
+  // Avoid infinities, which turn into NaN when multiplied by zero.
+  for (int i = 0; i < 3; ++i) {
+    const float d = t_ray.direction[i];
+    invDirection[i] =
+        1.0f / (std::abs(d) > 1e-30f ? d : (d < 0.0f ? -1e-30f : 1e-30f));
+  }
+}
+
+uint32_t intersectChildren(const Bvh4Node& t_node, const PreparedRay& t_ray,
+                           const float t_tMax, float* t_entries) {
+  const uint32_t used = (1u << t_node.numChildren) - 1;
+#if defined(FNK_BVH_SSE)
+  const __m128 originX = _mm_set1_ps(t_ray.origin.x);
+  const __m128 originY = _mm_set1_ps(t_ray.origin.y);
+  const __m128 originZ = _mm_set1_ps(t_ray.origin.z);
+  const __m128 invX = _mm_set1_ps(t_ray.invDirection.x);
+  const __m128 invY = _mm_set1_ps(t_ray.invDirection.y);
+  const __m128 invZ = _mm_set1_ps(t_ray.invDirection.z);
+  const __m128 x0 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.minX), originX), invX);
+  const __m128 x1 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.maxX), originX), invX);
+  const __m128 y0 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.minY), originY), invY);
+  const __m128 y1 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.maxY), originY), invY);
+  const __m128 z0 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.minZ), originZ), invZ);
+  const __m128 z1 =
+      _mm_mul_ps(_mm_sub_ps(_mm_load_ps(t_node.maxZ), originZ), invZ);
+  const __m128 entries = _mm_max_ps(
+      _mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+      _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+  const __m128 exits = _mm_min_ps(
+      _mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+      _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(t_tMax)));
+  _mm_storeu_ps(t_entries, entries);
+  return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(entries, exits))) &
+         used;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < t_node.numChildren; ++i) {
+    const glm::vec3 t0 =
+        (glm::vec3(t_node.minX[i], t_node.minY[i], t_node.minZ[i]) -
+         t_ray.origin) *
+        t_ray.invDirection;
+    const glm::vec3 t1 =
+        (glm::vec3(t_node.maxX[i], t_node.maxY[i], t_node.maxZ[i]) -
+         t_ray.origin) *
+        t_ray.invDirection;
+    const glm::vec3 entries = glm::min(t0, t1);
+    const glm::vec3 exits = glm::max(t0, t1);
+    t_entries[i] = std::max({entries.x, entries.y, entries.z, 0.0f});
+    const float exit = std::min({exits.x, exits.y, exits.z, t_tMax});
+    mask |= static_cast<uint32_t>(t_entries[i] <= exit) << i;
+  }
+  return mask & used;
+#endif
+}
+
+uint32_t overlapChildren(const Bvh4Node& t_node, const Frustum& t_frustum) {
+  const uint32_t used = (1u << t_node.numChildren) - 1;
+#if defined(FNK_BVH_SSE)
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 minX = _mm_load_ps(t_node.minX);
+  const __m128 minY = _mm_load_ps(t_node.minY);
+  const __m128 minZ = _mm_load_ps(t_node.minZ);
+  const __m128 maxX = _mm_load_ps(t_node.maxX);
+  const __m128 maxY = _mm_load_ps(t_node.maxY);
+  const __m128 maxZ = _mm_load_ps(t_node.maxZ);
+  const __m128 centerX = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+  const __m128 centerY = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+  const __m128 centerZ = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+  const __m128 extentX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+  const __m128 extentY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+  const __m128 extentZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+  __m128 outside = _mm_setzero_ps();
+  for (const glm::vec4& plane : t_frustum.planes) {
+    __m128 dist = _mm_set1_ps(plane.w);
+    dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.x), centerX));
+    dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.y), centerY));
+    dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.z), centerZ));
+    dist = _mm_add_ps(dist,
+                      _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), extentX));
+    dist = _mm_add_ps(dist,
+                      _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), extentY));
+    dist = _mm_add_ps(dist,
+                      _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), extentZ));
+    outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+  }
+  return ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & used;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < t_node.numChildren; ++i) {
+    const glm::vec3 min(t_node.minX[i], t_node.minY[i], t_node.minZ[i]);
+    const glm::vec3 max(t_node.maxX[i], t_node.maxY[i], t_node.maxZ[i]);
+    const glm::vec3 center = (min + max) * 0.5f;
+    const glm::vec3 extents = (max - min) * 0.5f;
+    bool outside = false;
+    for (const glm::vec4& plane : t_frustum.planes) {
+      const glm::vec3 normal(plane);
+      outside |= glm::dot(normal, center) + plane.w +
+                     glm::dot(glm::abs(normal), extents) <
+                 0.0f;
+    }
+    mask |= static_cast<uint32_t>(!outside) << i;
+  }
+  return mask;
+#endif
+}
+
+void TriangleBvh::build(const std::vector<glm::vec3>& t_vertices) {
+  const size_t numTriangles = t_vertices.size() / 3;
+  std::vector<Aabb> bounds(numTriangles);
+  m_bounds = Aabb();
+  for (size_t i = 0; i < numTriangles; ++i) {
+    for (int v = 0; v < 3; ++v) {
+      bounds[i].expand(t_vertices[i * 3 + v]);
+    }
+    expand(m_bounds, bounds[i]);
+  }
+
+  std::vector<uint32_t> order;
+  buildBvh4(bounds, MAX_LEAF_TRIANGLES, m_nodes, order);
+  m_triangles.clear();
+  m_triangles.reserve(numTriangles);
+  for (const uint32_t triangle : order) {
+    const glm::vec3& v0 = t_vertices[triangle * 3];
+    m_triangles.push_back({.v0 = v0,
+                           .edge1 = t_vertices[triangle * 3 + 1] - v0,
+                           .edge2 = t_vertices[triangle * 3 + 2] - v0,
+                           .index = triangle});
+  }
+}
+
+bool TriangleBvh::intersect(const Ray& t_ray, RayHit& t_hit) const {
+  return traverse<false>(t_ray, &t_hit);
+}
+
+bool TriangleBvh::intersectAny(const Ray& t_ray) const {
+  return traverse<true>(t_ray, nullptr);
+}
+
+template <bool ANY_HIT>
+bool TriangleBvh::traverse(const Ray& t_ray, RayHit* t_hit) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  const PreparedRay prepared(t_ray);
+  float closest = t_ray.tMax;
+  bool hit = false;
+
+  BvhStackEntry stack[MAX_TRAVERSAL_STACK];
+  int stackSize = 0;
+  stack[stackSize++] = {.node = 0, .entry = 0.0f};
+  while (stackSize) {
+    const BvhStackEntry current = stack[--stackSize];
+    // A closer hit may have been found since the node was pushed.
+    if (current.entry > closest) {
+      continue;
+    }
+    const Bvh4Node& node = m_nodes[current.node];
+    alignas(16) float entries[Bvh4Node::WIDTH];
+    uint32_t mask = intersectChildren(node, prepared, closest, entries);
+
+    BvhStackEntry pushed[Bvh4Node::WIDTH];
+    int numPushed = 0;
+    for (; mask; mask &= mask - 1) {
+      const int i = std::countr_zero(mask);
+      if (!node.isLeaf(i)) {
+        pushed[numPushed++] = {.node = node.child[i], .entry = entries[i]};
+        continue;
+      }
+      // Moller-Trumbore.
+      for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i];
+           ++j) {
+        const Triangle& tri = m_triangles[j];
+        const glm::vec3 p = glm::cross(t_ray.direction, tri.edge2);
+        const float det = glm::dot(tri.edge1, p);
+        if (std::abs(det) < 1e-12f) {
+          continue;
+        }
+        const float invDet = 1.0f / det;
+        const glm::vec3 s = t_ray.origin - tri.v0;
+        const float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f) {
+          continue;
+        }
+        const glm::vec3 q = glm::cross(s, tri.edge1);
+        const float v = glm::dot(t_ray.direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) {
+          continue;
+        }
+        const float t = glm::dot(tri.edge2, q) * invDet;
+        if (t > 0.0f && t <= closest) {
+          if constexpr (ANY_HIT) {
+            return true;
+          } else {
+            closest = t;
+            *t_hit = {.t = t, .triangle = tri.index, .backFace = det < 0.0f};
+            hit = true;
+          }
+        }
+      }
+    }
+    pushSortedByEntry(pushed, numPushed, stack, stackSize);
+  }
+  return hit;
+}
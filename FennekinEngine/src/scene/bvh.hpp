@@ -0,0 +1,133 @@
+#pragma once
+
+#include "scene/bounds.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+struct Ray {
+  glm::vec3 origin;
+  // Need not be normalized; hit distances are in units of its length.
+  glm::vec3 direction;
+  float tMax = std::numeric_limits<float>::max();
+};
+
+struct RayHit {
+  float t;
+  // The index of the triangle as passed to TriangleBvh::build().
+  uint32_t triangle;
+  // The user index of the instance hit, for SceneBvh queries.
+  uint32_t instance = 0;
+  // Whether the ray hit the side facing away from the triangle's normal,
+  // taking counter-clockwise winding as front facing.
+  bool backFace;
+};
+
+// A node of a 4-wide bounding volume hierarchy. The bounds of its children are
+// stored one array per component, so a ray or plane is tested against all
+// four children in one SIMD operation.
+struct alignas(16) Bvh4Node {
+  static constexpr uint32_t WIDTH = 4;
+
+  float minX[WIDTH], minY[WIDTH], minZ[WIDTH];
+  float maxX[WIDTH], maxY[WIDTH], maxZ[WIDTH];
+  // An internal child is the index of its node, with a count of zero. A leaf
+  // child is a range of count primitives starting at child.
+  uint32_t child[WIDTH];
+  uint32_t count[WIDTH];
+  // Children in use, always the first ones.
+  uint32_t numChildren;
+
+  [[nodiscard]] bool isLeaf(const uint32_t t_child) const {
+    return count[t_child] != 0;
+  }
+};
+
+// Builds a 4-wide BVH over primitives with the given bounds, splitting by the
+// surface area heuristic. The root is t_nodes[0]. Leaves hold at most
+// t_maxLeafSize primitives, as ranges of t_order, which receives the
+// primitive indices in leaf order.
+void buildBvh4(const std::vector<Aabb>& t_bounds, uint32_t t_maxLeafSize,
+               std::vector<Bvh4Node>& t_nodes, std::vector<uint32_t>& t_order);
+
+// A node left to visit by a traversal, and the distance at which the ray
+// enters it.
+struct BvhStackEntry {
+  uint32_t node;
+  float entry;
+};
+
+// Pushes the entries onto the stack farthest first, so the nearest is visited
+// next and a hit there can cull the rest.
+inline void pushSortedByEntry(BvhStackEntry* t_entries, const int t_count,
+                              BvhStackEntry* t_stack, int& t_stackSize) {
+  // At most four entries, so insertion sort.
+  for (int i = 1; i < t_count; ++i) {
+    const BvhStackEntry entry = t_entries[i];
+    int j = i;
+    for (; j > 0 && t_entries[j - 1].entry < entry.entry; --j) {
+      t_entries[j] = t_entries[j - 1];
+    }
+    t_entries[j] = entry;
+  }
+  for (int i = 0; i < t_count; ++i) {
+    t_stack[t_stackSize++] = t_entries[i];
+  }
+}
+
+// A ray with its reciprocal direction, for testing against many boxes.
+struct PreparedRay {
+  explicit PreparedRay(const Ray& t_ray);
+
+  glm::vec3 origin;
+  glm::vec3 invDirection;
+};
+
+// Tests the ray against the children of a node within [0, t_tMax]. Returns a
+// mask with bit i set if child i is hit, and the distances at which the ray
+// enters each child.
+uint32_t intersectChildren(const Bvh4Node& t_node, const PreparedRay& t_ray,
+                           float t_tMax, float* t_entries);
+// Returns a mask with bit i set if child i intersects or lies inside the
+// frustum. Conservative, like cullFrustums().
+uint32_t overlapChildren(const Bvh4Node& t_node, const Frustum& t_frustum);
+
+// A bounding volume hierarchy over the triangles of one mesh, for ray queries
+// on the CPU. Meshes placed in the world by SceneBvh share these as bottom
+// level structures.
+class TriangleBvh {
+ public:
+  // Builds the hierarchy over the given triangles, three vertices each.
+  void build(const std::vector<glm::vec3>& t_vertices);
+
+  // Finds the closest hit along the ray within (0, tMax].
+  bool intersect(const Ray& t_ray, RayHit& t_hit) const;
+  // Whether the ray hits anything within (0, tMax]. Stops at the first hit
+  // found, so it is cheaper than intersect(), e.g. for shadow rays.
+  bool intersectAny(const Ray& t_ray) const;
+
+  [[nodiscard]] size_t getNumTriangles() const { return m_triangles.size(); }
+  [[nodiscard]] size_t getNumNodes() const { return m_nodes.size(); }
+  [[nodiscard]] const Aabb& getBounds() const { return m_bounds; }
+
+ private:
+  static constexpr uint32_t MAX_LEAF_TRIANGLES = 4;
+
+  struct Triangle {
+    glm::vec3 v0;
+    glm::vec3 edge1;
+    glm::vec3 edge2;
+    uint32_t index;
+  };
+
+  // The shared traversal of intersect() and intersectAny().
+  template <bool ANY_HIT>
+  bool traverse(const Ray& t_ray, RayHit* t_hit) const;
+
+  std::vector<Bvh4Node> m_nodes;
+  // In leaf order.
+  std::vector<Triangle> m_triangles;
+  Aabb m_bounds;
+};
@@ -13,11 +13,16 @@ Camera::~Camera() = default;
 
 glm::vec3 Camera::getPosition() const { return m_position; }
 
-void Camera::setPosition(const glm::vec3 t_position) { m_position = t_position; }
+void Camera::setPosition(const glm::vec3 t_position) {
+  if (m_position == t_position) return;
+  m_position = t_position;
+  markChanged();
+}
 
 float Camera::getYaw() const { return m_yaw; }
 
 void Camera::setYaw(const float t_yaw) {
+  if (m_yaw == t_yaw) return;
   m_yaw = t_yaw;
   updateCameraVectors();
 }
@@ -25,28 +30,45 @@ void Camera::setYaw(const float t_yaw) {
 float Camera::getPitch() const { return m_pitch; }
 
 void Camera::setPitch(const float t_pitch) {
+  if (m_pitch == t_pitch) return;
   m_pitch = t_pitch;
   updateCameraVectors();
 }
 
 float Camera::getFov() const { return m_fov; }
 
-void Camera::setFov(const float t_fov) { m_fov = t_fov; }
+void Camera::setFov(const float t_fov) {
+  if (m_fov == t_fov) return;
+  m_fov = t_fov;
+  markChanged();
+}
 
 float Camera::getAspectRatio() const { return m_aspectRatio; }
 
-void Camera::setAspectRatio(const float t_aspectRatio) { m_aspectRatio = t_aspectRatio; }
+void Camera::setAspectRatio(const float t_aspectRatio) {
+  if (m_aspectRatio == t_aspectRatio) return;
+  m_aspectRatio = t_aspectRatio;
+  markChanged();
+}
 void Camera::setAspectRatio(const ImageSize t_size) {
-  m_aspectRatio = t_size.width / static_cast<float>(t_size.height);
+  setAspectRatio(t_size.width / static_cast<float>(t_size.height));
 }
 
 float Camera::getNearPlane() const { return m_near; }
 
-void Camera::setNearPlane(const float t_near) { m_near = t_near; }
+void Camera::setNearPlane(const float t_near) {
+  if (m_near == t_near) return;
+  m_near = t_near;
+  markChanged();
+}
 
 float Camera::getFarPlane() const { return m_far; }
 
-void Camera::setFarPlane(const float t_far) { m_far = t_far; }
+void Camera::setFarPlane(const float t_far) {
+  if (m_far == t_far) return;
+  m_far = t_far;
+  markChanged();
+}
 
 void Camera::updateCameraVectors() {
   glm::vec3 front;
@@ -57,6 +79,7 @@ void Camera::updateCameraVectors() {
   m_front = glm::normalize(front);
   m_right = glm::normalize(glm::cross(m_front, m_worldUp));
   m_up = glm::normalize(glm::cross(m_right, m_front));
+  markChanged();
 }
 
 void Camera::lookAt(const glm::vec3 t_center) {
@@ -76,9 +99,23 @@ glm::mat4 Camera::getProjectionTransform() const {
   return glm::perspective(glm::radians(getFov()), m_aspectRatio, m_near, m_far);
 }
 
-void Camera::updateUniforms(Shader &t_shader) {
-  t_shader.setMat4("view", getViewTransform());
-  t_shader.setMat4("projection", getProjectionTransform());
+Frustum Camera::getFrustum() const {
+  return Frustum::fromViewProjection(getProjectionTransform() *
+                                     getViewTransform());
+}
+
+void Camera::updateUniformBlock() {
+  if (m_uploadedVersion == m_version) {
+    // Still up to date; only make sure it's the bound camera.
+    m_uniformBuffer.bind();
+    return;
+  }
+  const CameraUniformBlock block = {
+      .view = getViewTransform(),
+      .projection = getProjectionTransform(),
+  };
+  m_uniformBuffer.update(block);
+  m_uploadedVersion = m_version;
 }
 
 void Camera::move(const ECameraDirection t_direction, const float t_velocity) {
@@ -102,6 +139,7 @@ void Camera::move(const ECameraDirection t_direction, const float t_velocity) {
     m_position -= m_up * t_velocity;
     break;
   }
+  markChanged();
 }
 
 void Camera::rotate(const float t_yawOffset, const float t_pitchOffset, const bool t_constrainPitch) {
@@ -118,6 +156,7 @@ void Camera::rotate(const float t_yawOffset, const float t_pitchOffset, const bo
 
 void Camera::zoom(const float t_offset) {
   m_fov = glm::clamp(m_fov - t_offset, MIN_FOV, MAX_FOV);
+  markChanged();
 }
 
 void CameraControls::handleDragStartEnd(const int t_button, const int t_action) {
@@ -5,8 +5,10 @@
 #include "core/core.hpp"
 // clang-format on
 
+#include "rendering/core/uniform_buffer.hpp"
 #include "rendering/interfaces/screen.hpp"
 #include "rendering/resources/shader.hpp"
+#include "scene/bounds.hpp"
 #include "scene/lighting/light.hpp"
 #include <GLFW/glfw3.h>
 #include <gl/glew.h>
@@ -35,7 +37,13 @@ constexpr float DEFAULT_ASPECT_RATIO = 4.0f / 3.0f;
 constexpr float MIN_FOV = 1.0f;
 constexpr float MAX_FOV = 135.0f;
 
-class Camera final : public UniformSource, public ViewSource {
+// CPU side mirror of the std140 FnkCamera block in core.glsl.
+struct CameraUniformBlock {
+  glm::mat4 view;
+  glm::mat4 projection;
+};
+
+class Camera final : public UniformBlockSource, public ViewSource {
 public:
   // Constructs a new Camera. Angular values should be provided in degrees.
   explicit Camera(glm::vec3 t_position = glm::vec3(0.0f),
@@ -71,8 +79,15 @@ public:
 
   [[nodiscard]] glm::mat4 getViewTransform() const override;
   [[nodiscard]] glm::mat4 getProjectionTransform() const;
+  // The world space view frustum, for culling.
+  [[nodiscard]] Frustum getFrustum() const;
 
-  void updateUniforms(Shader &t_shader) override;
+  // Returns a counter that changes whenever the view or projection changes.
+  [[nodiscard]] unsigned long long getVersion() const { return m_version; }
+
+  // Writes the view and projection into the shared camera uniform block. Does
+  // nothing if the camera hasn't changed since the last write.
+  void updateUniformBlock() override;
 
   // Moves the camera in the given direction by the given amount.
   void move(ECameraDirection t_direction, float t_velocity);
@@ -85,6 +100,7 @@ public:
 
 private:
   void updateCameraVectors();
+  void markChanged() { ++m_version; }
 
   glm::vec3 m_position;
   glm::vec3 m_front{};
@@ -101,6 +117,11 @@ private:
   float m_aspectRatio;
   float m_near;
   float m_far;
+
+  unsigned long long m_version = 1;
+  unsigned long long m_uploadedVersion = 0;
+  UniformBuffer m_uniformBuffer{EUniformBlockBinding::CAMERA,
+                                sizeof(CameraUniformBlock)};
 };
 
 struct MouseDelta {
@@ -0,0 +1,219 @@
+#include "culling.hpp"
+
+#include "core/debug/logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNK_CULL_SSE
+#include <emmintrin.h>
+#endif
+
+void CullingBounds::clear() {
+  m_size = 0;
+  m_centerX.clear();
+  m_centerY.clear();
+  m_centerZ.clear();
+  m_extentX.clear();
+  m_extentY.clear();
+  m_extentZ.clear();
+}
+
+void CullingBounds::reserve(const size_t t_count) {
+  const size_t padded =
+      (t_count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE * CULL_BATCH_SIZE;
+  m_centerX.reserve(padded);
+  m_centerY.reserve(padded);
+  m_centerZ.reserve(padded);
+  m_extentX.reserve(padded);
+  m_extentY.reserve(padded);
+  m_extentZ.reserve(padded);
+}
+
+void CullingBounds::set(const size_t t_index, const glm::vec3& t_center,
+                        const glm::vec3& t_extents) {
+  m_centerX[t_index] = t_center.x;
+  m_centerY[t_index] = t_center.y;
+  m_centerZ[t_index] = t_center.z;
+  m_extentX[t_index] = t_extents.x;
+  m_extentY[t_index] = t_extents.y;
+  m_extentZ[t_index] = t_extents.z;
+}
+
+void CullingBounds::resize(const size_t t_count) {
+  // Padding is always visible.
+  const size_t padded =
+      (t_count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE * CULL_BATCH_SIZE;
+  m_centerX.resize(padded, 0.0f);
+  m_centerY.resize(padded, 0.0f);
+  m_centerZ.resize(padded, 0.0f);
+  m_extentX.resize(padded, UNBOUNDED_EXTENT);
+  m_extentY.resize(padded, UNBOUNDED_EXTENT);
+  m_extentZ.resize(padded, UNBOUNDED_EXTENT);
+  m_size = t_count;
+}
+
+uint32_t CullingBounds::add(const Aabb& t_bounds) {
+  if (m_size == paddedSize()) {
+    // Start a new batch of always visible padding boxes.
+    const size_t size = m_size;
+    resize(m_size + 1);
+    m_size = size;
+  }
+
+  if (t_bounds.isEmpty()) {
+    set(m_size, glm::vec3(0.0f), glm::vec3(UNBOUNDED_EXTENT));
+  } else {
+    set(m_size, t_bounds.getCenter(), t_bounds.getExtents());
+  }
+  return static_cast<uint32_t>(m_size++);
+}
+
+void CullingBounds::append(const CullingBounds& t_other) {
+  const size_t first = m_size;
+  resize(m_size + t_other.size());
+  std::copy_n(t_other.centerX(), t_other.size(), m_centerX.begin() + first);
+  std::copy_n(t_other.centerY(), t_other.size(), m_centerY.begin() + first);
+  std::copy_n(t_other.centerZ(), t_other.size(), m_centerZ.begin() + first);
+  std::copy_n(t_other.extentX(), t_other.size(), m_extentX.begin() + first);
+  std::copy_n(t_other.extentY(), t_other.size(), m_extentY.begin() + first);
+  std::copy_n(t_other.extentZ(), t_other.size(), m_extentZ.begin() + first);
+}
+
+// A box is outside a plane if its center is further behind the plane than
+// the box's projected radius along the plane normal:
+//
+//   dot(n, c) + d < -dot(|n|, e)  <=>  dot(n, c) + d + dot(|n|, e) < 0
+//
+// It is outside a frustum if that holds for any of its planes.
+void cullFrustums(const CullingBounds& t_bounds, const Frustum* t_frustums,
+                  const int t_numFrustums, std::vector<ViewMask>& t_masks) {
+  if (t_numFrustums > MAX_CULL_VIEWS) {
+    LOG_CRITICAL("ERROR::CULLING::TOO_MANY_VIEWS");
+  }
+  const int numFrustums = std::min(t_numFrustums, MAX_CULL_VIEWS);
+  const size_t count = t_bounds.paddedSize();
+  t_masks.resize(count);
+
+  const float* cx = t_bounds.centerX();
+  const float* cy = t_bounds.centerY();
+  const float* cz = t_bounds.centerZ();
+  const float* ex = t_bounds.extentX();
+  const float* ey = t_bounds.extentY();
+  const float* ez = t_bounds.extentZ();
+
+#if defined(__AVX__) || defined(FNK_CULL_SSE)
+#if defined(__AVX__)
+  using Vec = __m256;
+  constexpr size_t WIDTH = 8;
+  const auto load = [](const float* t_p) { return _mm256_loadu_ps(t_p); };
+  const auto splat = [](const float t_v) { return _mm256_set1_ps(t_v); };
+  const auto add = [](Vec t_a, Vec t_b) { return _mm256_add_ps(t_a, t_b); };
+  const auto mul = [](Vec t_a, Vec t_b) { return _mm256_mul_ps(t_a, t_b); };
+  const auto bitOr = [](Vec t_a, Vec t_b) { return _mm256_or_ps(t_a, t_b); };
+  const auto andNot = [](Vec t_a, Vec t_b) {
+    return _mm256_andnot_ps(t_a, t_b);
+  };
+  const auto isNegative = [](Vec t_a) {
+    return _mm256_cmp_ps(t_a, _mm256_setzero_ps(), _CMP_LT_OQ);
+  };
+  const auto bit = [](const int t_view) {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(1 << t_view));
+  };
+  const auto store = [](ViewMask* t_p, Vec t_v) {
+    _mm256_storeu_ps(reinterpret_cast<float*>(t_p), t_v);
+  };
+  const Vec zero = _mm256_setzero_ps();
+#else
+  using Vec = __m128;
+  constexpr size_t WIDTH = 4;
+  const auto load = [](const float* t_p) { return _mm_loadu_ps(t_p); };
+  const auto splat = [](const float t_v) { return _mm_set1_ps(t_v); };
+  const auto add = [](Vec t_a, Vec t_b) { return _mm_add_ps(t_a, t_b); };
+  const auto mul = [](Vec t_a, Vec t_b) { return _mm_mul_ps(t_a, t_b); };
+  const auto bitOr = [](Vec t_a, Vec t_b) { return _mm_or_ps(t_a, t_b); };
+  const auto andNot = [](Vec t_a, Vec t_b) { return _mm_andnot_ps(t_a, t_b); };
+  const auto isNegative = [](Vec t_a) {
+    return _mm_cmplt_ps(t_a, _mm_setzero_ps());
+  };
+  const auto bit = [](const int t_view) {
+    return _mm_castsi128_ps(_mm_set1_epi32(1 << t_view));
+  };
+  const auto store = [](ViewMask* t_p, Vec t_v) {
+    _mm_storeu_ps(reinterpret_cast<float*>(t_p), t_v);
+  };
+  const Vec zero = _mm_setzero_ps();
+#endif
+
+  // Broadcast every plane coefficient once, outside the loop. Plain arrays,
+  // as containers of SIMD types drop their alignment attributes.
+  struct SplatPlane {
+    Vec x, y, z, w, absX, absY, absZ;
+  };
+  SplatPlane planes[MAX_CULL_VIEWS * Frustum::NUM_PLANES];
+  Vec viewBits[MAX_CULL_VIEWS];
+  for (int v = 0; v < numFrustums; ++v) {
+    for (int p = 0; p < Frustum::NUM_PLANES; ++p) {
+      const glm::vec4& plane = t_frustums[v].planes[p];
+      planes[v * Frustum::NUM_PLANES + p] = {
+          .x = splat(plane.x),
+          .y = splat(plane.y),
+          .z = splat(plane.z),
+          .w = splat(plane.w),
+          .absX = splat(std::abs(plane.x)),
+          .absY = splat(std::abs(plane.y)),
+          .absZ = splat(std::abs(plane.z)),
+      };
+    }
+    viewBits[v] = bit(v);
+  }
+
+  // Each box is loaded once, tested against every view while in registers,
+  // and its mask stored once.
+  for (size_t i = 0; i < count; i += WIDTH) {
+    const Vec centerX = load(cx + i);
+    const Vec centerY = load(cy + i);
+    const Vec centerZ = load(cz + i);
+    const Vec extentX = load(ex + i);
+    const Vec extentY = load(ey + i);
+    const Vec extentZ = load(ez + i);
+
+    Vec mask = zero;
+    const SplatPlane* plane = planes;
+    for (int v = 0; v < numFrustums; ++v) {
+      Vec outside = zero;
+      for (int p = 0; p < Frustum::NUM_PLANES; ++p, ++plane) {
+        Vec dist = add(plane->w, mul(plane->x, centerX));
+        dist = add(dist, mul(plane->y, centerY));
+        dist = add(dist, mul(plane->z, centerZ));
+        dist = add(dist, mul(plane->absX, extentX));
+        dist = add(dist, mul(plane->absY, extentY));
+        dist = add(dist, mul(plane->absZ, extentZ));
+        outside = bitOr(outside, isNegative(dist));
+      }
+      mask = bitOr(mask, andNot(outside, viewBits[v]));
+    }
+    store(&t_masks[i], mask);
+  }
+#else
+  for (size_t i = 0; i < count; ++i) {
+    ViewMask mask = 0;
+    for (int v = 0; v < numFrustums; ++v) {
+      bool outside = false;
+      for (const glm::vec4& plane : t_frustums[v].planes) {
+        const float dist =
+            plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w +
+            std::abs(plane.x) * ex[i] + std::abs(plane.y) * ey[i] +
+            std::abs(plane.z) * ez[i];
+        outside |= dist < 0.0f;
+      }
+      mask |= static_cast<ViewMask>(!outside) << v;
+    }
+    t_masks[i] = mask;
+  }
+#endif
+}
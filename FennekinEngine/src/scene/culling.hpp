@@ -0,0 +1,73 @@
+#pragma once
+
+#include "scene/bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// World space bounding boxes of many objects, stored as one array per
+// component so the culling kernel can test a full SIMD register of boxes per
+// iteration. The arrays are padded to CULL_BATCH_SIZE with boxes that are
+// always visible, so there is no scalar tail.
+class CullingBounds {
+ public:
+  // Boxes tested per kernel iteration; the largest supported SIMD width.
+  static constexpr size_t CULL_BATCH_SIZE = 8;
+  // Extents of unbounded boxes. Large enough to never be culled, yet finite
+  // so that multiplying by a zero plane component can't produce NaN.
+  static constexpr float UNBOUNDED_EXTENT = 1e30f;
+
+  void clear();
+  void reserve(size_t t_count);
+  // Appends a box and returns its index. Empty boxes are treated as unbounded
+  // and are never culled.
+  uint32_t add(const Aabb& t_bounds);
+  // Appends all boxes of another set.
+  void append(const CullingBounds& t_other);
+  // Resizes to t_count boxes, e.g. to be filled by transformBounds(). New
+  // boxes are unbounded.
+  void resize(size_t t_count);
+
+  [[nodiscard]] size_t size() const { return m_size; }
+  // The array length, including padding.
+  [[nodiscard]] size_t paddedSize() const { return m_centerX.size(); }
+
+  const float* centerX() const { return m_centerX.data(); }
+  const float* centerY() const { return m_centerY.data(); }
+  const float* centerZ() const { return m_centerZ.data(); }
+  const float* extentX() const { return m_extentX.data(); }
+  const float* extentY() const { return m_extentY.data(); }
+  const float* extentZ() const { return m_extentZ.data(); }
+  float* centerX() { return m_centerX.data(); }
+  float* centerY() { return m_centerY.data(); }
+  float* centerZ() { return m_centerZ.data(); }
+  float* extentX() { return m_extentX.data(); }
+  float* extentY() { return m_extentY.data(); }
+  float* extentZ() { return m_extentZ.data(); }
+
+ private:
+  void set(size_t t_index, const glm::vec3& t_center,
+           const glm::vec3& t_extents);
+
+  size_t m_size = 0;
+  std::vector<float> m_centerX, m_centerY, m_centerZ;
+  std::vector<float> m_extentX, m_extentY, m_extentZ;
+};
+
+// A set of view visibility bits, one per view passed to cullFrustums().
+using ViewMask = uint32_t;
+static constexpr int MAX_CULL_VIEWS = 32;
+
+// Tests every box against all of the given frustums in a single sweep,
+// setting bit v of t_masks[i] if box i intersects or lies inside
+// t_frustums[v]. t_masks is resized to the padded size of t_bounds.
+//
+// Each box is read once and its mask written once regardless of the number of
+// views, so memory traffic doesn't grow as views (e.g. shadow cascades or
+// cubemap faces) are added; only the arithmetic does.
+//
+// The test is conservative: boxes near a frustum corner may be kept even
+// though they are outside. Uses AVX (8 boxes per iteration) if the build
+// enables it and SSE (4 boxes) otherwise.
+void cullFrustums(const CullingBounds& t_bounds, const Frustum* t_frustums,
+                  int t_numFrustums, std::vector<ViewMask>& t_masks);
@@ -1,43 +1,230 @@
 #include "light.hpp"
 
-void LightRegistry::addLight(Light* light) {
-  // TODO: Throw an error if this exceeds the max light count supported in the
-  // shader.
-  m_lights.push_back(light);
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <limits>
+
+float getLightRange(const Attenuation& t_attenuation, const float t_intensity) {
+  // Solve constant + linear * d + quadratic * d^2 = intensity / LIGHT_CUTOFF.
+  const float c = t_attenuation.constant - t_intensity / LIGHT_CUTOFF;
+  const float b = t_attenuation.linear;
+  const float a = t_attenuation.quadratic;
+  if (c >= 0.0f) {
+    // Never brighter than the cutoff.
+    return 0.0f;
+  }
+  if (a > 0.0f) {
+    return (-b + std::sqrt(b * b - 4.0f * a * c)) / (2.0f * a);
+  }
+  if (b > 0.0f) {
+    return -c / b;
+  }
+  return std::numeric_limits<float>::infinity();
+}
 
+Attenuation getAttenuationForRange(const float t_range,
+                                   const float t_intensity) {
+  return {.constant = 0.0f,
+          .linear = 0.0f,
+          .quadratic = t_intensity / (LIGHT_CUTOFF * t_range * t_range)};
+}
+
+static float maxComponent(const glm::vec3& t_vector) {
+  return std::max({t_vector.x, t_vector.y, t_vector.z});
+}
+
+LightBoundingSphere getLightBounds(const Std430PointLight& t_light) {
+  const float intensity =
+      std::max(maxComponent(t_light.diffuse), maxComponent(t_light.specular));
+  return {.center = t_light.position,
+          .radius = getLightRange(t_light.attenuation, intensity)};
+}
+
+LightBoundingSphere getLightBounds(const Std430SpotLight& t_light) {
+  const float intensity =
+      std::max(maxComponent(t_light.diffuse), maxComponent(t_light.specular));
+  const float range = getLightRange(t_light.attenuation, intensity);
+  const glm::vec3 direction = glm::normalize(t_light.direction);
+  const float angle = std::min(t_light.outerAngle, glm::half_pi<float>());
+  if (angle > glm::quarter_pi<float>()) {
+    // Wide cones are bounded by the circle at their base.
+    return {.center = t_light.position + direction * (std::cos(angle) * range),
+            .radius = std::sin(angle) * range};
+  }
+  // Narrow ones by the sphere through their apex and base circle.
+  const float radius = range / (2.0f * std::cos(angle));
+  return {.center = t_light.position + direction * radius, .radius = radius};
+}
+
+void LightRegistry::addLight(Light* light) {
   switch (light->getLightType()) {
     case ELightType::DIRECTIONAL_LIGHT:
+      if (m_directionalCount >= MAX_DIRECTIONAL_LIGHTS) {
+        LOG_CRITICAL("ERROR::LIGHT_REGISTRY::TOO_MANY_DIRECTIONAL_LIGHTS");
+        return;
+      }
       light->setLightIdx(m_directionalCount);
       m_directionalCount++;
       break;
     case ELightType::POINT_LIGHT:
       light->setLightIdx(m_pointCount);
       m_pointCount++;
+      m_data.pointLights.resize(m_pointCount);
       break;
     case ELightType::SPOT_LIGHT:
       light->setLightIdx(m_spotCount);
       m_spotCount++;
+      m_data.spotLights.resize(m_spotCount);
+      break;
+  }
+  m_lights.push_back(light);
+  m_countsChanged = true;
+}
+
+void LightRegistry::removeLight(Light* light) {
+  const auto it = std::find(m_lights.begin(), m_lights.end(), light);
+  if (it == m_lights.end()) {
+    return;
+  }
+  m_lights.erase(it);
+
+  unsigned int* count = nullptr;
+  switch (light->getLightType()) {
+    case ELightType::DIRECTIONAL_LIGHT:
+      count = &m_directionalCount;
+      break;
+    case ELightType::POINT_LIGHT:
+      count = &m_pointCount;
+      break;
+    case ELightType::SPOT_LIGHT:
+      count = &m_spotCount;
+      break;
+  }
+  --*count;
+  // Keep the arrays dense by moving the last light of the type into the
+  // freed slot.
+  for (auto other : m_lights) {
+    if (other->getLightType() == light->getLightType() &&
+        other->lightIdx == *count) {
+      other->setLightIdx(light->lightIdx);
       break;
+    }
   }
+  m_data.pointLights.resize(m_pointCount);
+  m_data.spotLights.resize(m_spotCount);
+  m_countsChanged = true;
+}
+
+// Returns the byte range of `t_member` within `t_block`.
+template <typename T>
+static UniformBlockRange blockRangeOf(const LightsUniformBlock& t_block,
+                                      const T& t_member) {
+  return {
+      .offset = static_cast<std::size_t>(
+          reinterpret_cast<const char*>(&t_member) -
+          reinterpret_cast<const char*>(&t_block)),
+      .size = sizeof(T),
+  };
 }
 
-void LightRegistry::updateUniforms(Shader& shader) {
+// A span of dirty bytes, which grows to cover every marked range.
+struct DirtySpan {
+  std::size_t begin = std::numeric_limits<std::size_t>::max();
+  std::size_t end = 0;
+
+  void mark(const std::size_t t_offset, const std::size_t t_size) {
+    begin = std::min(begin, t_offset);
+    end = std::max(end, t_offset + t_size);
+  }
+  [[nodiscard]] bool isEmpty() const { return begin >= end; }
+};
+
+// Uploads the dirty part of a light array, or all of it if the buffer has to
+// grow and so loses its contents.
+template <typename T>
+static void uploadLights(StorageBuffer& t_buffer,
+                         const std::vector<T>& t_lights,
+                         const DirtySpan& t_dirty) {
+  const std::size_t sizeBytes = t_lights.size() * sizeof(T);
+  const auto* data = reinterpret_cast<const char*>(t_lights.data());
+  if (sizeBytes > t_buffer.getCapacity() || !t_buffer.getId()) {
+    t_buffer.update(data, sizeBytes);
+  } else if (!t_dirty.isEmpty()) {
+    t_buffer.update(data + t_dirty.begin, t_dirty.end - t_dirty.begin,
+                    t_dirty.begin);
+  } else {
+    t_buffer.bind();
+  }
+}
+
+void LightRegistry::updateUniformBlock() {
   if (viewSource_ != nullptr) {
     applyViewTransform(viewSource_->getViewTransform());
   }
-  shader.setInt("fnk_directionalLightCount", m_directionalCount);
-  shader.setInt("fnk_pointLightCount", m_pointCount);
-  shader.setInt("fnk_spotLightCount", m_spotCount);
+
+  // Track the dirty span of each buffer so that only the changed part is
+  // sent.
+  DirtySpan blockDirty;
+  DirtySpan pointsDirty;
+  DirtySpan spotsDirty;
+
+  if (m_countsChanged) {
+    m_data.block.directionalLightCount = static_cast<int>(m_directionalCount);
+    m_data.block.pointLightCount = static_cast<int>(m_pointCount);
+    m_data.block.spotLightCount = static_cast<int>(m_spotCount);
+    blockDirty.mark(0, 3 * sizeof(int));
+    m_countsChanged = false;
+  }
 
   for (auto light : m_lights) {
-    light->updateUniforms(shader);
+    const bool viewStale = m_viewChanged && light->useViewTransform;
+    if (light->writtenVersion == light->version && !viewStale) {
+      continue;
+    }
+    light->writeLightData(m_data);
+    light->writtenVersion = light->version;
+    switch (light->getLightType()) {
+      case ELightType::DIRECTIONAL_LIGHT: {
+        const UniformBlockRange range = blockRangeOf(
+            m_data.block, m_data.block.directionalLights[light->lightIdx]);
+        blockDirty.mark(range.offset, range.size);
+        break;
+      }
+      case ELightType::POINT_LIGHT:
+        pointsDirty.mark(light->lightIdx * sizeof(Std430PointLight),
+                         sizeof(Std430PointLight));
+        break;
+      case ELightType::SPOT_LIGHT:
+        spotsDirty.mark(light->lightIdx * sizeof(Std430SpotLight),
+                        sizeof(Std430SpotLight));
+        break;
+    }
   }
+  m_viewChanged = false;
+
+  uploadLights(m_pointLightBuffer, m_data.pointLights, pointsDirty);
+  uploadLights(m_spotLightBuffer, m_data.spotLights, spotsDirty);
+  if (blockDirty.isEmpty()) {
+    // Nothing changed.
+    m_uniformBuffer.bind();
+    return;
+  }
+  m_uniformBuffer.update(
+      reinterpret_cast<const char*>(&m_data.block) + blockDirty.begin,
+      blockDirty.end - blockDirty.begin, blockDirty.begin);
 }
 
 void LightRegistry::applyViewTransform(const glm::mat4& view) {
-  // TODO: Only do this when we need to.
+  const bool viewChanged = view != m_appliedView;
+  m_appliedView = view;
+  m_viewChanged = m_viewChanged || viewChanged;
+
   for (auto light : m_lights) {
-    light->applyViewTransform(view);
+    if (viewChanged || light->hasViewDependentChanged) {
+      light->applyViewTransform(view);
+      light->hasViewDependentChanged = false;
+    }
   }
 }
 
@@ -53,25 +240,15 @@ DirectionalLight::DirectionalLight(glm::vec3 direction, glm::vec3 diffuse,
       m_diffuse(diffuse),
       m_specular(specular) {}
 
-void DirectionalLight::updateUniforms(Shader& shader) {
-  checkState();
-
-  if (hasViewBeenApplied) {
-    shader.setVec3(uniformName + ".direction",
-                   useViewTransform ? m_viewDirection : m_direction);
-  }
-  if (hasLightChanged) {
-    shader.setVec3(uniformName + ".diffuse", m_diffuse);
-    shader.setVec3(uniformName + ".specular", m_specular);
-  }
-
-  // TODO: Fix change detection to work with >1 shaders.
-  // resetChangeDetection();
+void DirectionalLight::writeLightData(LightData& lightData) {
+  Std140DirectionalLight& data = lightData.block.directionalLights[lightIdx];
+  data.direction = useViewTransform ? m_viewDirection : m_direction;
+  data.diffuse = m_diffuse;
+  data.specular = m_specular;
 }
 
 void DirectionalLight::applyViewTransform(const glm::mat4& view) {
   m_viewDirection = glm::vec3(view * glm::vec4(m_direction, 0.0f));
-  hasViewBeenApplied = true;
 }
 
 PointLight::PointLight(glm::vec3 position, glm::vec3 diffuse,
@@ -81,29 +258,17 @@ PointLight::PointLight(glm::vec3 position, glm::vec3 diffuse,
       m_specular(specular),
       m_attenuation(attenuation) {}
 
-void PointLight::updateUniforms(Shader& shader) {
-  checkState();
-
-  if (hasViewBeenApplied) {
-    shader.setVec3(uniformName + ".position",
-                   useViewTransform ? m_viewPosition : m_position);
-  }
-  if (hasLightChanged) {
-    shader.setVec3(uniformName + ".diffuse", m_diffuse);
-    shader.setVec3(uniformName + ".specular", m_specular);
-    shader.setFloat(uniformName + ".attenuation.constant",
-                    m_attenuation.constant);
-    shader.setFloat(uniformName + ".attenuation.linear", m_attenuation.linear);
-    shader.setFloat(uniformName + ".attenuation.quadratic",
-                    m_attenuation.quadratic);
-  }
-
-  // resetChangeDetection();
+void PointLight::writeLightData(LightData& lightData) {
+  Std430PointLight& data = lightData.pointLights[lightIdx];
+  data.position = useViewTransform ? m_viewPosition : m_position;
+  data.diffuse = m_diffuse;
+  data.specular = m_specular;
+  data.attenuation = m_attenuation;
+  data.shadowIndex = shadowIndex;
 }
 
 void PointLight::applyViewTransform(const glm::mat4& view) {
   m_viewPosition = glm::vec3(view * glm::vec4(m_position, 1.0f));
-  hasViewBeenApplied = true;
 }
 
 SpotLight::SpotLight(glm::vec3 position, glm::vec3 direction, float innerAngle,
@@ -117,32 +282,19 @@ SpotLight::SpotLight(glm::vec3 position, glm::vec3 direction, float innerAngle,
       m_specular(specular),
       m_attenuation(attenuation) {}
 
-void SpotLight::updateUniforms(Shader& shader) {
-  checkState();
-
-  if (hasViewBeenApplied) {
-    shader.setVec3(uniformName + ".position",
-                   useViewTransform ? m_viewPosition : m_position);
-    shader.setVec3(uniformName + ".direction",
-                   useViewTransform ? m_viewDirection : m_direction);
-  }
-  if (hasLightChanged) {
-    shader.setFloat(uniformName + ".innerAngle", m_innerAngle);
-    shader.setFloat(uniformName + ".outerAngle", m_outerAngle);
-    shader.setVec3(uniformName + ".diffuse", m_diffuse);
-    shader.setVec3(uniformName + ".specular", m_specular);
-    shader.setFloat(uniformName + ".attenuation.constant",
-                    m_attenuation.constant);
-    shader.setFloat(uniformName + ".attenuation.linear", m_attenuation.linear);
-    shader.setFloat(uniformName + ".attenuation.quadratic",
-                    m_attenuation.quadratic);
-  }
-
-  // resetChangeDetection();
+void SpotLight::writeLightData(LightData& lightData) {
+  Std430SpotLight& data = lightData.spotLights[lightIdx];
+  data.position = useViewTransform ? m_viewPosition : m_position;
+  data.direction = useViewTransform ? m_viewDirection : m_direction;
+  data.innerAngle = m_innerAngle;
+  data.outerAngle = m_outerAngle;
+  data.diffuse = m_diffuse;
+  data.specular = m_specular;
+  data.attenuation = m_attenuation;
+  data.shadowIndex = shadowIndex;
 }
 
 void SpotLight::applyViewTransform(const glm::mat4& view) {
   m_viewPosition = glm::vec3(view * glm::vec4(m_position, 1.0f));
   m_viewDirection = glm::vec3(view * glm::vec4(m_direction, 0.0f));
-  hasViewBeenApplied = true;
 }
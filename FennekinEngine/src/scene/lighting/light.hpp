@@ -1,6 +1,8 @@
 #pragma once
 
 #include "core/debug/exceptions.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "rendering/core/uniform_buffer.hpp"
 #include "rendering/resources/shader.hpp"
 
 #include <glm/glm.hpp>
@@ -11,6 +13,8 @@ struct Attenuation {
     float constant;
     float linear;
     float quadratic;
+
+    bool operator==(const Attenuation&) const = default;
 };
 
 // TODO: Change this to [0, 0, 1].
@@ -21,6 +25,98 @@ constexpr glm::vec3 DEFAULT_SPECULAR = glm::vec3(1.0f, 1.0f, 1.0f);
 constexpr float DEFAULT_INNER_ANGLE = glm::radians(10.5f);
 constexpr float DEFAULT_OUTER_ANGLE = glm::radians(19.5f);
 
+// Must match the array size of the FnkLights block in core.glsl. Point and
+// spot lights live in storage buffers, so their number is only limited by
+// memory.
+constexpr unsigned int MAX_DIRECTIONAL_LIGHTS = 10;
+
+// Light contributions below this fraction of a light's brightest channel are
+// dropped, which gives point and spot lights a finite range.
+constexpr float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+// The distance at which a light of the given peak intensity falls below
+// LIGHT_CUTOFF, or infinity if it never does.
+float getLightRange(const Attenuation& t_attenuation, float t_intensity);
+// Inverse square attenuation that reaches LIGHT_CUTOFF at t_range for a light
+// of the given peak intensity.
+Attenuation getAttenuationForRange(float t_range, float t_intensity);
+
+// CPU side mirror of the std140 directional light struct in core.glsl. Every
+// vec3 takes up 16 bytes, so the padding members are load-bearing.
+struct Std140DirectionalLight {
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 diffuse;
+    float pad1;
+    glm::vec3 specular;
+    float pad2;
+};
+
+// CPU side mirrors of the std430 point and spot light structs in core.glsl.
+// Unlike std140, a struct member is only aligned to its largest member, so
+// the attenuation packs into the last vec3's padding.
+struct Std430PointLight {
+    glm::vec3 position;
+    float pad0;
+    glm::vec3 diffuse;
+    float pad1;
+    glm::vec3 specular;
+    Attenuation attenuation;
+    // The first of the light's six tiles in the shadow atlas, or -1.
+    int shadowIndex;
+    float pad2;
+};
+
+struct Std430SpotLight {
+    glm::vec3 position;
+    float pad0;
+    glm::vec3 direction;
+    float innerAngle;
+    float outerAngle;
+    float pad1[3];
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    Attenuation attenuation;
+    // The light's tile in the shadow atlas, or -1.
+    int shadowIndex;
+    float pad3;
+};
+
+static_assert(sizeof(Std140DirectionalLight) == 48);
+static_assert(sizeof(Std430PointLight) == 64);
+static_assert(sizeof(Std430SpotLight) == 96);
+
+// A sphere around everything a point or spot light can reach, in the space
+// the light's position is given in.
+struct LightBoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// A sphere of the light's range, or of radius 0 if it's never bright enough.
+LightBoundingSphere getLightBounds(const Std430PointLight& t_light);
+// The smallest sphere around the spot's cone, which is much tighter than one
+// of its whole range for narrow spots.
+LightBoundingSphere getLightBounds(const Std430SpotLight& t_light);
+
+// CPU side mirror of the std140 FnkLights block in core.glsl.
+struct LightsUniformBlock {
+    int directionalLightCount;
+    int pointLightCount;
+    int spotLightCount;
+    int pad0;
+    Std140DirectionalLight directionalLights[MAX_DIRECTIONAL_LIGHTS];
+};
+
+// The CPU side copies of everything the shaders know about the lights, which
+// each light writes its own slot of.
+struct LightData {
+    LightsUniformBlock block{};
+    std::vector<Std430PointLight> pointLights;
+    std::vector<Std430SpotLight> spotLights;
+};
+
 enum class ELightType {
     DIRECTIONAL_LIGHT,
     POINT_LIGHT,
@@ -34,46 +130,81 @@ public:
     virtual ~Light() = default;
     [[nodiscard]] virtual ELightType getLightType() const = 0;
 
-    void setUseViewTransform(bool useViewTransform) {
-        useViewTransform = useViewTransform;
+    void setUseViewTransform(bool t_useViewTransform) {
+        if (useViewTransform == t_useViewTransform) {
+            return;
+        }
+        useViewTransform = t_useViewTransform;
+        markViewDependentChanged();
+    }
+
+    // Returns a counter that changes whenever any of the light's values change.
+    [[nodiscard]] unsigned long long getVersion() const {
+        return version;
+    }
+
+    // Whether the light gets a shadow from the ShadowAtlas. Only point and
+    // spot lights do; directional ones use a ShadowCamera.
+    [[nodiscard]] bool getCastsShadows() const {
+        return castsShadows;
+    }
+    void setCastsShadows(bool t_castsShadows) {
+        castsShadows = t_castsShadows;
+    }
+    // The largest shadow tile side the light is given, however close it is.
+    [[nodiscard]] int getShadowResolution() const {
+        return shadowResolution;
+    }
+    void setShadowResolution(int t_resolution) {
+        shadowResolution = t_resolution;
     }
 
     friend LightRegistry;
+    friend class ShadowAtlas;
 
 protected:
-    void setLightIdx(unsigned int lightIdx) {
-        lightIdx = lightIdx;
-        uniformName = getUniformName(lightIdx);
+    void setLightIdx(unsigned int t_lightIdx) {
+        lightIdx = t_lightIdx;
+        // The light moved to a new slot of its array.
+        markChanged();
     }
 
-    void checkState() {
-        if (hasViewDependentChanged && !hasViewBeenApplied) {
-            LOG_CRITICAL("ERROR::LIGHT::VIEW_CHANGED\n"
-                                 "Light state changed without re-applying view transform.");
+    void markChanged() {
+        ++version;
+    }
+    void setShadowIndex(int t_shadowIndex) {
+        if (shadowIndex == t_shadowIndex) {
+            return;
         }
+        shadowIndex = t_shadowIndex;
+        markChanged();
     }
-
-    void resetChangeDetection() {
-        hasViewDependentChanged = false;
-        hasLightChanged = false;
-        hasViewBeenApplied = false;
+    // Marks a change to the world space values that view space values are
+    // derived from.
+    void markViewDependentChanged() {
+        ++version;
+        hasViewDependentChanged = true;
     }
 
-    [[nodiscard]] virtual std::string getUniformName(unsigned int lightIdx) const = 0;
-    virtual void updateUniforms(Shader& shader) = 0;
+    // Writes the light into its slot of the registry's light data.
+    virtual void writeLightData(LightData& data) = 0;
     virtual void applyViewTransform(const glm::mat4& view) = 0;
 
     unsigned int lightIdx{};
-    std::string uniformName;
+    // The light's first tile in the shadow atlas, or -1, see ShadowAtlas.
+    int shadowIndex = -1;
+    bool castsShadows = false;
+    int shadowResolution = 1024;
 
     // Whether the light's position uniforms should be in view space. If false,
     // the positions are instead in world space.
     bool useViewTransform = true;
-    // Start as `true` so that initial uniform values get set.
+    // Start as `true` so that the initial view space values get computed.
     bool hasViewDependentChanged = true;
-    bool hasLightChanged = true;
 
-    bool hasViewBeenApplied = false;
+    unsigned long long version = 1;
+    // The version last written into the registry's light data.
+    unsigned long long writtenVersion = 0;
 };
 
 // A source for the camera view transform.
@@ -83,32 +214,56 @@ public:
     [[nodiscard]] virtual glm::mat4 getViewTransform() const = 0;
 };
 
-class LightRegistry : public UniformSource {
+class LightRegistry : public UniformBlockSource {
 public:
     virtual ~LightRegistry() = default;
     void addLight(Light* light);
+    // Unregisters a light. The last light of the same type takes its slot.
+    void removeLight(Light* light);
     // Sets the view source used to update the light uniforms. The source is
     // called when updating uniforms.
     void setViewSource(ViewSource* viewSource) {
         viewSource_ = viewSource;
     }
-    void updateUniforms(Shader& shader);
+    // Writes the registered lights that changed since the last call into the
+    // shared lights uniform block and storage buffers, uploading only the
+    // changed span of each. Static lights under a static view cost no GL calls.
+    void updateUniformBlock() override;
 
     // Applies the view transform to the registered lights. This is automatically
-    // called if a view source has been set.
+    // called if a view source has been set. View space values are only
+    // recomputed for lights that moved, unless the view itself changed.
     void applyViewTransform(const glm::mat4& view);
 
     // Sets whether the registered lights should transform their positions to view
     // space. If false, positions remain in world space when passed to the shader.
     void setUseViewTransform(bool useViewTransform);
 
+    // The light data as of the last update, in the order of the shader arrays.
+    [[nodiscard]] const LightData& getLightData() const {
+        return m_data;
+    }
+    [[nodiscard]] const std::vector<Light*>& getLights() const {
+        return m_lights;
+    }
+
 private:
     unsigned int m_directionalCount = 0;
     unsigned int m_pointCount = 0;
     unsigned int m_spotCount = 0;
 
-    ViewSource* viewSource_;
+    ViewSource* viewSource_ = nullptr;
     std::vector<Light*> m_lights;
+
+    glm::mat4 m_appliedView = glm::mat4(0.0f);
+    // Whether the view changed since the last uniform block update.
+    bool m_viewChanged = true;
+    bool m_countsChanged = true;
+
+    LightData m_data;
+    UniformBuffer m_uniformBuffer{EUniformBlockBinding::LIGHTS, sizeof(LightsUniformBlock)};
+    StorageBuffer m_pointLightBuffer{EStorageBufferBinding::POINT_LIGHTS};
+    StorageBuffer m_spotLightBuffer{EStorageBufferBinding::SPOT_LIGHTS};
 };
 
 class DirectionalLight : public Light {
@@ -125,29 +280,35 @@ public:
         return m_direction;
     }
     void setDirection(glm::vec3 direction) {
+        if (m_direction == direction) {
+            return;
+        }
         m_direction = direction;
-        hasViewDependentChanged = true;
+        markViewDependentChanged();
     }
     glm::vec3 getDiffuse() const {
         return m_diffuse;
     }
     void setDiffuse(glm::vec3 diffuse) {
+        if (m_diffuse == diffuse) {
+            return;
+        }
         m_diffuse = diffuse;
-        hasLightChanged = true;
+        markChanged();
     }
     glm::vec3 getSpecular() const {
         return m_specular;
     }
     void setSpecular(glm::vec3 specular) {
+        if (m_specular == specular) {
+            return;
+        }
         m_specular = specular;
-        hasLightChanged = true;
+        markChanged();
     }
 
 protected:
-    std::string getUniformName(unsigned int lightIdx) const override {
-        return "fnk_directionalLights[" + std::to_string(lightIdx) + "]";
-    }
-    void updateUniforms(Shader& shader) override;
+    void writeLightData(LightData& data) override;
     void applyViewTransform(const glm::mat4& view) override;
 
 private:
@@ -171,36 +332,45 @@ public:
         return m_position;
     }
     void setPosition(glm::vec3 position) {
+        if (m_position == position) {
+            return;
+        }
         m_position = position;
-        hasViewDependentChanged = true;
+        markViewDependentChanged();
     }
     glm::vec3 getDiffuse() const {
         return m_diffuse;
     }
     void setDiffuse(glm::vec3 diffuse) {
+        if (m_diffuse == diffuse) {
+            return;
+        }
         m_diffuse = diffuse;
-        hasLightChanged = true;
+        markChanged();
     }
     glm::vec3 getSpecular() const {
         return m_specular;
     }
     void setSpecular(glm::vec3 specular) {
+        if (m_specular == specular) {
+            return;
+        }
         m_specular = specular;
-        hasLightChanged = true;
+        markChanged();
     }
     Attenuation getAttenuation() const {
         return m_attenuation;
     }
     void setAttenuation(Attenuation attenuation) {
+        if (m_attenuation == attenuation) {
+            return;
+        }
         m_attenuation = attenuation;
-        hasLightChanged = true;
+        markChanged();
     }
 
 protected:
-    [[nodiscard]] std::string getUniformName(unsigned int lightIdx) const override {
-        return "fnk_pointLights[" + std::to_string(lightIdx) + "]";
-    }
-    void updateUniforms(Shader& shader) override;
+    void writeLightData(LightData& data) override;
     void applyViewTransform(const glm::mat4& view) override;
 
 private:
@@ -228,43 +398,75 @@ public:
         return m_position;
     }
     void setPosition(glm::vec3 position) {
+        if (m_position == position) {
+            return;
+        }
         m_position = position;
-        hasViewDependentChanged = true;
+        markViewDependentChanged();
     }
     glm::vec3 getDirection() const {
         return m_direction;
     }
     void setDirection(glm::vec3 direction) {
+        if (m_direction == direction) {
+            return;
+        }
         m_direction = direction;
-        hasViewDependentChanged = true;
+        markViewDependentChanged();
+    }
+    float getInnerAngle() const {
+        return m_innerAngle;
+    }
+    void setInnerAngle(float innerAngle) {
+        if (m_innerAngle == innerAngle) {
+            return;
+        }
+        m_innerAngle = innerAngle;
+        markChanged();
+    }
+    float getOuterAngle() const {
+        return m_outerAngle;
+    }
+    void setOuterAngle(float outerAngle) {
+        if (m_outerAngle == outerAngle) {
+            return;
+        }
+        m_outerAngle = outerAngle;
+        markChanged();
     }
     glm::vec3 getDiffuse() const {
         return m_diffuse;
     }
     void setDiffuse(glm::vec3 diffuse) {
+        if (m_diffuse == diffuse) {
+            return;
+        }
         m_diffuse = diffuse;
-        hasLightChanged = true;
+        markChanged();
     }
     glm::vec3 getSpecular() const {
         return m_specular;
     }
     void setSpecular(glm::vec3 specular) {
+        if (m_specular == specular) {
+            return;
+        }
         m_specular = specular;
-        hasLightChanged = true;
+        markChanged();
     }
     Attenuation getAttenuation() const {
         return m_attenuation;
     }
     void setAttenuation(Attenuation attenuation) {
+        if (m_attenuation == attenuation) {
+            return;
+        }
         m_attenuation = attenuation;
-        hasLightChanged = true;
+        markChanged();
     }
 
 protected:
-    std::string getUniformName(unsigned int lightIdx) const override {
-        return "fnk_spotLights[" + std::to_string(lightIdx) + "]";
-    }
-    void updateUniforms(Shader& shader) override;
+    void writeLightData(LightData& data) override;
     void applyViewTransform(const glm::mat4& view) override;
 
 private:
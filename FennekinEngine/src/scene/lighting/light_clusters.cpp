@@ -0,0 +1,173 @@
+#include "light_clusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// The tile of a normalized device coordinate along an axis of t_tiles tiles.
+static int toTile(const float t_ndc, const uint32_t t_tiles) {
+  const auto tile = static_cast<int>(
+      std::floor((t_ndc * 0.5f + 0.5f) * static_cast<float>(t_tiles)));
+  return std::clamp(tile, 0, static_cast<int>(t_tiles) - 1);
+}
+
+void LightClusterGrid::build(const LightRegistry& t_lights,
+                             const glm::mat4& t_projection, const float t_near,
+                             const float t_far) {
+  const auto buildStart = std::chrono::steady_clock::now();
+  m_projection = t_projection;
+  m_near = t_near;
+  m_far = t_far;
+  const float logDepthRange = std::log(t_far / t_near);
+  m_sliceScale = static_cast<float>(SLICES) / logDepthRange;
+  m_sliceBias = -static_cast<float>(SLICES) * std::log(t_near) / logDepthRange;
+
+  m_lights.clear();
+  m_sliceLights.resize(SLICES);
+  for (std::vector<uint32_t>& lights : m_sliceLights) {
+    lights.clear();
+  }
+
+  // Points go first, so each slice lists its point lights before its spot
+  // lights, as the clusters must.
+  const LightData& data = t_lights.getLightData();
+  for (uint32_t i = 0; i < data.pointLights.size(); ++i) {
+    addLight(getLightBounds(data.pointLights[i]), i, /*t_spot=*/false);
+  }
+  for (uint32_t i = 0; i < data.spotLights.size(); ++i) {
+    addLight(getLightBounds(data.spotLights[i]), i, /*t_spot=*/true);
+  }
+
+  m_sliceRects.resize(SLICES);
+  m_clusters.assign(NUM_CLUSTERS, glm::uvec4(0));
+  m_workers.parallelFor(SLICES, [this](const unsigned int t_slice) {
+    countSlice(t_slice);
+  });
+
+  m_stats = {};
+  m_stats.pointLights = static_cast<int>(data.pointLights.size());
+  m_stats.spotLights = static_cast<int>(data.spotLights.size());
+  uint32_t offset = 0;
+  for (glm::uvec4& cluster : m_clusters) {
+    const uint32_t count = cluster.y + cluster.z;
+    cluster.x = offset;
+    // Where the next index of the cluster goes, while filling.
+    cluster.w = offset;
+    offset += count;
+    m_stats.litClusters += count != 0;
+    m_stats.maxLightsPerCluster =
+        std::max(m_stats.maxLightsPerCluster, static_cast<int>(count));
+  }
+  m_stats.lightIndices = static_cast<int>(offset);
+  m_indices.resize(offset);
+  m_workers.parallelFor(SLICES, [this](const unsigned int t_slice) {
+    fillSlice(t_slice);
+  });
+
+  m_clusterBuffer.update(m_clusters.data(),
+                         m_clusters.size() * sizeof(glm::uvec4));
+  m_indexBuffer.update(m_indices.data(), m_indices.size() * sizeof(uint32_t));
+  m_stats.buildMs = std::chrono::duration<float, std::milli>(
+                        std::chrono::steady_clock::now() - buildStart)
+                        .count();
+}
+
+void LightClusterGrid::addLight(const LightBoundingSphere& t_bounds,
+                                const uint32_t t_light, const bool t_spot) {
+  if (!(t_bounds.radius > 0.0f)) {
+    return;
+  }
+  // The view looks down -z.
+  const float depth = -t_bounds.center.z;
+  const float minDepth = std::max(depth - t_bounds.radius, m_near);
+  const float maxDepth = std::min(depth + t_bounds.radius, m_far);
+  if (minDepth > maxDepth) {
+    return;
+  }
+  const auto toSlice = [this](const float t_depth) {
+    const auto slice = static_cast<int>(
+        std::floor(std::log(t_depth) * m_sliceScale + m_sliceBias));
+    return std::clamp(slice, 0, static_cast<int>(SLICES) - 1);
+  };
+
+  const auto index = static_cast<uint32_t>(m_lights.size());
+  m_lights.push_back({.center = t_bounds.center,
+                      .radius = t_bounds.radius,
+                      .light = t_light,
+                      .spot = t_spot});
+  for (int slice = toSlice(minDepth); slice <= toSlice(maxDepth); ++slice) {
+    m_sliceLights[slice].push_back(index);
+  }
+}
+
+void LightClusterGrid::countSlice(const uint32_t t_slice) {
+  const float sliceNear =
+      std::exp((static_cast<float>(t_slice) - m_sliceBias) / m_sliceScale);
+  const float sliceFar =
+      std::exp((static_cast<float>(t_slice) + 1.0f - m_sliceBias) /
+               m_sliceScale);
+  const std::vector<uint32_t>& lights = m_sliceLights[t_slice];
+  std::vector<TileRect>& rects = m_sliceRects[t_slice];
+  rects.resize(lights.size());
+
+  for (size_t i = 0; i < lights.size(); ++i) {
+    const LightBounds& light = m_lights[lights[i]];
+    // The widest cross-section of the sphere within the slice, at the depth
+    // closest to its center, bounds it across the whole slice.
+    const float depth = -light.center.z;
+    const float offset = std::clamp(depth, sliceNear, sliceFar) - depth;
+    const float radius = std::sqrt(
+        std::max(light.radius * light.radius - offset * offset, 0.0f));
+    const float minDepth = std::max(depth - light.radius, sliceNear);
+    const float maxDepth = std::min(depth + light.radius, sliceFar);
+
+    // Project the box of the cross-section at both ends of the slice. x / depth
+    // is monotonic in each, so the corners give its extremes.
+    glm::vec2 minNdc(std::numeric_limits<float>::max());
+    glm::vec2 maxNdc(std::numeric_limits<float>::lowest());
+    for (const float cornerDepth : {minDepth, maxDepth}) {
+      for (const float sign : {-1.0f, 1.0f}) {
+        const glm::vec2 corner =
+            glm::vec2(light.center) + glm::vec2(sign * radius);
+        const glm::vec2 ndc(
+            m_projection[0][0] * corner.x / cornerDepth - m_projection[2][0],
+            m_projection[1][1] * corner.y / cornerDepth - m_projection[2][1]);
+        minNdc = glm::min(minNdc, ndc);
+        maxNdc = glm::max(maxNdc, ndc);
+      }
+    }
+    TileRect& rect = rects[i];
+    if (maxNdc.x < -1.0f || minNdc.x > 1.0f || maxNdc.y < -1.0f ||
+        minNdc.y > 1.0f) {
+      // Outside the frustum; an empty rect.
+      rect = {.minX = 1, .minY = 1, .maxX = 0, .maxY = 0};
+      continue;
+    }
+    rect = {.minX = static_cast<uint8_t>(toTile(minNdc.x, TILES_X)),
+            .minY = static_cast<uint8_t>(toTile(minNdc.y, TILES_Y)),
+            .maxX = static_cast<uint8_t>(toTile(maxNdc.x, TILES_X)),
+            .maxY = static_cast<uint8_t>(toTile(maxNdc.y, TILES_Y))};
+    for (uint32_t y = rect.minY; y <= rect.maxY; ++y) {
+      glm::uvec4* row = &m_clusters[(t_slice * TILES_Y + y) * TILES_X];
+      for (uint32_t x = rect.minX; x <= rect.maxX; ++x) {
+        ++(light.spot ? row[x].z : row[x].y);
+      }
+    }
+  }
+}
+
+void LightClusterGrid::fillSlice(const uint32_t t_slice) {
+  const std::vector<uint32_t>& lights = m_sliceLights[t_slice];
+  const std::vector<TileRect>& rects = m_sliceRects[t_slice];
+  for (size_t i = 0; i < lights.size(); ++i) {
+    const LightBounds& light = m_lights[lights[i]];
+    const TileRect& rect = rects[i];
+    for (uint32_t y = rect.minY; y <= rect.maxY; ++y) {
+      glm::uvec4* row = &m_clusters[(t_slice * TILES_Y + y) * TILES_X];
+      for (uint32_t x = rect.minX; x <= rect.maxX; ++x) {
+        m_indices[row[x].w++] = light.light;
+      }
+    }
+  }
+}
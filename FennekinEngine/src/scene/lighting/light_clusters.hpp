@@ -0,0 +1,97 @@
+#pragma once
+
+#include "core/worker_pool.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "scene/lighting/light.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Counts and timings of the last LightClusterGrid::build().
+struct LightClusterStats {
+  int pointLights = 0;
+  int spotLights = 0;
+  // Clusters reached by at least one light.
+  int litClusters = 0;
+  int maxLightsPerCluster = 0;
+  // Entries in the light index list, over all clusters.
+  int lightIndices = 0;
+  float buildMs = 0.0f;
+};
+
+// Assigns point and spot lights to the clusters of a view, so that shading a
+// pixel only visits the lights that can reach it.
+//
+// The view frustum is split into screen tiles and, along depth, into slices
+// whose thickness grows with distance, so clusters stay roughly cubic. Each
+// light is bounded by a sphere of its range, taken from its attenuation, and
+// listed in every cluster the sphere overlaps. Slices are filled in parallel
+// on the worker pool.
+//
+// The grid is uploaded as one (offset, point count, spot count) entry per
+// cluster, indexing a list of point light indices followed by spot light
+// indices. The lighting pass finds its cluster from the fragment's position
+// and depth, see fnk_getLightCluster().
+class LightClusterGrid {
+ public:
+  // Must match the FNK_CLUSTER_* defines in standard_lights.frag.
+  static constexpr uint32_t TILES_X = 16;
+  static constexpr uint32_t TILES_Y = 9;
+  static constexpr uint32_t SLICES = 24;
+  static constexpr uint32_t NUM_CLUSTERS = TILES_X * TILES_Y * SLICES;
+
+  explicit LightClusterGrid(WorkerPool& t_workers) : m_workers(t_workers) {}
+
+  // Rebuilds the clusters for the registry's lights, which must be in view
+  // space, under the given perspective projection and depth range, then
+  // uploads and binds them.
+  void build(const LightRegistry& t_lights, const glm::mat4& t_projection,
+             float t_near, float t_far);
+
+  [[nodiscard]] const LightClusterStats& getStats() const { return m_stats; }
+
+ private:
+  // A light's bounding sphere in view space.
+  struct LightBounds {
+    glm::vec3 center;
+    float radius;
+    // The index into the light's array.
+    uint32_t light;
+    bool spot;
+  };
+  // The tiles a light covers within one slice, inclusive.
+  struct TileRect {
+    uint8_t minX, minY, maxX, maxY;
+  };
+
+  void addLight(const LightBoundingSphere& t_bounds, uint32_t t_light,
+                bool t_spot);
+  // Finds the tiles each light of the slice covers, and counts the lights of
+  // each cluster.
+  void countSlice(uint32_t t_slice);
+  // Writes the light indices of the slice's clusters.
+  void fillSlice(uint32_t t_slice);
+
+  WorkerPool& m_workers;
+  LightClusterStats m_stats;
+
+  // The view of the current build.
+  glm::mat4 m_projection{};
+  float m_near = 0.0f;
+  float m_far = 0.0f;
+  // Converts a view depth to a slice: log(depth) * scale + bias.
+  float m_sliceScale = 0.0f;
+  float m_sliceBias = 0.0f;
+
+  std::vector<LightBounds> m_lights;
+  // The lights reaching each slice, points first, and their tile rects.
+  std::vector<std::vector<uint32_t>> m_sliceLights;
+  std::vector<std::vector<TileRect>> m_sliceRects;
+
+  // (offset, point count, spot count, unused) per cluster, as uploaded.
+  std::vector<glm::uvec4> m_clusters;
+  std::vector<uint32_t> m_indices;
+  StorageBuffer m_clusterBuffer{EStorageBufferBinding::LIGHT_CLUSTERS};
+  StorageBuffer m_indexBuffer{EStorageBufferBinding::CLUSTER_LIGHT_INDICES};
+};
@@ -0,0 +1,115 @@
+#include "light_volumes.hpp"
+
+#include "rendering/core/gl_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+LightVolumeRenderer::LightVolumeRenderer()
+    : m_sphere("", NUM_MERIDIANS, NUM_PARALLELS),
+      m_stencilShader(ShaderPath("content/shaders/light_volume.vert"),
+                      ShaderPath("content/shaders/builtin/shadow_map.frag")),
+      m_shader(ShaderPath("content/shaders/light_volume.vert"),
+               ShaderPath("content/shaders/light_volume.frag")) {}
+
+void LightVolumeRenderer::beginGeometryMask() {
+  GlState::setStencilTest(true);
+  glStencilFunc(GL_ALWAYS, GEOMETRY_STENCIL_BIT, GEOMETRY_STENCIL_BIT);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  glStencilMask(GEOMETRY_STENCIL_BIT);
+}
+
+void LightVolumeRenderer::endGeometryMask() {
+  glStencilMask(0xFF);
+  GlState::setStencilTest(false);
+}
+
+void LightVolumeRenderer::draw(const LightRegistry& t_lights,
+                               const float t_farPlane,
+                               TextureRegistry* t_textureRegistry) {
+  m_numVolumes = 0;
+  const LightData& data = t_lights.getLightData();
+  if (data.pointLights.empty() && data.spotLights.empty()) {
+    return;
+  }
+  m_shader.updateUniforms();
+
+  GlState::setStencilTest(true);
+  GlState::setDepthMask(false);
+  GlState::setBlendFunc(GL_ONE, GL_ONE);
+  GlState::setBlendEquation(GL_FUNC_ADD);
+  // Far back faces would be clipped, losing the count of everything behind
+  // them, so clamp them to the far plane instead.
+  glEnable(GL_DEPTH_CLAMP);
+  glStencilMask(COUNT_STENCIL_MASK);
+
+  for (unsigned int i = 0; i < data.pointLights.size(); ++i) {
+    drawVolume(getLightBounds(data.pointLights[i]), t_farPlane, i,
+               /*t_spot=*/false, t_textureRegistry);
+  }
+  for (unsigned int i = 0; i < data.spotLights.size(); ++i) {
+    drawVolume(getLightBounds(data.spotLights[i]), t_farPlane, i,
+               /*t_spot=*/true, t_textureRegistry);
+  }
+
+  glStencilMask(0xFF);
+  glDisable(GL_DEPTH_CLAMP);
+  GlState::setStencilTest(false);
+  GlState::setBlend(false);
+  GlState::setDepthTest(true);
+  GlState::setDepthMask(true);
+  GlState::setCullFace(true);
+  GlState::setCullFaceMode(GL_BACK);
+}
+
+void LightVolumeRenderer::drawVolume(const LightBoundingSphere& t_bounds,
+                                     const float t_farPlane,
+                                     const unsigned int t_light,
+                                     const bool t_spot,
+                                     TextureRegistry* t_textureRegistry) {
+  // A sphere of this radius covers everything within twice the far plane of
+  // the camera, which holds the whole frustum for any sane field of view.
+  const float radius = std::min(
+      t_bounds.radius, glm::length(t_bounds.center) + 2.0f * t_farPlane);
+  // The view looks down -z, so this volume is entirely behind the camera.
+  if (!(radius > 0.0f) || t_bounds.center.z - radius > 0.0f) {
+    return;
+  }
+  ++m_numVolumes;
+
+  // The mesh's faces cut inside the unit sphere, by up to the angle between a
+  // vertex and the middle of a face, so grow it until they clear it.
+  static const float INFLATION =
+      1.0f / std::cos(glm::pi<float>() / NUM_MERIDIANS +
+                      glm::pi<float>() / (2.0f * NUM_PARALLELS));
+  const glm::mat4 model =
+      glm::scale(glm::translate(glm::mat4(1.0f), t_bounds.center),
+                 glm::vec3(radius * INFLATION));
+
+  // Count the faces behind the scene, both sides at once. Pixels without the
+  // geometry bit fail the stencil test and keep a count of zero.
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  GlState::setBlend(false);
+  GlState::setDepthTest(true);
+  GlState::setCullFace(false);
+  glStencilFunc(GL_LEQUAL, GEOMETRY_STENCIL_BIT, GEOMETRY_STENCIL_BIT);
+  glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+  glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+  m_sphere.drawWithModel(model, m_stencilShader);
+
+  // Shade where the count isn't zero, i.e. the stencil is above the bare
+  // geometry bit. Back faces are drawn without a depth test, so the camera
+  // can be inside the volume. Replacing writes the reference's count, zero.
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  GlState::setBlend(true);
+  GlState::setDepthTest(false);
+  GlState::setCullFace(true);
+  GlState::setCullFaceMode(GL_FRONT);
+  glStencilFunc(GL_LESS, GEOMETRY_STENCIL_BIT, 0xFF);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  m_shader.setUInt("lightIndex", t_light);
+  m_shader.setBool("spotLight", t_spot);
+  m_sphere.drawWithModel(model, m_shader, t_textureRegistry);
+}
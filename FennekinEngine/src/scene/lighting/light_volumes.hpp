@@ -0,0 +1,68 @@
+#pragma once
+
+#include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/shader.hpp"
+#include "scene/lighting/light.hpp"
+#include "scene/mesh_primitives.hpp"
+
+#include <glm/glm.hpp>
+
+// Shades point and spot lights by drawing a volume around each over the
+// lighting pass, so a light only costs the pixels it covers on screen. An
+// alternative to the clustered lighting pass for scenes with a few sparse
+// local lights.
+//
+// Each volume is a low poly sphere around the light's bounding sphere, see
+// getLightBounds(), and takes two draws. The first counts, in the low stencil
+// bits, the volume's back faces behind the scene minus its front faces behind
+// it, which leaves a non-zero count only on surfaces inside the volume. The
+// second draws the back faces with additive blending where the count is
+// non-zero, shading just those pixels and resetting their count for the next
+// light. Only pixels the geometry pass marked with GEOMETRY_STENCIL_BIT are
+// counted, so the sky and background are never shaded.
+class LightVolumeRenderer {
+ public:
+  // Set on every pixel the geometry pass draws.
+  static constexpr unsigned int GEOMETRY_STENCIL_BIT = 0x80;
+  // The bits below it, which count volume faces.
+  static constexpr unsigned int COUNT_STENCIL_MASK = GEOMETRY_STENCIL_BIT - 1;
+
+  LightVolumeRenderer();
+
+  // Bracket the geometry pass, so that it sets GEOMETRY_STENCIL_BIT on every
+  // pixel it draws.
+  static void beginGeometryMask();
+  static void endGeometryMask();
+
+  // The program of the shading draws. It takes the lighting pass's material
+  // uniforms, and its uniform sources must provide the G-buffer.
+  Shader& getShader() { return m_shader; }
+
+  // Shades the registry's point and spot lights, which must be in view space,
+  // into the active framebuffer. Its depth and stencil must be copied from the
+  // G-buffer after a masked geometry pass. Lights whose range never ends are
+  // cut off at twice t_farPlane.
+  //
+  // Leaves depth testing and writes on, back face culling on, and stencil
+  // testing and blending off.
+  void draw(const LightRegistry& t_lights, float t_farPlane,
+            TextureRegistry* t_textureRegistry = nullptr);
+
+  // The volumes drawn by the last draw(), skipping those behind the camera.
+  [[nodiscard]] int getNumVolumes() const { return m_numVolumes; }
+
+ private:
+  // Coarse, since it is drawn twice per light.
+  static constexpr int NUM_MERIDIANS = 16;
+  static constexpr int NUM_PARALLELS = 12;
+
+  void drawVolume(const LightBoundingSphere& t_bounds, float t_farPlane,
+                  unsigned int t_light, bool t_spot,
+                  TextureRegistry* t_textureRegistry);
+
+  SphereMesh m_sphere;
+  // Depth only, for the counting draws.
+  Shader m_stencilShader;
+  Shader m_shader;
+  int m_numVolumes = 0;
+};
@@ -0,0 +1,481 @@
+#include "shadow_atlas.hpp"
+
+#include "rendering/core/gl_state.hpp"
+#include "rendering/resources/cubemap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+
+// Where the tiles' frustums start, unless the light's range is shorter.
+static constexpr float SHADOW_NEAR_PLANE = 0.05f;
+// Wider spots would need a tile of nearly infinite extent.
+static constexpr float MAX_SPOT_ANGLE = glm::radians(80.0f);
+
+static float maxComponent(const glm::vec3& t_vector) {
+  return std::max({t_vector.x, t_vector.y, t_vector.z});
+}
+
+static bool sphereOverlapsBox(const glm::vec3& t_center, const float t_radius,
+                              const glm::vec3& t_boxCenter,
+                              const glm::vec3& t_boxExtents) {
+  const glm::vec3 outside = glm::max(
+      glm::abs(t_center - t_boxCenter) - t_boxExtents, glm::vec3(0.0f));
+  return glm::dot(outside, outside) <= t_radius * t_radius;
+}
+
+static bool sphereInFrustum(const Frustum& t_frustum,
+                            const glm::vec3& t_center, const float t_radius) {
+  for (const glm::vec4& plane : t_frustum.planes) {
+    if (glm::dot(glm::vec3(plane), t_center) + plane.w < -t_radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ShadowAtlasAllocator::ShadowAtlasAllocator(const int t_size,
+                                           const int t_minTileSize)
+    : m_size(t_size), m_minTileSize(t_minTileSize) {
+  clear();
+}
+
+int ShadowAtlasAllocator::getLevel(const int t_tileSize) const {
+  return std::countr_zero(static_cast<unsigned int>(m_size)) -
+         std::countr_zero(static_cast<unsigned int>(t_tileSize));
+}
+
+bool ShadowAtlasAllocator::allocate(const int t_tileSize,
+                                    glm::ivec2& t_origin) {
+  const int level = getLevel(t_tileSize);
+  // Take the smallest free tile that's large enough.
+  int freeLevel = level;
+  while (freeLevel >= 0 && m_freeTiles[freeLevel].empty()) {
+    --freeLevel;
+  }
+  if (freeLevel < 0) {
+    return false;
+  }
+  glm::ivec2 origin = m_freeTiles[freeLevel].back();
+  m_freeTiles[freeLevel].pop_back();
+
+  // Split it down to size, keeping the first quarter each time.
+  for (int splitLevel = freeLevel + 1; splitLevel <= level; ++splitLevel) {
+    const int half = m_size >> splitLevel;
+    m_freeTiles[splitLevel].push_back(origin + glm::ivec2(half, 0));
+    m_freeTiles[splitLevel].push_back(origin + glm::ivec2(0, half));
+    m_freeTiles[splitLevel].push_back(origin + glm::ivec2(half, half));
+  }
+  t_origin = origin;
+  m_usedArea += static_cast<int64_t>(t_tileSize) * t_tileSize;
+  return true;
+}
+
+void ShadowAtlasAllocator::free(glm::ivec2 t_origin, int t_tileSize) {
+  m_usedArea -= static_cast<int64_t>(t_tileSize) * t_tileSize;
+  int level = getLevel(t_tileSize);
+  // Merge with the siblings for as long as all of them are free.
+  while (level > 0) {
+    std::vector<glm::ivec2>& freeTiles = m_freeTiles[level];
+    const glm::ivec2 parent = t_origin - t_origin % (2 * t_tileSize);
+    const glm::ivec2 siblings[4] = {
+        parent, parent + glm::ivec2(t_tileSize, 0),
+        parent + glm::ivec2(0, t_tileSize),
+        parent + glm::ivec2(t_tileSize, t_tileSize)};
+    int numFree = 0;
+    for (const glm::ivec2& sibling : siblings) {
+      numFree += sibling == t_origin ||
+                 std::find(freeTiles.begin(), freeTiles.end(), sibling) !=
+                     freeTiles.end();
+    }
+    if (numFree < 4) {
+      break;
+    }
+    std::erase_if(freeTiles, [&parent, t_tileSize](const glm::ivec2& t_tile) {
+      return t_tile - t_tile % (2 * t_tileSize) == parent;
+    });
+    t_origin = parent;
+    t_tileSize *= 2;
+    --level;
+  }
+  m_freeTiles[level].push_back(t_origin);
+}
+
+void ShadowAtlasAllocator::clear() {
+  m_freeTiles.assign(getLevel(m_minTileSize) + 1, {});
+  m_freeTiles[0].emplace_back(0, 0);
+  m_usedArea = 0;
+}
+
+ShadowAtlas::ShadowAtlas(const int t_size)
+    : Framebuffer(t_size, t_size),
+      m_size(t_size),
+      m_allocator(t_size, MIN_TILE_SIZE),
+      m_shader(ShaderPath("content/shaders/builtin/shadow_map.vert"),
+               ShaderPath("content/shaders/builtin/shadow_atlas.frag"),
+               ShaderPath("content/shaders/builtin/shadow_atlas.geom")) {
+  m_depthAttachment =
+      attachTexture(EBufferType::DEPTH,
+                    {
+                        .filtering = ETextureFiltering::NEAREST,
+                        .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE,
+                    });
+}
+
+bool ShadowAtlas::fitLight(const Light& t_light, LightTiles& t_tiles) {
+  glm::vec3 diffuse;
+  glm::vec3 specular;
+  Attenuation attenuation;
+  if (t_light.getLightType() == ELightType::POINT_LIGHT) {
+    const auto& light = static_cast<const PointLight&>(t_light);
+    t_tiles.spot = false;
+    t_tiles.position = light.getPosition();
+    t_tiles.direction = glm::vec3(0.0f);
+    t_tiles.outerAngle = 0.0f;
+    diffuse = light.getDiffuse();
+    specular = light.getSpecular();
+    attenuation = light.getAttenuation();
+  } else if (t_light.getLightType() == ELightType::SPOT_LIGHT) {
+    const auto& light = static_cast<const SpotLight&>(t_light);
+    t_tiles.spot = true;
+    t_tiles.position = light.getPosition();
+    t_tiles.direction = glm::normalize(light.getDirection());
+    t_tiles.outerAngle = light.getOuterAngle();
+    diffuse = light.getDiffuse();
+    specular = light.getSpecular();
+    attenuation = light.getAttenuation();
+    if (!(t_tiles.outerAngle < MAX_SPOT_ANGLE)) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  const float intensity =
+      std::max(maxComponent(diffuse), maxComponent(specular));
+  t_tiles.range = getLightRange(attenuation, intensity);
+  if (!(t_tiles.range > 0.0f) || std::isinf(t_tiles.range)) {
+    return false;
+  }
+  if (t_tiles.spot) {
+    Std430SpotLight data{};
+    data.position = t_tiles.position;
+    data.direction = t_tiles.direction;
+    data.outerAngle = t_tiles.outerAngle;
+    data.diffuse = diffuse;
+    data.specular = specular;
+    data.attenuation = attenuation;
+    const LightBoundingSphere bounds = getLightBounds(data);
+    t_tiles.center = bounds.center;
+    t_tiles.radius = bounds.radius;
+  } else {
+    t_tiles.center = t_tiles.position;
+    t_tiles.radius = t_tiles.range;
+  }
+  return true;
+}
+
+bool ShadowAtlas::allocateTiles(LightTiles& t_tiles, const int t_tileSize) {
+  const int numTiles = getNumTiles(t_tiles);
+  for (int i = 0; i < numTiles; ++i) {
+    if (!m_allocator.allocate(t_tileSize, t_tiles.origins[i])) {
+      for (int j = 0; j < i; ++j) {
+        m_allocator.free(t_tiles.origins[j], t_tileSize);
+      }
+      return false;
+    }
+  }
+  t_tiles.tileSize = t_tileSize;
+  t_tiles.drawn = false;
+  return true;
+}
+
+void ShadowAtlas::freeTiles(LightTiles& t_tiles) {
+  if (t_tiles.tileSize == 0) {
+    return;
+  }
+  for (int i = 0; i < getNumTiles(t_tiles); ++i) {
+    m_allocator.free(t_tiles.origins[i], t_tiles.tileSize);
+  }
+  t_tiles.tileSize = 0;
+  t_tiles.drawn = false;
+}
+
+void ShadowAtlas::computeViewProjections(const LightTiles& t_tiles,
+                                         glm::mat4* t_viewProjections) {
+  const float nearPlane = std::min(SHADOW_NEAR_PLANE, 0.5f * t_tiles.range);
+  if (t_tiles.spot) {
+    const glm::vec3 up = std::abs(t_tiles.direction.y) > 0.99f
+                             ? glm::vec3(0.0f, 0.0f, 1.0f)
+                             : glm::vec3(0.0f, 1.0f, 0.0f);
+    t_viewProjections[0] =
+        glm::perspective(2.0f * t_tiles.outerAngle, 1.0f, nearPlane,
+                         t_tiles.range) *
+        glm::lookAt(t_tiles.position, t_tiles.position + t_tiles.direction,
+                    up);
+    return;
+  }
+  const glm::mat4 projection =
+      glm::perspective(glm::half_pi<float>(), 1.0f, nearPlane, t_tiles.range);
+  // The tiles follow the faces of a cubemap, which lighting.frag relies on.
+  const std::array<glm::mat4, 6> faceViews =
+      getCubemapFaceViews(t_tiles.position);
+  for (int face = 0; face < MAX_TILES_PER_LIGHT; ++face) {
+    t_viewProjections[face] = projection * faceViews[face];
+  }
+}
+
+void ShadowAtlas::update(const LightRegistry& t_lights, const Camera& t_camera,
+                         Scene& t_scene, const glm::mat4& t_rootTransform) {
+  const Frustum frustum = t_camera.getFrustum();
+  const glm::vec3 cameraPosition = t_camera.getPosition();
+  const float projectionScale = t_camera.getProjectionTransform()[1][1];
+
+  // Fit the shadow casting lights in view, and rank them by the share of the
+  // screen their range covers.
+  std::vector<Light*> order;
+  std::vector<Light*> unshadowed;
+  for (Light* light : t_lights.getLights()) {
+    LightTiles fitted;
+    if (!light->getCastsShadows() || !fitLight(*light, fitted) ||
+        !sphereInFrustum(frustum, fitted.center, fitted.radius)) {
+      unshadowed.push_back(light);
+      continue;
+    }
+    const float distance = glm::length(fitted.center - cameraPosition);
+    fitted.importance =
+        distance <= fitted.radius
+            ? 1.0f
+            : std::min(projectionScale * fitted.radius / distance, 1.0f);
+
+    LightTiles& tiles = m_lights[light];
+    tiles.position = fitted.position;
+    tiles.direction = fitted.direction;
+    tiles.outerAngle = fitted.outerAngle;
+    tiles.range = fitted.range;
+    tiles.center = fitted.center;
+    tiles.radius = fitted.radius;
+    tiles.spot = fitted.spot;
+    tiles.importance = fitted.importance;
+    order.push_back(light);
+  }
+  std::sort(order.begin(), order.end(),
+            [this](const Light* t_a, const Light* t_b) {
+              return m_lights[t_a].importance > m_lights[t_b].importance;
+            });
+
+  // Drop the lights that left the view, were removed or stopped casting.
+  for (auto it = m_lights.begin(); it != m_lights.end();) {
+    if (std::find(order.begin(), order.end(), it->first) == order.end()) {
+      freeTiles(it->second);
+      it = m_lights.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (Light* light : unshadowed) {
+    light->setShadowIndex(-1);
+  }
+
+  // Resize the tiles of lights that grew, or shrank to well under their
+  // size, so that small moves of the camera don't redraw them.
+  std::vector<int> tileSizes(order.size());
+  const int maxTileSize = m_size / 4;
+  for (size_t i = 0; i < order.size(); ++i) {
+    LightTiles& tiles = m_lights[order[i]];
+    const int resolution =
+        std::clamp(order[i]->getShadowResolution(), MIN_TILE_SIZE, maxTileSize);
+    const auto wanted = static_cast<unsigned int>(std::max(
+        tiles.importance * static_cast<float>(resolution), 1.0f));
+    tileSizes[i] = std::clamp(static_cast<int>(std::bit_floor(wanted)),
+                              MIN_TILE_SIZE,
+                              static_cast<int>(std::bit_floor(
+                                  static_cast<unsigned int>(resolution))));
+    if (tiles.tileSize != 0 && (tileSizes[i] > tiles.tileSize ||
+                                2 * tileSizes[i] < tiles.tileSize)) {
+      freeTiles(tiles);
+    }
+  }
+
+  // Hand out tiles in order of importance. A light that doesn't fit takes
+  // the tiles of the least important ones, before settling for less.
+  for (size_t i = 0; i < order.size(); ++i) {
+    LightTiles& tiles = m_lights[order[i]];
+    int tileSize = tileSizes[i];
+    while (tiles.tileSize == 0) {
+      if (allocateTiles(tiles, tileSize)) {
+        break;
+      }
+      bool evicted = false;
+      for (size_t j = order.size() - 1; j > i && !evicted; --j) {
+        LightTiles& other = m_lights[order[j]];
+        if (other.tileSize != 0) {
+          freeTiles(other);
+          evicted = true;
+        }
+      }
+      if (evicted) {
+        continue;
+      }
+      if (tileSize == MIN_TILE_SIZE) {
+        break;
+      }
+      tileSize /= 2;
+    }
+  }
+
+  // Queue the lights whose tiles are out of date, up to the frame's budget.
+  std::vector<glm::vec3> dynamicCenters;
+  std::vector<glm::vec3> dynamicExtents;
+  const std::vector<SceneDrawItem>& items =
+      t_scene.getDrawItems(t_rootTransform);
+  const CullingBounds& bounds = t_scene.getWorldBounds();
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (items[i].mesh->isDynamic()) {
+      dynamicCenters.emplace_back(bounds.centerX()[i], bounds.centerY()[i],
+                                  bounds.centerZ()[i]);
+      dynamicExtents.emplace_back(bounds.extentX()[i], bounds.extentY()[i],
+                                  bounds.extentZ()[i]);
+    }
+  }
+  const uint64_t staticRevision = t_scene.getStaticRevision();
+  m_pending.clear();
+  for (Light* light : order) {
+    LightTiles& tiles = m_lights[light];
+    if (tiles.tileSize == 0 ||
+        static_cast<int>(m_pending.size()) >= m_maxLightsPerFrame) {
+      continue;
+    }
+    bool stale = !tiles.drawn || tiles.drawnPosition != tiles.position ||
+                 tiles.drawnDirection != tiles.direction ||
+                 tiles.drawnOuterAngle != tiles.outerAngle ||
+                 tiles.drawnRange != tiles.range ||
+                 tiles.drawnStaticRevision != staticRevision;
+    for (size_t i = 0; i < dynamicCenters.size() && !stale; ++i) {
+      stale = sphereOverlapsBox(tiles.center, tiles.radius, dynamicCenters[i],
+                                dynamicExtents[i]);
+    }
+    if (stale) {
+      computeViewProjections(tiles, tiles.viewProjections);
+      m_pending.push_back(light);
+    }
+  }
+
+  // Lights see their tiles in view space, like their positions.
+  const glm::mat4 inverseView = glm::inverse(t_camera.getViewTransform());
+  const float atlasSize = static_cast<float>(m_size);
+  m_tiles.clear();
+  for (Light* light : order) {
+    const LightTiles& tiles = m_lights[light];
+    const bool pending =
+        std::find(m_pending.begin(), m_pending.end(), light) != m_pending.end();
+    if (tiles.tileSize == 0 || (!tiles.drawn && !pending)) {
+      light->setShadowIndex(-1);
+      continue;
+    }
+    light->setShadowIndex(static_cast<int>(m_tiles.size()));
+    for (int i = 0; i < getNumTiles(tiles); ++i) {
+      m_tiles.push_back(
+          {.viewProjection = tiles.viewProjections[i] * inverseView,
+           .rect = glm::vec4(glm::vec2(tiles.origins[i]),
+                             static_cast<float>(tiles.tileSize),
+                             static_cast<float>(tiles.tileSize)) /
+                   atlasSize,
+           .invRange = 1.0f / tiles.range,
+           .size = static_cast<float>(tiles.tileSize),
+           .pad0 = {0.0f, 0.0f}});
+    }
+  }
+  if (!m_tiles.empty()) {
+    m_tileBuffer.update(m_tiles.data(),
+                        m_tiles.size() * sizeof(Std430ShadowTile));
+  }
+
+  m_stats.shadowedLights = 0;
+  for (const Light* light : order) {
+    m_stats.shadowedLights += m_lights[light].tileSize != 0;
+  }
+  m_stats.tiles = static_cast<int>(m_tiles.size());
+  m_stats.usedFraction = static_cast<float>(m_allocator.getUsedArea()) /
+                         (atlasSize * atlasSize);
+}
+
+void ShadowAtlas::render(Scene& t_scene, const glm::mat4& t_rootTransform) {
+  m_stats.lightsDrawn = static_cast<int>(m_pending.size());
+  if (m_pending.empty()) {
+    return;
+  }
+  activate();
+  const uint64_t staticRevision = t_scene.getStaticRevision();
+  for (const Light* light : m_pending) {
+    LightTiles& tiles = m_lights[light];
+    drawLight(tiles, t_scene, t_rootTransform);
+    tiles.drawn = true;
+    tiles.drawnPosition = tiles.position;
+    tiles.drawnDirection = tiles.direction;
+    tiles.drawnOuterAngle = tiles.outerAngle;
+    tiles.drawnRange = tiles.range;
+    tiles.drawnStaticRevision = staticRevision;
+  }
+  m_pending.clear();
+  deactivate();
+}
+
+void ShadowAtlas::drawLight(LightTiles& t_tiles, Scene& t_scene,
+                            const glm::mat4& t_rootTransform) {
+  const float farDistance = 1.0f;
+  const unsigned int texture = m_depthAttachment.id;
+  const int numTiles = getNumTiles(t_tiles);
+  for (int i = 0; i < numTiles; ++i) {
+    const glm::ivec2& origin = t_tiles.origins[i];
+    glClearTexSubImage(texture, /*level=*/0, origin.x, origin.y, 0,
+                       t_tiles.tileSize, t_tiles.tileSize, 1,
+                       GL_DEPTH_COMPONENT, GL_FLOAT, &farDistance);
+    GlState::setViewportIndexed(static_cast<unsigned int>(i), origin.x,
+                                origin.y, t_tiles.tileSize, t_tiles.tileSize);
+    m_shader.setMat4("tileViewProjections[" + std::to_string(i) + "]",
+                     t_tiles.viewProjections[i]);
+  }
+  m_shader.setInt("tileCount", numTiles);
+  m_shader.setVec3("lightPosition", t_tiles.position);
+  m_shader.setFloat("lightRange", t_tiles.range);
+
+  // Only meshes within the light's reach can cast into its tiles.
+  const std::vector<SceneDrawItem>& items =
+      t_scene.getDrawItems(t_rootTransform);
+  const CullingBounds& bounds = t_scene.getWorldBounds();
+  m_queue.begin(glm::translate(glm::mat4(1.0f), -t_tiles.position));
+  for (size_t i = 0; i < items.size(); ++i) {
+    const glm::vec3 center(bounds.centerX()[i], bounds.centerY()[i],
+                           bounds.centerZ()[i]);
+    const glm::vec3 extents(bounds.extentX()[i], bounds.extentY()[i],
+                            bounds.extentZ()[i]);
+    if (sphereOverlapsBox(t_tiles.center, t_tiles.radius, center, extents)) {
+      m_queue.addMesh(*items[i].mesh, items[i].transform, m_shader);
+    }
+  }
+  m_queue.sort();
+  m_queue.submit(nullptr, ERenderPass::DEPTH_ONLY);
+}
+
+void ShadowAtlas::releaseTiles(const LightRegistry& t_lights) {
+  m_lights.clear();
+  m_pending.clear();
+  m_allocator.clear();
+  for (Light* light : t_lights.getLights()) {
+    light->setShadowIndex(-1);
+  }
+  m_stats = {};
+}
+
+unsigned int ShadowAtlas::bindTexture(const unsigned int t_nextTextureUnit,
+                                      Shader& t_shader) {
+  m_depthAttachment.asTexture().bindToUnit(t_nextTextureUnit);
+  t_shader.setInt("fnk_shadowAtlas", t_nextTextureUnit);
+  t_shader.setBool("fnk_useShadowAtlas", true);
+  return t_nextTextureUnit + 1;
+}
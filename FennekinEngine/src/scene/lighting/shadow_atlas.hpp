@@ -0,0 +1,165 @@
+#pragma once
+
+#include "rendering/core/framebuffer.hpp"
+#include "rendering/core/render_queue.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/shader.hpp"
+#include "scene/camera.hpp"
+#include "scene/lighting/light.hpp"
+#include "scene/scene.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+// Hands out square tiles of a square atlas, with power of two sides, as a
+// quadtree: a free tile is split into four to serve a smaller one, and four
+// free siblings are merged back into their parent.
+class ShadowAtlasAllocator {
+ public:
+  ShadowAtlasAllocator(int t_size, int t_minTileSize);
+
+  // Finds room for a tile of the given side, which must be a power of two
+  // between the minimum tile size and the atlas size. Returns false if there
+  // is none left.
+  bool allocate(int t_tileSize, glm::ivec2& t_origin);
+  // Returns a tile given out by allocate().
+  void free(glm::ivec2 t_origin, int t_tileSize);
+  // Frees every tile.
+  void clear();
+
+  // The texels of all tiles given out.
+  [[nodiscard]] int64_t getUsedArea() const { return m_usedArea; }
+
+ private:
+  int getLevel(int t_tileSize) const;
+
+  int m_size;
+  int m_minTileSize;
+  // The free tiles of each level, where level 0 is the whole atlas and each
+  // level halves the side of the one before.
+  std::vector<std::vector<glm::ivec2>> m_freeTiles;
+  int64_t m_usedArea = 0;
+};
+
+// CPU side mirror of the std430 FnkShadowTile struct in core.glsl.
+struct Std430ShadowTile {
+  glm::mat4 viewProjection;
+  glm::vec4 rect;
+  float invRange;
+  float size;
+  float pad0[2];
+};
+
+static_assert(sizeof(Std430ShadowTile) == 96);
+
+// Counts of the last ShadowAtlas::update() and render().
+struct ShadowAtlasStats {
+  int shadowedLights = 0;
+  int tiles = 0;
+  // Lights whose tiles were drawn by the last render().
+  int lightsDrawn = 0;
+  // The fraction of the atlas given out.
+  float usedFraction = 0.0f;
+};
+
+// Shadows for point and spot lights, packed as tiles of one depth texture.
+//
+// Every shadow casting light, see Light::getCastsShadows(), whose range is in
+// view gets a tile sized by how large that range looks on screen, up to the
+// light's shadow resolution: one for a spot light, and six for a point light,
+// one per cube face. Tiles come from a fixed size atlas, so shadow memory
+// never grows. When it runs out, the least important lights give up their
+// tiles first, and the rest settle for smaller ones or none.
+//
+// A light's tiles are kept until it moves, its tiles change size, the static
+// scene changes or a dynamic mesh is in its range, and only a few lights are
+// redrawn per frame. All tiles of a light are drawn in one pass, with each
+// triangle sent to every tile's viewport by the geometry shader.
+class ShadowAtlas final : public Framebuffer, public TextureSource {
+ public:
+  static constexpr int MIN_TILE_SIZE = 64;
+
+  explicit ShadowAtlas(int t_size = 4096);
+
+  // Assigns tiles to the registry's shadow casting lights for the camera's
+  // view of the scene, and uploads them. Must be called before the registry's
+  // updateUniformBlock(), which passes each light its tiles.
+  void update(const LightRegistry& t_lights, const Camera& t_camera,
+              Scene& t_scene, const glm::mat4& t_rootTransform);
+  // Draws the tiles update() found out of date.
+  void render(Scene& t_scene, const glm::mat4& t_rootTransform);
+  // Takes every tile back, leaving the registry's lights without shadows.
+  void releaseTiles(const LightRegistry& t_lights);
+
+  // The most lights whose tiles are redrawn in a frame.
+  void setMaxLightsPerFrame(const int t_count) {
+    m_maxLightsPerFrame = t_count;
+  }
+
+  Texture getDepthTexture() { return m_depthAttachment.asTexture(); }
+  [[nodiscard]] const ShadowAtlasStats& getStats() const { return m_stats; }
+
+  unsigned int bindTexture(unsigned int t_nextTextureUnit,
+                           Shader& t_shader) override;
+
+ private:
+  static constexpr int MAX_TILES_PER_LIGHT = 6;
+
+  // A shadow casting light and the tiles it holds.
+  struct LightTiles {
+    // The world space values the tiles are fitted to.
+    glm::vec3 position{};
+    glm::vec3 direction{};
+    float outerAngle = 0.0f;
+    float range = 0.0f;
+    // A sphere around everything the light reaches.
+    glm::vec3 center{};
+    float radius = 0.0f;
+    bool spot = false;
+
+    float importance = 0.0f;
+    // 0 while the light holds no tiles.
+    int tileSize = 0;
+    glm::ivec2 origins[MAX_TILES_PER_LIGHT]{};
+    // The world space view projection of each tile, as last drawn.
+    glm::mat4 viewProjections[MAX_TILES_PER_LIGHT]{};
+    // Whether the tiles hold a shadow, and of what.
+    bool drawn = false;
+    glm::vec3 drawnPosition{};
+    glm::vec3 drawnDirection{};
+    float drawnOuterAngle = 0.0f;
+    float drawnRange = 0.0f;
+    uint64_t drawnStaticRevision = 0;
+  };
+
+  // Fills in t_tiles from the light, or returns false if it can't have a
+  // shadow.
+  static bool fitLight(const Light& t_light, LightTiles& t_tiles);
+  static int getNumTiles(const LightTiles& t_tiles) {
+    return t_tiles.spot ? 1 : MAX_TILES_PER_LIGHT;
+  }
+  bool allocateTiles(LightTiles& t_tiles, int t_tileSize);
+  void freeTiles(LightTiles& t_tiles);
+  // The view projections of the light's tiles as currently fitted.
+  static void computeViewProjections(const LightTiles& t_tiles,
+                                     glm::mat4* t_viewProjections);
+  void drawLight(LightTiles& t_tiles, Scene& t_scene,
+                 const glm::mat4& t_rootTransform);
+
+  int m_size;
+  int m_maxLightsPerFrame = 8;
+  Attachment m_depthAttachment;
+  ShadowAtlasAllocator m_allocator;
+  std::unordered_map<const Light*, LightTiles> m_lights;
+  // The lights to draw in the next render(), most important first.
+  std::vector<const Light*> m_pending;
+
+  Shader m_shader;
+  RenderQueue m_queue;
+  std::vector<Std430ShadowTile> m_tiles;
+  StorageBuffer m_tileBuffer{EStorageBufferBinding::SHADOW_TILES};
+  ShadowAtlasStats m_stats;
+};
@@ -1,39 +1,173 @@
 #include "shadows.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 
-ShadowCamera::ShadowCamera(const std::shared_ptr<DirectionalLight>& t_light, const float t_cuboidExtents, float near, float far, const float t_shadowCameraDistanceFromOrigin, const glm::vec3 t_worldUp)
+ShadowCamera::ShadowCamera(const std::shared_ptr<DirectionalLight>& t_light,
+                           const int t_mapSize, const int t_numCascades,
+                           const glm::vec3 t_worldUp)
     : m_light(t_light),
-      m_cuboidExtents(t_cuboidExtents),
-      m_near(near),
-      m_far(far),
-      m_shadowCameraDistanceFromOrigin(t_shadowCameraDistanceFromOrigin),
+      m_mapSize(t_mapSize),
+      m_numCascades(std::clamp(t_numCascades, MIN_SHADOW_CASCADES,
+                               MAX_SHADOW_CASCADES)),
       m_worldUp(t_worldUp) {}
 
-glm::mat4 ShadowCamera::getViewTransform() const {
-  return glm::lookAt(m_shadowCameraDistanceFromOrigin * -m_light->getDirection(),
-                     glm::vec3(0.0f), m_worldUp);
+void ShadowCamera::setNumCascades(const int t_numCascades) {
+  m_numCascades =
+      std::clamp(t_numCascades, MIN_SHADOW_CASCADES, MAX_SHADOW_CASCADES);
 }
 
-glm::mat4 ShadowCamera::getProjectionTransform() const {
-  // Directional lights cast orthographic shadows.
-  return glm::ortho(-m_cuboidExtents, m_cuboidExtents, -m_cuboidExtents,
-                    m_cuboidExtents, m_near, m_far);
+void ShadowCamera::fit(const Camera& t_camera) {
+  // Only the light's rotation matters, so its view doesn't move with the
+  // camera and texel snapping stays put.
+  const glm::vec3 direction = glm::normalize(m_light->getDirection());
+  const glm::vec3 up =
+      std::abs(glm::dot(direction, glm::normalize(m_worldUp))) > 0.99f
+          ? glm::vec3(1.0f, 0.0f, 0.0f)
+          : m_worldUp;
+  m_lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+  // The view looks down -z, in both the camera's and the light's view.
+  const glm::mat4 cameraView = t_camera.getViewTransform();
+  float nearDepth = t_camera.getNearPlane();
+  float farDepth =
+      std::min(t_camera.getFarPlane(), std::max(m_maxDistance, nearDepth));
+  Aabb lightBounds;
+  if (!m_sceneBounds.isEmpty()) {
+    const Aabb viewBounds = m_sceneBounds.transformed(cameraView);
+    nearDepth = std::max(nearDepth, -viewBounds.max.z);
+    farDepth = std::min(farDepth, -viewBounds.min.z);
+    lightBounds = m_sceneBounds.transformed(m_lightView);
+  }
+  // With nothing in view, any non-empty range will do.
+  farDepth = std::max(farDepth, nearDepth * 1.001f);
+
+  const float tanY = std::tan(glm::radians(t_camera.getFov()) * 0.5f);
+  const float tanX = tanY * t_camera.getAspectRatio();
+  // The squared slope of the frustum's corner edges.
+  const float cornerSlope2 = tanX * tanX + tanY * tanY;
+  const glm::mat4 cameraToWorld = glm::inverse(cameraView);
+
+  glm::vec3 coverMin(std::numeric_limits<float>::max());
+  glm::vec3 coverMax(std::numeric_limits<float>::lowest());
+  float sliceNear = nearDepth;
+  m_block = {};
+  m_block.cascadeCount = m_numCascades;
+  for (int i = 0; i < m_numCascades; ++i) {
+    const float t =
+        static_cast<float>(i + 1) / static_cast<float>(m_numCascades);
+    const float logSplit = nearDepth * std::pow(farDepth / nearDepth, t);
+    const float uniformSplit = nearDepth + (farDepth - nearDepth) * t;
+    const float sliceFar = glm::mix(uniformSplit, logSplit, m_splitLambda);
+
+    // The smallest sphere around the slice is centered on the view axis, at
+    // the same distance from its near and far corners, unless that falls
+    // past the far plane.
+    float center = (sliceNear + sliceFar) * (1.0f + cornerSlope2) * 0.5f;
+    float radius;
+    if (center >= sliceFar) {
+      center = sliceFar;
+      radius = sliceFar * std::sqrt(cornerSlope2);
+    } else {
+      radius = std::sqrt((center - sliceNear) * (center - sliceNear) +
+                         sliceNear * sliceNear * cornerSlope2);
+    }
+    // The splits follow the scene bounds, so round the size up to steps of
+    // about 9%. The texel size then only changes when a step is crossed.
+    radius = std::exp2(std::ceil(std::log2(radius) * 8.0f) / 8.0f);
+
+    glm::vec3 lightCenter =
+        m_lightView * cameraToWorld * glm::vec4(0.0f, 0.0f, -center, 1.0f);
+    const float texelSize = 2.0f * radius / static_cast<float>(m_mapSize);
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // Receivers lie in the sphere, but casters can be anywhere between it
+    // and the light, which looks down -z.
+    float minZ = lightCenter.z - radius;
+    float maxZ = lightCenter.z + radius;
+    if (!lightBounds.isEmpty()) {
+      minZ = std::max(minZ, lightBounds.min.z);
+      maxZ = lightBounds.max.z;
+    }
+    // Keep some range for depth to live in, even for flat scenes.
+    const float padding = std::max((maxZ - minZ) * 0.01f, 1e-3f);
+    minZ -= padding;
+    maxZ = std::max(maxZ, minZ) + padding;
+
+    const glm::vec3 boxMin(lightCenter.x - radius, lightCenter.y - radius,
+                           minZ);
+    const glm::vec3 boxMax(lightCenter.x + radius, lightCenter.y + radius,
+                           maxZ);
+    coverMin = glm::min(coverMin, boxMin);
+    coverMax = glm::max(coverMax, boxMax);
+    m_block.cascadeViewProjections[i] =
+        glm::ortho(boxMin.x, boxMax.x, boxMin.y, boxMax.y, -boxMax.z,
+                   -boxMin.z) *
+        m_lightView;
+    m_block.cascadeSplits[i] = sliceFar;
+    sliceNear = sliceFar;
+  }
+  m_coverProjection = glm::ortho(coverMin.x, coverMax.x, coverMin.y,
+                                 coverMax.y, -coverMax.z, -coverMin.z);
 }
 
-void ShadowCamera::updateUniforms(Shader& t_shader) {
-  t_shader.setMat4("lightViewProjection",
-                 getProjectionTransform() * getViewTransform());
+Frustum ShadowCamera::getFrustum() const {
+  return Frustum::fromViewProjection(m_coverProjection * m_lightView);
 }
 
-ShadowMap::ShadowMap(const int t_width, const int t_height) : Framebuffer(t_width, t_height) {
-  // Attach the depth texture used for the shadow map.
-  // TODO: Support omnidirectional shadow maps.
-  m_depthAttachment = attachTexture(
-      EBufferType::DEPTH, {
-                             .filtering = ETextureFiltering::NEAREST,
-                             .wrapMode = ETextureWrapMode::CLAMP_TO_BORDER,
-                             .borderColor = glm::vec4(1.0f),
-                         });
+void ShadowCamera::updateUniformBlock() {
+  if (m_uploaded &&
+      std::memcmp(&m_uploadedBlock, &m_block, sizeof(ShadowUniformBlock)) ==
+          0) {
+    m_uniformBuffer.bind();
+    return;
+  }
+  m_uniformBuffer.update(m_block);
+  m_uploadedBlock = m_block;
+  m_uploaded = true;
+}
+
+ShadowMap::ShadowMap(const int t_size, const int t_numCascades)
+    : Framebuffer(t_size, t_size) {
+  // Attach the depth texture used for the shadow map, one layer per cascade.
+  // Point and spot lights have their own, see ShadowAtlas.
+  m_depthAttachment = attachTextureArray(
+      EBufferType::DEPTH, t_numCascades,
+      {
+          .filtering = ETextureFiltering::NEAREST,
+          .wrapMode = ETextureWrapMode::CLAMP_TO_BORDER,
+          .borderColor = glm::vec4(1.0f),
+      });
+
+  m_cascadeViews.resize(t_numCascades);
+  glGenTextures(t_numCascades, m_cascadeViews.data());
+  for (int i = 0; i < t_numCascades; ++i) {
+    glTextureView(m_cascadeViews[i], GL_TEXTURE_2D, m_depthAttachment.id,
+                  bufferTypeToGlInternalFormat(EBufferType::DEPTH),
+                  /*minlevel=*/0, /*numlevels=*/1, /*minlayer=*/i,
+                  /*numlayers=*/1);
+    glTextureParameteri(m_cascadeViews[i], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(m_cascadeViews[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+}
+
+ShadowMap::~ShadowMap() {
+  for (const unsigned int view : m_cascadeViews) {
+    GlState::forgetTexture(view);
+  }
+  glDeleteTextures(static_cast<int>(m_cascadeViews.size()),
+                   m_cascadeViews.data());
+}
+
+Texture ShadowMap::getCascadeTexture(const int t_cascade) {
+  Attachment view = m_depthAttachment;
+  view.id = m_cascadeViews[t_cascade];
+  view.textureType = ETextureType::TEXTURE_2D;
+  view.numLayers = 1;
+  return view.asTexture();
 }
 
 unsigned int ShadowMap::bindTexture(const unsigned int t_nextTextureUnit,
@@ -43,3 +177,51 @@ unsigned int ShadowMap::bindTexture(const unsigned int t_nextTextureUnit,
   t_shader.setInt("shadowMap", t_nextTextureUnit);
   return t_nextTextureUnit + 1;
 }
+
+ShadowCache::ShadowCache(const int t_size, const int t_numCascades)
+    : m_staticMap(t_size, t_numCascades), m_size(t_size) {}
+
+unsigned int ShadowCache::update(const ShadowCamera& t_camera,
+                                 const uint64_t t_staticRevision) {
+  if (t_staticRevision != m_staticRevision) {
+    m_staticRevision = t_staticRevision;
+    m_validCascades = 0;
+  }
+  unsigned int staleCascades = 0;
+  for (int i = 0; i < t_camera.getNumCascades(); ++i) {
+    const glm::mat4 viewProjection = t_camera.getCascadeViewProjection(i);
+    if (!((m_validCascades >> i) & 1u) ||
+        viewProjection != m_viewProjections[i]) {
+      m_viewProjections[i] = viewProjection;
+      staleCascades |= 1u << i;
+    }
+  }
+  m_validCascades |= staleCascades;
+  if (staleCascades != 0) {
+    m_targetCurrent = false;
+  }
+  return staleCascades;
+}
+
+void ShadowCache::clearCascades(const unsigned int t_cascades) {
+  const float farDepth = 1.0f;
+  const unsigned int texture = m_staticMap.getDepthTexture().getId();
+  for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) {
+    if ((t_cascades >> i) & 1u) {
+      glClearTexSubImage(texture, /*level=*/0, 0, 0, i, m_size, m_size, 1,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+    }
+  }
+}
+
+void ShadowCache::compose(ShadowMap& t_target, const int t_numCascades,
+                          const bool t_drawsDynamic) {
+  if (!m_targetCurrent) {
+    glCopyImageSubData(m_staticMap.getDepthTexture().getId(),
+                       GL_TEXTURE_2D_ARRAY, /*srcLevel=*/0, 0, 0, 0,
+                       t_target.getDepthTexture().getId(),
+                       GL_TEXTURE_2D_ARRAY, /*dstLevel=*/0, 0, 0, 0, m_size,
+                       m_size, t_numCascades);
+  }
+  m_targetCurrent = !t_drawsDynamic;
+}
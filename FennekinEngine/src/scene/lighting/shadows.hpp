@@ -2,66 +2,156 @@
 
 #include "core/debug/exceptions.hpp"
 #include "rendering/core/framebuffer.hpp"
+#include "rendering/core/uniform_buffer.hpp"
 #include "scene/lighting/light.hpp"
 #include "rendering/resources/shader.hpp"
 #include "rendering/resources/texture.hpp"
 #include "rendering/registers/texture_registry.hpp"
+#include "scene/bounds.hpp"
+#include "scene/camera.hpp"
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <glm/gtc/matrix_transform.hpp>
+#include <memory>
+#include <vector>
 
 
-class ShadowCamera final : public UniformSource {
+// The fewest and most cascades a ShadowCamera splits the view into. The
+// maximum must match FNK_MAX_SHADOW_CASCADES in core.glsl.
+constexpr int MIN_SHADOW_CASCADES = 2;
+constexpr int MAX_SHADOW_CASCADES = 4;
+
+// CPU side mirror of the std140 FnkShadow block in core.glsl.
+struct ShadowUniformBlock {
+  glm::mat4 cascadeViewProjections[MAX_SHADOW_CASCADES];
+  // The view space depth at which each cascade ends.
+  glm::vec4 cascadeSplits;
+  int cascadeCount;
+  int pad0[3];
+};
+
+// Fits cascaded shadow maps for a directional light to a camera.
+//
+// The camera's view range is split into slices that grow with distance, and
+// each slice gets its own orthographic cascade, so texels near the camera
+// stay small however far the view reaches. A cascade bounds its slice with a
+// sphere, whose size doesn't change as the camera turns, and its center is
+// snapped to whole texels of the light's view, so shadow edges don't shimmer
+// as the camera moves. The view range and every cascade's depth range are
+// clipped to the scene bounds, which spends the depth precision and the
+// slices only where there is something to shadow.
+class ShadowCamera final : public UniformBlockSource {
  public:
-  // TODO: Currently only renders the origin. Make this more dynamic, and have
-  // it automatically determine a best-fit frustum based on the scene.
   explicit ShadowCamera(const std::shared_ptr<DirectionalLight>& t_light,
-                        float t_cuboidExtents = 10.0f, float near = 0.1f,
-                        float far = 15.0f, float t_shadowCameraDistanceFromOrigin = 7.0f,
+                        int t_mapSize, int t_numCascades = 3,
                         glm::vec3 t_worldUp = glm::vec3(0.0f, 1.0f, 0.0f));
   ~ShadowCamera() override = default;
 
-  float getCuboidExtents() const { return m_cuboidExtents; }
-  void setCuboidExtents(const float t_cuboidExtents) { m_cuboidExtents = t_cuboidExtents; }
-  float getNearPlane() const { return m_near; }
-  void setNearPlane(const float t_near) { m_near = t_near; }
-  float getFarPlane() const { return m_far; }
-  void setFarPlane(const float t_far) { m_far = t_far; }
-  float getDistanceFromOrigin() const {
-    return m_shadowCameraDistanceFromOrigin;
+  int getNumCascades() const { return m_numCascades; }
+  // Clamped to [MIN_SHADOW_CASCADES, MAX_SHADOW_CASCADES].
+  void setNumCascades(int t_numCascades);
+  // Blends the split depths between uniform (0) and logarithmic (1) spacing.
+  float getSplitLambda() const { return m_splitLambda; }
+  void setSplitLambda(float t_lambda) { m_splitLambda = t_lambda; }
+  // How far from the camera shadows reach at most.
+  float getMaxDistance() const { return m_maxDistance; }
+  void setMaxDistance(float t_distance) { m_maxDistance = t_distance; }
+  // The world space bounds of everything that casts or receives shadows.
+  void setSceneBounds(const Aabb& t_bounds) { m_sceneBounds = t_bounds; }
+
+  // Refits the cascades to the camera's view. Must be called whenever the
+  // camera, the light or the scene moves, before updateUniformBlock().
+  void fit(const Camera& t_camera);
+
+  // The light's view, a rotation only, which all cascades share.
+  glm::mat4 getViewTransform() const { return m_lightView; }
+  glm::mat4 getCascadeViewProjection(const int t_cascade) const {
+    return m_block.cascadeViewProjections[t_cascade];
   }
-  void setDistanceFromOrigin(const float t_dist) {
-    m_shadowCameraDistanceFromOrigin = t_dist;
+  // The view space depth at which the cascade ends.
+  float getCascadeSplit(const int t_cascade) const {
+    return m_block.cascadeSplits[t_cascade];
   }
+  // The world space box covered by all cascades, for culling casters.
+  Frustum getFrustum() const;
 
-  glm::mat4 getViewTransform() const;
-  glm::mat4 getProjectionTransform() const;
-
-  void updateUniforms(Shader& t_shader) override;
+  // Writes the cascades into the shared shadow uniform block. Does nothing if
+  // they didn't change since the last write.
+  void updateUniformBlock() override;
 
  private:
   std::shared_ptr<DirectionalLight> m_light;
-  // The extents of the ortho camera's rendering cuboid.
-  float m_cuboidExtents;
-  // The nearPlane plane of the ortho cuboid.
-  float m_near;
-  // The farPlane plane of the ortho cuboid.
-  float m_far;
-  // The fake distance from the origin that the shadow camera is positioned at.
-  float m_shadowCameraDistanceFromOrigin;
+  int m_mapSize;
+  int m_numCascades;
+  float m_splitLambda = 0.75f;
+  float m_maxDistance = 50.0f;
   glm::vec3 m_worldUp;
+  Aabb m_sceneBounds;
+
+  glm::mat4 m_lightView{1.0f};
+  // The union of the cascades' boxes in the light's view.
+  glm::mat4 m_coverProjection{1.0f};
+  ShadowUniformBlock m_block{};
+  bool m_uploaded = false;
+  ShadowUniformBlock m_uploadedBlock{};
+  UniformBuffer m_uniformBuffer{EUniformBlockBinding::SHADOW,
+                                sizeof(ShadowUniformBlock)};
 };
 
+// A layered depth map with one layer per shadow cascade, drawn in a single
+// pass, see ShadowMapShader.
 class ShadowMap final : public Framebuffer, public TextureSource {
  public:
-  explicit ShadowMap(int t_width = 1024, int t_height = 1024);
-  explicit ShadowMap(const ImageSize t_size) : ShadowMap(t_size.width, t_size.height) {}
-  ~ShadowMap() override = default;
+  explicit ShadowMap(int t_size = 1024,
+                     int t_numCascades = MAX_SHADOW_CASCADES);
+  ~ShadowMap() override;
 
   Texture getDepthTexture() { return m_depthAttachment.asTexture(); }
+  // A 2D view of one cascade's layer, e.g. for showing it in the UI.
+  Texture getCascadeTexture(int t_cascade);
   unsigned int bindTexture(unsigned int t_nextTextureUnit,
                            Shader& t_shader) override;
 
  private:
   Attachment m_depthAttachment;
+  std::vector<unsigned int> m_cascadeViews;
+};
+
+// Keeps the depth of static casters, see Mesh::isDynamic(), for each cascade,
+// so that a frame only draws its dynamic casters over a copy of it.
+//
+// A cascade's static depth is redrawn when its view projection changes, i.e.
+// when the light turns or the cascade moves or resizes with the camera, or
+// when the static scene changes. With a still camera and light, a mostly
+// static scene costs one copy per frame, or nothing without dynamic casters.
+class ShadowCache {
+ public:
+  ShadowCache(int t_size, int t_numCascades = MAX_SHADOW_CASCADES);
+
+  // Returns a mask of the cascades whose static depth is out of date for the
+  // camera's current fit and the given revision of the static scene, see
+  // Scene::getStaticRevision(), and takes them as redrawn.
+  unsigned int update(const ShadowCamera& t_camera, uint64_t t_staticRevision);
+  // Marks every cascade as out of date.
+  void invalidate() { m_validCascades = 0; }
+
+  // The static depth, to be redrawn for the cascades update() returns while
+  // it is active.
+  ShadowMap& getStaticMap() { return m_staticMap; }
+  // Resets the given cascades of the static map to the far plane.
+  void clearCascades(unsigned int t_cascades);
+  // Copies the first t_numCascades cascades of the static depth into
+  // t_target, unless it already holds them. t_drawsDynamic says whether
+  // dynamic casters will be drawn over them.
+  void compose(ShadowMap& t_target, int t_numCascades, bool t_drawsDynamic);
+
+ private:
+  ShadowMap m_staticMap;
+  int m_size;
+  unsigned int m_validCascades = 0;
+  uint64_t m_staticRevision = 0;
+  glm::mat4 m_viewProjections[MAX_SHADOW_CASCADES]{};
+  // Whether the last composed target holds exactly the static depth.
+  bool m_targetCurrent = false;
 };
@@ -0,0 +1,385 @@
+#include "virtual_shadow_map.hpp"
+
+#include "rendering/core/gl_state.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <limits>
+#include <string>
+#include <utility>
+
+// Must match the local size in virtual_shadow_map_mark.comp.
+static constexpr unsigned int MARK_GROUP_SIZE = 8;
+
+static bool rectsOverlap(const glm::ivec4& t_a, const glm::ivec4& t_b) {
+  return t_a.x <= t_b.z && t_b.x <= t_a.z && t_a.y <= t_b.w && t_b.y <= t_a.w;
+}
+
+VirtualShadowMap::VirtualShadowMap(std::shared_ptr<DirectionalLight> t_light,
+                                   const int t_poolSize)
+    : Framebuffer(t_poolSize, t_poolSize),
+      m_light(std::move(t_light)),
+      m_physicalPagesPerSide(t_poolSize / PAGE_SIZE),
+      m_markShader(
+          ShaderPath("content/shaders/builtin/virtual_shadow_map_mark.comp")),
+      m_shader(ShaderPath("content/shaders/builtin/shadow_map.vert"),
+               ShaderPath("content/shaders/builtin/shadow_map.frag"),
+               ShaderPath("content/shaders/builtin/virtual_shadow_map.geom")) {
+  m_depthAttachment =
+      attachTexture(EBufferType::DEPTH,
+                    {
+                        .filtering = ETextureFiltering::NEAREST,
+                        .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE,
+                    });
+  m_pageTableTexture =
+      Texture::create(PAGES_PER_SIDE, PAGES_PER_SIDE, GL_R32UI,
+                      {
+                          .filtering = ETextureFiltering::NEAREST,
+                          .wrapMode = ETextureWrapMode::CLAMP_TO_EDGE,
+                          .generateMips = EMipGeneration::NEVER,
+                      });
+  m_physicalPages.resize(m_physicalPagesPerSide * m_physicalPagesPerSide);
+  m_pageTable.resize(NUM_PAGES);
+  m_requests.resize(NUM_PAGES / 32);
+
+  // Requests are copied here to be read back without stalling.
+  glCreateBuffers(1, &m_readbackBuffer);
+  glNamedBufferStorage(m_readbackBuffer,
+                       static_cast<GLsizeiptr>(m_requests.size() *
+                                               sizeof(uint32_t)),
+                       nullptr, GL_CLIENT_STORAGE_BIT);
+  invalidate();
+}
+
+VirtualShadowMap::~VirtualShadowMap() {
+  if (m_requestFence) {
+    glDeleteSync(m_requestFence);
+  }
+  glDeleteBuffers(1, &m_readbackBuffer);
+  GlState::forgetTexture(m_pageTableTexture.getId());
+  m_pageTableTexture.free();
+}
+
+void VirtualShadowMap::invalidate() {
+  m_physicalPages.assign(m_physicalPages.size(), {});
+  m_freePages.clear();
+  // Backwards, so the pool fills from its first page.
+  for (int i = static_cast<int>(m_physicalPages.size()) - 1; i >= 0; --i) {
+    m_freePages.push_back(i);
+  }
+  std::fill(m_pageTable.begin(), m_pageTable.end(), 0u);
+  m_pageTableDirty = true;
+  m_dynamicRects.clear();
+}
+
+void VirtualShadowMap::update(Scene& t_scene,
+                              const glm::mat4& t_rootTransform) {
+  ++m_frame;
+  m_stats.pagesAllocated = 0;
+  m_stats.pagesRendered = 0;
+  m_stats.pagesCached = 0;
+
+  // Fit a square around the scene in the light's view, so texels are square
+  // too. It only changes with the light or the scene, so pages keep their
+  // place as the camera moves.
+  const glm::vec3 direction = glm::normalize(m_light->getDirection());
+  const glm::vec3 up = std::abs(direction.y) > 0.99f
+                           ? glm::vec3(1.0f, 0.0f, 0.0f)
+                           : glm::vec3(0.0f, 1.0f, 0.0f);
+  const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+  glm::mat4 lightViewProjection = m_lightViewProjection;
+  if (!m_sceneBounds.isEmpty()) {
+    const Aabb bounds = m_sceneBounds.transformed(lightView);
+    const glm::vec3 center = bounds.getCenter();
+    const glm::vec3 extents = bounds.getExtents();
+    const float halfSize = std::max({extents.x, extents.y, 1e-3f});
+    // The view looks down -z.
+    lightViewProjection =
+        glm::ortho(center.x - halfSize, center.x + halfSize,
+                   center.y - halfSize, center.y + halfSize,
+                   -bounds.max.z - 1e-3f, -bounds.min.z + 1e-3f) *
+        lightView;
+  }
+  if (lightViewProjection != m_lightViewProjection) {
+    m_lightView = lightView;
+    m_lightViewProjection = lightViewProjection;
+    invalidate();
+  }
+
+  readRequests();
+
+  // Drop the depth that changed: everything when the static scene did, and
+  // the pages under dynamic meshes, where they are and where they were.
+  const std::vector<SceneDrawItem>& items =
+      t_scene.getDrawItems(t_rootTransform);
+  const CullingBounds& bounds = t_scene.getWorldBounds();
+  if (t_scene.getStaticRevision() != m_staticRevision) {
+    m_staticRevision = t_scene.getStaticRevision();
+    for (PhysicalPage& page : m_physicalPages) {
+      page.valid = false;
+    }
+  }
+  for (const glm::ivec4& rect : m_dynamicRects) {
+    invalidateRect(rect);
+  }
+  m_dynamicRects.clear();
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (items[i].mesh->isDynamic()) {
+      const glm::ivec4 rect = getPageRect(
+          {bounds.centerX()[i], bounds.centerY()[i], bounds.centerZ()[i]},
+          {bounds.extentX()[i], bounds.extentY()[i], bounds.extentZ()[i]});
+      invalidateRect(rect);
+      m_dynamicRects.push_back(rect);
+    }
+  }
+
+  // Find the requested pages that are missing or out of date.
+  std::vector<int> stalePages;
+  for (size_t word = 0; word < m_requests.size(); ++word) {
+    for (uint32_t bits = m_requests[word]; bits != 0; bits &= bits - 1) {
+      const int page =
+          static_cast<int>(word * 32) + std::countr_zero(bits);
+      const uint32_t entry = m_pageTable[page];
+      if (entry != 0) {
+        PhysicalPage& physical = m_physicalPages[entry - 1];
+        physical.lastRequested = m_frame;
+        if (physical.valid) {
+          ++m_stats.pagesCached;
+          continue;
+        }
+      }
+      stalePages.push_back(page);
+    }
+  }
+
+  // Pages no longer requested can make room, least recently requested first.
+  std::vector<int> evictable;
+  for (int i = 0; i < static_cast<int>(m_physicalPages.size()); ++i) {
+    const PhysicalPage& page = m_physicalPages[i];
+    if (page.virtualPage >= 0 && page.lastRequested < m_frame) {
+      evictable.push_back(i);
+    }
+  }
+  std::sort(evictable.begin(), evictable.end(),
+            [this](const int t_a, const int t_b) {
+              return m_physicalPages[t_a].lastRequested >
+                     m_physicalPages[t_b].lastRequested;
+            });
+
+  std::vector<int> drawnPages;
+  for (const int page : stalePages) {
+    if (static_cast<int>(drawnPages.size()) >= m_maxPagesPerFrame) {
+      break;
+    }
+    if (m_pageTable[page] == 0) {
+      if (allocatePage(page, evictable) < 0) {
+        break;
+      }
+      ++m_stats.pagesAllocated;
+    }
+    drawnPages.push_back(page);
+  }
+  drawPages(drawnPages, t_scene, t_rootTransform);
+  for (const int page : drawnPages) {
+    m_physicalPages[m_pageTable[page] - 1].valid = true;
+  }
+  m_stats.pagesRendered = static_cast<int>(drawnPages.size());
+  m_stats.pagesResident =
+      static_cast<int>(m_physicalPages.size() - m_freePages.size());
+
+  if (m_pageTableDirty) {
+    glTextureSubImage2D(m_pageTableTexture.getId(), /*level=*/0, 0, 0,
+                        PAGES_PER_SIDE, PAGES_PER_SIDE, GL_RED_INTEGER,
+                        GL_UNSIGNED_INT, m_pageTable.data());
+    m_pageTableDirty = false;
+  }
+}
+
+bool VirtualShadowMap::readRequests() {
+  if (!m_requestFence) {
+    return false;
+  }
+  const GLenum status = glClientWaitSync(m_requestFence, 0, /*timeout=*/0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return false;
+  }
+  glDeleteSync(m_requestFence);
+  m_requestFence = nullptr;
+  glGetNamedBufferSubData(
+      m_readbackBuffer, 0,
+      static_cast<GLsizeiptr>(m_requests.size() * sizeof(uint32_t)),
+      m_requests.data());
+  m_stats.pagesRequested = 0;
+  for (const uint32_t bits : m_requests) {
+    m_stats.pagesRequested += std::popcount(bits);
+  }
+  return true;
+}
+
+void VirtualShadowMap::markPages(GBuffer& t_gBuffer, const Camera& t_camera) {
+  if (m_requestFence) {
+    return;
+  }
+  const auto sizeBytes = m_requests.size() * sizeof(uint32_t);
+  m_requestBuffer.reserve(sizeBytes);
+  glClearNamedBufferSubData(m_requestBuffer.getId(), GL_R32UI, 0,
+                            static_cast<GLsizeiptr>(sizeBytes),
+                            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  m_requestBuffer.bind();
+
+  t_gBuffer.getPositionAOTexture().bindToUnit(0);
+  t_gBuffer.getDepthTexture().bindToUnit(1);
+  m_markShader.setInt("gPositionAO", 0);
+  m_markShader.setInt("gDepth", 1);
+  m_markShader.setMat4("viewToLight",
+                       m_lightViewProjection *
+                           glm::inverse(t_camera.getViewTransform()));
+  const ImageSize size = t_gBuffer.getSize();
+  m_markShader.dispatch(
+      (size.width + MARK_GROUP_SIZE - 1) / MARK_GROUP_SIZE,
+      (size.height + MARK_GROUP_SIZE - 1) / MARK_GROUP_SIZE, 1,
+      GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  glCopyNamedBufferSubData(m_requestBuffer.getId(), m_readbackBuffer, 0, 0,
+                           static_cast<GLsizeiptr>(sizeBytes));
+  m_requestFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+glm::ivec4 VirtualShadowMap::getPageRect(const glm::vec3& t_center,
+                                         const glm::vec3& t_extents) const {
+  glm::vec2 minCoords(std::numeric_limits<float>::max());
+  glm::vec2 maxCoords(std::numeric_limits<float>::lowest());
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec3 sign((corner & 1) ? 1.0f : -1.0f,
+                         (corner & 2) ? 1.0f : -1.0f,
+                         (corner & 4) ? 1.0f : -1.0f);
+    // Orthographic, so there's no perspective divide.
+    const glm::vec2 coords =
+        glm::vec2(m_lightViewProjection *
+                  glm::vec4(t_center + sign * t_extents, 1.0f)) *
+            0.5f +
+        0.5f;
+    minCoords = glm::min(minCoords, coords);
+    maxCoords = glm::max(maxCoords, coords);
+  }
+  if (maxCoords.x < 0.0f || maxCoords.y < 0.0f || minCoords.x > 1.0f ||
+      minCoords.y > 1.0f) {
+    return {1, 1, 0, 0};
+  }
+  const auto toPage = [](const float t_coord) {
+    return std::clamp(static_cast<int>(std::floor(t_coord * PAGES_PER_SIDE)),
+                      0, PAGES_PER_SIDE - 1);
+  };
+  return {toPage(minCoords.x), toPage(minCoords.y), toPage(maxCoords.x),
+          toPage(maxCoords.y)};
+}
+
+void VirtualShadowMap::invalidateRect(const glm::ivec4& t_rect) {
+  for (int y = t_rect.y; y <= t_rect.w; ++y) {
+    for (int x = t_rect.x; x <= t_rect.z; ++x) {
+      const uint32_t entry = m_pageTable[y * PAGES_PER_SIDE + x];
+      if (entry != 0) {
+        m_physicalPages[entry - 1].valid = false;
+      }
+    }
+  }
+}
+
+int VirtualShadowMap::allocatePage(const int t_virtualPage,
+                                   std::vector<int>& t_evictable) {
+  int physical;
+  if (!m_freePages.empty()) {
+    physical = m_freePages.back();
+    m_freePages.pop_back();
+  } else if (!t_evictable.empty()) {
+    physical = t_evictable.back();
+    t_evictable.pop_back();
+    m_pageTable[m_physicalPages[physical].virtualPage] = 0;
+  } else {
+    return -1;
+  }
+  m_physicalPages[physical] = {.virtualPage = t_virtualPage,
+                               .valid = false,
+                               .lastRequested = m_frame};
+  m_pageTable[t_virtualPage] = static_cast<uint32_t>(physical) + 1;
+  m_pageTableDirty = true;
+  return physical;
+}
+
+glm::ivec2 VirtualShadowMap::getPhysicalOrigin(const int t_physicalPage) const {
+  return glm::ivec2(t_physicalPage % m_physicalPagesPerSide,
+                    t_physicalPage / m_physicalPagesPerSide) *
+         PAGE_SIZE;
+}
+
+void VirtualShadowMap::drawPages(const std::vector<int>& t_virtualPages,
+                                 Scene& t_scene,
+                                 const glm::mat4& t_rootTransform) {
+  if (t_virtualPages.empty()) {
+    return;
+  }
+  const std::vector<SceneDrawItem>& items =
+      t_scene.getDrawItems(t_rootTransform);
+  const CullingBounds& bounds = t_scene.getWorldBounds();
+  std::vector<glm::ivec4> itemRects(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    itemRects[i] = getPageRect(
+        {bounds.centerX()[i], bounds.centerY()[i], bounds.centerZ()[i]},
+        {bounds.extentX()[i], bounds.extentY()[i], bounds.extentZ()[i]});
+  }
+
+  activate();
+  const float farDepth = 1.0f;
+  const auto numPages = static_cast<int>(t_virtualPages.size());
+  for (int first = 0; first < numPages; first += MAX_PAGES_PER_PASS) {
+    const int count = std::min(MAX_PAGES_PER_PASS, numPages - first);
+    glm::ivec4 passRect(PAGES_PER_SIDE, PAGES_PER_SIDE, -1, -1);
+    for (int i = 0; i < count; ++i) {
+      const int page = t_virtualPages[first + i];
+      const glm::ivec2 pageCoords(page % PAGES_PER_SIDE, page / PAGES_PER_SIDE);
+      passRect = glm::ivec4(glm::min(glm::ivec2(passRect), pageCoords),
+                            glm::max(glm::ivec2(passRect.z, passRect.w),
+                                     pageCoords));
+
+      const glm::ivec2 origin =
+          getPhysicalOrigin(static_cast<int>(m_pageTable[page]) - 1);
+      glClearTexSubImage(m_depthAttachment.id, /*level=*/0, origin.x,
+                         origin.y, 0, PAGE_SIZE, PAGE_SIZE, 1,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+      GlState::setViewportIndexed(static_cast<unsigned int>(i), origin.x,
+                                  origin.y, PAGE_SIZE, PAGE_SIZE);
+
+      // Crop the light's projection to the page.
+      glm::mat4 crop(1.0f);
+      crop[0][0] = static_cast<float>(PAGES_PER_SIDE);
+      crop[1][1] = static_cast<float>(PAGES_PER_SIDE);
+      crop[3][0] = static_cast<float>(PAGES_PER_SIDE - 2 * pageCoords.x - 1);
+      crop[3][1] = static_cast<float>(PAGES_PER_SIDE - 2 * pageCoords.y - 1);
+      m_shader.setMat4("pageViewProjections[" + std::to_string(i) + "]",
+                       crop * m_lightViewProjection);
+    }
+    m_shader.setInt("pageCount", count);
+
+    m_queue.begin(m_lightView);
+    for (size_t i = 0; i < items.size(); ++i) {
+      if (rectsOverlap(itemRects[i], passRect)) {
+        m_queue.addMesh(*items[i].mesh, items[i].transform, m_shader);
+      }
+    }
+    m_queue.sort();
+    m_queue.submit(nullptr, ERenderPass::DEPTH_ONLY);
+  }
+  deactivate();
+}
+
+unsigned int VirtualShadowMap::bindTexture(
+    const unsigned int t_nextTextureUnit, Shader& t_shader) {
+  m_depthAttachment.asTexture().bindToUnit(t_nextTextureUnit);
+  t_shader.setInt("fnk_vsmPhysicalPages", t_nextTextureUnit);
+  m_pageTableTexture.bindToUnit(t_nextTextureUnit + 1);
+  t_shader.setInt("fnk_vsmPageTable", t_nextTextureUnit + 1);
+  t_shader.setMat4("fnk_vsmViewProjection", m_lightViewProjection);
+  return t_nextTextureUnit + 2;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "rendering/core/framebuffer.hpp"
+#include "rendering/core/gBuffer.hpp"
+#include "rendering/core/render_queue.hpp"
+#include "rendering/core/storage_buffer.hpp"
+#include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/shader.hpp"
+#include "rendering/resources/texture.hpp"
+#include "scene/bounds.hpp"
+#include "scene/camera.hpp"
+#include "scene/lighting/light.hpp"
+#include "scene/scene.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Counts of the last VirtualShadowMap::update().
+struct VirtualShadowMapStats {
+  // Pages the G-buffer sampled, as of the last requests read back.
+  int pagesRequested = 0;
+  // Pages backed by a physical page.
+  int pagesResident = 0;
+  // Pages given a physical page, which were drawn for the first time.
+  int pagesAllocated = 0;
+  // Pages drawn, including resident ones that were out of date.
+  int pagesRendered = 0;
+  // Requested pages that were resident and up to date, so weren't drawn.
+  int pagesCached = 0;
+};
+
+// An alternative to the cascades of ShadowMap for a directional light: one
+// 16K x 16K orthographic depth map over the whole scene, of which only the
+// 128 x 128 texel pages that are seen are backed by memory and drawn.
+//
+// markPages() finds the pages the G-buffer's pixels sample with a compute
+// shader. The requests are read back a frame or more later, once the GPU is
+// done with them, so reading never stalls. update() then gives each missing
+// page a page of a fixed size physical pool, evicting the least recently
+// requested ones when it is full, and draws it. A page table maps the
+// virtual pages to the physical ones for the lighting pass.
+//
+// Drawn pages are kept across frames, and only redrawn when the static scene
+// changes or a dynamic mesh, see Mesh::isDynamic(), covers them now or did in
+// the previous frame. Turning the light or changing the scene bounds moves
+// every page, so drops all of them.
+class VirtualShadowMap final : public Framebuffer, public TextureSource {
+ public:
+  static constexpr int PAGE_SIZE = 128;
+  static constexpr int PAGES_PER_SIDE = 128;
+  static constexpr int VIRTUAL_SIZE = PAGE_SIZE * PAGES_PER_SIDE;
+
+  // The pool is a square depth texture of t_poolSize texels per side.
+  explicit VirtualShadowMap(std::shared_ptr<DirectionalLight> t_light,
+                            int t_poolSize = 4096);
+  ~VirtualShadowMap() override;
+
+  // The world space bounds of everything that casts or receives shadows.
+  void setSceneBounds(const Aabb& t_bounds) { m_sceneBounds = t_bounds; }
+  // The most pages drawn in a frame. The rest wait for the next frames.
+  void setMaxPagesPerFrame(const int t_count) { m_maxPagesPerFrame = t_count; }
+
+  // Fits the light's projection, takes in the latest page requests, and
+  // draws the pages that are missing or out of date.
+  void update(Scene& t_scene, const glm::mat4& t_rootTransform);
+  // Requests the pages sampled by the pixels of the G-buffer, which must hold
+  // the camera's view of the scene. Does nothing while the last requests are
+  // still on their way back.
+  void markPages(GBuffer& t_gBuffer, const Camera& t_camera);
+  // Drops every page.
+  void invalidate();
+
+  // The pool of physical pages, e.g. for showing it in the UI.
+  Texture getPhysicalTexture() { return m_depthAttachment.asTexture(); }
+  [[nodiscard]] const VirtualShadowMapStats& getStats() const {
+    return m_stats;
+  }
+
+  unsigned int bindTexture(unsigned int t_nextTextureUnit,
+                           Shader& t_shader) override;
+
+ private:
+  static constexpr int NUM_PAGES = PAGES_PER_SIDE * PAGES_PER_SIDE;
+  // Must match MAX_PAGES in virtual_shadow_map.geom.
+  static constexpr int MAX_PAGES_PER_PASS = 16;
+
+  // A page of the pool and the virtual page it holds.
+  struct PhysicalPage {
+    // -1 while free.
+    int virtualPage = -1;
+    // Whether it holds the virtual page's current depth.
+    bool valid = false;
+    // The update() that last found the virtual page requested.
+    uint64_t lastRequested = 0;
+  };
+
+  // Whether new page requests arrived, and if so takes them in.
+  bool readRequests();
+  [[nodiscard]] bool isRequested(int t_virtualPage) const {
+    return (m_requests[t_virtualPage >> 5] >> (t_virtualPage & 31)) & 1u;
+  }
+  // The pages covered by a world space box, as (min x, min y, max x, max y),
+  // with min > max if none.
+  [[nodiscard]] glm::ivec4 getPageRect(const glm::vec3& t_center,
+                                       const glm::vec3& t_extents) const;
+  // Marks the resident pages within the rect as out of date.
+  void invalidateRect(const glm::ivec4& t_rect);
+  // Takes a physical page for the virtual page, evicting one if none is free.
+  // Returns -1 if every physical page is in use by a requested page.
+  int allocatePage(int t_virtualPage, std::vector<int>& t_evictable);
+  [[nodiscard]] glm::ivec2 getPhysicalOrigin(int t_physicalPage) const;
+  void drawPages(const std::vector<int>& t_virtualPages, Scene& t_scene,
+                 const glm::mat4& t_rootTransform);
+
+  std::shared_ptr<DirectionalLight> m_light;
+  Aabb m_sceneBounds;
+  int m_physicalPagesPerSide;
+  int m_maxPagesPerFrame = 128;
+  uint64_t m_frame = 0;
+  uint64_t m_staticRevision = 0;
+
+  glm::mat4 m_lightView{1.0f};
+  glm::mat4 m_lightViewProjection{1.0f};
+
+  Attachment m_depthAttachment;
+  std::vector<PhysicalPage> m_physicalPages;
+  std::vector<int> m_freePages;
+  // The physical page of each virtual page plus one, or 0, as in the table.
+  std::vector<uint32_t> m_pageTable;
+  Texture m_pageTableTexture;
+  bool m_pageTableDirty = true;
+  // The pages covered by dynamic meshes in the last update().
+  std::vector<glm::ivec4> m_dynamicRects;
+
+  // One bit per virtual page.
+  std::vector<uint32_t> m_requests;
+  StorageBuffer m_requestBuffer{
+      EStorageBufferBinding::VIRTUAL_SHADOW_PAGE_REQUESTS};
+  unsigned int m_readbackBuffer = 0;
+  GLsync m_requestFence = nullptr;
+
+  ComputeShader m_markShader;
+  Shader m_shader;
+  RenderQueue m_queue;
+  VirtualShadowMapStats m_stats;
+};
@@ -4,16 +4,24 @@
 
 #include <gl/glew.h>
 
+#include "rendering/core/geometry_arena.hpp"
+#include "rendering/core/render_queue.hpp"
 #include "rendering/core/vertex_array.hpp"
 #include "rendering/registers/texture_registry.hpp"
+#include "rendering/resources/material.hpp"
 #include "rendering/resources/shader.hpp"
 #include "rendering/resources/texture_map.hpp"
+#include "scene/bounds.hpp"
+#include "scene/occlusion.hpp"
 
-#include <sstream>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
+class Mesh;
+
+// Called with each mesh of a renderable tree and its full model transform.
+using MeshVisitor = std::function<void(Mesh&, const glm::mat4&)>;
 
 class Renderable {
  public:
@@ -32,38 +40,18 @@ class Renderable {
   virtual void drawWithTransform(
       const glm::mat4& t_transform, Shader& t_shader,
       TextureRegistry* t_textureRegistry = nullptr) = 0;
+  // Records draws into a render queue instead of drawing immediately.
+  virtual void enqueue(const glm::mat4& t_transform, Shader& t_shader,
+                       RenderQueue& t_queue) = 0;
+  // Visits every mesh under this renderable, in the same order as enqueue.
+  virtual void visitMeshes(const glm::mat4& t_transform,
+                           const MeshVisitor& t_visitor) = 0;
 
  protected:
   // The model transform matrix.
   glm::mat4 model = glm::mat4(1.0f);
 };
 
-// A node in a tree of Renderables, containing one or more renderables.
-// When rendering, each node's transform is applied to the transform of its
-// Renderables, as well as to its child RenderableNodes.
-class RenderableNode : public Renderable {
- public:
-    ~RenderableNode() override = default;
-  void drawWithTransform(const glm::mat4& t_transform, Shader& t_shader,
-                         TextureRegistry* t_textureRegistry = nullptr) override;
-
-  void addRenderable(std::unique_ptr<Renderable> renderable) {
-    renderables.push_back(std::move(renderable));
-  }
-
-  void addChildNode(std::unique_ptr<RenderableNode> childNode) {
-    childNodes.push_back(std::move(childNode));
-  }
-
-  void visitRenderables(const std::function<void(Renderable*)>& t_visitor) const;
-
- protected:
-  // The set of Renderables making up this node.
-  std::vector<std::unique_ptr<Renderable>> renderables;
-  // The set of child RenderableNodes.
-  std::vector<std::unique_ptr<RenderableNode>> childNodes;
-};
-
 // An abstract class that represents a triangle mesh and handles loading and
 // rendering. Child classes can specialize when configuring vertex attributes.
 class Mesh : public Renderable {
@@ -74,7 +62,52 @@ class Mesh : public Renderable {
   void loadInstanceModels(const glm::mat4* t_models, unsigned int t_size);
   void drawWithTransform(const glm::mat4& t_transform, Shader& t_shader,
                          TextureRegistry* t_textureRegistry = nullptr) override;
-
+  void enqueue(const glm::mat4& t_transform, Shader& t_shader,
+               RenderQueue& t_queue) override;
+  void visitMeshes(const glm::mat4& t_transform,
+                   const MeshVisitor& t_visitor) override;
+  // Draws with the given, fully combined model transform. Depth-only passes
+  // skip the material and, for arena meshes, read only positions.
+  void drawWithModel(const glm::mat4& t_model, Shader& t_shader,
+                     TextureRegistry* t_textureRegistry = nullptr,
+                     ERenderPass t_pass = ERenderPass::SHADED);
+
+  const Material& getMaterial() const { return material; }
+  // Binds the mesh's textures for a draw issued elsewhere, e.g. indirectly.
+  void bindMaterial(Shader& t_shader, TextureRegistry* t_textureRegistry) {
+    bindTextures(t_shader, t_textureRegistry);
+  }
+  // Meshes in an arena share its VAO and can be drawn indirectly.
+  GeometryArena* getArena() const { return arena; }
+  const GeometryAllocation& getArenaAllocation() const {
+    return arenaAllocation;
+  }
+  // The bounds of the mesh's vertices in model space, or an empty box if the
+  // mesh doesn't track them. Used for culling.
+  const Aabb& getLocalBounds() const { return localBounds; }
+  void setLocalBounds(const Aabb& t_bounds) { localBounds = t_bounds; }
+  // Model space triangles for software occlusion culling, or empty if the
+  // mesh is too detailed to serve as an occluder.
+  const OccluderGeometry& getOccluderGeometry() const {
+    return occluderGeometry;
+  }
+  void setOccluderGeometry(OccluderGeometry t_geometry) {
+    occluderGeometry = std::move(t_geometry);
+  }
+  // Whether the mesh always occludes, rather than only when it is large on
+  // screen. Requires occluder geometry.
+  bool isOccluder() const { return occluder; }
+  void setOccluder(bool t_occluder) { occluder = t_occluder; }
+  // Whether the mesh moves or changes at runtime. Passes that cache the
+  // static part of the scene, like ShadowCache, draw dynamic meshes every
+  // frame instead.
+  bool isDynamic() const { return dynamic; }
+  void setDynamic(bool t_dynamic) { dynamic = t_dynamic; }
+  // Appends the mesh's model space triangles, three vertices each, if it keeps
+  // its vertex data on the CPU. Returns false if it doesn't.
+  virtual bool getTriangles(std::vector<glm::vec3>& /*t_vertices*/) const {
+    return false;
+  }
   std::vector<unsigned int> getIndices() { return indices; }
   std::vector<TextureMap> getTextureMaps() { return textureMaps; }
 
@@ -87,11 +120,20 @@ class Mesh : public Renderable {
                             const std::vector<unsigned int>& t_indices,
                             const std::vector<TextureMap>& t_textureMaps,
                             unsigned int t_instanceCount = 0);
+  // Like loadMeshData, but suballocates the vertex and index data from a
+  // shared arena rather than the mesh's own VAO. Only for indexed,
+  // non-instanced meshes whose vertex format matches the arena.
+  void loadMeshDataIntoArena(GeometryArena& t_arena, const void* t_vertexData,
+                             unsigned int t_numVertices,
+                             unsigned int t_vertexSizeBytes,
+                             const std::vector<unsigned int>& t_indices,
+                             const std::vector<TextureMap>& t_textureMaps);
   // Initializes vertex attributes.
   virtual void initializeVertexAttributes() = 0;
   // Allocates and initializes vertex array instance data.
   virtual void initializeVertexArrayInstanceData();
   // Binds texture maps to texture units and sets shader sampler uniforms.
+  // Subclasses that change textureMaps after loading must rebuild material.
   virtual void bindTextures(Shader& t_shader, TextureRegistry* t_textureRegistry);
   // Emits glDraw* calls based on the mesh instancing/indexing. Requires shaders
   // and VAOs to be active prior to calling.
@@ -100,6 +142,15 @@ class Mesh : public Renderable {
   VertexArray vertexArray;
   std::vector<unsigned int> indices;
   std::vector<TextureMap> textureMaps;
+  // The binding table for textureMaps.
+  Material material;
+  // Set if the mesh data lives in a shared arena instead of vertexArray.
+  GeometryArena* arena = nullptr;
+  GeometryAllocation arenaAllocation;
+  Aabb localBounds;
+  OccluderGeometry occluderGeometry;
+  bool occluder = false;
+  bool dynamic = false;
 
   // The number of vertices in the mesh.
   unsigned int numVertices = 0;
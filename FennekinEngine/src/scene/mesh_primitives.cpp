@@ -2,6 +2,18 @@
 
 #include "core/debug/logger.hpp"
 
+// Returns the bounds of interleaved vertex data whose first three floats per
+// vertex are the position.
+static Aabb computePositionBounds(const float* t_vertexData,
+                                  const size_t t_numFloats,
+                                  const unsigned int t_floatsPerVertex) {
+  Aabb bounds;
+  for (size_t i = 0; i + 2 < t_numFloats; i += t_floatsPerVertex) {
+    bounds.expand(glm::vec3(t_vertexData[i], t_vertexData[i + 1],
+                            t_vertexData[i + 2]));
+  }
+  return bounds;
+}
 
 // clang-format off
 constexpr float planeVertices[] = {
@@ -35,6 +47,8 @@ void PlaneMesh::loadMeshAndTextures(
   constexpr unsigned int planeVertexSizeBytes = 11 * sizeof(float);
   loadMeshData(planeVertices, sizeof(planeVertices) / planeVertexSizeBytes,
                planeVertexSizeBytes, /*indices=*/{}, t_textureMaps);
+  setLocalBounds(computePositionBounds(planeVertices, std::size(planeVertices),
+                                       planeVertexSizeBytes / sizeof(float)));
 }
 
 void PlaneMesh::initializeVertexAttributes() {
@@ -122,6 +136,8 @@ void CubeMesh::loadMeshAndTextures(const std::vector<TextureMap>& t_textureMaps)
   constexpr unsigned int cubeVertexSizeBytes = 11 * sizeof(float);
   loadMeshData(CUBE_VERTICES, sizeof(CUBE_VERTICES) / cubeVertexSizeBytes,
                cubeVertexSizeBytes, /*indices=*/{}, t_textureMaps);
+  setLocalBounds(computePositionBounds(CUBE_VERTICES, std::size(CUBE_VERTICES),
+                                       cubeVertexSizeBytes / sizeof(float)));
 }
 
 void CubeMesh::initializeVertexAttributes() {
@@ -209,6 +225,8 @@ void RoomMesh::loadMeshAndTextures(const std::vector<TextureMap>& t_textureMaps)
   constexpr unsigned int roomVertexSizeBytes = 11 * sizeof(float);
   loadMeshData(ROOM_VERTICES, sizeof(ROOM_VERTICES) / roomVertexSizeBytes,
                roomVertexSizeBytes, /*indices=*/{}, t_textureMaps);
+  setLocalBounds(computePositionBounds(ROOM_VERTICES, std::size(ROOM_VERTICES),
+                                       roomVertexSizeBytes / sizeof(float)));
 }
 
 void RoomMesh::initializeVertexAttributes() {
@@ -326,6 +344,8 @@ void SphereMesh::loadMeshAndTextures(
   loadMeshData(vertexData.data(),
                (sizeof(float) * vertexData.size()) / sphereVertexSizeBytes,
                sphereVertexSizeBytes, indices, t_textureMaps);
+  setLocalBounds(computePositionBounds(vertexData.data(), vertexData.size(),
+                                       sphereVertexSizeBytes / sizeof(float)));
 }
 
 void SphereMesh::initializeVertexAttributes() {
@@ -409,6 +429,7 @@ void SkyboxMesh::setTexture(Texture t_texture) {
   // TODO: This copies the texture info, meaning it won't see updates.
   textureMaps.clear();
   textureMaps.emplace_back(t_texture, ETextureMapType::CUBEMAP);
+  material = Material(textureMaps);
 }
 
 void SkyboxMesh::loadMesh() {
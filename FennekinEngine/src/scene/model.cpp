@@ -8,6 +8,10 @@
 #include <assimp/Importer.hpp>
 
 
+// Meshes with more triangles than this are too detailed to rasterize on the
+// CPU, and never occlude in SoftwareOcclusionCuller.
+constexpr size_t MAX_OCCLUDER_TRIANGLES = 4096;
+
 constexpr ETextureMapType loaderSupportedTextureMapTypes[] = {
     ETextureMapType::DIFFUSE, ETextureMapType::SPECULAR, ETextureMapType::ROUGHNESS, ETextureMapType::METALLIC,
     ETextureMapType::AO,      ETextureMapType::EMISSION, ETextureMapType::NORMAL,
@@ -27,9 +31,48 @@ glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4& m) {
 ModelMesh::ModelMesh(std::vector<ModelVertex> t_vertices, const std::vector<unsigned int>& t_indices,
                      const std::vector<TextureMap>& t_textureMaps, unsigned int t_instanceCount) :
     m_vertices(std::move(t_vertices)) {
+    if (t_instanceCount == 0 && !t_indices.empty()) {
+        // Static meshes share one arena, so they can be drawn indirectly.
+        Mesh::loadMeshDataIntoArena(getArena(), m_vertices.data(), m_vertices.size(), sizeof(ModelVertex),
+                                    t_indices, t_textureMaps);
+        return;
+    }
     Mesh::loadMeshData(m_vertices.data(), m_vertices.size(), sizeof(ModelVertex), t_indices, t_textureMaps, t_instanceCount);
 }
 
+bool ModelMesh::getTriangles(std::vector<glm::vec3>& t_vertices) const {
+    // Instances are placed at runtime, so their triangles aren't known here.
+    if (instanceCount) {
+        return false;
+    }
+    if (indices.empty()) {
+        for (const ModelVertex& vertex : m_vertices) {
+            t_vertices.push_back(vertex.position);
+        }
+    } else {
+        for (const unsigned int index : indices) {
+            t_vertices.push_back(m_vertices[index].position);
+        }
+    }
+    return true;
+}
+
+GeometryArena& ModelMesh::getArena() {
+    static GeometryArena* arena = [] {
+        auto* newArena = new GeometryArena(sizeof(ModelVertex));
+        // Must match initializeVertexAttributes().
+        newArena->addVertexAttrib(3, GL_FLOAT);
+        newArena->addVertexAttrib(3, GL_FLOAT);
+        newArena->addVertexAttrib(3, GL_FLOAT);
+        newArena->addVertexAttrib(2, GL_FLOAT);
+        newArena->finalizeVertexAttribs();
+        // For shadow and depth passes, which only need positions.
+        newArena->addPositionStream();
+        return newArena;
+    }();
+    return *arena;
+}
+
 void ModelMesh::initializeVertexAttributes() {
     // Positions.
     vertexArray.addVertexAttrib(3, GL_FLOAT);
@@ -43,7 +86,7 @@ void ModelMesh::initializeVertexAttributes() {
     vertexArray.finalizeVertexAttribs();
 }
 
-Model::Model(const char* t_path, unsigned int t_instanceCount) : m_instanceCount(t_instanceCount) {
+Model::Model(const char* t_path, unsigned int t_instanceCount) : m_instanceCount(t_instanceCount), m_path(t_path) {
     const std::string pathString(t_path);
     const size_t i = pathString.find_last_of("/");
     // This will either be the model's directory, or empty string if the model is
@@ -54,23 +97,40 @@ Model::Model(const char* t_path, unsigned int t_instanceCount) : m_instanceCount
 }
 
 void Model::loadInstanceModels(const std::vector<glm::mat4>& t_models) const {
-    m_rootNode.visitRenderables([&](Renderable* t_renderable) {
-        // All renderables in a Model are ModelMeshes.
-        auto* mesh = dynamic_cast<ModelMesh*>(t_renderable);
+    for (const auto& mesh : m_scene.getMeshes()) {
         mesh->loadInstanceModels(t_models);
-    });
+    }
 }
 
 void Model::loadInstanceModels(const glm::mat4* t_models, unsigned int t_size) const {
-    m_rootNode.visitRenderables([&](Renderable* t_renderable) {
-        // All renderables in a Model are ModelMeshes.
-        auto* mesh = dynamic_cast<ModelMesh*>(t_renderable);
+    for (const auto& mesh : m_scene.getMeshes()) {
         mesh->loadInstanceModels(t_models, t_size);
-    });
+    }
 }
 
 void Model::drawWithTransform(const glm::mat4& t_transform, Shader& t_shader, TextureRegistry* t_textureRegistry) {
-    m_rootNode.drawWithTransform(t_transform * getModelTransform(), t_shader, t_textureRegistry);
+    m_scene.drawWithTransform(t_transform * getModelTransform(), t_shader, t_textureRegistry);
+}
+
+void Model::enqueue(const glm::mat4& t_transform, Shader& t_shader, RenderQueue& t_queue) {
+    m_scene.enqueue(t_transform * getModelTransform(), t_shader, t_queue);
+}
+
+void Model::visitMeshes(const glm::mat4& t_transform, const MeshVisitor& t_visitor) {
+    m_scene.visitMeshes(t_transform * getModelTransform(), t_visitor);
+}
+
+void Model::setOccluder(const bool t_occluder) {
+    for (const auto& mesh : m_scene.getMeshes()) {
+        mesh->setOccluder(t_occluder && !mesh->getOccluderGeometry().isEmpty());
+    }
+}
+
+void Model::setDynamic(const bool t_dynamic) {
+    for (const auto& mesh : m_scene.getMeshes()) {
+        mesh->setDynamic(t_dynamic);
+    }
+    m_scene.invalidateStatic();
 }
 
 void Model::loadModel(const std::string& t_path) {
@@ -82,26 +142,24 @@ void Model::loadModel(const std::string& t_path) {
         LOG_ERROR(importer.GetErrorString());
     }
 
-    processNode(m_rootNode, scene->mRootNode, scene);
+    processNode(Scene::NO_PARENT, scene->mRootNode, scene);
 }
 
-void Model::processNode(RenderableNode& t_target, const aiNode* t_node, const aiScene* t_scene) {
+void Model::processNode(const Scene::NodeId t_parent, const aiNode* t_node, const aiScene* t_scene) {
     // Consume the transform.
-    t_target.setModelTransform(aiMatrix4x4ToGlm(t_node->mTransformation));
+    const Scene::NodeId node = m_scene.addNode(t_parent, aiMatrix4x4ToGlm(t_node->mTransformation));
 
     // Process each mesh in the node.
     for (unsigned int i = 0; i < t_node->mNumMeshes; i++) {
         // TODO: This might be creating meshes multiple times when they are
         // referenced by multiple nodes.
         aiMesh* mesh = t_scene->mMeshes[t_node->mMeshes[i]];
-        t_target.addRenderable(processMesh(mesh, t_scene));
+        m_scene.addMesh(node, processMesh(mesh, t_scene));
     }
 
     // Recurse for children. Recursion stops when no children left.
     for (unsigned int i = 0; i < t_node->mNumChildren; i++) {
-        auto childTarget = std::make_unique<RenderableNode>();
-        processNode(*childTarget, t_node->mChildren[i], t_scene);
-        t_target.addChildNode(std::move(childTarget));
+        processNode(node, t_node->mChildren[i], t_scene);
     }
 }
 
@@ -109,6 +167,7 @@ std::unique_ptr<ModelMesh> Model::processMesh(aiMesh* t_mesh, const aiScene* t_s
     std::vector<ModelVertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<TextureMap> textureMaps;
+    Aabb bounds;
 
     for (unsigned int i = 0; i < t_mesh->mNumVertices; i++) {
         ModelVertex vertex{};
@@ -117,6 +176,7 @@ std::unique_ptr<ModelMesh> Model::processMesh(aiMesh* t_mesh, const aiScene* t_s
         auto inputPos = t_mesh->mVertices[i];
         glm::vec3 position(inputPos.x, inputPos.y, inputPos.z);
         vertex.position = position;
+        bounds.expand(position);
 
         if (t_mesh->HasNormals()) {
             auto inputNorm = t_mesh->mNormals[i];
@@ -160,7 +220,21 @@ std::unique_ptr<ModelMesh> Model::processMesh(aiMesh* t_mesh, const aiScene* t_s
         }
     }
 
-    return std::make_unique<ModelMesh>(vertices, indices, textureMaps, m_instanceCount);
+    auto modelMesh = std::make_unique<ModelMesh>(vertices, indices, textureMaps, m_instanceCount);
+    // Instances can be placed anywhere, so instanced meshes are never culled.
+    if (m_instanceCount == 0) {
+        modelMesh->setLocalBounds(bounds);
+        if (indices.size() / 3 <= MAX_OCCLUDER_TRIANGLES) {
+            OccluderGeometry occluder;
+            occluder.positions.reserve(vertices.size());
+            for (const ModelVertex& vertex : vertices) {
+                occluder.positions.push_back(vertex.position);
+            }
+            occluder.indices = indices;
+            modelMesh->setOccluderGeometry(std::move(occluder));
+        }
+    }
+    return modelMesh;
 }
 
 std::vector<TextureMap> Model::loadMaterialTextureMaps(const aiMaterial* t_material, const ETextureMapType t_type) {
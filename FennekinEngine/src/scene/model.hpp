@@ -11,6 +11,7 @@
 #include "rendering/resources/shader.hpp"
 #include "rendering/resources/texture_map.hpp"
 #include "scene/mesh.hpp"
+#include "scene/scene.hpp"
 
 
 struct ModelVertex {
@@ -27,6 +28,12 @@ public:
 
     ~ModelMesh() override = default;
 
+    // The arena shared by all static model meshes. It is leaked on purpose so
+    // that no GL calls happen after the context is destroyed.
+    static GeometryArena& getArena();
+
+    bool getTriangles(std::vector<glm::vec3>& t_vertices) const override;
+
 private:
     void initializeVertexAttributes() override;
     std::vector<ModelVertex> m_vertices;
@@ -38,6 +45,7 @@ constexpr auto DEFAULT_LOAD_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothN
                                     aiProcess_OptimizeGraph | aiProcess_SplitLargeMeshes |
                                     aiProcess_RemoveRedundantMaterials;
 
+// Imports a model file into a Scene, one scene node per node of the file.
 class Model final : public Renderable {
 public:
     explicit Model(const char* t_path, unsigned int t_instanceCount = 0);
@@ -46,15 +54,30 @@ public:
     void loadInstanceModels(const glm::mat4* t_models, unsigned int t_size) const;
     void drawWithTransform(const glm::mat4& t_transform, Shader& t_shader,
                            TextureRegistry* t_textureRegistry = nullptr) override;
+    void enqueue(const glm::mat4& t_transform, Shader& t_shader, RenderQueue& t_queue) override;
+    void visitMeshes(const glm::mat4& t_transform, const MeshVisitor& t_visitor) override;
+    // Makes every mesh of the model occlude in software occlusion culling, not
+    // just those that are large on screen. Meshes too detailed to rasterize on
+    // the CPU are left out.
+    void setOccluder(bool t_occluder);
+    // Marks every mesh of the model as dynamic, see Mesh::isDynamic(), or
+    // static again. Shadow caches then draw it every frame instead of
+    // caching it, so it can move without redrawing the rest of the scene.
+    void setDynamic(bool t_dynamic);
+
+    [[nodiscard]] Scene& getScene() { return m_scene; }
+
+    [[nodiscard]] const std::string& getPath() const { return m_path; }
 
 private:
     void loadModel(const std::string& t_path);
-    void processNode(RenderableNode& t_target, const aiNode* t_node, const aiScene* t_scene);
+    void processNode(Scene::NodeId t_parent, const aiNode* t_node, const aiScene* t_scene);
     std::unique_ptr<ModelMesh> processMesh(aiMesh* t_mesh, const aiScene* t_scene);
     std::vector<TextureMap> loadMaterialTextureMaps(const aiMaterial* t_material, ETextureMapType t_type);
 
     unsigned int m_instanceCount;
-    RenderableNode m_rootNode;
+    Scene m_scene;
+    std::string m_path;
     std::string m_directory;
     std::unordered_map<std::string, TextureMap> m_loadedTextureMaps;
 };
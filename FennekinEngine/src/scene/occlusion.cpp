@@ -0,0 +1,474 @@
+#include "occlusion.hpp"
+
+#include "scene/mesh.hpp"
+#include "scene/visibility.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNK_RASTER_SSE
+#include <emmintrin.h>
+#endif
+
+// Entries tested per job. Small enough to balance the load, large enough to
+// amortize handing out the job.
+static constexpr unsigned int TEST_BATCH_SIZE = 256;
+
+// The screen rectangle and nearest depth of a projected box.
+struct ScreenRect {
+  float minX, minY, maxX, maxY;
+  // The largest 1/w of the box's corners.
+  float nearestDepth;
+};
+
+static float elapsedMs(const std::chrono::steady_clock::time_point t_start) {
+  return std::chrono::duration<float, std::milli>(
+             std::chrono::steady_clock::now() - t_start)
+      .count();
+}
+
+// Projects the corners of a world space box into the depth buffer's pixel
+// space. Returns false if the box reaches in front of the near plane, in which
+// case it must be treated as covering the whole screen.
+static bool projectBox(const glm::mat4& t_viewProjection,
+                       const glm::vec3& t_center, const glm::vec3& t_extents,
+                       ScreenRect& t_rect) {
+  // Corners are center +- each column scaled by the extents.
+  const glm::vec4 center = t_viewProjection * glm::vec4(t_center, 1.0f);
+  const glm::vec4 axisX = t_viewProjection[0] * t_extents.x;
+  const glm::vec4 axisY = t_viewProjection[1] * t_extents.y;
+  const glm::vec4 axisZ = t_viewProjection[2] * t_extents.z;
+
+  t_rect = {.minX = std::numeric_limits<float>::max(),
+            .minY = std::numeric_limits<float>::max(),
+            .maxX = std::numeric_limits<float>::lowest(),
+            .maxY = std::numeric_limits<float>::lowest(),
+            .nearestDepth = 0.0f};
+  for (int i = 0; i < 8; ++i) {
+    const glm::vec4 clip = center + ((i & 1) ? axisX : -axisX) +
+                           ((i & 2) ? axisY : -axisY) +
+                           ((i & 4) ? axisZ : -axisZ);
+    if (clip.z < -clip.w) {
+      return false;
+    }
+    const float invW = 1.0f / clip.w;
+    const float x = (clip.x * invW * 0.5f + 0.5f) *
+                    SoftwareOcclusionCuller::WIDTH;
+    const float y = (clip.y * invW * 0.5f + 0.5f) *
+                    SoftwareOcclusionCuller::HEIGHT;
+    t_rect.minX = std::min(t_rect.minX, x);
+    t_rect.minY = std::min(t_rect.minY, y);
+    t_rect.maxX = std::max(t_rect.maxX, x);
+    t_rect.maxY = std::max(t_rect.maxY, y);
+    t_rect.nearestDepth = std::max(t_rect.nearestDepth, invW);
+  }
+  return true;
+}
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(WorkerPool& t_workers)
+    : m_workers(t_workers),
+      m_bins(t_workers.getNumThreads()),
+      m_depth(WIDTH * HEIGHT, 0.0f),
+      m_blockDepth(BLOCKS_X * BLOCKS_Y, 0.0f) {}
+
+void SoftwareOcclusionCuller::cull(SceneVisibility& t_visibility,
+                                   const int t_view,
+                                   const glm::mat4& t_viewProjection) {
+  const auto rasterizeStart = std::chrono::steady_clock::now();
+  m_stats = {};
+  m_viewProjection = t_viewProjection;
+
+  // Pick the occluders among the visible meshes.
+  const std::vector<SceneVisibility::Entry>& entries =
+      t_visibility.getEntries();
+  const CullingBounds& bounds = t_visibility.getBounds();
+  const float minArea = m_minOccluderArea * WIDTH * HEIGHT;
+  m_occluders.clear();
+  m_numTriangles = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const Mesh& mesh = *entries[i].mesh;
+    const OccluderGeometry& geometry = mesh.getOccluderGeometry();
+    if (geometry.isEmpty() || !t_visibility.isVisible(i, t_view)) {
+      continue;
+    }
+    if (!mesh.isOccluder()) {
+      ScreenRect rect;
+      const glm::vec3 center(bounds.centerX()[i], bounds.centerY()[i],
+                             bounds.centerZ()[i]);
+      const glm::vec3 extents(bounds.extentX()[i], bounds.extentY()[i],
+                              bounds.extentZ()[i]);
+      if (projectBox(t_viewProjection, center, extents, rect) &&
+          (rect.maxX - rect.minX) * (rect.maxY - rect.minY) < minArea) {
+        continue;
+      }
+    }
+    m_occluders.push_back({.geometry = &geometry,
+                           .transform = t_viewProjection * entries[i].transform,
+                           .firstTriangle = m_numTriangles});
+    m_numTriangles += geometry.getNumTriangles();
+  }
+  m_stats.occluders = static_cast<int>(m_occluders.size());
+  m_stats.triangles = static_cast<int>(m_numTriangles);
+
+  // Set up and bin the triangles, split evenly across jobs, then rasterize
+  // each tile on its own so threads never write the same pixels.
+  const auto numJobs = static_cast<unsigned int>(m_bins.size());
+  m_workers.parallelFor(numJobs, [&](const unsigned int t_job) {
+    binTriangles(t_job, numJobs);
+  });
+  m_workers.parallelFor(TILES_X * TILES_Y, [&](const unsigned int t_tile) {
+    rasterizeTile(t_tile);
+  });
+  m_stats.rasterizeMs = elapsedMs(rasterizeStart);
+
+  const auto testStart = std::chrono::steady_clock::now();
+  std::atomic<int> tested = 0;
+  std::atomic<int> culled = 0;
+  const auto numEntries = static_cast<unsigned int>(entries.size());
+  const unsigned int numBatches =
+      m_occluders.empty()
+          ? 0
+          : (numEntries + TEST_BATCH_SIZE - 1) / TEST_BATCH_SIZE;
+  m_workers.parallelFor(numBatches, [&](const unsigned int t_batch) {
+    const unsigned int end =
+        std::min(numEntries, (t_batch + 1) * TEST_BATCH_SIZE);
+    int batchTested = 0;
+    int batchCulled = 0;
+    for (unsigned int i = t_batch * TEST_BATCH_SIZE; i < end; ++i) {
+      if (!t_visibility.isVisible(i, t_view) ||
+          entries[i].mesh->getLocalBounds().isEmpty()) {
+        continue;
+      }
+      ++batchTested;
+      const glm::vec3 center(bounds.centerX()[i], bounds.centerY()[i],
+                             bounds.centerZ()[i]);
+      const glm::vec3 extents(bounds.extentX()[i], bounds.extentY()[i],
+                              bounds.extentZ()[i]);
+      if (isOccluded(center, extents)) {
+        // Each entry's mask is only touched by the job that owns it.
+        t_visibility.hide(i, t_view);
+        ++batchCulled;
+      }
+    }
+    tested += batchTested;
+    culled += batchCulled;
+  });
+  m_stats.tested = tested;
+  m_stats.culled = culled;
+  m_stats.testMs = elapsedMs(testStart);
+}
+
+void SoftwareOcclusionCuller::binTriangles(const unsigned int t_job,
+                                           const unsigned int t_numJobs) {
+  Bins& bins = m_bins[t_job];
+  bins.triangles.clear();
+  for (std::vector<uint32_t>& tile : bins.tiles) {
+    tile.clear();
+  }
+
+  const size_t first = m_numTriangles * t_job / t_numJobs;
+  const size_t last = m_numTriangles * (t_job + 1) / t_numJobs;
+  if (first == last) {
+    return;
+  }
+  // The occluder containing the first triangle.
+  auto occluder = std::upper_bound(
+                      m_occluders.begin(), m_occluders.end(), first,
+                      [](const size_t t_triangle, const Occluder& t_occluder) {
+                        return t_triangle < t_occluder.firstTriangle;
+                      }) -
+                  1;
+  for (size_t triangle = first; triangle < last; ++occluder) {
+    const OccluderGeometry& geometry = *occluder->geometry;
+    const size_t end = std::min(
+        last, occluder->firstTriangle + geometry.getNumTriangles());
+    for (; triangle < end; ++triangle) {
+      const uint32_t* indices =
+          &geometry.indices[(triangle - occluder->firstTriangle) * 3];
+      glm::vec4 clip[3];
+      for (int v = 0; v < 3; ++v) {
+        clip[v] = occluder->transform *
+                  glm::vec4(geometry.positions[indices[v]], 1.0f);
+      }
+
+      // Clip against the near plane (z >= -w), which leaves at most a quad.
+      glm::vec4 polygon[4];
+      int numVertices = 0;
+      for (int v = 0; v < 3; ++v) {
+        const glm::vec4& a = clip[v];
+        const glm::vec4& b = clip[(v + 1) % 3];
+        const float distA = a.z + a.w;
+        const float distB = b.z + b.w;
+        if (distA >= 0.0f) {
+          polygon[numVertices++] = a;
+        }
+        if ((distA >= 0.0f) != (distB >= 0.0f)) {
+          polygon[numVertices++] = a + (b - a) * (distA / (distA - distB));
+        }
+      }
+      for (int v = 2; v < numVertices; ++v) {
+        addTriangle(bins, polygon[0], polygon[v - 1], polygon[v]);
+      }
+    }
+  }
+}
+
+void SoftwareOcclusionCuller::addTriangle(Bins& t_bins, const glm::vec4& t_v0,
+                                          const glm::vec4& t_v1,
+                                          const glm::vec4& t_v2) {
+  // To pixel space, keeping 1/w.
+  glm::vec3 p[3];
+  const glm::vec4* clip[3] = {&t_v0, &t_v1, &t_v2};
+  for (int v = 0; v < 3; ++v) {
+    const float invW = 1.0f / clip[v]->w;
+    p[v] = glm::vec3((clip[v]->x * invW * 0.5f + 0.5f) * WIDTH,
+                     (clip[v]->y * invW * 0.5f + 0.5f) * HEIGHT, invW);
+  }
+
+  // Occluders are drawn double sided, so make every triangle counter-clockwise.
+  float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) -
+               (p[2].x - p[0].x) * (p[1].y - p[0].y);
+  if (area < 0.0f) {
+    std::swap(p[1], p[2]);
+    area = -area;
+  }
+  if (area < 1e-6f) {
+    return;
+  }
+
+  // Pixels whose centers may be covered.
+  const float minX = std::min({p[0].x, p[1].x, p[2].x});
+  const float maxX = std::max({p[0].x, p[1].x, p[2].x});
+  const float minY = std::min({p[0].y, p[1].y, p[2].y});
+  const float maxY = std::max({p[0].y, p[1].y, p[2].y});
+  if (maxX < 0.0f || maxY < 0.0f || minX > WIDTH || minY > HEIGHT) {
+    return;
+  }
+  Triangle triangle;
+  triangle.minX = static_cast<int>(std::max(minX, 0.0f));
+  triangle.minY = static_cast<int>(std::max(minY, 0.0f));
+  triangle.maxX = static_cast<int>(std::min(maxX, WIDTH - 1.0f));
+  triangle.maxY = static_cast<int>(std::min(maxY, HEIGHT - 1.0f));
+
+  for (int e = 0; e < 3; ++e) {
+    const glm::vec3& a = p[e];
+    const glm::vec3& b = p[(e + 1) % 3];
+    triangle.edgeA[e] = a.y - b.y;
+    triangle.edgeB[e] = b.x - a.x;
+    triangle.edgeC[e] = -(triangle.edgeA[e] * a.x + triangle.edgeB[e] * a.y);
+  }
+  const float dz1 = p[1].z - p[0].z;
+  const float dz2 = p[2].z - p[0].z;
+  triangle.depthA =
+      (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+  triangle.depthB =
+      (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+  triangle.depthC =
+      p[0].z - triangle.depthA * p[0].x - triangle.depthB * p[0].y;
+
+  const auto index = static_cast<uint32_t>(t_bins.triangles.size());
+  t_bins.triangles.push_back(triangle);
+  for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE;
+       ++ty) {
+    for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE;
+         ++tx) {
+      t_bins.tiles[ty * TILES_X + tx].push_back(index);
+    }
+  }
+}
+
+void SoftwareOcclusionCuller::rasterizeTile(const unsigned int t_tile) {
+  const int tileX = static_cast<int>(t_tile) % TILES_X * TILE_SIZE;
+  const int tileY = static_cast<int>(t_tile) / TILES_X * TILE_SIZE;
+  for (int y = tileY; y < tileY + TILE_SIZE; ++y) {
+    std::fill_n(&m_depth[y * WIDTH + tileX], TILE_SIZE, 0.0f);
+  }
+
+#if defined(__AVX__)
+  using Vec = __m256;
+  constexpr int LANES = 8;
+  const Vec laneOffsets =
+      _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+  const auto splat = [](const float t_v) { return _mm256_set1_ps(t_v); };
+  const auto add = [](Vec t_a, Vec t_b) { return _mm256_add_ps(t_a, t_b); };
+  const auto mul = [](Vec t_a, Vec t_b) { return _mm256_mul_ps(t_a, t_b); };
+  const auto bitAnd = [](Vec t_a, Vec t_b) { return _mm256_and_ps(t_a, t_b); };
+  const auto max = [](Vec t_a, Vec t_b) { return _mm256_max_ps(t_a, t_b); };
+  const auto isNonNegative = [](Vec t_a) {
+    return _mm256_cmp_ps(t_a, _mm256_setzero_ps(), _CMP_GE_OQ);
+  };
+  const auto load = [](const float* t_p) { return _mm256_loadu_ps(t_p); };
+  const auto store = [](float* t_p, Vec t_v) { _mm256_storeu_ps(t_p, t_v); };
+#elif defined(FNK_RASTER_SSE)
+  using Vec = __m128;
+  constexpr int LANES = 4;
+  const Vec laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const auto splat = [](const float t_v) { return _mm_set1_ps(t_v); };
+  const auto add = [](Vec t_a, Vec t_b) { return _mm_add_ps(t_a, t_b); };
+  const auto mul = [](Vec t_a, Vec t_b) { return _mm_mul_ps(t_a, t_b); };
+  const auto bitAnd = [](Vec t_a, Vec t_b) { return _mm_and_ps(t_a, t_b); };
+  const auto max = [](Vec t_a, Vec t_b) { return _mm_max_ps(t_a, t_b); };
+  const auto isNonNegative = [](Vec t_a) {
+    return _mm_cmpge_ps(t_a, _mm_setzero_ps());
+  };
+  const auto load = [](const float* t_p) { return _mm_loadu_ps(t_p); };
+  const auto store = [](float* t_p, Vec t_v) { _mm_storeu_ps(t_p, t_v); };
+#endif
+
+  for (const Bins& bins : m_bins) {
+    for (const uint32_t index : bins.tiles[t_tile]) {
+      const Triangle& tri = bins.triangles[index];
+      const int minX = std::max(tri.minX, tileX);
+      const int maxX = std::min(tri.maxX, tileX + TILE_SIZE - 1);
+      const int minY = std::max(tri.minY, tileY);
+      const int maxY = std::min(tri.maxY, tileY + TILE_SIZE - 1);
+
+#if defined(__AVX__) || defined(FNK_RASTER_SSE)
+      // Tiles are a whole number of SIMD widths, so aligning the span down
+      // never leaves the tile.
+      const int startX = minX / LANES * LANES;
+      const Vec edgeA0 = splat(tri.edgeA[0]);
+      const Vec edgeA1 = splat(tri.edgeA[1]);
+      const Vec edgeA2 = splat(tri.edgeA[2]);
+      const Vec depthA = splat(tri.depthA);
+      for (int y = minY; y <= maxY; ++y) {
+        const float centerY = static_cast<float>(y) + 0.5f;
+        const Vec row0 = splat(tri.edgeB[0] * centerY + tri.edgeC[0]);
+        const Vec row1 = splat(tri.edgeB[1] * centerY + tri.edgeC[1]);
+        const Vec row2 = splat(tri.edgeB[2] * centerY + tri.edgeC[2]);
+        const Vec rowDepth = splat(tri.depthB * centerY + tri.depthC);
+        float* depthRow = &m_depth[y * WIDTH];
+        for (int x = startX; x <= maxX; x += LANES) {
+          const Vec centerX = add(splat(static_cast<float>(x)), laneOffsets);
+          const Vec inside =
+              bitAnd(bitAnd(isNonNegative(add(mul(edgeA0, centerX), row0)),
+                            isNonNegative(add(mul(edgeA1, centerX), row1))),
+                     isNonNegative(add(mul(edgeA2, centerX), row2)));
+          // Masked out lanes become 0, which never beats the stored depth.
+          const Vec depth = bitAnd(inside, add(mul(depthA, centerX), rowDepth));
+          store(depthRow + x, max(load(depthRow + x), depth));
+        }
+      }
+#else
+      for (int y = minY; y <= maxY; ++y) {
+        const float centerY = static_cast<float>(y) + 0.5f;
+        for (int x = minX; x <= maxX; ++x) {
+          const float centerX = static_cast<float>(x) + 0.5f;
+          bool inside = true;
+          for (int e = 0; e < 3; ++e) {
+            inside &= tri.edgeA[e] * centerX + tri.edgeB[e] * centerY +
+                          tri.edgeC[e] >=
+                      0.0f;
+          }
+          if (inside) {
+            float& depth = m_depth[y * WIDTH + x];
+            depth = std::max(depth, tri.depthA * centerX +
+                                        tri.depthB * centerY + tri.depthC);
+          }
+        }
+      }
+#endif
+    }
+  }
+
+  // Reduce the tile into the coarse level.
+  for (int by = tileY / BLOCK_SIZE; by < (tileY + TILE_SIZE) / BLOCK_SIZE;
+       ++by) {
+    for (int bx = tileX / BLOCK_SIZE; bx < (tileX + TILE_SIZE) / BLOCK_SIZE;
+         ++bx) {
+      float farthest = std::numeric_limits<float>::max();
+      for (int y = by * BLOCK_SIZE; y < (by + 1) * BLOCK_SIZE; ++y) {
+        const float* row = &m_depth[y * WIDTH + bx * BLOCK_SIZE];
+        farthest = std::min(farthest, *std::min_element(row, row + BLOCK_SIZE));
+      }
+      m_blockDepth[by * BLOCKS_X + bx] = farthest;
+    }
+  }
+}
+
+bool SoftwareOcclusionCuller::isOccluded(const glm::vec3& t_center,
+                                         const glm::vec3& t_extents) const {
+  ScreenRect rect;
+  if (!projectBox(m_viewProjection, t_center, t_extents, rect)) {
+    return false;
+  }
+  // Every pixel the rectangle touches, not just those whose centers it covers.
+  const int minX = std::max(static_cast<int>(std::floor(rect.minX)), 0);
+  const int minY = std::max(static_cast<int>(std::floor(rect.minY)), 0);
+  const int maxX = std::min(static_cast<int>(std::floor(rect.maxX)), WIDTH - 1);
+  const int maxY =
+      std::min(static_cast<int>(std::floor(rect.maxY)), HEIGHT - 1);
+  if (minX > maxX || minY > maxY) {
+    // Off screen. Leave it to frustum culling.
+    return false;
+  }
+
+  for (int by = minY / BLOCK_SIZE; by <= maxY / BLOCK_SIZE; ++by) {
+    for (int bx = minX / BLOCK_SIZE; bx <= maxX / BLOCK_SIZE; ++bx) {
+      if (m_blockDepth[by * BLOCKS_X + bx] > rect.nearestDepth) {
+        // The whole block is in front of the box.
+        continue;
+      }
+      const int blockMaxY = std::min(maxY, (by + 1) * BLOCK_SIZE - 1);
+      const int blockMaxX = std::min(maxX, (bx + 1) * BLOCK_SIZE - 1);
+      for (int y = std::max(minY, by * BLOCK_SIZE); y <= blockMaxY; ++y) {
+        for (int x = std::max(minX, bx * BLOCK_SIZE); x <= blockMaxX; ++x) {
+          if (m_depth[y * WIDTH + x] <= rect.nearestDepth) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+OcclusionBenchmarkResult benchmarkOcclusion(Scene& t_scene,
+                                            const glm::mat4& t_rootTransform,
+                                            const Frustum& t_frustum,
+                                            const glm::mat4& t_viewProjection,
+                                            WorkerPool& t_workers,
+                                            const float t_minOccluderArea,
+                                            const int t_repeats) {
+  OcclusionBenchmarkResult result;
+  SceneVisibility visibility;
+  SoftwareOcclusionCuller culler(t_workers);
+  culler.setMinOccluderArea(t_minOccluderArea);
+
+  // Returns the meshes left visible.
+  const auto cull = [&](const bool t_occlusion) {
+    visibility.begin();
+    visibility.add(t_scene, t_rootTransform);
+    const int view = visibility.addView(t_frustum);
+    visibility.cull();
+    if (t_occlusion) {
+      culler.cull(visibility, view, t_viewProjection);
+    }
+    int visible = 0;
+    for (size_t i = 0; i < visibility.getEntries().size(); ++i) {
+      visible += visibility.isVisible(i, view);
+    }
+    return visible;
+  };
+  const auto timeBest = [&](const bool t_occlusion, int& t_visible) {
+    float best = std::numeric_limits<float>::max();
+    for (int i = 0; i < t_repeats; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      t_visible = cull(t_occlusion);
+      best = std::min(best, elapsedMs(start));
+    }
+    return best;
+  };
+
+  result.frustumMs = timeBest(false, result.frustumVisible);
+  result.occlusionMs = timeBest(true, result.occlusionVisible);
+  result.meshes = static_cast<int>(visibility.getEntries().size());
+  result.occluders = culler.getStats().occluders;
+  return result;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "core/worker_pool.hpp"
+#include "scene/bounds.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Scene;
+class SceneVisibility;
+
+// Model space triangles of a mesh, kept on the CPU so the mesh can occlude
+// others in SoftwareOcclusionCuller.
+struct OccluderGeometry {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+
+  [[nodiscard]] bool isEmpty() const { return indices.empty(); }
+  [[nodiscard]] size_t getNumTriangles() const { return indices.size() / 3; }
+};
+
+// Counts and timings of the last SoftwareOcclusionCuller::cull().
+struct OcclusionCullStats {
+  int occluders = 0;
+  // Occluder triangles sent to the rasterizer, before clipping.
+  int triangles = 0;
+  // Meshes tested against the depth buffer, and those found hidden.
+  int tested = 0;
+  int culled = 0;
+  float rasterizeMs = 0.0f;
+  float testMs = 0.0f;
+};
+
+// Occlusion culls meshes on the CPU, for machines without a GPU that runs
+// compute well.
+//
+// Large meshes, and those marked as occluders, are rasterized into a small
+// depth buffer. Each 32x32 pixel tile is rasterized by one thread, with 4 or 8
+// pixels per SIMD operation. A coarse level stores the farthest depth of each
+// 8x8 block, and the bounds of every mesh visible in the view are tested
+// against it, falling back to single pixels only in blocks where the result
+// isn't clear.
+//
+// Depth is stored as 1/w, which is linear in screen space and larger for
+// nearer surfaces. The cleared buffer is 0, infinitely far away.
+class SoftwareOcclusionCuller {
+ public:
+  static constexpr int WIDTH = 256;
+  static constexpr int HEIGHT = 128;
+  static constexpr int TILE_SIZE = 32;
+  static constexpr int BLOCK_SIZE = 8;
+
+  explicit SoftwareOcclusionCuller(WorkerPool& t_workers);
+
+  // Rasterizes the occluders among the meshes visible in t_view, then clears
+  // t_view's visibility bit of every mesh hidden behind them. t_visibility
+  // must have been culled, and t_viewProjection is the view's camera.
+  void cull(SceneVisibility& t_visibility, int t_view,
+            const glm::mat4& t_viewProjection);
+
+  // Meshes whose bounds cover at least this fraction of the screen are used as
+  // occluders, along with those marked as occluders.
+  void setMinOccluderArea(const float t_fraction) {
+    m_minOccluderArea = t_fraction;
+  }
+  [[nodiscard]] float getMinOccluderArea() const { return m_minOccluderArea; }
+
+  [[nodiscard]] const OcclusionCullStats& getStats() const { return m_stats; }
+  // The depth buffer, row by row from the bottom of the screen.
+  [[nodiscard]] const std::vector<float>& getDepth() const { return m_depth; }
+
+ private:
+  static constexpr int TILES_X = WIDTH / TILE_SIZE;
+  static constexpr int TILES_Y = HEIGHT / TILE_SIZE;
+  static constexpr int BLOCKS_X = WIDTH / BLOCK_SIZE;
+  static constexpr int BLOCKS_Y = HEIGHT / BLOCK_SIZE;
+
+  // A screen space triangle, ready to rasterize.
+  struct Triangle {
+    // Edge functions a*x + b*y + c, positive inside.
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    // The plane of 1/w.
+    float depthA, depthB, depthC;
+    // Pixel bounds, inclusive.
+    int minX, minY, maxX, maxY;
+  };
+
+  // An occluder and its model-view-projection.
+  struct Occluder {
+    const OccluderGeometry* geometry;
+    glm::mat4 transform;
+    // Triangles of all occluders before this one.
+    size_t firstTriangle;
+  };
+
+  // The triangles set up by one binning job, and the indices of those
+  // overlapping each tile.
+  struct Bins {
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> tiles[TILES_X * TILES_Y];
+  };
+
+  void binTriangles(unsigned int t_job, unsigned int t_numJobs);
+  void addTriangle(Bins& t_bins, const glm::vec4& t_v0, const glm::vec4& t_v1,
+                   const glm::vec4& t_v2);
+  void rasterizeTile(unsigned int t_tile);
+  // Whether the world space box is hidden behind the depth buffer.
+  bool isOccluded(const glm::vec3& t_center, const glm::vec3& t_extents) const;
+
+  WorkerPool& m_workers;
+  float m_minOccluderArea = 0.02f;
+
+  glm::mat4 m_viewProjection = glm::mat4(1.0f);
+  std::vector<Occluder> m_occluders;
+  size_t m_numTriangles = 0;
+  std::vector<Bins> m_bins;
+  std::vector<float> m_depth;
+  // The smallest (farthest) depth of each block.
+  std::vector<float> m_blockDepth;
+  OcclusionCullStats m_stats;
+};
+
+// Frustum culling alone against frustum plus software occlusion culling, both
+// of the same view of a scene.
+struct OcclusionBenchmarkResult {
+  int meshes = 0;
+  // Meshes left to draw by each.
+  int frustumVisible = 0;
+  int occlusionVisible = 0;
+  int occluders = 0;
+  // Best time of each in ms, including gathering the scene's meshes.
+  float frustumMs = 0.0f;
+  float occlusionMs = 0.0f;
+};
+
+// Culls the scene for the camera t_repeats times each way, with its own
+// culler so that the caller's state is left alone.
+OcclusionBenchmarkResult benchmarkOcclusion(Scene& t_scene,
+                                            const glm::mat4& t_rootTransform,
+                                            const Frustum& t_frustum,
+                                            const glm::mat4& t_viewProjection,
+                                            WorkerPool& t_workers,
+                                            float t_minOccluderArea,
+                                            int t_repeats = 20);
@@ -0,0 +1,411 @@
+#include "pvs.hpp"
+
+#include "core/debug/logger.hpp"
+#include "scene/mesh.hpp"
+#include "scene/scene_bvh.hpp"
+#include "scene/visibility.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/constants.hpp>
+#include <iterator>
+#include <map>
+#include <random>
+
+static constexpr char PVS_MAGIC[4] = {'F', 'P', 'V', 'S'};
+static constexpr uint32_t PVS_VERSION = 2;
+
+// Axis rays from a cell's center that must hit back faces for the cell to
+// count as inside geometry.
+static constexpr int MIN_SOLID_BACK_FACES = 4;
+
+static float elapsedMs(const std::chrono::steady_clock::time_point t_start) {
+  return std::chrono::duration<float, std::milli>(
+             std::chrono::steady_clock::now() - t_start)
+      .count();
+}
+
+static bool testBit(const std::vector<uint64_t>& t_bits, const size_t t_index) {
+  return (t_bits[t_index / 64] >> (t_index % 64)) & 1u;
+}
+
+static void setBit(std::vector<uint64_t>& t_bits, const size_t t_index) {
+  t_bits[t_index / 64] |= uint64_t(1) << (t_index % 64);
+}
+
+template <typename T>
+static void writeRaw(std::vector<uint8_t>& t_out, const T& t_value) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(&t_value);
+  t_out.insert(t_out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static bool readRaw(const uint8_t*& t_in, const uint8_t* t_end, T& t_value) {
+  if (static_cast<size_t>(t_end - t_in) < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&t_value, t_in, sizeof(T));
+  t_in += sizeof(T);
+  return true;
+}
+
+// LEB128: seven bits per byte, with the high bit set on all but the last.
+static void writeVarint(std::vector<uint8_t>& t_out, uint64_t t_value) {
+  while (t_value >= 0x80) {
+    t_out.push_back(static_cast<uint8_t>(t_value | 0x80));
+    t_value >>= 7;
+  }
+  t_out.push_back(static_cast<uint8_t>(t_value));
+}
+
+static bool readVarint(const uint8_t*& t_in, const uint8_t* t_end,
+                       uint64_t& t_value) {
+  t_value = 0;
+  for (int shift = 0; shift < 64 && t_in != t_end; shift += 7) {
+    const uint8_t byte = *t_in++;
+    t_value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sets are stored as the lengths of alternating runs of hidden and visible
+// entries, starting with hidden. Neighbouring meshes tend to be visible
+// together, so the runs are few and short to encode.
+static void writeSet(std::vector<uint8_t>& t_out,
+                     const std::vector<uint64_t>& t_bits,
+                     const size_t t_numEntries) {
+  bool visible = false;
+  size_t runStart = 0;
+  for (size_t i = 0; i < t_numEntries; ++i) {
+    if (testBit(t_bits, i) != visible) {
+      writeVarint(t_out, i - runStart);
+      runStart = i;
+      visible = !visible;
+    }
+  }
+  writeVarint(t_out, t_numEntries - runStart);
+}
+
+static bool readSet(const uint8_t*& t_in, const uint8_t* t_end,
+                    const size_t t_numEntries, std::vector<uint64_t>& t_bits) {
+  t_bits.assign((t_numEntries + 63) / 64, 0);
+  bool visible = false;
+  size_t entry = 0;
+  while (entry < t_numEntries) {
+    uint64_t run;
+    if (!readVarint(t_in, t_end, run) || run > t_numEntries - entry) {
+      return false;
+    }
+    if (visible) {
+      for (size_t i = entry; i < entry + run; ++i) {
+        setBit(t_bits, i);
+      }
+    }
+    entry += run;
+    visible = !visible;
+  }
+  return true;
+}
+
+uint64_t PotentiallyVisibleSet::hashMeshes(Renderable& t_renderable) {
+  // FNV-1a over the bytes of each entry's data. Transforms are left out, as
+  // model space ones are only recovered up to rounding.
+  uint64_t hash = 14695981039346656037ull;
+  const auto add = [&hash](const auto& t_value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&t_value);
+    for (size_t i = 0; i < sizeof(t_value); ++i) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+  };
+  t_renderable.visitMeshes(glm::mat4(1.0f),
+                           [&](Mesh& t_mesh, const glm::mat4&) {
+                             const Aabb& bounds = t_mesh.getLocalBounds();
+                             add(bounds.min);
+                             add(bounds.max);
+                             add(t_mesh.getArenaAllocation().indexCount);
+                           });
+  return hash;
+}
+
+void PotentiallyVisibleSet::bake(Renderable& t_renderable,
+                                 WorkerPool& t_workers,
+                                 const PvsBakeSettings& t_settings) {
+  const auto bakeStart = std::chrono::steady_clock::now();
+  clear();
+
+  // Every mesh in the renderable's model space, with instances numbered by
+  // entry.
+  SceneBvh bvh;
+  // Entries without triangles on the CPU can't be tested, so they are always
+  // visible.
+  std::vector<uint32_t> skipped;
+  m_meshHash = hashMeshes(t_renderable);
+  m_numEntries = bvh.addRenderable(
+      t_renderable, glm::inverse(t_renderable.getModelTransform()), &skipped);
+  std::vector<uint64_t> alwaysVisible((m_numEntries + 63) / 64, 0);
+  for (const uint32_t entry : skipped) {
+    setBit(alwaysVisible, entry);
+  }
+  bvh.build(t_workers);
+  const Aabb bounds = bvh.getBounds();
+  if (bounds.isEmpty()) {
+    m_numEntries = 0;
+    return;
+  }
+
+  // Cube cells over the bounds, padded a little so surfaces on the boundary
+  // fall inside the grid.
+  const glm::vec3 size = bounds.max - bounds.min;
+  const float longest = std::max({size.x, size.y, size.z});
+  const int cellsAlongLongest = std::max(t_settings.cellsAlongLongestAxis, 1);
+  m_cellSize = longest * 1.01f / static_cast<float>(cellsAlongLongest);
+  m_dimensions =
+      glm::max(glm::ivec3(glm::ceil(size / m_cellSize)), glm::ivec3(1));
+  m_origin = bounds.getCenter() -
+             glm::vec3(m_dimensions) * (m_cellSize * 0.5f);
+  const int numCells = m_dimensions.x * m_dimensions.y * m_dimensions.z;
+
+  static constexpr glm::vec3 AXES[6] = {
+      {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+      {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+  const int numSamples = std::max(t_settings.samplesPerCell, 1);
+  const int numRays = std::max(t_settings.raysPerSample, 1);
+  const size_t numWords = alwaysVisible.size();
+
+  // Each cell's visible set, or empty for solid cells.
+  std::vector<std::vector<uint64_t>> cellSets(numCells);
+  t_workers.parallelFor(
+      static_cast<unsigned int>(numCells), [&](const unsigned int t_cell) {
+        const glm::ivec3 coords(
+            t_cell % m_dimensions.x,
+            (t_cell / m_dimensions.x) % m_dimensions.y,
+            t_cell / (m_dimensions.x * m_dimensions.y));
+        const glm::vec3 cellMin = m_origin + glm::vec3(coords) * m_cellSize;
+
+        // A point inside closed geometry sees mostly back faces. Nothing is
+        // drawn from there, so it needs no set.
+        int backFaces = 0;
+        for (const glm::vec3& axis : AXES) {
+          RayHit hit;
+          const Ray ray{.origin = cellMin + m_cellSize * 0.5f,
+                        .direction = axis};
+          if (bvh.intersect(ray, hit) && hit.backFace) {
+            ++backFaces;
+          }
+        }
+        if (backFaces >= MIN_SOLID_BACK_FACES) {
+          return;
+        }
+
+        std::vector<uint64_t> bits = alwaysVisible;
+        // Seeded by cell, so bakes are repeatable however cells are spread
+        // across threads.
+        std::mt19937 random(t_cell);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int sample = 0; sample < numSamples; ++sample) {
+          const glm::vec3 origin =
+              cellMin +
+              glm::vec3(unit(random), unit(random), unit(random)) * m_cellSize;
+          // Directions on a Fibonacci sphere, spun by a random angle per
+          // sample so samples don't all miss the same thin gaps.
+          const float spin = unit(random) * glm::two_pi<float>();
+          for (int i = 0; i < numRays; ++i) {
+            const float z = 1.0f - (2.0f * static_cast<float>(i) + 1.0f) /
+                                       static_cast<float>(numRays);
+            const float radius = std::sqrt(std::max(1.0f - z * z, 0.0f));
+            const float phi =
+                static_cast<float>(i) * glm::pi<float>() *
+                    (3.0f - std::sqrt(5.0f)) +
+                spin;
+            const Ray ray{
+                .origin = origin,
+                .direction = glm::vec3(radius * std::cos(phi),
+                                       radius * std::sin(phi), z)};
+            RayHit hit;
+            // Back faces are only seen from inside geometry, by samples that
+            // landed in a wall.
+            if (bvh.intersect(ray, hit) && !hit.backFace) {
+              setBit(bits, hit.instance);
+            }
+          }
+        }
+        cellSets[t_cell] = std::move(bits);
+      });
+
+  // Many cells see the same meshes, so each distinct set is stored once.
+  std::map<std::vector<uint64_t>, uint32_t> setIndices;
+  m_cells.resize(numCells);
+  for (int cell = 0; cell < numCells; ++cell) {
+    if (cellSets[cell].size() != numWords) {
+      m_cells[cell] = NO_SET;
+      ++m_stats.solidCells;
+      continue;
+    }
+    auto [it, inserted] = setIndices.try_emplace(
+        std::move(cellSets[cell]), static_cast<uint32_t>(m_sets.size() + 1));
+    if (inserted) {
+      m_sets.push_back(it->first);
+    }
+    m_cells[cell] = it->second;
+  }
+
+  m_stats.cells = numCells;
+  m_stats.uniqueSets = static_cast<int>(m_sets.size());
+  m_stats.bakeMs = elapsedMs(bakeStart);
+}
+
+bool PotentiallyVisibleSet::save(const std::string& t_path) {
+  if (!isValid()) {
+    return false;
+  }
+
+  std::vector<uint8_t> data;
+  data.insert(data.end(), std::begin(PVS_MAGIC), std::end(PVS_MAGIC));
+  writeRaw(data, PVS_VERSION);
+  writeRaw(data, static_cast<uint64_t>(m_numEntries));
+  writeRaw(data, m_meshHash);
+  writeRaw(data, m_origin);
+  writeRaw(data, m_cellSize);
+  writeRaw(data, m_dimensions);
+  writeVarint(data, m_sets.size());
+  for (const std::vector<uint64_t>& set : m_sets) {
+    writeSet(data, set, m_numEntries);
+  }
+  for (const uint32_t cell : m_cells) {
+    writeVarint(data, cell);
+  }
+
+  std::ofstream file(t_path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(data.data()),
+             static_cast<std::streamsize>(data.size()));
+  if (!file) {
+    LOG_ERROR("ERROR::PVS::FAILED_TO_WRITE " + t_path);
+    return false;
+  }
+  m_stats.bytes = data.size();
+  return true;
+}
+
+bool PotentiallyVisibleSet::load(const std::string& t_path,
+                                 Renderable& t_renderable) {
+  clear();
+  std::ifstream file(t_path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+  const uint8_t* in = data.data();
+  const uint8_t* end = in + data.size();
+
+  const auto parse = [&] {
+    char magic[4];
+    uint32_t version;
+    uint64_t numEntries;
+    if (!readRaw(in, end, magic) ||
+        std::memcmp(magic, PVS_MAGIC, sizeof(magic)) ||
+        !readRaw(in, end, version) || version != PVS_VERSION ||
+        !readRaw(in, end, numEntries) || !readRaw(in, end, m_meshHash) ||
+        !readRaw(in, end, m_origin) ||
+        !readRaw(in, end, m_cellSize) || !readRaw(in, end, m_dimensions)) {
+      return false;
+    }
+    if (glm::any(glm::lessThan(m_dimensions, glm::ivec3(1))) ||
+        !(m_cellSize > 0.0f)) {
+      return false;
+    }
+    m_numEntries = numEntries;
+
+    uint64_t numSets;
+    if (!readVarint(in, end, numSets) || numSets > data.size()) {
+      return false;
+    }
+    m_sets.resize(numSets);
+    for (std::vector<uint64_t>& set : m_sets) {
+      if (!readSet(in, end, m_numEntries, set)) {
+        return false;
+      }
+    }
+
+    const size_t numCells = static_cast<size_t>(m_dimensions.x) *
+                            m_dimensions.y * m_dimensions.z;
+    if (numCells > data.size()) {
+      return false;
+    }
+    m_cells.resize(numCells);
+    for (uint32_t& cell : m_cells) {
+      uint64_t set;
+      if (!readVarint(in, end, set) || set > numSets) {
+        return false;
+      }
+      cell = static_cast<uint32_t>(set);
+      m_stats.solidCells += cell == NO_SET;
+    }
+    return true;
+  };
+
+  if (!parse()) {
+    LOG_ERROR("ERROR::PVS::INVALID_FILE " + t_path);
+    clear();
+    return false;
+  }
+  if (m_meshHash != hashMeshes(t_renderable)) {
+    // Baked for another version of the model, whose entries could be
+    // numbered differently.
+    LOG_ERROR("ERROR::PVS::MESH_MISMATCH " + t_path);
+    clear();
+    return false;
+  }
+  m_stats.cells = static_cast<int>(m_cells.size());
+  m_stats.uniqueSets = static_cast<int>(m_sets.size());
+  m_stats.bytes = data.size();
+  return true;
+}
+
+void PotentiallyVisibleSet::clear() {
+  m_numEntries = 0;
+  m_meshHash = 0;
+  m_origin = glm::vec3(0.0f);
+  m_cellSize = 0.0f;
+  m_dimensions = glm::ivec3(0);
+  m_sets.clear();
+  m_cells.clear();
+  m_stats = {};
+}
+
+int PotentiallyVisibleSet::findCell(const glm::vec3& t_position) const {
+  const glm::ivec3 coords(glm::floor((t_position - m_origin) / m_cellSize));
+  if (glm::any(glm::lessThan(coords, glm::ivec3(0))) ||
+      glm::any(glm::greaterThanEqual(coords, m_dimensions))) {
+    return -1;
+  }
+  return coords.x + m_dimensions.x * (coords.y + m_dimensions.y * coords.z);
+}
+
+int PotentiallyVisibleSet::apply(SceneVisibility& t_visibility,
+                                 const int t_view,
+                                 const glm::vec3& t_position) const {
+  const size_t numEntries = t_visibility.getEntries().size();
+  if (!isValid() || numEntries != m_numEntries) {
+    return 0;
+  }
+  const int cell = findCell(t_position);
+  if (cell < 0 || m_cells[cell] == NO_SET) {
+    return 0;
+  }
+
+  const std::vector<uint64_t>& set = m_sets[m_cells[cell] - 1];
+  int hidden = 0;
+  for (size_t i = 0; i < numEntries; ++i) {
+    if (!testBit(set, i) && t_visibility.isVisible(i, t_view)) {
+      t_visibility.hide(i, t_view);
+      ++hidden;
+    }
+  }
+  return hidden;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "core/worker_pool.hpp"
+#include "scene/bounds.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+class Renderable;
+class SceneVisibility;
+
+struct PvsBakeSettings {
+  // The number of cells along the longest side of the scene's bounds. Cells
+  // are cubes, so the other sides get proportionally fewer.
+  int cellsAlongLongestAxis = 32;
+  // Random points per cell that rays are cast from.
+  int samplesPerCell = 8;
+  // Rays cast from each point, spread evenly over the sphere.
+  int raysPerSample = 256;
+};
+
+// Sizes and timings of the last bake or load.
+struct PvsStats {
+  int cells = 0;
+  // Cells found inside geometry, which have no visible set.
+  int solidCells = 0;
+  // Distinct visible sets, shared between cells.
+  int uniqueSets = 0;
+  // The size of the stored PVS.
+  size_t bytes = 0;
+  float bakeMs = 0.0f;
+};
+
+// A precomputed potentially visible set for static scenes.
+//
+// The scene's bounds are cut into a grid of cells, and the meshes seen from
+// each cell are found offline by casting rays from random points in it
+// against a BVH of the whole scene. At runtime the camera's cell is looked up
+// and every mesh outside its set is hidden, with no other occlusion work.
+//
+// Everything is baked in the renderable's model space, so the set stays valid
+// as long as its meshes don't move relative to each other. Meshes are
+// identified by the order visitMeshes() reaches them, which is the order of
+// SceneVisibility's entries.
+class PotentiallyVisibleSet {
+ public:
+  // Bakes the set of a renderable, spreading cells across the workers.
+  void bake(Renderable& t_renderable, WorkerPool& t_workers,
+            const PvsBakeSettings& t_settings = {});
+
+  // Writes the set to a file, with each cell's set run-length encoded.
+  // Returns false on failure.
+  bool save(const std::string& t_path);
+  // Reads a set written by save() for the renderable. Returns false and
+  // leaves the set empty if the file is missing or invalid, or was baked for
+  // different meshes.
+  bool load(const std::string& t_path, Renderable& t_renderable);
+  void clear();
+
+  [[nodiscard]] bool isValid() const { return !m_cells.empty(); }
+  [[nodiscard]] const PvsStats& getStats() const { return m_stats; }
+
+  // Hides from t_view every entry the cell around the model space position
+  // can't see, and returns how many were hidden. Does nothing if the position
+  // is outside the grid or in solid geometry, or if t_visibility's entries
+  // don't match the baked scene.
+  int apply(SceneVisibility& t_visibility, int t_view,
+            const glm::vec3& t_position) const;
+
+ private:
+  // Cells reference their visible set by index. Index 0 is reserved for
+  // cells without one.
+  static constexpr uint32_t NO_SET = 0;
+
+  // Identifies the meshes of a renderable, in the order of its entries, by
+  // their local bounds and index counts.
+  static uint64_t hashMeshes(Renderable& t_renderable);
+
+  // The cell containing the position, or -1 if it's outside the grid.
+  [[nodiscard]] int findCell(const glm::vec3& t_position) const;
+
+  // Bit i of a set is whether entry i is visible.
+  size_t m_numEntries = 0;
+  // hashMeshes() of the baked renderable.
+  uint64_t m_meshHash = 0;
+  glm::vec3 m_origin = glm::vec3(0.0f);
+  float m_cellSize = 0.0f;
+  glm::ivec3 m_dimensions = glm::ivec3(0);
+  std::vector<std::vector<uint64_t>> m_sets;
+  std::vector<uint32_t> m_cells;
+  PvsStats m_stats;
+};
@@ -0,0 +1,212 @@
+#include "scene.hpp"
+
+#include <algorithm>
+
+static constexpr size_t BATCH_SIZE = Mat4Array::BATCH_SIZE;
+
+static size_t padToBatch(const size_t t_count) {
+  return (t_count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+}
+
+// Calls t_run(first, count) for each run of consecutive batches in
+// [t_first, t_end) for which t_isDirty(batch start) holds.
+template <typename IsDirty, typename Run>
+static void forEachDirtyRun(const size_t t_first, const size_t t_end,
+                            const IsDirty& t_isDirty, const Run& t_run) {
+  size_t runStart = t_end;
+  for (size_t i = t_first; i < t_end; i += BATCH_SIZE) {
+    if (t_isDirty(i)) {
+      runStart = std::min(runStart, i);
+    } else if (runStart != t_end) {
+      t_run(runStart, i - runStart);
+      runStart = t_end;
+    }
+  }
+  if (runStart != t_end) {
+    t_run(runStart, t_end - runStart);
+  }
+}
+
+Scene::NodeId Scene::addNode(const NodeId t_parent,
+                             const glm::mat4& t_localTransform) {
+  const auto node = static_cast<NodeId>(m_parents.size());
+  m_parents.push_back(t_parent);
+  m_localTransforms.push_back(t_localTransform);
+  m_layoutDirty = true;
+  return node;
+}
+
+Mesh& Scene::addMesh(const NodeId t_node, std::unique_ptr<Mesh> t_mesh) {
+  Mesh& mesh = *t_mesh;
+  m_meshes.push_back(std::move(t_mesh));
+  m_meshNodes.push_back(t_node);
+  m_drawItems.push_back({.mesh = &mesh, .transform = glm::mat4(1.0f)});
+  m_layoutDirty = true;
+  return mesh;
+}
+
+void Scene::setLocalTransform(const NodeId t_node,
+                              const glm::mat4& t_transform) {
+  m_localTransforms[t_node] = t_transform;
+  if (!m_layoutDirty) {
+    m_local.set(m_slots[t_node], t_transform);
+    m_dirty[m_slots[t_node]] = 1;
+    m_anyDirty = true;
+  }
+}
+
+glm::mat4 Scene::getWorldTransform(const NodeId t_node) const {
+  return m_world.get(m_slots[t_node]);
+}
+
+void Scene::layout() {
+  // Parents are added before their children, so their depth is known first.
+  std::vector<uint32_t> depths(m_parents.size());
+  std::vector<size_t> levelSizes;
+  for (size_t i = 0; i < m_parents.size(); ++i) {
+    depths[i] = m_parents[i] == NO_PARENT ? 0 : depths[m_parents[i]] + 1;
+    if (depths[i] == levelSizes.size()) {
+      levelSizes.push_back(0);
+    }
+    ++levelSizes[depths[i]];
+  }
+
+  m_levels.clear();
+  size_t numSlots = BATCH_SIZE;
+  for (const size_t size : levelSizes) {
+    m_levels.emplace_back(numSlots, padToBatch(size));
+    numSlots += m_levels.back().second;
+  }
+
+  m_local = Mat4Array();
+  m_local.resize(numSlots);
+  m_world = Mat4Array();
+  m_world.resize(numSlots);
+  m_slotParents.assign(numSlots, ROOT_SLOT);
+  m_dirty.assign(numSlots, 1);
+  m_slots.resize(m_parents.size());
+  std::vector<size_t> nextSlots(m_levels.size());
+  for (size_t level = 0; level < m_levels.size(); ++level) {
+    nextSlots[level] = m_levels[level].first;
+  }
+  for (size_t i = 0; i < m_parents.size(); ++i) {
+    const auto slot = static_cast<uint32_t>(nextSlots[depths[i]]++);
+    m_slots[i] = slot;
+    m_slotParents[slot] =
+        m_parents[i] == NO_PARENT ? ROOT_SLOT : m_slots[m_parents[i]];
+    m_local.set(slot, m_localTransforms[i]);
+  }
+
+  const size_t numMeshes = m_meshes.size();
+  m_meshSlots.assign(padToBatch(numMeshes), ROOT_SLOT);
+  m_meshTransforms = Mat4Array();
+  m_meshTransforms.resize(numMeshes);
+  m_itemTransforms = Mat4Array();
+  m_itemTransforms.resize(numMeshes);
+  m_localBounds.clear();
+  for (size_t i = 0; i < numMeshes; ++i) {
+    m_meshSlots[i] = m_slots[m_meshNodes[i]];
+    m_meshTransforms.set(i, m_meshes[i]->getModelTransform());
+    m_localBounds.add(m_meshes[i]->getLocalBounds());
+  }
+  m_worldBounds.clear();
+  m_worldBounds.resize(numMeshes);
+
+  m_layoutDirty = false;
+  m_anyDirty = true;
+  ++m_staticRevision;
+}
+
+void Scene::update(const glm::mat4& t_rootTransform) {
+  if (m_layoutDirty) {
+    layout();
+  }
+  if (t_rootTransform != m_rootTransform) {
+    m_rootTransform = t_rootTransform;
+    m_dirty[ROOT_SLOT] = 1;
+    m_anyDirty = true;
+  }
+  if (!m_anyDirty) {
+    return;
+  }
+
+  // Parents come before their children, so a parent's flag is final by the
+  // time its children read it.
+  m_world.set(ROOT_SLOT, m_rootTransform);
+  for (size_t slot = BATCH_SIZE; slot < m_dirty.size(); ++slot) {
+    m_dirty[slot] |= m_dirty[m_slotParents[slot]];
+  }
+
+  const auto isNodeBatchDirty = [this](const size_t t_first) {
+    return std::any_of(m_dirty.begin() + t_first,
+                       m_dirty.begin() + t_first + BATCH_SIZE,
+                       [](const uint8_t t_dirty) { return t_dirty != 0; });
+  };
+  for (const auto& [first, count] : m_levels) {
+    forEachDirtyRun(first, first + count, isNodeBatchDirty,
+                    [this](const size_t t_first, const size_t t_count) {
+                      multiplyGathered(m_world, m_slotParents.data(), m_local,
+                                       m_world, t_first, t_count);
+                    });
+  }
+
+  const auto isItemBatchDirty = [this](const size_t t_first) {
+    for (size_t i = t_first; i < t_first + BATCH_SIZE; ++i) {
+      if (m_dirty[m_meshSlots[i]]) {
+        return true;
+      }
+    }
+    return false;
+  };
+  bool staticMoved = false;
+  forEachDirtyRun(
+      0, m_meshSlots.size(), isItemBatchDirty,
+      [this, &staticMoved](const size_t t_first, const size_t t_count) {
+        multiplyGathered(m_world, m_meshSlots.data(), m_meshTransforms,
+                         m_itemTransforms, t_first, t_count);
+        transformBounds(m_itemTransforms, m_localBounds, m_worldBounds,
+                        t_first, t_count);
+        const size_t end = std::min(t_first + t_count, m_drawItems.size());
+        for (size_t i = t_first; i < end; ++i) {
+          m_drawItems[i].transform = m_itemTransforms.get(i);
+          staticMoved |=
+              m_dirty[m_meshSlots[i]] && !m_drawItems[i].mesh->isDynamic();
+        }
+      });
+  if (staticMoved) {
+    ++m_staticRevision;
+  }
+
+  std::fill(m_dirty.begin(), m_dirty.end(), uint8_t(0));
+  m_anyDirty = false;
+}
+
+const std::vector<SceneDrawItem>& Scene::getDrawItems(
+    const glm::mat4& t_rootTransform) {
+  update(t_rootTransform);
+  return m_drawItems;
+}
+
+void Scene::drawWithTransform(const glm::mat4& t_transform, Shader& t_shader,
+                              TextureRegistry* t_textureRegistry) {
+  for (const SceneDrawItem& item :
+       getDrawItems(t_transform * getModelTransform())) {
+    item.mesh->drawWithModel(item.transform, t_shader, t_textureRegistry);
+  }
+}
+
+void Scene::enqueue(const glm::mat4& t_transform, Shader& t_shader,
+                    RenderQueue& t_queue) {
+  for (const SceneDrawItem& item :
+       getDrawItems(t_transform * getModelTransform())) {
+    t_queue.addMesh(*item.mesh, item.transform, t_shader);
+  }
+}
+
+void Scene::visitMeshes(const glm::mat4& t_transform,
+                        const MeshVisitor& t_visitor) {
+  for (const SceneDrawItem& item :
+       getDrawItems(t_transform * getModelTransform())) {
+    t_visitor(*item.mesh, item.transform);
+  }
+}
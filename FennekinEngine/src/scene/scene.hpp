@@ -0,0 +1,123 @@
+#pragma once
+
+#include "scene/culling.hpp"
+#include "scene/mesh.hpp"
+#include "scene/transform_kernels.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A mesh ready to draw, with its full model transform.
+struct SceneDrawItem {
+  Mesh* mesh;
+  glm::mat4 transform;
+};
+
+// A transform hierarchy stored flat, in place of a tree of renderables.
+//
+// Nodes are kept in arrays: parent, local transform, world transform and a
+// dirty flag each. Internally they are laid out level by level, so that every
+// parent is in an earlier level than its children, and each level is padded
+// to a whole batch of the transform kernels. A level's world transforms are
+// then computed 4 or 8 at a time from the level before, skipping batches
+// where neither a node nor any of its ancestors changed since the last update.
+//
+// The meshes of all nodes are flattened into one array of draw items, whose
+// transforms and world bounds are computed by the same kernels. Drawing,
+// queueing and culling are plain loops over it.
+class Scene : public Renderable {
+ public:
+  using NodeId = uint32_t;
+  static constexpr NodeId NO_PARENT = std::numeric_limits<NodeId>::max();
+
+  ~Scene() override = default;
+
+  // Adds a node under t_parent, which must already exist, or a root node if
+  // t_parent is NO_PARENT.
+  NodeId addNode(NodeId t_parent, const glm::mat4& t_localTransform);
+  // Adds a mesh drawn with its node's world transform, followed by the mesh's
+  // own model transform. The mesh's transform and bounds are read on the
+  // next update.
+  Mesh& addMesh(NodeId t_node, std::unique_ptr<Mesh> t_mesh);
+
+  [[nodiscard]] size_t getNumNodes() const { return m_parents.size(); }
+  [[nodiscard]] NodeId getParent(const NodeId t_node) const {
+    return m_parents[t_node];
+  }
+  [[nodiscard]] const glm::mat4& getLocalTransform(const NodeId t_node) const {
+    return m_localTransforms[t_node];
+  }
+  // Marks the node and all of its descendants for update.
+  void setLocalTransform(NodeId t_node, const glm::mat4& t_transform);
+  // The node's transform as of the last update, including the root transform.
+  [[nodiscard]] glm::mat4 getWorldTransform(NodeId t_node) const;
+
+  // Recomputes the world transforms of dirty nodes and the draw items under
+  // them. t_rootTransform is applied above every root node; passing a
+  // different one than last time updates everything.
+  void update(const glm::mat4& t_rootTransform);
+  // Updates the scene and returns its draw items, in the order their meshes
+  // were added.
+  const std::vector<SceneDrawItem>& getDrawItems(
+      const glm::mat4& t_rootTransform);
+  // The world bounds of the draw items as of the last update, in the same
+  // order.
+  [[nodiscard]] const CullingBounds& getWorldBounds() const {
+    return m_worldBounds;
+  }
+  [[nodiscard]] const std::vector<std::unique_ptr<Mesh>>& getMeshes() const {
+    return m_meshes;
+  }
+  // Changes whenever an update adds or moves a static mesh, see
+  // Mesh::isDynamic(), so caches of the static scene know to redraw.
+  [[nodiscard]] uint64_t getStaticRevision() const { return m_staticRevision; }
+  // Must be called when meshes change between static and dynamic, as that
+  // changes the static scene too.
+  void invalidateStatic() { ++m_staticRevision; }
+
+  void drawWithTransform(const glm::mat4& t_transform, Shader& t_shader,
+                         TextureRegistry* t_textureRegistry = nullptr) override;
+  void enqueue(const glm::mat4& t_transform, Shader& t_shader,
+               RenderQueue& t_queue) override;
+  void visitMeshes(const glm::mat4& t_transform,
+                   const MeshVisitor& t_visitor) override;
+
+ private:
+  // Slot 0 holds the root transform, and its batch has no other nodes.
+  static constexpr uint32_t ROOT_SLOT = 0;
+
+  // Sorts the nodes into levels and rebuilds every slot array.
+  void layout();
+
+  // Per node, by id.
+  std::vector<NodeId> m_parents;
+  std::vector<glm::mat4> m_localTransforms;
+  std::vector<uint32_t> m_slots;
+
+  // Per node, by slot. Padding slots are identity and children of the root.
+  std::vector<uint32_t> m_slotParents;
+  Mat4Array m_local;
+  Mat4Array m_world;
+  std::vector<uint8_t> m_dirty;
+  // The first slot and padded size of each level.
+  std::vector<std::pair<size_t, size_t>> m_levels;
+  bool m_layoutDirty = true;
+  bool m_anyDirty = false;
+  glm::mat4 m_rootTransform = glm::mat4(1.0f);
+  uint64_t m_staticRevision = 0;
+
+  // Per mesh.
+  std::vector<std::unique_ptr<Mesh>> m_meshes;
+  std::vector<NodeId> m_meshNodes;
+  // The slot of each mesh's node, padded like m_meshTransforms.
+  std::vector<uint32_t> m_meshSlots;
+  Mat4Array m_meshTransforms;
+  Mat4Array m_itemTransforms;
+  CullingBounds m_localBounds;
+  CullingBounds m_worldBounds;
+  std::vector<SceneDrawItem> m_drawItems;
+};
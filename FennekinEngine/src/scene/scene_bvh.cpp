@@ -0,0 +1,286 @@
+#include "scene_bvh.hpp"
+
+#include "scene/mesh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+
+// Instances per top level leaf. With one, leaf bounds are exactly instance
+// bounds, which keeps frustum queries tight.
+static constexpr uint32_t MAX_LEAF_INSTANCES = 1;
+static constexpr int MAX_TRAVERSAL_STACK = 256;
+
+static float elapsedMs(const std::chrono::steady_clock::time_point t_start) {
+  return std::chrono::duration<float, std::milli>(
+             std::chrono::steady_clock::now() - t_start)
+      .count();
+}
+
+uint32_t SceneBvh::addMesh(std::vector<glm::vec3> t_vertices) {
+  const auto mesh = static_cast<uint32_t>(m_meshes.size());
+  m_meshes.emplace_back();
+  m_pendingVertices.resize(m_meshes.size());
+  m_pendingVertices[mesh] = std::move(t_vertices);
+  return mesh;
+}
+
+void SceneBvh::addInstance(const uint32_t t_mesh,
+                           const glm::mat4& t_transform,
+                           const uint32_t t_userIndex) {
+  m_instances.push_back(
+      {.objectToWorld = t_transform,
+       .worldToObject = glm::inverse(t_transform),
+       .mesh = t_mesh,
+       .userIndex = t_userIndex,
+       .mirrored = glm::determinant(glm::mat3(t_transform)) < 0.0f});
+}
+
+size_t SceneBvh::addRenderable(Renderable& t_renderable,
+                               const glm::mat4& t_transform,
+                               std::vector<uint32_t>* t_skipped) {
+  std::unordered_map<const Mesh*, uint32_t> meshIds;
+  std::vector<glm::vec3> vertices;
+  const uint32_t firstIndex = m_numUserIndices;
+  t_renderable.visitMeshes(
+      t_transform, [&](Mesh& t_mesh, const glm::mat4& t_meshTransform) {
+        const uint32_t userIndex = m_numUserIndices++;
+        auto it = meshIds.find(&t_mesh);
+        if (it == meshIds.end()) {
+          vertices.clear();
+          if (!t_mesh.getTriangles(vertices) || vertices.empty()) {
+            if (t_skipped) {
+              t_skipped->push_back(userIndex);
+            }
+            return;
+          }
+          it = meshIds.emplace(&t_mesh, addMesh(vertices)).first;
+        }
+        addInstance(it->second, t_meshTransform, userIndex);
+      });
+  return m_numUserIndices - firstIndex;
+}
+
+void SceneBvh::clear() {
+  m_meshes.clear();
+  m_pendingVertices.clear();
+  m_instances.clear();
+  m_nodes.clear();
+  m_bounds = Aabb();
+  m_numUserIndices = 0;
+  m_buildMs = 0.0f;
+}
+
+void SceneBvh::build(WorkerPool& t_workers) {
+  const auto buildStart = std::chrono::steady_clock::now();
+
+  // Each bottom level hierarchy is built by one thread. The largest go first,
+  // so a big mesh picked up last doesn't leave the other threads idle.
+  std::vector<uint32_t> pending;
+  for (uint32_t mesh = 0; mesh < m_pendingVertices.size(); ++mesh) {
+    if (!m_pendingVertices[mesh].empty()) {
+      pending.push_back(mesh);
+    }
+  }
+  std::sort(pending.begin(), pending.end(),
+            [this](const uint32_t t_a, const uint32_t t_b) {
+              return m_pendingVertices[t_a].size() >
+                     m_pendingVertices[t_b].size();
+            });
+  t_workers.parallelFor(static_cast<unsigned int>(pending.size()),
+                        [&](const unsigned int t_index) {
+                          const uint32_t mesh = pending[t_index];
+                          m_meshes[mesh].build(m_pendingVertices[mesh]);
+                          m_pendingVertices[mesh] = {};
+                        });
+
+  std::vector<Aabb> bounds(m_instances.size());
+  m_bounds = Aabb();
+  for (size_t i = 0; i < m_instances.size(); ++i) {
+    const Instance& instance = m_instances[i];
+    bounds[i] = m_meshes[instance.mesh].getBounds().transformed(
+        instance.objectToWorld);
+    if (!bounds[i].isEmpty()) {
+      m_bounds.expand(bounds[i].min);
+      m_bounds.expand(bounds[i].max);
+    }
+  }
+  std::vector<uint32_t> order;
+  buildBvh4(bounds, MAX_LEAF_INSTANCES, m_nodes, order);
+  std::vector<Instance> instances;
+  instances.reserve(m_instances.size());
+  for (const uint32_t instance : order) {
+    instances.push_back(m_instances[instance]);
+  }
+  m_instances = std::move(instances);
+
+  m_buildMs = elapsedMs(buildStart);
+}
+
+bool SceneBvh::intersect(const Ray& t_ray, RayHit& t_hit) const {
+  return traverse<false>(t_ray, &t_hit);
+}
+
+bool SceneBvh::intersectAny(const Ray& t_ray) const {
+  return traverse<true>(t_ray, nullptr);
+}
+
+template <bool ANY_HIT>
+bool SceneBvh::traverse(const Ray& t_ray, RayHit* t_hit) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  const PreparedRay prepared(t_ray);
+  float closest = t_ray.tMax;
+  bool hit = false;
+
+  BvhStackEntry stack[MAX_TRAVERSAL_STACK];
+  int stackSize = 0;
+  stack[stackSize++] = {.node = 0, .entry = 0.0f};
+  while (stackSize) {
+    const BvhStackEntry current = stack[--stackSize];
+    if (current.entry > closest) {
+      continue;
+    }
+    const Bvh4Node& node = m_nodes[current.node];
+    alignas(16) float entries[Bvh4Node::WIDTH];
+    uint32_t mask = intersectChildren(node, prepared, closest, entries);
+
+    BvhStackEntry pushed[Bvh4Node::WIDTH];
+    int numPushed = 0;
+    for (; mask; mask &= mask - 1) {
+      const int i = std::countr_zero(mask);
+      if (!node.isLeaf(i)) {
+        pushed[numPushed++] = {.node = node.child[i], .entry = entries[i]};
+        continue;
+      }
+      for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i];
+           ++j) {
+        const Instance& instance = m_instances[j];
+        // The direction isn't normalized, so distances along the ray are the
+        // same in both spaces.
+        const Ray objectRay{
+            .origin = glm::vec3(instance.worldToObject *
+                                glm::vec4(t_ray.origin, 1.0f)),
+            .direction = glm::mat3(instance.worldToObject) * t_ray.direction,
+            .tMax = closest};
+        if constexpr (ANY_HIT) {
+          if (m_meshes[instance.mesh].intersectAny(objectRay)) {
+            return true;
+          }
+        } else {
+          RayHit meshHit;
+          if (m_meshes[instance.mesh].intersect(objectRay, meshHit)) {
+            closest = meshHit.t;
+            meshHit.instance = instance.userIndex;
+            meshHit.backFace = meshHit.backFace != instance.mirrored;
+            *t_hit = meshHit;
+            hit = true;
+          }
+        }
+      }
+    }
+    pushSortedByEntry(pushed, numPushed, stack, stackSize);
+  }
+  return hit;
+}
+
+void SceneBvh::queryFrustum(const Frustum& t_frustum,
+                            std::vector<uint32_t>& t_userIndices) const {
+  if (m_nodes.empty()) {
+    return;
+  }
+  uint32_t stack[MAX_TRAVERSAL_STACK];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize) {
+    const Bvh4Node& node = m_nodes[stack[--stackSize]];
+    for (uint32_t mask = overlapChildren(node, t_frustum); mask;
+         mask &= mask - 1) {
+      const int i = std::countr_zero(mask);
+      if (!node.isLeaf(i)) {
+        stack[stackSize++] = node.child[i];
+        continue;
+      }
+      for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i];
+           ++j) {
+        t_userIndices.push_back(m_instances[j].userIndex);
+      }
+    }
+  }
+}
+
+size_t SceneBvh::getNumTriangles() const {
+  size_t numTriangles = 0;
+  for (const Instance& instance : m_instances) {
+    numTriangles += m_meshes[instance.mesh].getNumTriangles();
+  }
+  return numTriangles;
+}
+
+BvhBenchmarkResult benchmarkBvh(const SceneBvh& t_bvh, WorkerPool& t_workers,
+                                const size_t t_numRays) {
+  BvhBenchmarkResult result;
+  result.numRays = t_numRays;
+  result.numThreads = t_workers.getNumThreads();
+  const Aabb& bounds = t_bvh.getBounds();
+  if (bounds.isEmpty() || !t_numRays) {
+    return result;
+  }
+
+  // Generated up front, so only the queries are timed.
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+  const glm::vec3 center = bounds.getCenter();
+  const float radius = glm::length(bounds.getExtents()) * 1.5f;
+  std::vector<Ray> rays(t_numRays);
+  for (Ray& ray : rays) {
+    glm::vec3 onSphere(normal(random), normal(random), normal(random));
+    onSphere /= std::max(glm::length(onSphere), 1e-6f);
+    const glm::vec3 target =
+        bounds.min +
+        glm::vec3(unit(random), unit(random), unit(random)) *
+            (bounds.max - bounds.min);
+    ray.origin = center + onSphere * radius;
+    ray.direction = target - ray.origin;
+  }
+
+  const auto toRaysPerSecond = [t_numRays](const float t_ms) {
+    return static_cast<double>(t_numRays) * 1000.0 /
+           std::max(static_cast<double>(t_ms), 1e-3);
+  };
+
+  size_t numHits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) {
+    RayHit hit;
+    numHits += t_bvh.intersect(ray, hit);
+  }
+  result.closestRaysPerSecond = toRaysPerSecond(elapsedMs(start));
+  result.hitRate =
+      static_cast<float>(numHits) / static_cast<float>(t_numRays);
+
+  start = std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) {
+    t_bvh.intersectAny(ray);
+  }
+  result.anyHitRaysPerSecond = toRaysPerSecond(elapsedMs(start));
+
+  // Chunks big enough that handing them out costs nothing next to the rays.
+  static constexpr size_t CHUNK_SIZE = 1024;
+  const size_t numChunks = (t_numRays + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  start = std::chrono::steady_clock::now();
+  t_workers.parallelFor(
+      static_cast<unsigned int>(numChunks), [&](const unsigned int t_chunk) {
+        const size_t end = std::min((t_chunk + 1) * CHUNK_SIZE, t_numRays);
+        for (size_t i = t_chunk * CHUNK_SIZE; i < end; ++i) {
+          RayHit hit;
+          t_bvh.intersect(rays[i], hit);
+        }
+      });
+  result.parallelClosestRaysPerSecond = toRaysPerSecond(elapsedMs(start));
+  return result;
+}
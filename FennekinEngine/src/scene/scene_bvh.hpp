@@ -0,0 +1,102 @@
+#pragma once
+
+#include "core/worker_pool.hpp"
+#include "scene/bounds.hpp"
+#include "scene/bvh.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Renderable;
+
+// A two-level bounding volume hierarchy over a scene, for ray and frustum
+// queries on the CPU.
+//
+// Each distinct mesh gets a TriangleBvh over its triangles in object space,
+// the bottom level. Instances place a mesh in the world with a transform, and
+// a top level hierarchy over the instances' world bounds finds the ones a
+// query reaches. Rays are moved into each instance's object space, so any
+// number of instances share one bottom level hierarchy, and moving an
+// instance only needs the small top level rebuilt.
+class SceneBvh {
+ public:
+  // Adds a mesh from its triangles, three vertices each, and returns its id.
+  // Its hierarchy is built by the next build().
+  uint32_t addMesh(std::vector<glm::vec3> t_vertices);
+  // Places a mesh in the world. Hits report t_userIndex as the instance.
+  void addInstance(uint32_t t_mesh, const glm::mat4& t_transform,
+                   uint32_t t_userIndex);
+  // Adds an instance for every mesh of the renderable, numbered in visit
+  // order, continuing after the meshes of earlier calls. Meshes visited more
+  // than once are shared. Meshes without triangles on the CPU are skipped,
+  // and their numbers appended to t_skipped if given. Returns the number of
+  // meshes visited.
+  size_t addRenderable(Renderable& t_renderable,
+                       const glm::mat4& t_transform = glm::mat4(1.0f),
+                       std::vector<uint32_t>* t_skipped = nullptr);
+  void clear();
+
+  // Builds the hierarchies of new meshes, largest first and in parallel, then
+  // the top level over all instances.
+  void build(WorkerPool& t_workers);
+
+  // Finds the closest hit along the ray within (0, tMax]. backFace is as seen
+  // in the world, also for mirrored instances.
+  bool intersect(const Ray& t_ray, RayHit& t_hit) const;
+  // Whether the ray hits anything within (0, tMax].
+  bool intersectAny(const Ray& t_ray) const;
+  // Appends the user indices of the instances whose world bounds intersect
+  // or lie inside the frustum.
+  void queryFrustum(const Frustum& t_frustum,
+                    std::vector<uint32_t>& t_userIndices) const;
+
+  [[nodiscard]] size_t getNumMeshes() const { return m_meshes.size(); }
+  [[nodiscard]] size_t getNumInstances() const { return m_instances.size(); }
+  // Triangles in the world, counting those of every instance.
+  [[nodiscard]] size_t getNumTriangles() const;
+  [[nodiscard]] const Aabb& getBounds() const { return m_bounds; }
+  // The time the last build() took.
+  [[nodiscard]] float getBuildMs() const { return m_buildMs; }
+
+ private:
+  struct Instance {
+    glm::mat4 objectToWorld;
+    glm::mat4 worldToObject;
+    uint32_t mesh;
+    uint32_t userIndex;
+    // Whether the transform flips winding, so back faces in object space
+    // face the front in the world.
+    bool mirrored;
+  };
+
+  template <bool ANY_HIT>
+  bool traverse(const Ray& t_ray, RayHit* t_hit) const;
+
+  std::vector<TriangleBvh> m_meshes;
+  // Triangles of meshes added since the last build.
+  std::vector<std::vector<glm::vec3>> m_pendingVertices;
+  // In leaf order of the top level after a build.
+  std::vector<Instance> m_instances;
+  std::vector<Bvh4Node> m_nodes;
+  Aabb m_bounds;
+  uint32_t m_numUserIndices = 0;
+  float m_buildMs = 0.0f;
+};
+
+// Rays per second of SceneBvh queries.
+struct BvhBenchmarkResult {
+  size_t numRays = 0;
+  // The fraction of rays that hit anything.
+  float hitRate = 0.0f;
+  double closestRaysPerSecond = 0.0;
+  double anyHitRaysPerSecond = 0.0;
+  // Closest hit queries spread over every thread of the pool.
+  double parallelClosestRaysPerSecond = 0.0;
+  unsigned int numThreads = 1;
+};
+
+// Times t_numRays random rays through the scene, cast from a sphere around
+// its bounds towards points inside them.
+BvhBenchmarkResult benchmarkBvh(const SceneBvh& t_bvh, WorkerPool& t_workers,
+                                size_t t_numRays = 1 << 18);
@@ -0,0 +1,492 @@
+#include "transform_kernels.hpp"
+
+#include "core/debug/logger.hpp"
+#include "scene/bounds.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || \
+    defined(__i386__)
+#define FNK_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FNK_KERNELS_SSE
+#endif
+// MSVC compiles intrinsics of any instruction set. GCC and Clang only allow
+// them in functions built for it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define FNK_TARGET_AVX2
+#else
+#define FNK_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+void Mat4Array::resize(const size_t t_count) {
+  const size_t padded =
+      (t_count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+  for (int i = 0; i < 16; ++i) {
+    // Diagonal elements are one.
+    m_elements[i].resize(padded, i % 5 == 0 ? 1.0f : 0.0f);
+  }
+  m_size = t_count;
+}
+
+void Mat4Array::set(const size_t t_index, const glm::mat4& t_matrix) {
+  for (int c = 0; c < 4; ++c) {
+    for (int r = 0; r < 4; ++r) {
+      m_elements[c * 4 + r][t_index] = t_matrix[c][r];
+    }
+  }
+}
+
+glm::mat4 Mat4Array::get(const size_t t_index) const {
+  glm::mat4 matrix;
+  for (int c = 0; c < 4; ++c) {
+    for (int r = 0; r < 4; ++r) {
+      matrix[c][r] = m_elements[c * 4 + r][t_index];
+    }
+  }
+  return matrix;
+}
+
+static bool isAvx2Supported() {
+#if defined(FNK_KERNELS_X86) && defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  const bool fma = info[2] & (1 << 12);
+  const bool osxsave = info[2] & (1 << 27);
+  const bool avx = info[2] & (1 << 28);
+  // The OS must also save the YMM registers on context switches.
+  if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return info[1] & (1 << 5);
+#elif defined(FNK_KERNELS_X86)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+  return false;
+#endif
+}
+
+ESimdLevel getSupportedSimdLevel() {
+  static const ESimdLevel level = [] {
+    if (isAvx2Supported()) {
+      return ESimdLevel::AVX2;
+    }
+#if defined(FNK_KERNELS_SSE)
+    return ESimdLevel::SSE;
+#else
+    return ESimdLevel::SCALAR;
+#endif
+  }();
+  return level;
+}
+
+const char* getSimdLevelName(const ESimdLevel t_level) {
+  switch (t_level) {
+    case ESimdLevel::SCALAR:
+      return "scalar";
+    case ESimdLevel::SSE:
+      return "SSE";
+    case ESimdLevel::AVX2:
+      return "AVX2";
+  }
+  return "unknown";
+}
+
+// The elements of two matrix arrays, plus where to write the products.
+struct MultiplyArgs {
+  const float* parents[16];
+  const float* local[16];
+  float* out[16];
+};
+
+static MultiplyArgs getMultiplyArgs(const Mat4Array& t_parents,
+                                    const Mat4Array& t_local,
+                                    Mat4Array& t_out) {
+  MultiplyArgs args;
+  for (int c = 0; c < 4; ++c) {
+    for (int r = 0; r < 4; ++r) {
+      args.parents[c * 4 + r] = t_parents.element(c, r);
+      args.local[c * 4 + r] = t_local.element(c, r);
+      args.out[c * 4 + r] = t_out.element(c, r);
+    }
+  }
+  return args;
+}
+
+// Both matrices are affine, so only the top three rows are computed:
+//
+//   out[c][r] = parent[0][r] * local[c][0] + parent[1][r] * local[c][1] +
+//               parent[2][r] * local[c][2] (+ parent[3][r] if c == 3)
+//
+// and the bottom row is written as (0, 0, 0, 1).
+static void multiplyGatheredScalar(const MultiplyArgs& t_args,
+                                   const uint32_t* t_parentIndices,
+                                   const size_t t_first, const size_t t_end) {
+  for (size_t i = t_first; i < t_end; ++i) {
+    const uint32_t parent = t_parentIndices[i];
+    float parentElements[16];
+    float localElements[16];
+    for (int e = 0; e < 16; ++e) {
+      parentElements[e] = t_args.parents[e][parent];
+      localElements[e] = t_args.local[e][i];
+    }
+    // Computed in full before storing, as t_out may alias t_parents.
+    float out[16];
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 3; ++r) {
+        out[c * 4 + r] = parentElements[r] * localElements[c * 4] +
+                         parentElements[4 + r] * localElements[c * 4 + 1] +
+                         parentElements[8 + r] * localElements[c * 4 + 2];
+      }
+      out[c * 4 + 3] = c == 3 ? 1.0f : 0.0f;
+    }
+    for (int r = 0; r < 3; ++r) {
+      out[12 + r] += parentElements[12 + r];
+    }
+    for (int e = 0; e < 16; ++e) {
+      t_args.out[e][i] = out[e];
+    }
+  }
+}
+
+#if defined(FNK_KERNELS_SSE)
+static void multiplyGatheredSse(const MultiplyArgs& t_args,
+                                const uint32_t* t_parentIndices,
+                                const size_t t_first, const size_t t_end) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (size_t i = t_first; i < t_end; i += 4) {
+    // SSE has no gather, so parent elements are collected one at a time.
+    const uint32_t* parents = t_parentIndices + i;
+    __m128 parent[16];
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 3; ++r) {
+        const float* elements = t_args.parents[c * 4 + r];
+        parent[c * 4 + r] =
+            _mm_setr_ps(elements[parents[0]], elements[parents[1]],
+                        elements[parents[2]], elements[parents[3]]);
+      }
+    }
+    for (int c = 0; c < 4; ++c) {
+      const __m128 local0 = _mm_loadu_ps(t_args.local[c * 4] + i);
+      const __m128 local1 = _mm_loadu_ps(t_args.local[c * 4 + 1] + i);
+      const __m128 local2 = _mm_loadu_ps(t_args.local[c * 4 + 2] + i);
+      for (int r = 0; r < 3; ++r) {
+        __m128 sum = _mm_mul_ps(parent[r], local0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(parent[4 + r], local1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(parent[8 + r], local2));
+        if (c == 3) {
+          sum = _mm_add_ps(sum, parent[12 + r]);
+        }
+        _mm_storeu_ps(t_args.out[c * 4 + r] + i, sum);
+      }
+      _mm_storeu_ps(t_args.out[c * 4 + 3] + i, c == 3 ? one : zero);
+    }
+  }
+}
+#endif
+
+#if defined(FNK_KERNELS_X86)
+FNK_TARGET_AVX2 static void multiplyGatheredAvx2(
+    const MultiplyArgs& t_args, const uint32_t* t_parentIndices,
+    const size_t t_first, const size_t t_end) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  for (size_t i = t_first; i < t_end; i += 8) {
+    const __m256i indices = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(t_parentIndices + i));
+    __m256 parent[16];
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 3; ++r) {
+        parent[c * 4 + r] =
+            _mm256_i32gather_ps(t_args.parents[c * 4 + r], indices, 4);
+      }
+    }
+    for (int c = 0; c < 4; ++c) {
+      const __m256 local0 = _mm256_loadu_ps(t_args.local[c * 4] + i);
+      const __m256 local1 = _mm256_loadu_ps(t_args.local[c * 4 + 1] + i);
+      const __m256 local2 = _mm256_loadu_ps(t_args.local[c * 4 + 2] + i);
+      for (int r = 0; r < 3; ++r) {
+        __m256 sum = c == 3 ? parent[12 + r] : zero;
+        sum = _mm256_fmadd_ps(parent[r], local0, sum);
+        sum = _mm256_fmadd_ps(parent[4 + r], local1, sum);
+        sum = _mm256_fmadd_ps(parent[8 + r], local2, sum);
+        _mm256_storeu_ps(t_args.out[c * 4 + r] + i, sum);
+      }
+      _mm256_storeu_ps(t_args.out[c * 4 + 3] + i, c == 3 ? one : zero);
+    }
+  }
+}
+#endif
+
+void multiplyGathered(const Mat4Array& t_parents,
+                      const uint32_t* t_parentIndices,
+                      const Mat4Array& t_local, Mat4Array& t_out,
+                      const size_t t_first, const size_t t_count,
+                      const ESimdLevel t_level) {
+  if ((t_first | t_count) % Mat4Array::BATCH_SIZE) {
+    LOG_CRITICAL("ERROR::TRANSFORM_KERNELS::UNALIGNED_RANGE");
+  }
+  const MultiplyArgs args = getMultiplyArgs(t_parents, t_local, t_out);
+  const size_t end = t_first + t_count;
+  switch (t_level) {
+#if defined(FNK_KERNELS_X86)
+    case ESimdLevel::AVX2:
+      multiplyGatheredAvx2(args, t_parentIndices, t_first, end);
+      return;
+#endif
+#if defined(FNK_KERNELS_SSE)
+    case ESimdLevel::SSE:
+      multiplyGatheredSse(args, t_parentIndices, t_first, end);
+      return;
+#endif
+    default:
+      multiplyGatheredScalar(args, t_parentIndices, t_first, end);
+      return;
+  }
+}
+
+// The element arrays of the transforms and both sets of boxes.
+struct BoundsArgs {
+  const float* transform[16];
+  const float* center[3];
+  const float* extent[3];
+  float* outCenter[3];
+  float* outExtent[3];
+};
+
+static BoundsArgs getBoundsArgs(const Mat4Array& t_transforms,
+                                const CullingBounds& t_local,
+                                CullingBounds& t_out) {
+  BoundsArgs args;
+  for (int c = 0; c < 4; ++c) {
+    for (int r = 0; r < 4; ++r) {
+      args.transform[c * 4 + r] = t_transforms.element(c, r);
+    }
+  }
+  args.center[0] = t_local.centerX();
+  args.center[1] = t_local.centerY();
+  args.center[2] = t_local.centerZ();
+  args.extent[0] = t_local.extentX();
+  args.extent[1] = t_local.extentY();
+  args.extent[2] = t_local.extentZ();
+  args.outCenter[0] = t_out.centerX();
+  args.outCenter[1] = t_out.centerY();
+  args.outCenter[2] = t_out.centerZ();
+  args.outExtent[0] = t_out.extentX();
+  args.outExtent[1] = t_out.extentY();
+  args.outExtent[2] = t_out.extentZ();
+  return args;
+}
+
+// The center is transformed as a point, and the extents are projected onto
+// the new axes: extent'[r] = sum over k of |m[k][r]| * extent[k]. Extents are
+// clamped so unbounded boxes stay finite.
+static void transformBoundsScalar(const BoundsArgs& t_args,
+                                  const size_t t_first, const size_t t_end) {
+  for (size_t i = t_first; i < t_end; ++i) {
+    for (int r = 0; r < 3; ++r) {
+      float center = t_args.transform[12 + r][i];
+      float extent = 0.0f;
+      for (int k = 0; k < 3; ++k) {
+        const float m = t_args.transform[k * 4 + r][i];
+        center += m * t_args.center[k][i];
+        extent += std::abs(m) * t_args.extent[k][i];
+      }
+      t_args.outCenter[r][i] = center;
+      t_args.outExtent[r][i] =
+          std::min(extent, CullingBounds::UNBOUNDED_EXTENT);
+    }
+  }
+}
+
+#if defined(FNK_KERNELS_SSE)
+static void transformBoundsSse(const BoundsArgs& t_args, const size_t t_first,
+                               const size_t t_end) {
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 maxExtent = _mm_set1_ps(CullingBounds::UNBOUNDED_EXTENT);
+  for (size_t i = t_first; i < t_end; i += 4) {
+    const __m128 center[3] = {_mm_loadu_ps(t_args.center[0] + i),
+                              _mm_loadu_ps(t_args.center[1] + i),
+                              _mm_loadu_ps(t_args.center[2] + i)};
+    const __m128 extent[3] = {_mm_loadu_ps(t_args.extent[0] + i),
+                              _mm_loadu_ps(t_args.extent[1] + i),
+                              _mm_loadu_ps(t_args.extent[2] + i)};
+    for (int r = 0; r < 3; ++r) {
+      __m128 outCenter = _mm_loadu_ps(t_args.transform[12 + r] + i);
+      __m128 outExtent = _mm_setzero_ps();
+      for (int k = 0; k < 3; ++k) {
+        const __m128 m = _mm_loadu_ps(t_args.transform[k * 4 + r] + i);
+        outCenter = _mm_add_ps(outCenter, _mm_mul_ps(m, center[k]));
+        outExtent = _mm_add_ps(
+            outExtent, _mm_mul_ps(_mm_andnot_ps(signMask, m), extent[k]));
+      }
+      _mm_storeu_ps(t_args.outCenter[r] + i, outCenter);
+      _mm_storeu_ps(t_args.outExtent[r] + i, _mm_min_ps(outExtent, maxExtent));
+    }
+  }
+}
+#endif
+
+#if defined(FNK_KERNELS_X86)
+FNK_TARGET_AVX2 static void transformBoundsAvx2(const BoundsArgs& t_args,
+                                                const size_t t_first,
+                                                const size_t t_end) {
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  const __m256 maxExtent = _mm256_set1_ps(CullingBounds::UNBOUNDED_EXTENT);
+  for (size_t i = t_first; i < t_end; i += 8) {
+    const __m256 center[3] = {_mm256_loadu_ps(t_args.center[0] + i),
+                              _mm256_loadu_ps(t_args.center[1] + i),
+                              _mm256_loadu_ps(t_args.center[2] + i)};
+    const __m256 extent[3] = {_mm256_loadu_ps(t_args.extent[0] + i),
+                              _mm256_loadu_ps(t_args.extent[1] + i),
+                              _mm256_loadu_ps(t_args.extent[2] + i)};
+    for (int r = 0; r < 3; ++r) {
+      __m256 outCenter = _mm256_loadu_ps(t_args.transform[12 + r] + i);
+      __m256 outExtent = _mm256_setzero_ps();
+      for (int k = 0; k < 3; ++k) {
+        const __m256 m = _mm256_loadu_ps(t_args.transform[k * 4 + r] + i);
+        outCenter = _mm256_fmadd_ps(m, center[k], outCenter);
+        outExtent = _mm256_fmadd_ps(_mm256_andnot_ps(signMask, m), extent[k],
+                                    outExtent);
+      }
+      _mm256_storeu_ps(t_args.outCenter[r] + i, outCenter);
+      _mm256_storeu_ps(t_args.outExtent[r] + i,
+                       _mm256_min_ps(outExtent, maxExtent));
+    }
+  }
+}
+#endif
+
+void transformBounds(const Mat4Array& t_transforms,
+                     const CullingBounds& t_local, CullingBounds& t_out,
+                     const size_t t_first, const size_t t_count,
+                     const ESimdLevel t_level) {
+  if ((t_first | t_count) % Mat4Array::BATCH_SIZE) {
+    LOG_CRITICAL("ERROR::TRANSFORM_KERNELS::UNALIGNED_RANGE");
+  }
+  const BoundsArgs args = getBoundsArgs(t_transforms, t_local, t_out);
+  const size_t end = t_first + t_count;
+  switch (t_level) {
+#if defined(FNK_KERNELS_X86)
+    case ESimdLevel::AVX2:
+      transformBoundsAvx2(args, t_first, end);
+      return;
+#endif
+#if defined(FNK_KERNELS_SSE)
+    case ESimdLevel::SSE:
+      transformBoundsSse(args, t_first, end);
+      return;
+#endif
+    default:
+      transformBoundsScalar(args, t_first, end);
+      return;
+  }
+}
+
+// Runs t_body t_repeats times and returns the best time per item in ns.
+template <typename Body>
+static float timeBest(const size_t t_count, const int t_repeats,
+                      const Body& t_body) {
+  float best = std::numeric_limits<float>::max();
+  for (int i = 0; i < t_repeats; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    t_body();
+    const float ns = std::chrono::duration<float, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    best = std::min(best, ns);
+  }
+  return best / static_cast<float>(t_count);
+}
+
+TransformBenchmarkResult benchmarkTransformKernels(const size_t t_count,
+                                                   const int t_repeats) {
+  TransformBenchmarkResult result;
+  result.count = t_count;
+  result.level = getSupportedSimdLevel();
+
+  // A random forest: each matrix's parent is an earlier one, in a separate
+  // array so the whole range can be written in one go.
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<glm::mat4> parents(t_count);
+  std::vector<glm::mat4> locals(t_count);
+  std::vector<uint32_t> parentIndices(
+      (t_count + Mat4Array::BATCH_SIZE - 1) / Mat4Array::BATCH_SIZE *
+          Mat4Array::BATCH_SIZE,
+      0);
+  std::vector<Aabb> boxes(t_count);
+  Mat4Array parentArray;
+  Mat4Array localArray;
+  parentArray.resize(t_count);
+  localArray.resize(t_count);
+  CullingBounds localBounds;
+  for (size_t i = 0; i < t_count; ++i) {
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 3; ++r) {
+        parents[i][c][r] = unit(random);
+        locals[i][c][r] = unit(random);
+      }
+    }
+    parentIndices[i] = static_cast<uint32_t>(random() % (i + 1));
+    parentArray.set(i, parents[i]);
+    localArray.set(i, locals[i]);
+    const glm::vec3 center(unit(random), unit(random), unit(random));
+    const glm::vec3 extents =
+        glm::abs(glm::vec3(unit(random), unit(random), unit(random)));
+    boxes[i] = {.min = center - extents, .max = center + extents};
+    localBounds.add(boxes[i]);
+  }
+
+  std::vector<glm::mat4> glmOut(t_count);
+  std::vector<Aabb> glmBoxes(t_count);
+  Mat4Array out;
+  out.resize(t_count);
+  CullingBounds outBounds;
+  outBounds.resize(t_count);
+  const size_t padded = out.paddedSize();
+
+  result.glmMultiplyNs = timeBest(t_count, t_repeats, [&] {
+    for (size_t i = 0; i < t_count; ++i) {
+      glmOut[i] = parents[parentIndices[i]] * locals[i];
+    }
+  });
+  result.glmBoundsNs = timeBest(t_count, t_repeats, [&] {
+    for (size_t i = 0; i < t_count; ++i) {
+      glmBoxes[i] = boxes[i].transformed(glmOut[i]);
+    }
+  });
+  result.scalarMultiplyNs = timeBest(t_count, t_repeats, [&] {
+    multiplyGathered(parentArray, parentIndices.data(), localArray, out, 0,
+                     padded, ESimdLevel::SCALAR);
+  });
+  result.scalarBoundsNs = timeBest(t_count, t_repeats, [&] {
+    transformBounds(out, localBounds, outBounds, 0, padded,
+                    ESimdLevel::SCALAR);
+  });
+  result.simdMultiplyNs = timeBest(t_count, t_repeats, [&] {
+    multiplyGathered(parentArray, parentIndices.data(), localArray, out, 0,
+                     padded, result.level);
+  });
+  result.simdBoundsNs = timeBest(t_count, t_repeats, [&] {
+    transformBounds(out, localBounds, outBounds, 0, padded, result.level);
+  });
+  return result;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "scene/culling.hpp"
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// 4x4 matrices stored one array per element, so a SIMD register holds the
+// same element of several matrices. Elements are column-major like glm:
+// element(c, r) is column c, row r. The arrays are padded to BATCH_SIZE with
+// identity matrices, so the kernels below have no scalar tail.
+class Mat4Array {
+ public:
+  // Matrices processed per kernel iteration; the largest supported SIMD
+  // width.
+  static constexpr size_t BATCH_SIZE = 8;
+
+  // Resizes to t_count matrices. New matrices are identity.
+  void resize(size_t t_count);
+
+  [[nodiscard]] size_t size() const { return m_size; }
+  // The array length, including padding.
+  [[nodiscard]] size_t paddedSize() const { return m_elements[0].size(); }
+
+  void set(size_t t_index, const glm::mat4& t_matrix);
+  [[nodiscard]] glm::mat4 get(size_t t_index) const;
+
+  float* element(const int t_column, const int t_row) {
+    return m_elements[t_column * 4 + t_row].data();
+  }
+  const float* element(const int t_column, const int t_row) const {
+    return m_elements[t_column * 4 + t_row].data();
+  }
+
+ private:
+  size_t m_size = 0;
+  std::array<std::vector<float>, 16> m_elements;
+};
+
+// The instruction sets the kernels can run with, chosen at runtime from what
+// the CPU supports.
+enum class ESimdLevel {
+  SCALAR,
+  SSE,
+  // AVX2 with FMA, 8 matrices per iteration.
+  AVX2,
+};
+
+// The best level both the build and the CPU support. Detected once.
+ESimdLevel getSupportedSimdLevel();
+const char* getSimdLevelName(ESimdLevel t_level);
+
+// Computes t_out[i] = t_parents[t_parentIndices[i]] * t_local[i] for i in
+// [t_first, t_first + t_count), e.g. world transforms from parent world
+// transforms and local transforms. t_first and t_count must be multiples of
+// BATCH_SIZE. t_out may be t_parents, as long as no parent lies in the range
+// being written.
+//
+// Both inputs must be affine, as scene transforms are: their bottom rows are
+// taken to be (0, 0, 0, 1), which saves a quarter of the gathers and almost
+// half the arithmetic.
+void multiplyGathered(const Mat4Array& t_parents,
+                      const uint32_t* t_parentIndices,
+                      const Mat4Array& t_local, Mat4Array& t_out,
+                      size_t t_first, size_t t_count,
+                      ESimdLevel t_level = getSupportedSimdLevel());
+
+// Transforms box i of t_local by t_transforms[i] into box i of t_out, for i in
+// [t_first, t_first + t_count), like Aabb::transformed(). t_first and t_count
+// must be multiples of BATCH_SIZE, and t_out must be as large as t_local.
+// Extents are clamped to CullingBounds::UNBOUNDED_EXTENT, so unbounded boxes
+// stay finite.
+void transformBounds(const Mat4Array& t_transforms,
+                     const CullingBounds& t_local, CullingBounds& t_out,
+                     size_t t_first, size_t t_count,
+                     ESimdLevel t_level = getSupportedSimdLevel());
+
+// Nanoseconds per matrix of each way to propagate transforms and bounds.
+struct TransformBenchmarkResult {
+  size_t count = 0;
+  ESimdLevel level = ESimdLevel::SCALAR;
+  // One glm multiply and Aabb::transformed() per node, as the recursive
+  // scene tree did.
+  float glmMultiplyNs = 0.0f;
+  float glmBoundsNs = 0.0f;
+  float scalarMultiplyNs = 0.0f;
+  float scalarBoundsNs = 0.0f;
+  float simdMultiplyNs = 0.0f;
+  float simdBoundsNs = 0.0f;
+};
+
+// Times the kernels against per-node glm code on t_count random transforms,
+// taking the best of t_repeats runs of each.
+TransformBenchmarkResult benchmarkTransformKernels(size_t t_count = 16384,
+                                                   int t_repeats = 20);
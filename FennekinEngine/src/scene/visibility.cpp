@@ -0,0 +1,40 @@
+#include "visibility.hpp"
+
+#include "core/debug/logger.hpp"
+#include "scene/mesh.hpp"
+#include "scene/scene.hpp"
+
+void SceneVisibility::begin() {
+  m_entries.clear();
+  m_bounds.clear();
+  m_views.clear();
+  m_masks.clear();
+}
+
+void SceneVisibility::add(Renderable& t_renderable) {
+  t_renderable.visitMeshes(
+      glm::mat4(1.0f), [this](Mesh& t_mesh, const glm::mat4& t_transform) {
+        m_entries.push_back({.mesh = &t_mesh, .transform = t_transform});
+        m_bounds.add(t_mesh.getLocalBounds().transformed(t_transform));
+      });
+}
+
+void SceneVisibility::add(Scene& t_scene, const glm::mat4& t_rootTransform) {
+  for (const SceneDrawItem& item : t_scene.getDrawItems(t_rootTransform)) {
+    m_entries.push_back({.mesh = item.mesh, .transform = item.transform});
+  }
+  m_bounds.append(t_scene.getWorldBounds());
+}
+
+int SceneVisibility::addView(const Frustum& t_frustum) {
+  if (m_views.size() == MAX_CULL_VIEWS) {
+    LOG_CRITICAL("ERROR::SCENE_VISIBILITY::TOO_MANY_VIEWS");
+  }
+  m_views.push_back(t_frustum);
+  return static_cast<int>(m_views.size()) - 1;
+}
+
+void SceneVisibility::cull() {
+  cullFrustums(m_bounds, m_views.data(), static_cast<int>(m_views.size()),
+               m_masks);
+}
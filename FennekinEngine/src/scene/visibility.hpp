@@ -0,0 +1,59 @@
+#pragma once
+
+#include "scene/bounds.hpp"
+#include "scene/culling.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Mesh;
+class Renderable;
+class Scene;
+
+// The visibility of a scene's meshes from every view rendered in a frame.
+//
+// The scene's meshes are gathered once into a list with their world
+// transforms and bounds. All views (main camera, shadow cameras, cubemap
+// faces, ...) are then culled together in one sweep over the bounds, leaving
+// one ViewMask per mesh. Each pass picks out its meshes by its view bit
+// instead of walking the scene again.
+class SceneVisibility {
+ public:
+  struct Entry {
+    Mesh* mesh;
+    // The full model transform, including all parent transforms.
+    glm::mat4 transform;
+  };
+
+  // Clears all meshes and views.
+  void begin();
+  // Adds every mesh under the renderable.
+  void add(Renderable& t_renderable);
+  // Adds a scene's draw items, updating the scene first, and copies their
+  // world bounds in bulk.
+  void add(Scene& t_scene, const glm::mat4& t_rootTransform);
+  // Adds a view to cull against and returns its bit index.
+  int addView(const Frustum& t_frustum);
+  // Culls every mesh against every view. Must be called after the last add()
+  // and addView().
+  void cull();
+
+  [[nodiscard]] const std::vector<Entry>& getEntries() const {
+    return m_entries;
+  }
+  // The world space bounds of each entry.
+  [[nodiscard]] const CullingBounds& getBounds() const { return m_bounds; }
+  [[nodiscard]] bool isVisible(size_t t_entry, int t_view) const {
+    return (m_masks[t_entry] >> t_view) & 1u;
+  }
+  // Marks an entry as hidden from a view, e.g. when it is found occluded.
+  void hide(size_t t_entry, int t_view) {
+    m_masks[t_entry] &= ~(ViewMask(1) << t_view);
+  }
+
+ private:
+  std::vector<Entry> m_entries;
+  CullingBounds m_bounds;
+  std::vector<Frustum> m_views;
+  std::vector<ViewMask> m_masks;
+};